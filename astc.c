@@ -49,8 +49,7 @@ int get_astc_block_size_height(int astc_block_type) {
 }
 
 int draw_block_rgba_astc(const unsigned char *bitstring, unsigned int *image_buffer, int flags) {
-	printf("Error -- ASTC block decoding not implemented.\n");
-	exit(1);
+	report_error("Error -- ASTC block decoding not implemented.\n");
 }
 
 void convert_astc_texture_to_image(Texture *texture, Image *image) {
@@ -73,11 +72,10 @@ void convert_astc_texture_to_image(Texture *texture, Image *image) {
 	int r = system(s);
 	// Remove the temporary .astc filename,
 	remove(astc_filename);
+	free(s);
 	if (r == - 1) {
-		printf("Error executing command during ASTC decoding.\n");
-		exit(1);
+		report_error("Error executing command during ASTC decoding.\n");
 	}
-	free(s);
 	// Load the .ktx file.
 	load_image(ktx_filename, FILE_TYPE_KTX, image);
 	// Remove the temporary .ktx filename.
@@ -96,11 +94,10 @@ void decompress_astc_file(const char *filename, Image *image) {
 	sprintf(s, "astcenc -d %s %s -silentmode", filename, ktx_filename);
 	printf("Executing command %s\n", s);
 	int r = system(s);
+	free(s);
 	if (r == - 1) {
-		printf("Error executing command during ASTC decoding.\n");
-		exit(1);
+		report_error("Error executing command during ASTC decoding.\n");
 	}
-	free(s);
 	load_image(ktx_filename, FILE_TYPE_KTX, image);
 	remove(ktx_filename);
 	// astcenc flip the image during decoding to an uncompressed .ktx file; revert that.
@@ -137,11 +134,10 @@ void compress_image_to_astc_texture(Image *image, int texture_type, Texture *tex
 	printf("Executing command %s\n", s);
 	int r = system(s);
 	remove(png_filename);
+	free(s);
 	if (r == - 1) {
-		printf("Error executing command during ASTC encoding.\n");
-		exit(1);
+		report_error("Error executing command during ASTC encoding.\n");
 	}
-	free(s);
 	// Load the created .astc texture.
 	load_astc_file(astc_filename, texture);
 	remove(astc_filename);
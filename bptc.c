@@ -19,6 +19,12 @@ OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <float.h>
+#include <math.h>
+#include <pthread.h>
 #include "texgenpack.h"
 #include "decode.h"
 #include "packing.h"
@@ -190,7 +196,7 @@ static uint32_t block_extract_bits(Block *block, int nu_bits) {
 }
 
 static uint32_t get_bits_uint64(uint64_t data, int bit0, int bit1) {
-	return (data & (((uint64_t)1 << (bit1 + 1)) - 1)) >> bit0;
+	return (data >> bit0) & (((uint64_t)1 << (bit1 - bit0 + 1)) - 1);
 }
 
 static char color_precision_table[8] = { 4, 6, 5, 7, 5, 7, 7, 5 };
@@ -318,11 +324,14 @@ void fully_decode_endpoints(uint8_t *endpoint_array, int nu_subsets, int mode, B
 		// Mode 1 handled elsewhere.
 
 		// Extract end-point pbits.
-		// Take advantage of the fact that they don't cross the 64-bit word boundary
-		// in any mode.
+		// They only cross the 64-bit word boundary in mode 6, of which the second p-bit is
+		// the first bit of data1.
 		uint32_t bits;
-		if (block->index < 64)
+		if (block->index < 64) {
 			bits = block->data0 >> block->index;
+			if (block->index + nu_subsets * 2 > 64)
+				bits |= block->data1 << (64 - block->index);
+		}
 		else
 			bits = block->data1 >> (block->index - 64);
 		for (int i = 0; i < nu_subsets * 2; i++) {
@@ -503,6 +512,66 @@ void block4x4_bptc_set_mode(unsigned char *bitstring, int flags) {
 	}
 }
 
+// Describe the fields of a BPTC block in the order in which they are stored: the mode bits, partition, rotation and
+// index selection bits, the endpoint components (all red components first), the P-bits and the pixel indices.
+// The anchor pixels of the subsets have one index bit less.
+
+int block4x4_bptc_get_fields(const unsigned char *bitstring, BlockField *fields) {
+	int mode = block4x4_bptc_get_mode(bitstring);
+	if (mode < 0)
+		return 0;
+	int nu_subsets = get_nu_subsets(mode);
+	int bit = 0;
+	int n = 0;
+	fields[n++] = (BlockField){ BLOCK_FIELD_OTHER, bit, mode + 1 };
+	bit += mode + 1;
+	int partition_set_id = 0;
+	if (PB[mode] > 0) {
+		partition_set_id = get_bits_uint64(*(uint64_t *)&bitstring[0], bit, bit + PB[mode] - 1);
+		fields[n++] = (BlockField){ BLOCK_FIELD_OTHER, bit, PB[mode] };
+		bit += PB[mode];
+	}
+	if (RB[mode] > 0) {
+		fields[n++] = (BlockField){ BLOCK_FIELD_OTHER, bit, RB[mode] };
+		bit += RB[mode];
+	}
+	if (mode == 4) {
+		fields[n++] = (BlockField){ BLOCK_FIELD_OTHER, bit, 1 };
+		bit++;
+	}
+	int nu_components = alpha_component_precision(mode) > 0 ? 4 : 3;
+	for (int i = 0; i < nu_components; i++) {
+		int precision = i < 3 ? color_component_precision(mode) : alpha_component_precision(mode);
+		for (int j = 0; j < nu_subsets * 2; j++) {
+			fields[n++] = (BlockField){ BLOCK_FIELD_NUMERIC, bit, precision };
+			bit += precision;
+		}
+	}
+	if (mode_has_p_bits[mode]) {
+		// Mode 1 has one shared P-bit per subset, the other modes one per endpoint.
+		int nu_p_bits = mode == 1 ? 2 : nu_subsets * 2;
+		for (int i = 0; i < nu_p_bits; i++) {
+			fields[n++] = (BlockField){ BLOCK_FIELD_OTHER, bit, 1 };
+			bit++;
+		}
+	}
+	int anchor_pixels = 0;
+	for (int i = 0; i < nu_subsets; i++)
+		anchor_pixels |= 1 << get_anchor_index(partition_set_id, i, nu_subsets);
+	for (int i = 0; i < 16; i++) {
+		int index_bits = IB[mode] - ((anchor_pixels >> i) & 1);
+		fields[n++] = (BlockField){ BLOCK_FIELD_INDEX, bit, index_bits };
+		bit += index_bits;
+	}
+	if (IB2[mode] > 0)
+		for (int i = 0; i < 16; i++) {
+			int index_bits = i == 0 ? IB2[mode] - 1 : IB2[mode];
+			fields[n++] = (BlockField){ BLOCK_FIELD_INDEX, bit, index_bits };
+			bit += index_bits;
+		}
+	return n;
+}
+
 static uint64_t clear_bits_uint64(uint64_t data, int bit0, int bit1) {
 	uint64_t mask = ~(((uint64_t)1 << (bit1 + 1)) - 1);
 	mask |= ((uint64_t)1 << bit0) - 1;
@@ -1487,3 +1556,1096 @@ int draw_block4x4_bptc_signed_float(const unsigned char *bitstring, unsigned int
 	return draw_block4x4_bptc_float_shared(bitstring, image_buffer, 1, flags);
 }
 
+// Encoding of blocks that only have one color, without the genetic algorithm.
+
+typedef struct {
+	unsigned char endpoint0;
+	unsigned char endpoint1;
+	unsigned char error;
+} BPTCEndpointPair;
+
+static pthread_mutex_t table_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// For every 8-bit component value, the pair of 7-bit endpoint values of which the interpolated value with
+// 2-bit index 1 comes closest to the value. Index 0 is for mode 5 (no P-bits), indices 1 to 4 for mode 3 with
+// the P-bits of the first and second endpoint given by bits 0 and 1 of (index - 1).
+static BPTCEndpointPair (*single_color_table)[256] = NULL;
+
+static void calculate_single_color_table() {
+	pthread_mutex_lock(&table_mutex);
+	if (single_color_table != NULL) {
+		pthread_mutex_unlock(&table_mutex);
+		return;
+	}
+	BPTCEndpointPair (*table)[256] = (BPTCEndpointPair (*)[256])malloc(sizeof(BPTCEndpointPair) * 5 * 256);
+	for (int t = 0; t < 5; t++) {
+		for (int value = 0; value < 256; value++)
+			table[t][value].error = 0xFF;
+		// Find the values that can be represented exactly.
+		for (int e0 = 0; e0 < 128; e0++)
+			for (int e1 = 0; e1 < 128; e1++) {
+				int c0, c1;
+				if (t == 0) {
+					c0 = (e0 << 1) | (e0 >> 6);
+					c1 = (e1 << 1) | (e1 >> 6);
+				}
+				else {
+					c0 = (e0 << 1) | ((t - 1) & 1);
+					c1 = (e1 << 1) | ((t - 1) >> 1);
+				}
+				int value = interpolate(c0, c1, 1, 2);
+				if (table[t][value].error != 0) {
+					table[t][value].endpoint0 = e0;
+					table[t][value].endpoint1 = e1;
+					table[t][value].error = 0;
+				}
+			}
+		// Use the closest value for the others.
+		for (int value = 0; value < 256; value++)
+			for (int d = 1; table[t][value].error == 0xFF; d++) {
+				int v;
+				if (value - d >= 0 && table[t][value - d].error == 0)
+					v = value - d;
+				else if (value + d < 256 && table[t][value + d].error == 0)
+					v = value + d;
+				else
+					continue;
+				table[t][value].endpoint0 = table[t][v].endpoint0;
+				table[t][value].endpoint1 = table[t][v].endpoint1;
+				table[t][value].error = d;
+			}
+	}
+	single_color_table = table;
+	pthread_mutex_unlock(&table_mutex);
+}
+
+static void bptc_put_bits(uint64_t *data, int *index, int nu_bits, unsigned int value) {
+	for (int i = 0; i < nu_bits; i++) {
+		if ((value >> i) & 1)
+			data[*index >> 6] |= (uint64_t)1 << (*index & 63);
+		(*index)++;
+	}
+}
+
+// Encode a BPTC block of which the pixels that are not transparent have one color, with every pixel using color
+// index 1. Opaque blocks use mode 3, other blocks use mode 5 and may have two alpha values. The pixels are in
+// row-major order. Return 0 when the block can not be encoded this way.
+
+int encode_trivial_block4x4_bptc(const unsigned int *pixels, int flags, unsigned char *bitstring) {
+	int nu_colors = 0;
+	unsigned int rgb = 0;
+	int nu_alpha_values = 0;
+	int alpha_value[2] = { 0, 0 };
+	for (int i = 0; i < 16; i++) {
+		int alpha = pixel_get_a(pixels[i]);
+		if (nu_alpha_values == 0 || (alpha != alpha_value[0] && nu_alpha_values == 1))
+			alpha_value[nu_alpha_values++] = alpha;
+		else if (alpha != alpha_value[0] && alpha != alpha_value[1])
+			return 0;
+		// The color of a pixel that is completely transparent in both the source and the texture doesn't
+		// matter.
+		if (alpha == 0)
+			continue;
+		if (nu_colors > 0 && (pixels[i] & 0xFFFFFF) != rgb)
+			return 0;
+		rgb = pixels[i] & 0xFFFFFF;
+		nu_colors = 1;
+	}
+	int color[3] = { pixel_get_r(rgb), pixel_get_g(rgb), pixel_get_b(rgb) };
+	calculate_single_color_table();
+	uint64_t data[2] = { 0, 0 };
+	int index = 0;
+	if (flags & MODES_ALLOWED_OPAQUE_ONLY) {
+		if (!(flags & (1 << 3)))
+			return 0;
+		// Mode 3 with the same endpoints for both subsets of partition 0. Select the P-bits with the smallest
+		// error.
+		int best_error = INT_MAX;
+		int best_t;
+		for (int t = 1; t < 5; t++) {
+			int error = 0;
+			for (int c = 0; c < 3; c++)
+				error += single_color_table[t][color[c]].error * single_color_table[t][color[c]].error;
+			if (error < best_error) {
+				best_error = error;
+				best_t = t;
+			}
+		}
+		bptc_put_bits(data, &index, 4, 1 << 3);
+		bptc_put_bits(data, &index, 6, 0);
+		for (int c = 0; c < 3; c++)
+			for (int i = 0; i < 2; i++) {
+				bptc_put_bits(data, &index, 7, single_color_table[best_t][color[c]].endpoint0);
+				bptc_put_bits(data, &index, 7, single_color_table[best_t][color[c]].endpoint1);
+			}
+		for (int i = 0; i < 2; i++) {
+			bptc_put_bits(data, &index, 1, (best_t - 1) & 1);
+			bptc_put_bits(data, &index, 1, (best_t - 1) >> 1);
+		}
+		for (int i = 0; i < 16; i++)
+			if (i == get_anchor_index(0, get_partition_index(2, 0, i), 2))
+				bptc_put_bits(data, &index, 1, 1);
+			else
+				bptc_put_bits(data, &index, 2, 1);
+	}
+	else {
+		if (!(flags & (1 << 5)))
+			return 0;
+		// Mode 5 without rotation. The first alpha endpoint is the alpha value of pixel 0, which is an anchor
+		// index.
+		if (nu_alpha_values == 1)
+			alpha_value[1] = alpha_value[0];
+		bptc_put_bits(data, &index, 6, 1 << 5);
+		bptc_put_bits(data, &index, 2, 0);
+		for (int c = 0; c < 3; c++) {
+			bptc_put_bits(data, &index, 7, single_color_table[0][color[c]].endpoint0);
+			bptc_put_bits(data, &index, 7, single_color_table[0][color[c]].endpoint1);
+		}
+		bptc_put_bits(data, &index, 8, alpha_value[0]);
+		bptc_put_bits(data, &index, 8, alpha_value[1]);
+		bptc_put_bits(data, &index, 1, 1);
+		for (int i = 1; i < 16; i++)
+			bptc_put_bits(data, &index, 2, 1);
+		bptc_put_bits(data, &index, 1, 0);
+		for (int i = 1; i < 16; i++)
+			bptc_put_bits(data, &index, 2, pixel_get_a(pixels[i]) == alpha_value[0] ? 0 : 3);
+	}
+	*(uint64_t *)&bitstring[0] = data[0];
+	*(uint64_t *)&bitstring[8] = data[1];
+	return 1;
+}
+
+// Partition preselection.
+
+// Calculate the principal axis (the eigenvector with the largest eigenvalue) of an n x n covariance matrix with
+// power iteration, starting from the axis of the component with the largest variance. Returns the variance
+// along the axis (the largest eigenvalue).
+
+static float principal_axis(const float *covariance, int n, float *axis) {
+	int largest = 0;
+	for (int i = 1; i < n; i++)
+		if (covariance[i * n + i] > covariance[largest * n + largest])
+			largest = i;
+	for (int i = 0; i < n; i++)
+		axis[i] = 0;
+	axis[largest] = 1.0f;
+	float eigenvalue = 0;
+	for (int iteration = 0; iteration < 8; iteration++) {
+		float w[4];
+		float length = 0;
+		for (int i = 0; i < n; i++) {
+			w[i] = 0;
+			for (int j = 0; j < n; j++)
+				w[i] += covariance[i * n + j] * axis[j];
+			length += w[i] * w[i];
+		}
+		if (length == 0)
+			return 0;
+		length = sqrtf(length);
+		for (int i = 0; i < n; i++)
+			axis[i] = w[i] / length;
+		eigenvalue = length;
+	}
+	return eigenvalue;
+}
+
+// Return an estimate of the error of encoding a subset of pixels with colors on a line between two endpoints:
+// the sum of the squared distances of the RGBA values of the pixels to the principal axis through their mean.
+// The sums of the components (sum[4]) and of the products of the components (sum_products[16]) are given.
+
+static float subset_line_error(int n, const float *sum, const float *sum_products) {
+	if (n <= 1)
+		return 0;
+	float covariance[16];
+	float trace = 0;
+	for (int i = 0; i < 4; i++) {
+		for (int j = 0; j < 4; j++)
+			covariance[i * 4 + j] = sum_products[i * 4 + j] - sum[i] * sum[j] / n;
+		trace += covariance[i * 5];
+	}
+	if (trace <= 0)
+		return 0;
+	float axis[4];
+	return trace - principal_axis(covariance, 4, axis);
+}
+
+// Return the estimated error for a partition with the given number of subsets of the n visible pixels of a
+// block, of which the components and the positions in the block are given.
+
+static float partition_line_error(int n, const float (*components)[4], const int *pos, int nu_subsets,
+int partition_set_id) {
+	int count[3] = { 0, 0, 0 };
+	float sum[3][4];
+	float sum_products[3][16];
+	memset(sum, 0, sizeof(sum));
+	memset(sum_products, 0, sizeof(sum_products));
+	for (int i = 0; i < n; i++) {
+		int subset = get_partition_index(nu_subsets, partition_set_id, pos[i]);
+		const float *c = components[i];
+		count[subset]++;
+		for (int j = 0; j < 4; j++) {
+			sum[subset][j] += c[j];
+			for (int k = 0; k < 4; k++)
+				sum_products[subset][j * 4 + k] += c[j] * c[k];
+		}
+	}
+	float error = 0;
+	for (int subset = 0; subset < nu_subsets; subset++)
+		error += subset_line_error(count[subset], sum[subset], sum_products[subset]);
+	return error;
+}
+
+// Select the nu_selected partitions with the lowest estimated error out of the first nu_partitions partitions
+// with the given number of subsets, in order of increasing error.
+
+static void preselect_partitions(int n, const float (*components)[4], const int *pos, int nu_subsets,
+int nu_partitions, int nu_selected, unsigned char *partitions) {
+	float error[64];
+	bool selected[64];
+	for (int i = 0; i < nu_partitions; i++) {
+		error[i] = partition_line_error(n, components, pos, nu_subsets, i);
+		selected[i] = false;
+	}
+	for (int i = 0; i < nu_selected; i++) {
+		int best = - 1;
+		for (int j = 0; j < nu_partitions; j++)
+			if (!selected[j] && (best < 0 || error[j] < error[best]))
+				best = j;
+		partitions[i] = best;
+		selected[best] = true;
+	}
+}
+
+// Rank the partitions of the BPTC modes with two or three subsets for a block of pixels in row-major order, of
+// which the width x height pixels are visible, by how well the colors of each subset fit on a line, which is
+// what the endpoints and indices of a subset can represent. partitions is set to three lists of
+// BPTC_NU_PRESELECTED_PARTITIONS partitions: the best ones with two subsets (modes 1, 3 and 7), with three
+// subsets (mode 2) and with three subsets out of the first 16 (mode 0).
+
+void bptc_preselect_partitions(const unsigned int *pixels, int width, int height, unsigned char *partitions) {
+	int n = 0;
+	int pos[16];
+	float components[16][4];
+	for (int y = 0; y < height; y++)
+		for (int x = 0; x < width; x++) {
+			int i = y * 4 + x;
+			pos[n] = i;
+			components[n][0] = pixel_get_r(pixels[i]);
+			components[n][1] = pixel_get_g(pixels[i]);
+			components[n][2] = pixel_get_b(pixels[i]);
+			components[n][3] = pixel_get_a(pixels[i]);
+			n++;
+		}
+	preselect_partitions(n, (const float (*)[4])components, pos, 2, 64, BPTC_NU_PRESELECTED_PARTITIONS,
+		&partitions[0]);
+	preselect_partitions(n, (const float (*)[4])components, pos, 3, 64, BPTC_NU_PRESELECTED_PARTITIONS,
+		&partitions[BPTC_NU_PRESELECTED_PARTITIONS]);
+	preselect_partitions(n, (const float (*)[4])components, pos, 3, 16, BPTC_NU_PRESELECTED_PARTITIONS,
+		&partitions[BPTC_NU_PRESELECTED_PARTITIONS * 2]);
+}
+
+// Replace the partition of a BPTC block in a mode with partitions by one of the partitions selected by
+// bptc_preselect_partitions() when it is not one of them. The choice depends on the old partition, so that the
+// genetic algorithm can still select any of them.
+
+void block4x4_bptc_set_preselected_partition(unsigned char *bitstring, const unsigned char *partitions) {
+	Block block;
+	block.data0 = *(uint64_t *)&bitstring[0];
+	block.data1 = *(uint64_t *)&bitstring[8];
+	block.index = 0;
+	int mode = extract_mode(&block);
+	if (mode < 0 || !mode_has_partition_bits[mode])
+		return;
+	int partition_set_id = extract_partition_set_id(&block, mode);
+	const unsigned char *allowed = &partitions[0];
+	if (mode == 0)
+		allowed = &partitions[BPTC_NU_PRESELECTED_PARTITIONS * 2];
+	else if (get_nu_subsets(mode) == 3)
+		allowed = &partitions[BPTC_NU_PRESELECTED_PARTITIONS];
+	for (int i = 0; i < BPTC_NU_PRESELECTED_PARTITIONS; i++)
+		if (allowed[i] == partition_set_id)
+			return;
+	partition_set_id = allowed[partition_set_id % BPTC_NU_PRESELECTED_PARTITIONS];
+	// The partition bits follow the mode bits.
+	block.data0 = set_bits_uint64(block.data0, mode + 1, mode + PB[mode], partition_set_id);
+	*(uint64_t *)&bitstring[0] = block.data0;
+}
+
+// Direct encoding of blocks in the modes with a single subset (4, 5 and 6).
+
+typedef struct {
+	int mode;
+	int rotation;
+	int index_selection_bit;
+	// The endpoints as stored in the block (without p-bits), for the components after rotation.
+	int endpoint[2][4];
+	int p_bit[2];
+	// The pixel indices. In mode 6, the color indices are used for all components.
+	uint8_t color_index[16];
+	uint8_t alpha_index[16];
+} SingleSubsetBlock;
+
+// Return the precision of an endpoint component of a block in a single subset mode including the p-bit.
+
+static int single_subset_component_precision(int mode, int component) {
+	if (component == 3)
+		return alpha_component_precision_plus_pbit(mode);
+	return color_component_precision_plus_pbit(mode);
+}
+
+// Return the value of an endpoint component after decoding, in the same way as fully_decode_endpoints().
+
+static int single_subset_decoded_component(const SingleSubsetBlock *b, int endpoint, int component) {
+	int precision = single_subset_component_precision(b->mode, component);
+	int value = b->endpoint[endpoint][component];
+	if (mode_has_p_bits[b->mode])
+		value = (value << 1) | b->p_bit[endpoint];
+	value <<= 8 - precision;
+	return (value | (value >> precision)) & 0xFF;
+}
+
+// Return the endpoint value as stored in the block that decodes to the value closest to v.
+
+static int single_subset_quantize_component(const SingleSubsetBlock *b, int endpoint, int component, float v) {
+	SingleSubsetBlock c = *b;
+	int bits = single_subset_component_precision(b->mode, component) - mode_has_p_bits[b->mode];
+	int max_value = (1 << bits) - 1;
+	int q = (int)(v * max_value / 255.0f + 0.5f);
+	int best_q = 0;
+	float best_error = FLT_MAX;
+	for (int i = q - 2; i <= q + 2; i++) {
+		if (i < 0 || i > max_value)
+			continue;
+		c.endpoint[endpoint][component] = i;
+		float error = fabsf(single_subset_decoded_component(&c, endpoint, component) - v);
+		if (error < best_error) {
+			best_error = error;
+			best_q = i;
+		}
+	}
+	return best_q;
+}
+
+static int get_single_subset_color_index_bitcount(const SingleSubsetBlock *b) {
+	return get_color_index_bitcount(b->mode, b->index_selection_bit);
+}
+
+static int get_single_subset_alpha_index_bitcount(const SingleSubsetBlock *b) {
+	if (b->mode == 6)
+		return 4;
+	return get_alpha_index_bitcount(b->mode, b->index_selection_bit);
+}
+
+// Set the pixel indices of the block to the ones with the smallest error for its endpoints, and return the
+// total squared error. The components of the n visible pixels, after rotation, are given, and pos holds the
+// position of each visible pixel in the block.
+
+static int single_subset_set_indices(SingleSubsetBlock *b, int n, const int (*components)[4], const int *pos) {
+	int e[2][4];
+	for (int i = 0; i < 2; i++)
+		for (int j = 0; j < 4; j++)
+			e[i][j] = single_subset_decoded_component(b, i, j);
+	int color_bits = get_single_subset_color_index_bitcount(b);
+	int alpha_bits = get_single_subset_alpha_index_bitcount(b);
+	int palette[16][4];
+	for (int i = 0; i < (1 << color_bits); i++)
+		for (int j = 0; j < 3; j++)
+			palette[i][j] = interpolate(e[0][j], e[1][j], i, color_bits);
+	for (int i = 0; i < (1 << alpha_bits); i++)
+		palette[i][3] = interpolate(e[0][3], e[1][3], i, alpha_bits);
+	memset(b->color_index, 0, 16);
+	memset(b->alpha_index, 0, 16);
+	int total_error = 0;
+	for (int i = 0; i < n; i++) {
+		const int *c = components[i];
+		if (b->mode == 6) {
+			int best_error = INT_MAX;
+			for (int j = 0; j < 16; j++) {
+				int dr = palette[j][0] - c[0];
+				int dg = palette[j][1] - c[1];
+				int db = palette[j][2] - c[2];
+				int da = palette[j][3] - c[3];
+				int error = dr * dr + dg * dg + db * db + da * da;
+				if (error < best_error) {
+					best_error = error;
+					b->color_index[pos[i]] = j;
+				}
+			}
+			total_error += best_error;
+			continue;
+		}
+		int best_error = INT_MAX;
+		for (int j = 0; j < (1 << color_bits); j++) {
+			int dr = palette[j][0] - c[0];
+			int dg = palette[j][1] - c[1];
+			int db = palette[j][2] - c[2];
+			int error = dr * dr + dg * dg + db * db;
+			if (error < best_error) {
+				best_error = error;
+				b->color_index[pos[i]] = j;
+			}
+		}
+		total_error += best_error;
+		best_error = INT_MAX;
+		for (int j = 0; j < (1 << alpha_bits); j++) {
+			int da = palette[j][3] - c[3];
+			if (da * da < best_error) {
+				best_error = da * da;
+				b->alpha_index[pos[i]] = j;
+			}
+		}
+		total_error += best_error;
+	}
+	return total_error;
+}
+
+// Fit the endpoints of the components first to last - 1, which share the given pixel indices, to the pixels
+// with least squares, and quantize them. Nothing is changed when all pixels use the same index.
+
+static void single_subset_fit_endpoints(SingleSubsetBlock *b, int first, int last, const uint8_t *index,
+int index_bitcount, int n, const int (*components)[4], const int *pos) {
+	const uint16_t *weights = index_bitcount == 2 ? aWeight2 : (index_bitcount == 3 ? aWeight3 : aWeight4);
+	float a = 0, m = 0, c = 0;
+	float x0[4] = { 0, 0, 0, 0 };
+	float x1[4] = { 0, 0, 0, 0 };
+	for (int i = 0; i < n; i++) {
+		float w = weights[index[pos[i]]] / 64.0f;
+		a += (1.0f - w) * (1.0f - w);
+		m += (1.0f - w) * w;
+		c += w * w;
+		for (int j = first; j < last; j++) {
+			x0[j] += (1.0f - w) * components[i][j];
+			x1[j] += w * components[i][j];
+		}
+	}
+	float det = a * c - m * m;
+	if (det < 0.0001f)
+		return;
+	for (int j = first; j < last; j++) {
+		float e0 = (c * x0[j] - m * x1[j]) / det;
+		float e1 = (a * x1[j] - m * x0[j]) / det;
+		b->endpoint[0][j] = single_subset_quantize_component(b, 0, j, fminf(fmaxf(e0, 0), 255.0f));
+		b->endpoint[1][j] = single_subset_quantize_component(b, 1, j, fminf(fmaxf(e1, 0), 255.0f));
+	}
+}
+
+// Set the endpoints of the components first to last - 1 to the extremes of the projections of the pixels on
+// the principal axis of the components.
+
+static void single_subset_set_principal_axis_endpoints(SingleSubsetBlock *b, int first, int last, int n,
+const int (*components)[4]) {
+	int nu_components = last - first;
+	float mean[4] = { 0, 0, 0, 0 };
+	for (int i = 0; i < n; i++)
+		for (int j = 0; j < nu_components; j++)
+			mean[j] += components[i][first + j];
+	for (int j = 0; j < nu_components; j++)
+		mean[j] /= n;
+	float covariance[16];
+	memset(covariance, 0, sizeof(covariance));
+	for (int i = 0; i < n; i++)
+		for (int j = 0; j < nu_components; j++)
+			for (int k = 0; k < nu_components; k++)
+				covariance[j * nu_components + k] += (components[i][first + j] - mean[j]) *
+					(components[i][first + k] - mean[k]);
+	float axis[4];
+	principal_axis(covariance, nu_components, axis);
+	float t_min = 0, t_max = 0;
+	for (int i = 0; i < n; i++) {
+		float t = 0;
+		for (int j = 0; j < nu_components; j++)
+			t += (components[i][first + j] - mean[j]) * axis[j];
+		if (t < t_min)
+			t_min = t;
+		if (t > t_max)
+			t_max = t;
+	}
+	for (int j = 0; j < nu_components; j++) {
+		float e0 = fminf(fmaxf(mean[j] + t_min * axis[j], 0), 255.0f);
+		float e1 = fminf(fmaxf(mean[j] + t_max * axis[j], 0), 255.0f);
+		b->endpoint[0][first + j] = single_subset_quantize_component(b, 0, first + j, e0);
+		b->endpoint[1][first + j] = single_subset_quantize_component(b, 1, first + j, e1);
+	}
+}
+
+// Fit a block for the given mode, rotation, index selection bit and p-bits, which are set in b, to the pixels.
+// Returns the total squared error.
+
+static int single_subset_fit(SingleSubsetBlock *b, int n, const int (*components)[4], const int *pos) {
+	if (b->mode == 6)
+		single_subset_set_principal_axis_endpoints(b, 0, 4, n, components);
+	else {
+		single_subset_set_principal_axis_endpoints(b, 0, 3, n, components);
+		single_subset_set_principal_axis_endpoints(b, 3, 4, n, components);
+	}
+	int error = single_subset_set_indices(b, n, components, pos);
+	// Alternately fit the endpoints to the pixel indices with least squares and calculate the pixel indices.
+	for (int iteration = 0; iteration < 2 && error > 0; iteration++) {
+		SingleSubsetBlock c = *b;
+		if (c.mode == 6)
+			single_subset_fit_endpoints(&c, 0, 4, c.color_index, 4, n, components, pos);
+		else {
+			single_subset_fit_endpoints(&c, 0, 3, c.color_index, get_single_subset_color_index_bitcount(&c),
+				n, components, pos);
+			single_subset_fit_endpoints(&c, 3, 4, c.alpha_index, get_single_subset_alpha_index_bitcount(&c),
+				n, components, pos);
+		}
+		int new_error = single_subset_set_indices(&c, n, components, pos);
+		if (new_error >= error)
+			break;
+		*b = c;
+		error = new_error;
+	}
+	// Refine the quantized endpoints by trying to change every endpoint component by one step.
+	for (int pass = 0; pass < 4 && error > 0; pass++) {
+		bool improved = false;
+		for (int i = 0; i < 2; i++)
+			for (int j = 0; j < 4; j++)
+				for (int step = - 1; step <= 1; step += 2) {
+					SingleSubsetBlock c = *b;
+					int max_value = (1 << (single_subset_component_precision(c.mode, j) -
+						mode_has_p_bits[c.mode])) - 1;
+					c.endpoint[i][j] += step;
+					if (c.endpoint[i][j] < 0 || c.endpoint[i][j] > max_value)
+						continue;
+					int new_error = single_subset_set_indices(&c, n, components, pos);
+					if (new_error < error) {
+						*b = c;
+						error = new_error;
+						improved = true;
+					}
+				}
+		if (!improved)
+			break;
+	}
+	return error;
+}
+
+// Swap the endpoints of the components first to last - 1 and invert the pixel indices so that the anchor pixel
+// index (pixel 0) has its highest bit cleared, as required by the format.
+
+static void single_subset_fix_anchor(SingleSubsetBlock *b, int first, int last, uint8_t *index, int index_bitcount) {
+	if (!(index[0] & (1 << (index_bitcount - 1))))
+		return;
+	for (int j = first; j < last; j++) {
+		int t = b->endpoint[0][j];
+		b->endpoint[0][j] = b->endpoint[1][j];
+		b->endpoint[1][j] = t;
+	}
+	if (b->mode == 6) {
+		int t = b->p_bit[0];
+		b->p_bit[0] = b->p_bit[1];
+		b->p_bit[1] = t;
+	}
+	for (int i = 0; i < 16; i++)
+		index[i] = (1 << index_bitcount) - 1 - index[i];
+}
+
+static void single_subset_write_indices(uint64_t *data, int *bit_index, const uint8_t *index, int index_bitcount) {
+	bptc_put_bits(data, bit_index, index_bitcount - 1, index[0]);
+	for (int i = 1; i < 16; i++)
+		bptc_put_bits(data, bit_index, index_bitcount, index[i]);
+}
+
+// Write a block in a single subset mode to a bitstring.
+
+static void single_subset_write_block(SingleSubsetBlock *b, unsigned char *bitstring) {
+	int color_bits = get_single_subset_color_index_bitcount(b);
+	int alpha_bits = get_single_subset_alpha_index_bitcount(b);
+	if (b->mode == 6)
+		single_subset_fix_anchor(b, 0, 4, b->color_index, color_bits);
+	else {
+		single_subset_fix_anchor(b, 0, 3, b->color_index, color_bits);
+		single_subset_fix_anchor(b, 3, 4, b->alpha_index, alpha_bits);
+	}
+	uint64_t data[2] = { 0, 0 };
+	int index = 0;
+	bptc_put_bits(data, &index, b->mode + 1, 1 << b->mode);
+	bptc_put_bits(data, &index, RB[b->mode], b->rotation);
+	if (b->mode == 4)
+		bptc_put_bits(data, &index, 1, b->index_selection_bit);
+	for (int j = 0; j < 4; j++)
+		for (int i = 0; i < 2; i++)
+			bptc_put_bits(data, &index, single_subset_component_precision(b->mode, j) -
+				mode_has_p_bits[b->mode], b->endpoint[i][j]);
+	if (b->mode == 6) {
+		bptc_put_bits(data, &index, 1, b->p_bit[0]);
+		bptc_put_bits(data, &index, 1, b->p_bit[1]);
+		single_subset_write_indices(data, &index, b->color_index, 4);
+	}
+	else if (b->index_selection_bit) {
+		// Mode 4 with the two-bit indices used for alpha.
+		single_subset_write_indices(data, &index, b->alpha_index, alpha_bits);
+		single_subset_write_indices(data, &index, b->color_index, color_bits);
+	}
+	else {
+		single_subset_write_indices(data, &index, b->color_index, color_bits);
+		single_subset_write_indices(data, &index, b->alpha_index, alpha_bits);
+	}
+	*(uint64_t *)&bitstring[0] = data[0];
+	*(uint64_t *)&bitstring[8] = data[1];
+}
+
+// Directly encode a block in mode 4, 5 or 6, which have a single subset, from the width x height visible pixels
+// of the block in row-major order. For every rotation, index selection bit (mode 4) and combination of p-bits
+// (mode 6), the endpoints are set to the extremes of the pixels along their principal axis, refined with least
+// squares and adjusted after quantization. The combination with the smallest error is used.
+
+void encode_single_subset_block4x4_bptc(const unsigned int *pixels, int width, int height, int mode,
+unsigned char *bitstring) {
+	int n = 0;
+	int pos[16];
+	int original_components[16][4];
+	for (int y = 0; y < height; y++)
+		for (int x = 0; x < width; x++) {
+			int i = y * 4 + x;
+			pos[n] = i;
+			original_components[n][0] = pixel_get_r(pixels[i]);
+			original_components[n][1] = pixel_get_g(pixels[i]);
+			original_components[n][2] = pixel_get_b(pixels[i]);
+			original_components[n][3] = pixel_get_a(pixels[i]);
+			n++;
+		}
+	int nu_rotations = RB[mode] > 0 ? 4 : 1;
+	int nu_variants = mode == 4 ? 2 : (mode == 6 ? 4 : 1);
+	SingleSubsetBlock best;
+	int best_error = INT_MAX;
+	for (int rotation = 0; rotation < nu_rotations; rotation++) {
+		// The rotation swaps alpha with one of the color components after decoding.
+		int components[16][4];
+		memcpy(components, original_components, sizeof(components));
+		if (rotation > 0)
+			for (int i = 0; i < n; i++) {
+				components[i][rotation - 1] = original_components[i][3];
+				components[i][3] = original_components[i][rotation - 1];
+			}
+		for (int variant = 0; variant < nu_variants; variant++) {
+			SingleSubsetBlock b;
+			memset(&b, 0, sizeof(b));
+			b.mode = mode;
+			b.rotation = rotation;
+			if (mode == 4)
+				b.index_selection_bit = variant;
+			else if (mode == 6) {
+				b.p_bit[0] = variant & 1;
+				b.p_bit[1] = variant >> 1;
+			}
+			int error = single_subset_fit(&b, n, (const int (*)[4])components, pos);
+			if (error < best_error) {
+				best_error = error;
+				best = b;
+			}
+		}
+	}
+	single_subset_write_block(&best, bitstring);
+}
+
+// Direct encoding of BPTC float (BC6H) blocks.
+
+// The layout of the endpoint fields after the mode bits for every mode, as in draw_block4x4_bptc_float_shared().
+// The fields are listed from the lowest bit position upwards, and a field x[a:b] holds bits a down to b of x, with
+// bit b at the lowest position, so that fields such as r0[10:11] are stored reversed.
+
+static const char *bptc_float_layout[14] = {
+	"g2[4],b2[4],b3[4],r0[9:0],g0[9:0],b0[9:0],r1[4:0],g3[4],g2[3:0],g1[4:0],b3[0],g3[3:0],b1[4:0],b3[1],"
+	"b2[3:0],r2[4:0],b3[2],r3[4:0],b3[3]",
+	"g2[5],g3[4],g3[5],r0[6:0],b3[0],b3[1],b2[4],g0[6:0],b2[5],b3[2],g2[4],b0[6:0],b3[3],b3[5],b3[4],r1[5:0],"
+	"g2[3:0],g1[5:0],g3[3:0],b1[5:0],b2[3:0],r2[5:0],r3[5:0]",
+	"r0[9:0],g0[9:0],b0[9:0],r1[4:0],r0[10],g2[3:0],g1[3:0],g0[10],b3[0],g3[3:0],b1[3:0],b0[10],b3[1],b2[3:0],"
+	"r2[4:0],b3[2],r3[4:0],b3[3]",
+	"r0[9:0],g0[9:0],b0[9:0],r1[3:0],r0[10],g3[4],g2[3:0],g1[4:0],g0[10],g3[3:0],b1[3:0],b0[10],b3[1],b2[3:0],"
+	"r2[3:0],b3[0],b3[2],r3[3:0],g2[4],b3[3]",
+	"r0[9:0],g0[9:0],b0[9:0],r1[3:0],r0[10],b2[4],g2[3:0],g1[3:0],g0[10],b3[0],g3[3:0],b1[4:0],b0[10],b2[3:0],"
+	"r2[3:0],b3[1],b3[2],r3[3:0],b3[4],b3[3]",
+	"r0[8:0],b2[4],g0[8:0],g2[4],b0[8:0],b3[4],r1[4:0],g3[4],g2[3:0],g1[4:0],b3[0],g3[3:0],b1[4:0],b3[1],"
+	"b2[3:0],r2[4:0],b3[2],r3[4:0],b3[3]",
+	"r0[7:0],g3[4],b2[4],g0[7:0],b3[2],g2[4],b0[7:0],b3[3],b3[4],r1[5:0],g2[3:0],g1[4:0],b3[0],g3[3:0],b1[4:0],"
+	"b3[1],b2[3:0],r2[5:0],r3[5:0]",
+	"r0[7:0],b3[0],b2[4],g0[7:0],g2[5],g2[4],b0[7:0],g3[5],b3[4],r1[4:0],g3[4],g2[3:0],g1[5:0],g3[3:0],b1[4:0],"
+	"b3[1],b2[3:0],r2[4:0],b3[2],r3[4:0],b3[3]",
+	"r0[7:0],b3[1],b2[4],g0[7:0],b2[5],g2[4],b0[7:0],b3[5],b3[4],r1[4:0],g3[4],g2[3:0],g1[4:0],b3[0],g3[3:0],"
+	"b1[5:0],b2[3:0],r2[4:0],b3[2],r3[4:0],b3[3]",
+	"r0[5:0],g3[4],b3[0],b3[1],b2[4],g0[5:0],g2[5],b2[5],b3[2],g2[4],b0[5:0],g3[5],b3[3],b3[5],b3[4],r1[5:0],"
+	"g2[3:0],g1[5:0],g3[3:0],b1[5:0],b2[3:0],r2[5:0],r3[5:0]",
+	"r0[9:0],g0[9:0],b0[9:0],r1[9:0],g1[9:0],b1[9:0]",
+	"r0[9:0],g0[9:0],b0[9:0],r1[8:0],r0[10],g1[8:0],g0[10],b1[8:0],b0[10]",
+	"r0[9:0],g0[9:0],b0[9:0],r1[7:0],r0[10:11],g1[7:0],g0[10:11],b1[7:0],b0[10:11]",
+	"r0[9:0],g0[9:0],b0[9:0],r1[3:0],r0[10:15],g1[3:0],g0[10:15],b1[3:0],b0[10:15]"
+};
+
+// The number of bits of the red, green and blue deltas of the transformed endpoints. Modes 9 and 10 store all
+// endpoints directly.
+
+static char bptc_float_delta_bits[14][3] = {
+	{ 5, 5, 5 }, { 6, 6, 6 }, { 5, 4, 4 }, { 4, 5, 4 }, { 4, 4, 5 }, { 5, 5, 5 }, { 6, 5, 5 },
+	{ 5, 6, 5 }, { 5, 5, 6 }, { 0, 0, 0 }, { 0, 0, 0 }, { 9, 9, 9 }, { 8, 8, 8 }, { 4, 4, 4 }
+};
+
+typedef struct {
+	int mode;
+	int signed_flag;
+	int nu_subsets;
+	int partition_set_id;
+	// The quantized endpoints for every subset, as signed values for the signed format.
+	int endpoint[2][2][3];
+	uint8_t index[16];
+} BPTCFloatBlock;
+
+// Write the endpoint fields of a block according to the layout of its mode. field[i][j] is component j of
+// endpoint i, in the order of the layout (r0, g0, b0, r1, ...).
+
+static void bptc_float_put_fields(const char *layout, const int (*field)[3], uint64_t *data, int *index) {
+	const char *p = layout;
+	while (*p != '\0') {
+		int component = *p == 'r' ? 0 : (*p == 'g' ? 1 : 2);
+		int endpoint = p[1] - '0';
+		char *end;
+		int first = strtol(&p[3], &end, 10);
+		int last = first;
+		if (*end == ':')
+			last = strtol(&end[1], &end, 10);
+		p = &end[1];
+		if (*p == ',')
+			p++;
+		// The bit listed last is at the lowest position.
+		int step = first >= last ? 1 : - 1;
+		for (int bit = last;; bit += step) {
+			bptc_put_bits(data, index, 1, field[endpoint][component] >> bit);
+			if (bit == first)
+				break;
+		}
+	}
+}
+
+// Return the target value in the space in which the decoder interpolates, which is roughly logarithmic, for a
+// half float component.
+
+static float bptc_float_target(int half_float, int signed_flag) {
+	int magnitude = half_float & 0x7FFF;
+	// Clamp infinities and NaNs to the largest finite value.
+	if (magnitude > 0x7BFF)
+		magnitude = 0x7BFF;
+	if (signed_flag) {
+		if (half_float & 0x8000)
+			return - magnitude * 32.0f / 31.0f;
+		return magnitude * 32.0f / 31.0f;
+	}
+	if (half_float & 0x8000)
+		return 0;
+	return magnitude * 64.0f / 31.0f;
+}
+
+// Return the half float component decoded from an interpolated value, as a signed value.
+
+static int bptc_float_decoded_value(int32_t value, int signed_flag) {
+	if (!signed_flag)
+		return value * 31 / 64;
+	if (value < 0)
+		return - (((- value) * 31) >> 5);
+	return (value * 31) >> 5;
+}
+
+static int32_t bptc_float_unquantize(int x, const BPTCFloatBlock *b) {
+	if (b->signed_flag)
+		return unquantize_signed(x, b->mode);
+	return unquantize(x, b->mode);
+}
+
+// Return the quantized endpoint value that unquantizes to the value closest to v.
+
+static int bptc_float_quantize(float v, const BPTCFloatBlock *b) {
+	int min_value, max_value;
+	if (b->signed_flag) {
+		max_value = (1 << (bptc_float_EPB[b->mode] - 1)) - 1;
+		min_value = - max_value;
+	}
+	else {
+		min_value = 0;
+		max_value = (1 << bptc_float_EPB[b->mode]) - 1;
+	}
+	int low = min_value;
+	int high = max_value;
+	// Find the smallest value that unquantizes to at least v.
+	while (low < high) {
+		int middle = low + ((high - low) >> 1);
+		if (bptc_float_unquantize(middle, b) < v)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	if (low > min_value && fabsf(bptc_float_unquantize(low - 1, b) - v) <= fabsf(bptc_float_unquantize(low, b) - v))
+		return low - 1;
+	return low;
+}
+
+// Limit the endpoints of a mode with transformed endpoints to the range of the deltas from the first endpoint.
+// When the endpoints are spread too far, they are first contracted towards the middle of their range, so that
+// the first endpoint does not keep its value at the expense of all others.
+
+static void bptc_float_limit_deltas(BPTCFloatBlock *b) {
+	if (b->mode == 9 || b->mode == 10)
+		return;
+	for (int c = 0; c < 3; c++) {
+		int max_delta = (1 << (bptc_float_delta_bits[b->mode][c] - 1)) - 1;
+		int low = b->endpoint[0][0][c];
+		int high = low;
+		for (int i = 1; i < b->nu_subsets * 2; i++) {
+			int e = b->endpoint[i >> 1][i & 1][c];
+			if (e < low)
+				low = e;
+			if (e > high)
+				high = e;
+		}
+		if (high - low > max_delta) {
+			float middle = (low + high) * 0.5f;
+			float scale = (float)max_delta / (high - low);
+			for (int i = 0; i < b->nu_subsets * 2; i++) {
+				int *e = &b->endpoint[i >> 1][i & 1][c];
+				*e = lroundf(middle + (*e - middle) * scale);
+			}
+		}
+		int base = b->endpoint[0][0][c];
+		for (int i = 1; i < b->nu_subsets * 2; i++) {
+			int *e = &b->endpoint[i >> 1][i & 1][c];
+			if (*e - base > max_delta)
+				*e = base + max_delta;
+			if (*e - base < - max_delta - 1)
+				*e = base - max_delta - 1;
+		}
+	}
+}
+
+// Set the pixel indices of the block to the ones with the smallest error in the half float representation for
+// its endpoints, and return the total squared error. The anchor pixels only use the indices of which the highest
+// bit is clear. The half float components of the n visible pixels are given as signed values, and pos holds
+// the position of each visible pixel in the block.
+
+static int64_t bptc_float_set_indices(BPTCFloatBlock *b, int n, const int (*values)[3], const int *pos) {
+	int index_bitcount = b->nu_subsets == 1 ? 4 : 3;
+	int palette[2][16][3];
+	for (int s = 0; s < b->nu_subsets; s++) {
+		int32_t e[2][3];
+		for (int i = 0; i < 2; i++)
+			for (int c = 0; c < 3; c++)
+				e[i][c] = bptc_float_unquantize(b->endpoint[s][i][c], b);
+		for (int j = 0; j < (1 << index_bitcount); j++)
+			for (int c = 0; c < 3; c++)
+				palette[s][j][c] = bptc_float_decoded_value(interpolate_float(e[0][c], e[1][c], j,
+					index_bitcount), b->signed_flag);
+	}
+	memset(b->index, 0, 16);
+	int64_t total_error = 0;
+	for (int i = 0; i < n; i++) {
+		int s = bptc_float_get_partition_index(b->nu_subsets, b->partition_set_id, pos[i]);
+		int nu_indices = 1 << index_bitcount;
+		if (pos[i] == get_anchor_index(b->partition_set_id, s, b->nu_subsets))
+			nu_indices >>= 1;
+		int64_t best_error = INT64_MAX;
+		for (int j = 0; j < nu_indices; j++) {
+			int64_t error = 0;
+			for (int c = 0; c < 3; c++) {
+				int d = palette[s][j][c] - values[i][c];
+				error += (int64_t)d * d;
+			}
+			if (error < best_error) {
+				best_error = error;
+				b->index[pos[i]] = j;
+			}
+		}
+		total_error += best_error;
+	}
+	return total_error;
+}
+
+// Set the endpoints of a subset to the extremes of the target values of its pixels along their principal axis,
+// oriented so that the anchor pixel is nearest to the first endpoint.
+
+static void bptc_float_set_principal_axis_endpoints(BPTCFloatBlock *b, int subset, int n,
+const float (*targets)[3], const int *pos, float (*endpoint)[3]) {
+	int count = 0;
+	float mean[3] = { 0, 0, 0 };
+	for (int i = 0; i < n; i++)
+		if (bptc_float_get_partition_index(b->nu_subsets, b->partition_set_id, pos[i]) == subset) {
+			for (int c = 0; c < 3; c++)
+				mean[c] += targets[i][c];
+			count++;
+		}
+	if (count == 0) {
+		for (int c = 0; c < 3; c++)
+			endpoint[0][c] = endpoint[1][c] = 0;
+		return;
+	}
+	for (int c = 0; c < 3; c++)
+		mean[c] /= count;
+	float covariance[9];
+	memset(covariance, 0, sizeof(covariance));
+	for (int i = 0; i < n; i++)
+		if (bptc_float_get_partition_index(b->nu_subsets, b->partition_set_id, pos[i]) == subset)
+			for (int j = 0; j < 3; j++)
+				for (int k = 0; k < 3; k++)
+					covariance[j * 3 + k] += (targets[i][j] - mean[j]) * (targets[i][k] - mean[k]);
+	float axis[3];
+	principal_axis(covariance, 3, axis);
+	float t_min = 0, t_max = 0, t_anchor = 0;
+	int anchor = get_anchor_index(b->partition_set_id, subset, b->nu_subsets);
+	for (int i = 0; i < n; i++)
+		if (bptc_float_get_partition_index(b->nu_subsets, b->partition_set_id, pos[i]) == subset) {
+			float t = 0;
+			for (int c = 0; c < 3; c++)
+				t += (targets[i][c] - mean[c]) * axis[c];
+			if (t < t_min)
+				t_min = t;
+			if (t > t_max)
+				t_max = t;
+			if (pos[i] == anchor)
+				t_anchor = t;
+		}
+	if (t_anchor - t_min > t_max - t_anchor) {
+		float t = t_min;
+		t_min = t_max;
+		t_max = t;
+	}
+	for (int c = 0; c < 3; c++) {
+		endpoint[0][c] = mean[c] + t_min * axis[c];
+		endpoint[1][c] = mean[c] + t_max * axis[c];
+	}
+}
+
+// Quantize the endpoints, given in the space in which the decoder interpolates, of all subsets.
+
+static void bptc_float_quantize_endpoints(BPTCFloatBlock *b, float (*endpoint)[2][3]) {
+	for (int s = 0; s < b->nu_subsets; s++)
+		for (int i = 0; i < 2; i++)
+			for (int c = 0; c < 3; c++)
+				b->endpoint[s][i][c] = bptc_float_quantize(endpoint[s][i][c], b);
+	bptc_float_limit_deltas(b);
+}
+
+// Fit the endpoints of all subsets to the target values of the pixels with least squares for the current
+// pixel indices. The endpoints of a subset of which all pixels use the same index are not changed.
+
+static void bptc_float_fit_endpoints(BPTCFloatBlock *b, int n, const float (*targets)[3], const int *pos) {
+	int index_bitcount = b->nu_subsets == 1 ? 4 : 3;
+	const uint16_t *weights = index_bitcount == 3 ? aWeight3 : aWeight4;
+	float endpoint[2][2][3];
+	for (int s = 0; s < b->nu_subsets; s++) {
+		for (int i = 0; i < 2; i++)
+			for (int c = 0; c < 3; c++)
+				endpoint[s][i][c] = bptc_float_unquantize(b->endpoint[s][i][c], b);
+		float a = 0, m = 0, d = 0;
+		float x0[3] = { 0, 0, 0 };
+		float x1[3] = { 0, 0, 0 };
+		for (int i = 0; i < n; i++) {
+			if (bptc_float_get_partition_index(b->nu_subsets, b->partition_set_id, pos[i]) != s)
+				continue;
+			float w = weights[b->index[pos[i]]] / 64.0f;
+			a += (1.0f - w) * (1.0f - w);
+			m += (1.0f - w) * w;
+			d += w * w;
+			for (int c = 0; c < 3; c++) {
+				x0[c] += (1.0f - w) * targets[i][c];
+				x1[c] += w * targets[i][c];
+			}
+		}
+		float det = a * d - m * m;
+		if (det < 0.0001f)
+			continue;
+		for (int c = 0; c < 3; c++) {
+			endpoint[s][0][c] = (d * x0[c] - m * x1[c]) / det;
+			endpoint[s][1][c] = (a * x1[c] - m * x0[c]) / det;
+		}
+	}
+	bptc_float_quantize_endpoints(b, endpoint);
+}
+
+// Write a BPTC float block to a bitstring.
+
+static void bptc_float_write_block(const BPTCFloatBlock *b, unsigned char *bitstring) {
+	int mask = (1 << bptc_float_EPB[b->mode]) - 1;
+	int field[4][3];
+	for (int i = 0; i < b->nu_subsets * 2; i++)
+		for (int c = 0; c < 3; c++) {
+			int e = b->endpoint[i >> 1][i & 1][c];
+			if (i == 0 || b->mode == 9 || b->mode == 10)
+				field[i][c] = e & mask;
+			else
+				field[i][c] = (e - b->endpoint[0][0][c]) & ((1 << bptc_float_delta_bits[b->mode][c]) - 1);
+		}
+	uint64_t data[2] = { 0, 0 };
+	int index = 0;
+	if (b->mode < 2)
+		bptc_put_bits(data, &index, 2, b->mode);
+	else
+		bptc_put_bits(data, &index, 5, bptc_float_set_mode_table[b->mode]);
+	bptc_float_put_fields(bptc_float_layout[b->mode], (const int (*)[3])field, data, &index);
+	int index_bitcount = 4;
+	if (b->nu_subsets == 2) {
+		bptc_put_bits(data, &index, 5, b->partition_set_id);
+		index_bitcount = 3;
+	}
+	for (int i = 0; i < 16; i++) {
+		int s = bptc_float_get_partition_index(b->nu_subsets, b->partition_set_id, i);
+		if (i == get_anchor_index(b->partition_set_id, s, b->nu_subsets))
+			bptc_put_bits(data, &index, index_bitcount - 1, b->index[i]);
+		else
+			bptc_put_bits(data, &index, index_bitcount, b->index[i]);
+	}
+	*(uint64_t *)&bitstring[0] = data[0];
+	*(uint64_t *)&bitstring[8] = data[1];
+}
+
+// Directly encode a BPTC float block in the given mode from the width x height visible pixels of the block (with
+// 64-bit half float pixels in row-major order). The endpoints of each subset are set to the extremes of the
+// pixels along their principal axis and refined with least squares, in the space in which the decoder
+// interpolates, which is close to the logarithm of the values. For the modes with two subsets, the partitions
+// are ranked by how well the pixels of each subset fit on a line in that space, and the partition with the
+// given rank (0 for the best one) is used.
+
+void encode_block4x4_bptc_float(const uint64_t *pixels, int width, int height, int mode, int partition_rank,
+int signed_flag, unsigned char *bitstring) {
+	BPTCFloatBlock b;
+	memset(&b, 0, sizeof(b));
+	b.mode = mode;
+	b.signed_flag = signed_flag;
+	b.nu_subsets = mode >= 10 ? 1 : 2;
+	int n = 0;
+	int pos[16];
+	int values[16][3];
+	float targets[16][4];
+	for (int y = 0; y < height; y++)
+		for (int x = 0; x < width; x++) {
+			int i = y * 4 + x;
+			pos[n] = i;
+			for (int c = 0; c < 3; c++) {
+				int half_float = (pixels[i] >> (c * 16)) & 0xFFFF;
+				targets[n][c] = bptc_float_target(half_float, signed_flag);
+				values[n][c] = bptc_float_decoded_value(roundf(targets[n][c]), signed_flag);
+			}
+			targets[n][3] = 0;
+			n++;
+		}
+	if (b.nu_subsets == 2) {
+		unsigned char partitions[32];
+		preselect_partitions(n, (const float (*)[4])targets, pos, 2, 32, partition_rank + 1, partitions);
+		b.partition_set_id = partitions[partition_rank];
+	}
+	float target_rgb[16][3];
+	for (int i = 0; i < n; i++)
+		for (int c = 0; c < 3; c++)
+			target_rgb[i][c] = targets[i][c];
+	float endpoint[2][2][3];
+	for (int s = 0; s < b.nu_subsets; s++)
+		bptc_float_set_principal_axis_endpoints(&b, s, n, (const float (*)[3])target_rgb, pos, endpoint[s]);
+	bptc_float_quantize_endpoints(&b, endpoint);
+	int64_t error = bptc_float_set_indices(&b, n, (const int (*)[3])values, pos);
+	for (int iteration = 0; iteration < 2 && error > 0; iteration++) {
+		BPTCFloatBlock c = b;
+		bptc_float_fit_endpoints(&c, n, (const float (*)[3])target_rgb, pos);
+		int64_t new_error = bptc_float_set_indices(&c, n, (const int (*)[3])values, pos);
+		if (new_error >= error)
+			break;
+		b = c;
+		error = new_error;
+	}
+	bptc_float_write_block(&b, bitstring);
+}
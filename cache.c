@@ -0,0 +1,214 @@
+/*
+
+Copyright (c) 2015 Harm Hanemaaijer <fgenfb@yahoo.com>
+
+Permission to use, copy, modify, and/or distribute this software for any
+purpose with or without fee is hereby granted, provided that the above
+copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+*/
+
+// Persistent cache of compressed blocks. The cache is a memory-mapped file that is shared by all processes
+// that use it. It maps a 128-bit key, derived from the source pixels of a block and the parameters of the
+// compression, to the best compressed block found so far and its fitness.
+//
+// The entries are organized in sets of BLOCK_CACHE_WAYS entries; a key can only be stored in the set selected
+// by its hash. Every entry has a sequence number that is odd while the entry is being written, so that
+// readers in other processes can detect and skip an entry that is being changed without taking a lock. A
+// writer that finds the entry being written by another process gives up; the cache is only a hint, so losing
+// a store does no harm.
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+#include "texgenpack.h"
+
+#define BLOCK_CACHE_MAGIC "TGPBLKC1"
+#define BLOCK_CACHE_VERSION 1
+#define BLOCK_CACHE_WAYS 8
+// 2^17 sets of 8 entries of 64 bytes, 64 MB. The file is created sparse, so that only the parts that are used
+// take up disk space.
+#define BLOCK_CACHE_DEFAULT_NU_SETS (1 << 17)
+
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint32_t nu_sets;
+	unsigned char padding[48];
+} BlockCacheHeader;
+
+typedef struct {
+	uint32_t sequence;		// Zero for an empty entry, odd while the entry is being written.
+	uint32_t padding0;
+	uint64_t key[2];
+	double fitness;
+	unsigned char bitstring[16];
+	unsigned char padding1[16];
+} BlockCacheEntry;
+
+struct BlockCache_t {
+	int fd;
+	size_t size;
+	BlockCacheHeader *header;
+	BlockCacheEntry *entries;
+	uint32_t nu_sets;
+};
+
+#ifdef _WIN32
+
+BlockCache *open_block_cache(const char *filename) {
+	report_error("Error -- the block cache is not supported on this platform.\n");
+}
+
+void close_block_cache(BlockCache *cache) {
+}
+
+#else
+
+// Open the block cache file with the given name, creating it when it does not exist. The file is locked while
+// it is initialized, so that processes that open it at the same time see a valid header.
+
+BlockCache *open_block_cache(const char *filename) {
+	int fd = open(filename, O_RDWR | O_CREAT, 0666);
+	if (fd < 0) {
+		report_error("Error -- couldn't open block cache file %s.\n", filename);
+	}
+	flock(fd, LOCK_EX);
+	struct stat st;
+	BlockCacheHeader header;
+	if (fstat(fd, &st) != 0)
+		goto error;
+	if (st.st_size == 0) {
+		memset(&header, 0, sizeof(BlockCacheHeader));
+		memcpy(header.magic, BLOCK_CACHE_MAGIC, 8);
+		header.version = BLOCK_CACHE_VERSION;
+		header.nu_sets = BLOCK_CACHE_DEFAULT_NU_SETS;
+		if (ftruncate(fd, sizeof(BlockCacheHeader) + (off_t)header.nu_sets * BLOCK_CACHE_WAYS *
+		sizeof(BlockCacheEntry)) != 0)
+			goto error;
+		if (pwrite(fd, &header, sizeof(BlockCacheHeader), 0) != sizeof(BlockCacheHeader))
+			goto error;
+	}
+	else {
+		if (pread(fd, &header, sizeof(BlockCacheHeader), 0) != sizeof(BlockCacheHeader) ||
+		memcmp(header.magic, BLOCK_CACHE_MAGIC, 8) != 0 || header.version != BLOCK_CACHE_VERSION ||
+		header.nu_sets == 0 || st.st_size != sizeof(BlockCacheHeader) + (off_t)header.nu_sets *
+		BLOCK_CACHE_WAYS * sizeof(BlockCacheEntry)) {
+			flock(fd, LOCK_UN);
+			close(fd);
+			report_error("Error -- %s is not a valid block cache file.\n", filename);
+		}
+	}
+	flock(fd, LOCK_UN);
+	size_t size = sizeof(BlockCacheHeader) + (size_t)header.nu_sets * BLOCK_CACHE_WAYS * sizeof(BlockCacheEntry);
+	void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (p == MAP_FAILED) {
+		close(fd);
+		report_error("Error -- couldn't map block cache file %s.\n", filename);
+	}
+	BlockCache *cache = (BlockCache *)malloc(sizeof(BlockCache));
+	cache->fd = fd;
+	cache->size = size;
+	cache->header = (BlockCacheHeader *)p;
+	cache->entries = (BlockCacheEntry *)((unsigned char *)p + sizeof(BlockCacheHeader));
+	cache->nu_sets = header.nu_sets;
+	return cache;
+
+error :
+	flock(fd, LOCK_UN);
+	close(fd);
+	report_error("Error -- couldn't initialize block cache file %s.\n", filename);
+}
+
+void close_block_cache(BlockCache *cache) {
+	munmap(cache->header, cache->size);
+	close(cache->fd);
+	free(cache);
+}
+
+#endif
+
+static BlockCacheEntry *get_block_cache_set(BlockCache *cache, const uint64_t *key) {
+	return &cache->entries[(key[0] % cache->nu_sets) * BLOCK_CACHE_WAYS];
+}
+
+// Read an entry. Returns false when the entry is empty, is being written or has been changed while it was
+// read.
+
+static bool read_block_cache_entry(BlockCacheEntry *entry, BlockCacheEntry *copy) {
+	uint32_t sequence = __atomic_load_n(&entry->sequence, __ATOMIC_ACQUIRE);
+	if (sequence == 0 || (sequence & 1))
+		return false;
+	memcpy(copy, entry, sizeof(BlockCacheEntry));
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	return __atomic_load_n(&entry->sequence, __ATOMIC_RELAXED) == sequence;
+}
+
+// Look up the compressed block with the given key. When it is found, the 16-byte bitstring buffer is filled
+// with the block, the fitness is set and 1 is returned; otherwise 0 is returned.
+
+int block_cache_lookup(BlockCache *cache, const uint64_t *key, unsigned char *bitstring, double *fitness) {
+	BlockCacheEntry *set = get_block_cache_set(cache, key);
+	for (int i = 0; i < BLOCK_CACHE_WAYS; i++) {
+		BlockCacheEntry entry;
+		if (read_block_cache_entry(&set[i], &entry) && entry.key[0] == key[0] && entry.key[1] == key[1]) {
+			memcpy(bitstring, entry.bitstring, 16);
+			*fitness = entry.fitness;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+// Store a compressed block, given as a 16-byte bitstring, with the given key, unless a block with the same key
+// and at least the same fitness is already stored. When the set is full, an entry selected by the key is replaced.
+
+void block_cache_store(BlockCache *cache, const uint64_t *key, const unsigned char *bitstring, double fitness) {
+	BlockCacheEntry *set = get_block_cache_set(cache, key);
+	BlockCacheEntry *target = NULL;
+	for (int i = 0; i < BLOCK_CACHE_WAYS; i++) {
+		BlockCacheEntry entry;
+		if (read_block_cache_entry(&set[i], &entry) && entry.key[0] == key[0] && entry.key[1] == key[1]) {
+			if (entry.fitness >= fitness)
+				return;
+			target = &set[i];
+			break;
+		}
+	}
+	if (target == NULL)
+		for (int i = 0; i < BLOCK_CACHE_WAYS; i++)
+			if (__atomic_load_n(&set[i].sequence, __ATOMIC_RELAXED) == 0) {
+				target = &set[i];
+				break;
+			}
+	if (target == NULL)
+		target = &set[key[1] % BLOCK_CACHE_WAYS];
+	uint32_t sequence = __atomic_load_n(&target->sequence, __ATOMIC_RELAXED);
+	if (sequence & 1)
+		return;
+	if (!__atomic_compare_exchange_n(&target->sequence, &sequence, sequence + 1, false, __ATOMIC_ACQUIRE,
+	__ATOMIC_RELAXED))
+		return;
+	target->key[0] = key[0];
+	target->key[1] = key[1];
+	target->fitness = fitness;
+	memcpy(target->bitstring, bitstring, 16);
+	__atomic_store_n(&target->sequence, sequence + 2, __ATOMIC_RELEASE);
+}
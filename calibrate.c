@@ -21,22 +21,15 @@ OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 #include <stdint.h>
 #include <math.h>
 #include <malloc.h>
+#ifndef TEXGENPACK_BUILTIN_GA
 #include <fgen.h>
+#endif
 #include "texgenpack.h"
 
 // Calibrate genetic algorithm parameters.
 
-static const int fixed_crossover_probability = 1;
-static const int real_valued_ga = 0;
 static const int deterministic = 0;
 
-typedef struct {
-	Image *image;
-	int texture_format;
-} FitUserData;
-
-static FitUserData fit_user_data;
-
 typedef struct {
 	double cumulative_rmse;
 	int count;
@@ -72,6 +65,20 @@ static void mutation_bin_report() {
 static void compress_callback(BlockUserData *user_data) {
 }
 
+// Fitting of the parameters with libfgen, which is not available with the built-in genetic algorithm engine.
+
+#ifndef TEXGENPACK_BUILTIN_GA
+
+static const int fixed_crossover_probability = 1;
+static const int real_valued_ga = 0;
+
+typedef struct {
+	Image *image;
+	int texture_format;
+} FitUserData;
+
+static FitUserData fit_user_data;
+
 static double calibrate_calculate_error(const Ffit *fit, const double *param) {
 	FitUserData *user_data = &fit_user_data;
 	Texture texture;
@@ -103,6 +110,8 @@ static void calibrate_generation_callback(Ffit *fit, int generation, const doubl
 		ffit_signal_model_change(fit);
 }
 
+#endif
+
 void calibrate_genetic_parameters(Image *image, int texture_type) {
 	option_deterministic = deterministic;	// Whether to initialize random function seed with timer.
 	option_quiet = 1;
@@ -21,6 +21,7 @@ OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 #include <stdint.h>
 #include <math.h>
 #include <float.h>
+#include <pthread.h>
 #include "texgenpack.h"
 #include "decode.h"
 #include "packing.h"
@@ -887,15 +888,25 @@ double compare_border_block_perceptive_4x4_rgba(unsigned int *image_buffer, Bloc
 	return (double)1 / error;
 }
 
+// The lookup tables are shared by all compressions. They are calculated on first use; the mutex makes
+// sure that a table is complete before any thread can see it.
+
+static pthread_mutex_t table_mutex = PTHREAD_MUTEX_INITIALIZER;
+
 float *normalized_float_table = NULL;
 
 void calculate_normalized_float_table() {
-	if (normalized_float_table != NULL)
+	pthread_mutex_lock(&table_mutex);
+	if (normalized_float_table != NULL) {
+		pthread_mutex_unlock(&table_mutex);
 		return;
-	normalized_float_table = (float *)malloc(sizeof(float) * 256);
+	}
+	float *table = (float *)malloc(sizeof(float) * 256);
 	for (int i = 0; i < 256; i++) {
-		normalized_float_table[i] = (float)i / 255.0;
+		table[i] = (float)i / 255.0;
 	}
+	normalized_float_table = table;
+	pthread_mutex_unlock(&table_mutex);
 }
 
 // Compare RGB block image with 32-bit pixels with source image with 64-bit half-float pixels block size 4x4.
@@ -1282,16 +1293,21 @@ double compare_block_4x4_r16_signed(unsigned int *image_buffer, BlockUserData *u
 float *half_float_table = NULL;
 
 void calculate_half_float_table() {
-	if (half_float_table != NULL)
+	pthread_mutex_lock(&table_mutex);
+	if (half_float_table != NULL) {
+		pthread_mutex_unlock(&table_mutex);
 		return;
-	half_float_table = (float *)malloc(sizeof(float) * 65536);
+	}
+	float *table = (float *)malloc(sizeof(float) * 65536);
 	for (int i = 0; i < 65536; i++) {
 		uint16_t h[1];
 		float f[1];
 		h[0] = (uint16_t)i;
 		halfp2singles(&f[0], &h[0], 1);
-		half_float_table[i] = f[0];
+		table[i] = f[0];
 	}
+	half_float_table = table;
+	pthread_mutex_unlock(&table_mutex);
 }
 
 // Compare 4x4 rgba half-float block (64-bit pixels) in normalized format.
@@ -1444,19 +1460,24 @@ double compare_block_4x4_r_half_float(unsigned int *image_buffer, BlockUserData
 float *gamma_corrected_half_float_table = NULL;
 
 void calculate_gamma_corrected_half_float_table() {
-	if (gamma_corrected_half_float_table != NULL)
+	pthread_mutex_lock(&table_mutex);
+	if (gamma_corrected_half_float_table != NULL) {
+		pthread_mutex_unlock(&table_mutex);
 		return;
-	gamma_corrected_half_float_table = (float *)malloc(sizeof(float) * 65536);
+	}
+	float *table = (float *)malloc(sizeof(float) * 65536);
 	for (int i = 0; i < 65536; i++) {
 		uint16_t h[1];
 		float f[1];
 		h[0] = (uint16_t)i;
 		halfp2singles(&f[0], &h[0], 1);
 		if (f[0] >= 0)
-			gamma_corrected_half_float_table[i] = powf(f[0], 1 / 2.2);
+			table[i] = powf(f[0], 1 / 2.2);
 		else
-			gamma_corrected_half_float_table[i] = - powf(- f[0], 1 / 2.2);
+			table[i] = - powf(- f[0], 1 / 2.2);
 	}
+	gamma_corrected_half_float_table = table;
+	pthread_mutex_unlock(&table_mutex);
 }
 
 // Compare 4x4 rgba half-float block (64-bit pixels) in HDR (unnormalized) format.
@@ -23,7 +23,12 @@ OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 #include <stdbool.h>
 #include <math.h>
 #include <malloc.h>
+#include <pthread.h>
+#ifdef TEXGENPACK_BUILTIN_GA
+#include "ga.h"
+#else
 #include <fgen.h>
+#endif
 #include "texgenpack.h"
 #include "decode.h"
 #include "packing.h"
@@ -45,42 +50,105 @@ enum {
 	BLOCK_FLAG_PUNCHTHROUGH = 0x40,
 };
 
-static void compress_with_single_population(Image *image, Texture *Texture);
-static void compress_with_archipelago(Image *image, Texture *texture);
-static void compress_multiple_blocks_concurrently(Image *image, Texture *texture);
-static void compress_multiple_blocks_concurrently_second_pass(Image *image, Texture *texture);
+// A mipmap level that is being compressed. The blocks of all levels that are compressed together are
+// numbered consecutively, starting with the blocks of the first level.
+
+struct MipmapLevel_t {
+	Image *image;
+	Texture *texture;
+	int first_block;
+	int nu_blocks;
+	int blocks_per_row;
+	// block_done[i] is set when compressed block i of the level is final and can be used by the seeding
+	// functions.
+	unsigned char *block_done;
+	// Decompressed pixels of the compressed blocks, used by the perceptive quality strategy.
+	unsigned int *texture_pixels;
+};
+
+static void compress_with_single_population(CompressionContext *context, MipmapLevel *level);
+static void compress_with_archipelago(CompressionContext *context);
+static void compress_multiple_blocks_concurrently(CompressionContext *context);
+static void compress_multiple_blocks_concurrently_second_pass(CompressionContext *context);
+static void compress_blocks_with_work_stealing(CompressionContext *context, int nu_workers, FgenPopulation **pops,
+int max_generations);
+static void seed_population_rngs(CompressionContext *context, int nu_pops, FgenPopulation **pops);
+static MipmapLevel *get_texture_level(CompressionContext *context, Texture *texture);
+static unsigned int *allocate_texture_pixels(Texture *texture);
+static void run_populations_concurrently(CompressionContext *context, int nu_pops, FgenPopulation **pops);
+static int get_number_of_threads(CompressionContext *context);
 static void set_alpha_pixels(Image *image, int x, int y, int w, int h, unsigned char *alpha_pixels);
 static int get_block_flags_rgba8(Image *image, int x, int y, int w, int h, unsigned char *alpha_pixels,
 unsigned int *colors);
+static int get_block_flags(Image *image, Texture *texture, int x, int y, unsigned char *alpha_pixels,
+unsigned int *colors);
 static void optimize_alpha(Image *image, Texture *texture);
-static double get_rmse_threshold(Texture *texture, int speed, Image *image);
-
-static int nu_generations, nu_generations_second_pass;
-static int population_size;
-static int nu_islands, nu_islands_second_pass;
-static float mutation_probability;
-static float mutation_probability_second_pass;
-static float crossover_probability;
-static CompressCallbackFunction compress_callback_func;
-static int mode_statistics[16];
-static double rmse_threshold;
+static void find_duplicate_blocks(CompressionContext *context);
+static void encode_trivial_blocks(CompressionContext *context);
+static void encode_planar_blocks(CompressionContext *context);
+static void encode_single_subset_bptc_blocks(CompressionContext *context);
+static void encode_optimal_components(CompressionContext *context);
+static void preselect_bptc_partitions(CompressionContext *context);
+static void keep_unchanged_blocks(CompressionContext *context);
+static void look_up_cached_blocks(CompressionContext *context);
+static bool block_cache_usable(CompressionContext *context, Texture *texture);
+static void get_block_cache_key(CompressionContext *context, int block_index, uint64_t *key);
+static double get_rmse_threshold(CompressionContext *context, Texture *texture, int speed, Image *image);
+
+// Initialize a compression context with the command line options and the given callback function, which
+// may be NULL.
+
+void init_compression_context(CompressionContext *context, CompressCallbackFunction callback_func) {
+	memset(context, 0, sizeof(CompressionContext));
+	context->options.compression_level = option_compression_level;
+	context->options.perceptive = option_perceptive;
+	context->options.modal_etc2 = option_modal_etc2;
+	context->options.allowed_modes_etc2 = option_allowed_modes_etc2;
+	context->options.evolve_pixel_indices = option_evolve_indices;
+	context->options.generations = option_generations;
+	context->options.islands = option_islands;
+	context->options.generations_second_pass = option_generations_second_pass;
+	context->options.islands_second_pass = option_islands_second_pass;
+	context->options.max_threads = option_max_threads;
+	context->options.deterministic = option_deterministic;
+	context->options.hdr = option_hdr;
+	context->options.verbose = option_verbose;
+	context->options.quiet = option_quiet;
+	context->options.progress = option_progress;
+	context->callback_func = callback_func;
+}
 
 // Compress an image into a texture.
 
 void compress_image(Image *image, int texture_type, CompressCallbackFunction callback_func, Texture *texture,
 int genetic_parameters, float mutation_prob, float crossover_prob) {
-	texture->info = match_texture_type(texture_type);
-	if (texture_type & TEXTURE_TYPE_UNCOMPRESSED_BIT) {
-		copy_image_to_uncompressed_texture(image, texture_type, texture);
-		return;
-	}
-	if (texture_type & TEXTURE_TYPE_ASTC_BIT) {
-		compress_image_to_astc_texture(image, texture_type, texture);
-		return;
-	}
+	compress_mipmap_images(image, 1, texture_type, callback_func, texture, genetic_parameters, mutation_prob,
+		crossover_prob);
+}
+
+// Compress a chain of mipmap images into textures, using the command line options.
+
+void compress_mipmap_images(Image *images, int nu_images, int texture_type, CompressCallbackFunction callback_func,
+Texture *textures, int genetic_parameters, float mutation_prob, float crossover_prob) {
+	CompressionContext context;
+	init_compression_context(&context, callback_func);
+	context.options.genetic_parameters = genetic_parameters;
+	context.options.mutation_probability = mutation_prob;
+	context.options.crossover_probability = crossover_prob;
+	compress_mipmap_images_with_context(&context, images, nu_images, texture_type, textures);
+}
+
+// Compress an image into a texture with the options of the given context.
+
+void compress_image_with_context(CompressionContext *context, Image *image, int texture_type, Texture *texture) {
+	compress_mipmap_images_with_context(context, image, 1, texture_type, texture);
+}
+
+// Set up a texture for compression of the image.
+
+static void set_up_texture(CompressionContext *context, Image *image, int texture_type, Texture *texture) {
 	if ((texture_type & TEXTURE_TYPE_HALF_FLOAT_BIT) && !image->is_half_float) {
-		printf("Error -- image is not in half float format.\n");
-		exit(1);
+		report_error("Error -- image is not in half float format.\n");
 	}
 	texture->width = image->width;
 	texture->height = image->height;
@@ -97,19 +165,173 @@ int genetic_parameters, float mutation_prob, float crossover_prob) {
 	set_texture_decoding_function(texture, image);
 	if ((texture_type & TEXTURE_TYPE_HALF_FLOAT_BIT) || image->is_half_float)
 		calculate_half_float_table();
-	if ((texture_type == TEXTURE_TYPE_BPTC_FLOAT || texture_type == TEXTURE_TYPE_BPTC_SIGNED_FLOAT) && option_hdr)
+	if ((texture_type == TEXTURE_TYPE_BPTC_FLOAT || texture_type == TEXTURE_TYPE_BPTC_SIGNED_FLOAT) &&
+	context->options.hdr)
 		calculate_gamma_corrected_half_float_table();
 	if (image->is_half_float)
 		calculate_normalized_float_table();
-	rmse_threshold = get_rmse_threshold(texture, option_compression_level, image);
+}
 
-	if (option_verbose) {
-		memset(mode_statistics, 0, sizeof(int) * 16);
+// Return the 64-bit texture type of each half of a 128-bit texture type of which the two halves are
+// independent blocks of the same single component format, one for the red component and one for the green
+// component, or - 1 for other texture types.
+
+static int get_half_texture_type(int texture_type) {
+	switch (texture_type) {
+	case TEXTURE_TYPE_RG11_EAC :
+		return TEXTURE_TYPE_R11_EAC;
+	case TEXTURE_TYPE_SIGNED_RG11_EAC :
+		return TEXTURE_TYPE_SIGNED_R11_EAC;
+	case TEXTURE_TYPE_SIGNED_RGTC2 :
+		return TEXTURE_TYPE_SIGNED_RGTC1;
 	}
-	compress_callback_func = callback_func;
-	if (genetic_parameters) {
-		mutation_probability = mutation_prob;
-		crossover_probability = crossover_prob;
+	return - 1;
+}
+
+// Create an image with 16-bit components that holds one component (0 for red, 1 for green) of another image
+// with two 16-bit components as its only (red) component.
+
+static void get_component_image(Image *image, int component, Image *component_image) {
+	*component_image = *image;
+	component_image->nu_components = 1;
+	component_image->pixels = (unsigned int *)calloc(image->extended_height * image->extended_width, 4);
+	for (int i = 0; i < image->height * image->extended_width; i++)
+		*(uint16_t *)&component_image->pixels[i] = *((uint16_t *)&image->pixels[i] + component);
+}
+
+// Create a texture of the half texture type that holds one half (0 for the first 64 bits, 1 for the last 64 bits)
+// of every block of a texture of a 128-bit texture type that consists of two independent halves.
+
+static void get_half_texture(Texture *texture, int half, Texture *half_texture) {
+	*half_texture = *texture;
+	half_texture->type = get_half_texture_type(texture->type);
+	half_texture->info = match_texture_type(half_texture->type);
+	half_texture->bits_per_block = 64;
+	int nu_blocks = (texture->extended_height / texture->block_height) *
+		(texture->extended_width / texture->block_width);
+	half_texture->pixels = (unsigned int *)malloc(nu_blocks * 8);
+	for (int i = 0; i < nu_blocks; i++)
+		memcpy(&half_texture->pixels[i * 2], &texture->pixels[i * 4 + half * 2], 8);
+}
+
+// Compress images into a texture type of which the blocks consist of two independent halves, one for the red
+// and one for the green component (RG11_EAC, SIGNED_RG11_EAC and SIGNED_RGTC2). The error of a block is the sum
+// of the errors of its halves, so instead of letting the genetic algorithm search the 128-bit blocks, each
+// component is compressed into its own 64-bit texture, with a fitness that only depends on that component, and
+// the halves are combined afterwards. The red and green components of all mipmap levels are handed to the block
+// scheduler together as separate levels, so that they are compressed concurrently. The compress callback
+// function is called with the user data of the halves.
+
+static void compress_halves_separately(CompressionContext *context, Image *images, int nu_images,
+int texture_type, Texture *textures) {
+	int half_texture_type = get_half_texture_type(texture_type);
+	Image *half_images = (Image *)malloc(sizeof(Image) * nu_images * 2);
+	Texture *half_textures = (Texture *)malloc(sizeof(Texture) * nu_images * 2);
+	for (int i = 0; i < nu_images; i++) {
+		get_component_image(&images[i], 0, &half_images[i]);
+		get_component_image(&images[i], 1, &half_images[nu_images + i]);
+	}
+	// The levels of the previous compression are split in the same way, as far as they have the texture type and
+	// size of the levels that are compressed; the other levels are dropped. When fewer levels remain, only the
+	// red components can use them.
+	Image *previous_images = context->previous_images;
+	Texture *previous_textures = context->previous_textures;
+	int nu_previous_levels = context->nu_previous_levels;
+	int n = 0;
+	if (previous_textures != NULL)
+		while (n < nu_previous_levels && n < nu_images && previous_textures[n].type == texture_type &&
+		previous_textures[n].width == images[n].width && previous_textures[n].height == images[n].height)
+			n++;
+	if (previous_textures != NULL) {
+		context->previous_images = (Image *)malloc(sizeof(Image) * n * 2);
+		context->previous_textures = (Texture *)malloc(sizeof(Texture) * n * 2);
+		for (int i = 0; i < n; i++) {
+			get_component_image(&previous_images[i], 0, &context->previous_images[i]);
+			get_half_texture(&previous_textures[i], 0, &context->previous_textures[i]);
+			get_component_image(&previous_images[i], 1, &context->previous_images[n + i]);
+			get_half_texture(&previous_textures[i], 1, &context->previous_textures[n + i]);
+		}
+		context->nu_previous_levels = n == nu_images ? n * 2 : n;
+	}
+	compress_mipmap_images_with_context(context, half_images, nu_images * 2, half_texture_type, half_textures);
+	if (previous_textures != NULL) {
+		for (int i = 0; i < n * 2; i++) {
+			destroy_image(&context->previous_images[i]);
+			destroy_texture(&context->previous_textures[i]);
+		}
+		free(context->previous_images);
+		free(context->previous_textures);
+		context->previous_images = previous_images;
+		context->previous_textures = previous_textures;
+		context->nu_previous_levels = nu_previous_levels;
+	}
+	// Combine the halves.
+	for (int i = 0; i < nu_images; i++) {
+		set_up_texture(context, &images[i], texture_type, &textures[i]);
+		int nu_blocks = (textures[i].extended_height / textures[i].block_height) *
+			(textures[i].extended_width / textures[i].block_width);
+		for (int j = 0; j < nu_blocks; j++) {
+			memcpy(&textures[i].pixels[j * 4], &half_textures[i].pixels[j * 2], 8);
+			memcpy(&textures[i].pixels[j * 4 + 2], &half_textures[nu_images + i].pixels[j * 2], 8);
+		}
+	}
+	for (int i = 0; i < nu_images * 2; i++) {
+		destroy_image(&half_images[i]);
+		destroy_texture(&half_textures[i]);
+	}
+	free(half_images);
+	free(half_textures);
+}
+
+// Compress a chain of mipmap images into textures with the options of the given context. The blocks of all
+// levels are handed to the same scheduler, so that the blocks of the small levels fill the gaps left by the
+// large levels instead of each level being compressed with its own setup and teardown. Returns when every
+// level is done.
+
+void compress_mipmap_images_with_context(CompressionContext *context, Image *images, int nu_images,
+int texture_type, Texture *textures) {
+	for (int i = 0; i < nu_images; i++)
+		textures[i].info = match_texture_type(texture_type);
+	if (texture_type & TEXTURE_TYPE_UNCOMPRESSED_BIT) {
+		for (int i = 0; i < nu_images; i++)
+			copy_image_to_uncompressed_texture(&images[i], texture_type, &textures[i]);
+		return;
+	}
+	if (texture_type & TEXTURE_TYPE_ASTC_BIT) {
+		for (int i = 0; i < nu_images; i++)
+			compress_image_to_astc_texture(&images[i], texture_type, &textures[i]);
+		return;
+	}
+	if (get_half_texture_type(texture_type) != - 1 && !images[0].is_half_float) {
+		compress_halves_separately(context, images, nu_images, texture_type, textures);
+		return;
+	}
+	for (int i = 0; i < nu_images; i++)
+		set_up_texture(context, &images[i], texture_type, &textures[i]);
+	context->rmse_threshold = get_rmse_threshold(context, &textures[0], context->options.compression_level,
+		&images[0]);
+	// For formats of which the optimal pixel indices follow directly from the other fields of a block, calculate
+	// them instead of letting the genetic algorithm search for them.
+	context->calculate_pixel_indices = 0;
+	if (!images[0].is_half_float && !context->options.evolve_pixel_indices)
+		switch (texture_type) {
+		case TEXTURE_TYPE_DXT1 :
+		case TEXTURE_TYPE_DXT1A :
+		case TEXTURE_TYPE_DXT3 :
+		case TEXTURE_TYPE_DXT5 :
+		case TEXTURE_TYPE_ETC1 :
+		case TEXTURE_TYPE_ETC2_RGB8 :
+		case TEXTURE_TYPE_ETC2_EAC :
+			context->calculate_pixel_indices = 1;
+			break;
+		}
+
+	if (context->options.verbose) {
+		memset(context->mode_statistics, 0, sizeof(int) * 16);
+	}
+	if (context->options.genetic_parameters) {
+		context->mutation_probability = context->options.mutation_probability;
+		context->crossover_probability = context->options.crossover_probability;
 	}
 	else {
 		// Emperically determined mutation probability.
@@ -118,257 +340,483 @@ int genetic_parameters, float mutation_prob, float crossover_prob) {
 			if (texture_type == TEXTURE_TYPE_BPTC_FLOAT)
 				// bptc_float format needs higher mutation probability.
 				if (option_speed == SPEED_ULTRA)
-					mutation_probability = 0.016;
+					context->mutation_probability = 0.016;
 				else
 				if (option_speed == SPEED_FAST)
-					mutation_probability = 0.014;
+					context->mutation_probability = 0.014;
 				else
 				if (option_speed == SPEED_MEDIUM)
-					mutation_probability = 0.018;
+					context->mutation_probability = 0.018;
 				else	// SPEED_SLOW
-					mutation_probability = 0.018;
+					context->mutation_probability = 0.018;
 			else
 			if (texture_type == TEXTURE_TYPE_BPTC)
 				// bptc
 				if (option_speed == SPEED_ULTRA)
-					mutation_probability = 0.010;
+					context->mutation_probability = 0.010;
 				else
 				if (option_speed == SPEED_FAST)
-					mutation_probability = 0.011;
+					context->mutation_probability = 0.011;
 				else
 				if (option_speed == SPEED_MEDIUM)
-					mutation_probability = 0.012;
+					context->mutation_probability = 0.012;
 				else	// SPEED_SLOW
-					mutation_probability = 0.012;
+					context->mutation_probability = 0.012;
 			else
 			if (texture_type == TEXTURE_TYPE_DXT5)
 				// dxt5
 				if (option_speed == SPEED_ULTRA)
-					mutation_probability = 0.020;
+					context->mutation_probability = 0.020;
 				else
 				if (option_speed == SPEED_FAST)
-					mutation_probability = 0.017;
+					context->mutation_probability = 0.017;
 				else
 				if (option_speed == SPEED_MEDIUM)
-					mutation_probability = 0.018;
+					context->mutation_probability = 0.018;
 				else	// SPEED_SLOW
-					mutation_probability = 0.018;
+					context->mutation_probability = 0.018;
 			else
 				// Other 128-bit block texture types.
 				if (option_speed == SPEED_ULTRA)
-					mutation_probability = 0.015;
+					context->mutation_probability = 0.015;
 				else
 				if (option_speed == SPEED_FAST)
-					mutation_probability = 0.013;
+					context->mutation_probability = 0.013;
 				else
 				if (option_speed == SPEED_MEDIUM)
-					mutation_probability = 0.015;
+					context->mutation_probability = 0.015;
 				else	// SPEED_SLOW
-					mutation_probability = 0.015;
+					context->mutation_probability = 0.015;
 		else	// 64-bit texture formats.
 			if (texture_type == TEXTURE_TYPE_ETC1)
 				if (option_speed == SPEED_ULTRA)
-					mutation_probability = 0.027;
+					context->mutation_probability = 0.027;
 				else
 				if (option_speed == SPEED_FAST)
-					mutation_probability = 0.023;
+					context->mutation_probability = 0.023;
 				else
 				if (option_speed == SPEED_MEDIUM)
-					mutation_probability = 0.024;
+					context->mutation_probability = 0.024;
 				else	// SPEED_SLOW
-					mutation_probability = 0.025;
+					context->mutation_probability = 0.025;
 			else
 			if (texture_type == TEXTURE_TYPE_ETC2_RGB8)
 				if (option_speed == SPEED_ULTRA)
-					mutation_probability = 0.023;
+					context->mutation_probability = 0.023;
 				else
 				if (option_speed == SPEED_FAST)
-					mutation_probability = 0.022;
+					context->mutation_probability = 0.022;
 				else
 				if (option_speed == SPEED_MEDIUM)
-					mutation_probability = 0.024;
+					context->mutation_probability = 0.024;
 				else	// SPEED_SLOW
-					mutation_probability = 0.025;
+					context->mutation_probability = 0.025;
 			else
 			if (texture_type == TEXTURE_TYPE_DXT1)
 				if (option_speed == SPEED_ULTRA)
-					mutation_probability = 0.028;
+					context->mutation_probability = 0.028;
 				else
 				if (option_speed == SPEED_FAST)
-					mutation_probability = 0.025;
+					context->mutation_probability = 0.025;
 				else
 				if (option_speed == SPEED_MEDIUM)
-					mutation_probability = 0.026;
+					context->mutation_probability = 0.026;
 				else	// SPEED_SLOW
-					mutation_probability = 0.026;
+					context->mutation_probability = 0.026;
 			else
 			if (texture_type == TEXTURE_TYPE_R11_EAC)
 				if (option_speed == SPEED_ULTRA)
-					mutation_probability = 0.029;
+					context->mutation_probability = 0.029;
 				else
 				if (option_speed == SPEED_FAST)
-					mutation_probability = 0.028;
+					context->mutation_probability = 0.028;
 				else
 				if (option_speed == SPEED_MEDIUM)
-					mutation_probability = 0.026;
+					context->mutation_probability = 0.026;
 				else
-					mutation_probability = 0.027;
+					context->mutation_probability = 0.027;
 			else	// Other 64-bit texture formats.
 				if (option_speed == SPEED_ULTRA)
-					mutation_probability = 0.025;
+					context->mutation_probability = 0.025;
 				else
 				if (option_speed == SPEED_FAST)
-					mutation_probability = 0.024;
+					context->mutation_probability = 0.024;
 				else
 				if (option_speed == SPEED_MEDIUM)
-					mutation_probability = 0.025;
+					context->mutation_probability = 0.025;
 				else
-					mutation_probability = 0.026;
+					context->mutation_probability = 0.026;
 #else
 		if (texture_type & TEXTURE_TYPE_128BIT_BIT)
 			if (texture_type == TEXTURE_TYPE_BPTC_FLOAT)
 				// bptc_float format needs higher mutation probability.
-				mutation_probability = 0.014;
+				context->mutation_probability = 0.014;
 			else if (texture_type == TEXTURE_TYPE_BPTC)
 				// bptc
-				mutation_probability = 0.012;
+				context->mutation_probability = 0.012;
 			else if (texture_type == TEXTURE_TYPE_DXT5)
-				mutation_probability = 0.017;
+				context->mutation_probability = 0.017;
 			else
-				mutation_probability = 0.013;
+				context->mutation_probability = 0.013;
 		else	// 64-bit texture formats.
 			if (texture_type == TEXTURE_TYPE_ETC1)
-				mutation_probability = 0.023;
+				context->mutation_probability = 0.023;
 			else if (texture_type == TEXTURE_TYPE_ETC2_RGB8)
-				mutation_probability = 0.022;
+				context->mutation_probability = 0.022;
 			else if (texture_type == TEXTURE_TYPE_DXT1)
-				mutation_probability = 0.025;
+				context->mutation_probability = 0.025;
 			else if (texture_type == TEXTURE_TYPE_R11_EAC)
-				mutation_probability = 0.028;
+				context->mutation_probability = 0.028;
 			else	// Other 64-bit texture formats.
-				mutation_probability = 0.024;
+				context->mutation_probability = 0.024;
 #endif
-		crossover_probability = 0.7;
-	}
-	mutation_probability_second_pass = mutation_probability * 0.66667f;
-	if (option_compression_level < COMPRESSION_LEVEL_CLASS_1) {
-		// Compression level class 0.
-		population_size = 256;
-		nu_generations = 100 + option_compression_level * 25;
-		nu_islands = 8;
-		nu_generations_second_pass = 4000;
-		nu_islands_second_pass = 8;
-	}
-	else if (option_compression_level < COMPRESSION_LEVEL_CLASS_2 - 1) {
+		context->crossover_probability = 0.7;
+	}
+	context->mutation_probability_second_pass = context->mutation_probability * 0.66667f;
+	if (context->options.compression_level < COMPRESSION_LEVEL_CLASS_1) {
+		// Compression level class 0. Different blocks are compressed concurrently, use at least one
+		// thread for every processor.
+		context->population_size = 256;
+		context->nu_generations = 100 + context->options.compression_level * 25;
+		context->nu_islands = 8;
+		if (get_number_of_processors() > context->nu_islands)
+			context->nu_islands = get_number_of_processors();
+		context->nu_generations_second_pass = 4000;
+		context->nu_islands_second_pass = context->nu_islands;
+	}
+	else if (context->options.compression_level < COMPRESSION_LEVEL_CLASS_2 - 1) {
 		// Compression level class 1.
-		population_size = 128;
-		nu_generations = 50;
-		nu_islands = option_compression_level;		
-		nu_generations_second_pass = 4000;
-		nu_islands_second_pass = 4;
+		context->population_size = 128;
+		context->nu_generations = 50;
+		context->nu_islands = context->options.compression_level;		
+		context->nu_generations_second_pass = 4000;
+		context->nu_islands_second_pass = 4;
 	}
 	else {
 		// Compression level class 2.
-		population_size = 128;
-		nu_generations = 50 + (option_compression_level - 32) * 10;
-		nu_islands = 32;
-		nu_generations_second_pass = 8000;
-		nu_islands_second_pass = 4;
-	}
-
-	if (option_generations != - 1)
-		nu_generations = option_generations;
-	if (option_islands != - 1)
-		nu_islands = option_islands;
-	if (option_generations_second_pass != - 1)
-		nu_generations_second_pass = option_generations_second_pass;
-	if (option_islands_second_pass != - 1)
-		nu_islands = option_islands_second_pass;
+		context->population_size = 128;
+		context->nu_generations = 50 + (context->options.compression_level - 32) * 10;
+		context->nu_islands = 32;
+		context->nu_generations_second_pass = 8000;
+		context->nu_islands_second_pass = 4;
+	}
+
+	if (context->options.generations != - 1)
+		context->nu_generations = context->options.generations;
+	if (context->options.islands != - 1)
+		context->nu_islands = context->options.islands;
+	if (context->options.generations_second_pass != - 1)
+		context->nu_generations_second_pass = context->options.generations_second_pass;
+	if (context->options.islands_second_pass != - 1)
+		context->nu_islands = context->options.islands_second_pass;
 #if 0
-	if (option_max_threads != -1) {
-		if (option_compression_level >= COMPRESSION_LEVEL_CLASS_1) {
+	if (context->options.max_threads != -1) {
+		if (context->options.compression_level >= COMPRESSION_LEVEL_CLASS_1) {
 			// When the maximum number of threads is constrained, modify the GA parameters
 			// for roughly similar quality by doubling the number of generations.
-			while (nu_islands > option_max_threads) {
-				nu_islands /= 2;
-				nu_generations *= 2;
+			while (context->nu_islands > context->options.max_threads) {
+				context->nu_islands /= 2;
+				context->nu_generations *= 2;
 			}
-			while (nu_islands_second_pass > option_max_threads) {
-				nu_islands_second_pass /= 2;
-				nu_generations_second_pass *= 2;
+			while (context->nu_islands_second_pass > context->options.max_threads) {
+				context->nu_islands_second_pass /= 2;
+				context->nu_generations_second_pass *= 2;
 			}
 		}
 	}
 #endif
 
-	if (option_perceptive && option_compression_level >= COMPRESSION_LEVEL_CLASS_1
-	&& texture->perceptive_comparison_function == NULL && !option_quiet)
+	if (context->options.perceptive && context->options.compression_level >= COMPRESSION_LEVEL_CLASS_1
+	&& textures[0].perceptive_comparison_function == NULL && !context->options.quiet)
 		printf("Warning: Perceptive quality strategy not available for texture format.\n");
-	if (option_compression_level < COMPRESSION_LEVEL_CLASS_1)
-		compress_multiple_blocks_concurrently(image, texture);
+	context->levels = (MipmapLevel *)malloc(sizeof(MipmapLevel) * nu_images);
+	context->nu_levels = nu_images;
+	context->nu_blocks_total = 0;
+	for (int i = 0; i < nu_images; i++) {
+		MipmapLevel *level = &context->levels[i];
+		Texture *texture = &textures[i];
+		level->image = &images[i];
+		level->texture = texture;
+		level->first_block = context->nu_blocks_total;
+		level->blocks_per_row = texture->extended_width / texture->block_width;
+		level->nu_blocks = (texture->extended_height / texture->block_height) * level->blocks_per_row;
+		level->block_done = (unsigned char *)calloc(level->nu_blocks, 1);
+		level->texture_pixels = NULL;
+		if (context->options.perceptive && context->options.compression_level >= COMPRESSION_LEVEL_CLASS_1)
+			level->texture_pixels = allocate_texture_pixels(texture);
+		context->nu_blocks_total += level->nu_blocks;
+	}
+	find_duplicate_blocks(context);
+	if (!context->options.quiet && context->nu_unique_blocks < context->nu_blocks_total)
+		printf("%d of %d blocks are duplicates of another block and are not compressed separately.\n",
+			context->nu_blocks_total - context->nu_unique_blocks, context->nu_blocks_total);
+	context->known_fitness = (double *)calloc(context->nu_blocks_total, sizeof(double));
+	encode_trivial_blocks(context);
+	encode_planar_blocks(context);
+	encode_single_subset_bptc_blocks(context);
+	keep_unchanged_blocks(context);
+	look_up_cached_blocks(context);
+	encode_optimal_components(context);
+	preselect_bptc_partitions(context);
+	// The thread pool is shared by all compression passes. It is only created once and persists
+	// afterwards.
+	thread_pool_initialize(context->options.max_threads);
+	context->nu_blocks_reported = 0;
+	if (context->options.compression_level < COMPRESSION_LEVEL_CLASS_1)
+		compress_multiple_blocks_concurrently(context);
 	else
-		compress_with_archipelago(image, texture);
+		compress_with_archipelago(context);
 
 	// Perform second pass (non-perceptive quality mode, compression level class 0 (ultra)).
-	if (option_compression_level < COMPRESSION_LEVEL_CLASS_1) {
-		if (option_verbose) {
-			// Decompress the compressed texture and calculate the difference with the original
-			// and report it.
-			Image compressed_image;
-			convert_texture_to_image(texture, &compressed_image);
-			compare_images(image, &compressed_image);
-			destroy_image(&compressed_image);
-		}
-		compress_multiple_blocks_concurrently_second_pass(image, texture);
+	if (context->options.compression_level < COMPRESSION_LEVEL_CLASS_1) {
+		if (context->options.verbose)
+			for (int i = 0; i < context->nu_levels; i++) {
+				// Decompress the compressed texture and calculate the difference with the original
+				// and report it.
+				Image compressed_image;
+				convert_texture_to_image(context->levels[i].texture, &compressed_image);
+				compare_images(context->levels[i].image, &compressed_image);
+				destroy_image(&compressed_image);
+			}
+		context->nu_blocks_reported = 0;
+		compress_multiple_blocks_concurrently_second_pass(context);
 	}
 
 	// Optionally post-process the texture to optimize the alpha values.
 //	optimize_alpha(image, texture);
 
-	if (option_verbose) {
+	for (int i = 0; i < context->nu_levels; i++) {
+		free(context->levels[i].block_done);
+		if (context->levels[i].texture_pixels != NULL)
+			free(context->levels[i].texture_pixels);
+	}
+	free(context->levels);
+	context->levels = NULL;
+	free(context->duplicate_of);
+	free(context->next_duplicate);
+	free(context->known_fitness);
+	free(context->optimal_alpha_blocks);
+	free(context->bptc_partitions);
+	context->duplicate_of = NULL;
+	context->next_duplicate = NULL;
+	context->known_fitness = NULL;
+	context->optimal_alpha_blocks = NULL;
+	context->bptc_partitions = NULL;
+
+	if (context->options.verbose) {
 		int nu_modes = 0;
-		if (texture->type == TEXTURE_TYPE_ETC1)
+		if (texture_type == TEXTURE_TYPE_ETC1)
 			nu_modes = 2;
-		else if (texture->type == TEXTURE_TYPE_ETC2_RGB8 || texture->type == TEXTURE_TYPE_ETC2_EAC ||
-		texture->type == TEXTURE_TYPE_ETC2_PUNCHTHROUGH)
+		else if (texture_type == TEXTURE_TYPE_ETC2_RGB8 || texture_type == TEXTURE_TYPE_ETC2_EAC ||
+		texture_type == TEXTURE_TYPE_ETC2_PUNCHTHROUGH)
 			nu_modes = 5;
-		else if (texture->type == TEXTURE_TYPE_BPTC)
+		else if (texture_type == TEXTURE_TYPE_BPTC)
 			nu_modes = 8;
-		else if (texture->type == TEXTURE_TYPE_BPTC_FLOAT || texture->type == TEXTURE_TYPE_BPTC_SIGNED_FLOAT)
+		else if (texture_type == TEXTURE_TYPE_BPTC_FLOAT || texture_type == TEXTURE_TYPE_BPTC_SIGNED_FLOAT)
 			nu_modes = 14;
 		if (nu_modes > 0) {
 			printf("Mode statistics:\n");
 			for (int i = 0; i < nu_modes; i++)
-				printf("Mode %d: %d blocks\n", i, mode_statistics[i]);
+				printf("Mode %d: %d blocks\n", i, context->mode_statistics[i]);
 		}
 	}
 }
 
 
-// The fitness function of the genetic algorithm.
+// Calculate the fitness of a compressed block for the block described by the auxilliary data.
 
-static double calculate_fitness(const FgenPopulation *pop, const unsigned char *bitstring) {
+static double calculate_block_fitness(BlockUserData *user_data, const unsigned char *bitstring) {
 	unsigned int image_buffer[32];	// 16 required for regular pixels, 32 for 64-bit pixel formats like half floats.
-	BlockUserData *user_data = (BlockUserData *)pop->user_data;
+	CompressionContext *context = user_data->context;
 	int flags = user_data->flags;
 	int r = user_data->texture->decoding_function(bitstring, image_buffer, flags);
 	if (r == 0) {
 //		printf("Invalid block.\n");
 		return 0;	// Fitness is zero for invalid blocks.
 	}
-	if (option_perceptive && option_compression_level >= COMPRESSION_LEVEL_CLASS_1 &&
+	if (context->options.perceptive && context->options.compression_level >= COMPRESSION_LEVEL_CLASS_1 &&
 	user_data->texture->perceptive_comparison_function != NULL)
 		return user_data->texture->perceptive_comparison_function(image_buffer, user_data);
 	else
 		return user_data->texture->comparison_function(image_buffer, user_data);
 }
 
+// Get the 16 pixels in row-major order of the 4x4 block described by the auxilliary data, and the width and height
+// of the part of the block that lies inside the image. The pixels of a block on the border that lie outside the
+// image are replaced by the first pixel.
+
+static void get_user_data_block_pixels(BlockUserData *user_data, unsigned int *pixels, int *w, int *h) {
+	Texture *texture = user_data->texture;
+	unsigned int *source_pixels = user_data->image_pixels + user_data->y_offset * (user_data->image_rowstride / 4) +
+		user_data->x_offset;
+	*w = texture->width - user_data->x_offset;
+	if (*w > 4)
+		*w = 4;
+	*h = texture->height - user_data->y_offset;
+	if (*h > 4)
+		*h = 4;
+	for (int y = 0; y < 4; y++)
+		for (int x = 0; x < 4; x++)
+			if (y < *h && x < *w)
+				pixels[y * 4 + x] = source_pixels[y * (user_data->image_rowstride / 4) + x];
+			else
+				pixels[y * 4 + x] = source_pixels[0];
+}
+
+// Get the 16 64-bit half float pixels of the block described by the auxilliary data for a half float source
+// image, in the same way as get_user_data_block_pixels().
+
+static void get_user_data_block_half_float_pixels(BlockUserData *user_data, uint64_t *pixels, int *w, int *h) {
+	Texture *texture = user_data->texture;
+	uint64_t *source_pixels = (uint64_t *)user_data->image_pixels + user_data->y_offset *
+		(user_data->image_rowstride / 8) + user_data->x_offset;
+	*w = texture->width - user_data->x_offset;
+	if (*w > 4)
+		*w = 4;
+	*h = texture->height - user_data->y_offset;
+	if (*h > 4)
+		*h = 4;
+	for (int y = 0; y < 4; y++)
+		for (int x = 0; x < 4; x++)
+			if (y < *h && x < *w)
+				pixels[y * 4 + x] = source_pixels[y * (user_data->image_rowstride / 8) + x];
+			else
+				pixels[y * 4 + x] = source_pixels[0];
+}
+
+// Replace the pixel indices of a compressed block by the optimal ones for the other fields of the block and the
+// source pixels of the block described by the auxilliary data.
+
+static void set_optimal_pixel_indices(BlockUserData *user_data, unsigned char *bitstring) {
+	Texture *texture = user_data->texture;
+	unsigned int pixels[16];
+	int w, h;
+	get_user_data_block_pixels(user_data, pixels, &w, &h);
+	switch (texture->type) {
+	case TEXTURE_TYPE_DXT1 :
+	case TEXTURE_TYPE_DXT1A :
+	case TEXTURE_TYPE_DXT3 :
+	case TEXTURE_TYPE_DXT5 :
+		optimize_block_indices_dxtc(bitstring, pixels, texture->type);
+		break;
+	case TEXTURE_TYPE_ETC1 :
+	case TEXTURE_TYPE_ETC2_RGB8 :
+	case TEXTURE_TYPE_ETC2_EAC :
+		optimize_block_indices_etc(bitstring, pixels, texture->type);
+		break;
+	}
+}
+
+// Return the index in the context of the block described by the auxilliary data.
+
+static int get_user_data_block_index(BlockUserData *user_data) {
+	Texture *texture = user_data->texture;
+	MipmapLevel *level = get_texture_level(user_data->context, texture);
+	return level->first_block + (user_data->y_offset / texture->block_height) * level->blocks_per_row +
+		user_data->x_offset / texture->block_width;
+}
+
+// Replace the alpha part of a compressed block by the one with the smallest possible error that was calculated
+// for the block described by the auxilliary data before compression started.
+
+static void set_optimal_alpha(BlockUserData *user_data, unsigned char *bitstring) {
+	CompressionContext *context = user_data->context;
+	int block_index = get_user_data_block_index(user_data);
+	memcpy(bitstring, &context->optimal_alpha_blocks[block_index * 8], 8);
+}
+
+// Constrain the partition of a compressed BPTC block to the partitions that were preselected for the block
+// described by the auxilliary data before compression started.
+
+static void set_preselected_partition(BlockUserData *user_data, unsigned char *bitstring) {
+	CompressionContext *context = user_data->context;
+	int block_index = get_user_data_block_index(user_data);
+	block4x4_bptc_set_preselected_partition(bitstring,
+		&context->bptc_partitions[block_index * BPTC_NU_PRESELECTED_PARTITIONS * 3]);
+}
+
+// The fitness function of the genetic algorithm. When the pixel indices are calculated instead of evolved, they
+// are set in the individual itself before its fitness is calculated, so that the individual always holds the
+// block that its fitness belongs to. The pixel indices then have no influence on the fitness, so that the
+// genetic algorithm effectively only optimizes the other fields of the block. The same applies to an alpha part
+// that was calculated before compression started. The partition of a BPTC block is likewise replaced by one of
+// the partitions preselected for the block when it isn't one of them.
+
+static void calculate_fitness_batch(const FgenPopulation *pop, int n, unsigned char *bitstrings, double *fitness);
+static bool batch_fitness_function_available(BlockUserData *user_data);
+
+static double calculate_fitness(const FgenPopulation *pop, const unsigned char *bitstring) {
+	BlockUserData *user_data = (BlockUserData *)pop->user_data;
+	if (batch_fitness_function_available(user_data)) {
+		double fitness;
+		calculate_fitness_batch(pop, 1, (unsigned char *)bitstring, &fitness);
+		return fitness;
+	}
+	if (user_data->context->optimal_alpha_blocks != NULL)
+		set_optimal_alpha(user_data, (unsigned char *)bitstring);
+	if (user_data->context->bptc_partitions != NULL)
+		set_preselected_partition(user_data, (unsigned char *)bitstring);
+	if (user_data->context->calculate_pixel_indices)
+		set_optimal_pixel_indices(user_data, (unsigned char *)bitstring);
+	return calculate_block_fitness(user_data, bitstring);
+}
+
+// Return whether the fitness of the individuals for the block described by the auxilliary data is calculated by a
+// format-specific batched function, which sets the optimal pixel indices of several blocks and calculates their
+// errors at the same time without decoding them. This is the case for DXT1 and ETC1 when the pixel indices are
+// calculated and the regular comparison function is used.
+
+static bool batch_fitness_function_available(BlockUserData *user_data) {
+	Texture *texture = user_data->texture;
+	CompressionContext *context = user_data->context;
+	if (!context->calculate_pixel_indices || texture->comparison_function != compare_block_4x4_rgb ||
+	(context->options.perceptive && context->options.compression_level >= COMPRESSION_LEVEL_CLASS_1 &&
+	texture->perceptive_comparison_function != NULL))
+		return false;
+	return texture->type == TEXTURE_TYPE_DXT1 || texture->type == TEXTURE_TYPE_ETC1;
+}
+
+// Calculate the fitness of the n individuals stored consecutively in bitstrings, in the same way as
+// calculate_fitness() does for each of them. Formats with a batched fitness function evaluate the individuals
+// BATCH_LANES at a time.
+
+static void calculate_fitness_batch(const FgenPopulation *pop, int n, unsigned char *bitstrings, double *fitness) {
+	BlockUserData *user_data = (BlockUserData *)pop->user_data;
+	int block_size = user_data->texture->info->internal_bits_per_block / 8;
+	if (!batch_fitness_function_available(user_data)) {
+		for (int i = 0; i < n; i++)
+			fitness[i] = calculate_fitness(pop, &bitstrings[i * block_size]);
+		return;
+	}
+	unsigned int pixels[16];
+	int w, h;
+	get_user_data_block_pixels(user_data, pixels, &w, &h);
+	for (int first = 0; first < n; first += BATCH_LANES) {
+		int nu_blocks = n - first;
+		if (nu_blocks > BATCH_LANES)
+			nu_blocks = BATCH_LANES;
+		int errors[BATCH_LANES];
+		if (user_data->texture->type == TEXTURE_TYPE_DXT1)
+			optimize_block_indices_dxt1_batch(nu_blocks, &bitstrings[first * block_size], pixels, w, h,
+				errors);
+		else
+			optimize_block_indices_etc1_batch(nu_blocks, &bitstrings[first * block_size], pixels, w, h,
+				user_data->flags, errors);
+		for (int i = 0; i < nu_blocks; i++)
+			if (errors[i] < 0)
+				fitness[first + i] = 0;	// Fitness is zero for invalid blocks.
+			else
+				fitness[first + i] = (double)1 / errors[i];
+	}
+}
+
 // The generation callback function of the genetic algorithm.
 
 static void generation_callback(FgenPopulation *pop, int generation) {
+	CompressionContext *context = ((BlockUserData *)pop->user_data)->context;
 	if (generation == 0)
 		return;
-	if (generation >= nu_generations * 2) {
+	if (generation >= context->nu_generations * 2) {
 		fgen_signal_stop(pop);
 		return;
 	}
@@ -376,23 +824,25 @@ static void generation_callback(FgenPopulation *pop, int generation) {
 	// generations.
 	FgenIndividual *best = fgen_best_individual_of_population(pop);
 	double rmse = sqrt((1.0 / best->fitness) / 16);
-	if (generation <= nu_generations && rmse < rmse_threshold)
+	if (generation <= context->nu_generations && rmse < context->rmse_threshold)
 		fgen_signal_stop(pop);
 }
 
 static void generation_callback_non_adaptive(FgenPopulation *pop, int generation) {
+	CompressionContext *context = ((BlockUserData *)pop->user_data)->context;
 	if (generation == 0)
 		return;
-	if (generation >= nu_generations) {
+	if (generation >= context->nu_generations) {
 		fgen_signal_stop(pop);
 		return;
 	}
 }
 
 static void generation_callback_archipelago(FgenPopulation *pop, int generation) {
+	CompressionContext *context = ((BlockUserData *)pop->user_data)->context;
 	if (generation == 0)
 		return;
-	if (generation >= nu_generations * 3) {
+	if (generation >= context->nu_generations * 3) {
 		fgen_signal_stop(pop);
 		return;
 	}
@@ -400,12 +850,12 @@ static void generation_callback_archipelago(FgenPopulation *pop, int generation)
 	// generations.
 	FgenIndividual *best = fgen_best_individual_of_population(pop);
 	double rmse = sqrt((1.0 / best->fitness) / 16);
-	if (generation <= nu_generations) {
-		if (rmse < rmse_threshold)
+	if (generation <= context->nu_generations) {
+		if (rmse < context->rmse_threshold)
 			fgen_signal_stop(pop);
 	}
-	else if (generation <= nu_generations * 2) {
-		if (rmse < rmse_threshold * 1.5)
+	else if (generation <= context->nu_generations * 2) {
+		if (rmse < context->rmse_threshold * 1.5)
 			fgen_signal_stop(pop);
 	}
 }
@@ -413,14 +863,170 @@ static void generation_callback_archipelago(FgenPopulation *pop, int generation)
 // Generation call-back for second-pass.
 
 static void generation_callback_second_pass(FgenPopulation *pop, int generation) {
+	CompressionContext *context = ((BlockUserData *)pop->user_data)->context;
 	if (generation == 0)
 		return;
-	if (generation >= nu_generations_second_pass) {
+	if (generation >= context->nu_generations_second_pass) {
 		fgen_signal_stop(pop);
 		return;
 	}
 }
 
+// Return the mipmap level of the block with the given index in the numbering of all blocks.
+
+static MipmapLevel *get_block_level(CompressionContext *context, int block_index) {
+	int i = 0;
+	while (block_index >= context->levels[i].first_block + context->levels[i].nu_blocks)
+		i++;
+	return &context->levels[i];
+}
+
+// Return the mipmap level that is compressed into the given texture.
+
+static MipmapLevel *get_texture_level(CompressionContext *context, Texture *texture) {
+	for (int i = 0; i < context->nu_levels; i++)
+		if (context->levels[i].texture == texture)
+			return &context->levels[i];
+	return NULL;
+}
+
+// Copy the compressed block with the given index from the texture of the block that is being compressed
+// into bitstring. Returns false when the block is not available yet because it is still being compressed.
+
+static bool get_compressed_block(BlockUserData *user_data, int compressed_block_index, unsigned char *bitstring) {
+	Texture *texture = user_data->texture;
+	MipmapLevel *level = get_texture_level(user_data->context, texture);
+	if (!__atomic_load_n(&level->block_done[compressed_block_index], __ATOMIC_ACQUIRE))
+		return false;
+	memcpy(bitstring, &texture->pixels[compressed_block_index * (texture->bits_per_block / 32)],
+		texture->bits_per_block / 8);
+	return true;
+}
+
+// Seed with the least-squares planar mode encoding of the block, for ETC2 RGB8 and ETC2 EAC populations that
+// allow planar mode, with chance 1/32th for islands that only use planar mode and 1/128th otherwise. The alpha
+// part of an ETC2 EAC block is optimized as in seed_128bit(). Returns whether the individual was seeded.
+
+static bool seed_planar(FgenPopulation *pop, unsigned char *bitstring) {
+	BlockUserData *user_data = (BlockUserData *)pop->user_data;
+	if ((user_data->texture->type != TEXTURE_TYPE_ETC2_RGB8 && user_data->texture->type != TEXTURE_TYPE_ETC2_EAC)
+	|| !(user_data->flags & ETC2_MODE_ALLOWED_PLANAR))
+		return false;
+	int r = fgen_random_8(fgen_get_rng(pop));
+	if ((user_data->flags & ETC2_MODE_ALLOWED_ALL) == ETC2_MODE_ALLOWED_PLANAR) {
+		if (r >= 8)
+			return false;
+	}
+	else if (r >= 2)
+		return false;
+	fgen_seed_random(pop, bitstring);
+	unsigned int pixels[16];
+	int w, h;
+	get_user_data_block_pixels(user_data, pixels, &w, &h);
+	encode_planar_block4x4_etc2(pixels, w, h, user_data->texture->type, bitstring);
+	if (user_data->texture->type == TEXTURE_TYPE_ETC2_EAC)
+		optimize_block_alpha_etc2_eac(bitstring, user_data->alpha_pixels, user_data->flags);
+	return true;
+}
+
+// Seed with an encoding of the block in T or H mode derived from two clusters of its pixels, for ETC2 RGB8 and
+// ETC2 EAC populations that allow T or H mode, with chance 1/32th for islands that only use T or H mode and
+// 1/128th otherwise. The alpha part of an ETC2 EAC block is optimized as in seed_128bit(). Returns whether the
+// individual was seeded.
+
+static bool seed_T_or_H_mode(FgenPopulation *pop, unsigned char *bitstring) {
+	BlockUserData *user_data = (BlockUserData *)pop->user_data;
+	if ((user_data->texture->type != TEXTURE_TYPE_ETC2_RGB8 && user_data->texture->type != TEXTURE_TYPE_ETC2_EAC)
+	|| !(user_data->flags & (ETC2_MODE_ALLOWED_T | ETC2_MODE_ALLOWED_H)))
+		return false;
+	int r = fgen_random_8(fgen_get_rng(pop));
+	int mode;
+	if ((user_data->flags & ETC2_MODE_ALLOWED_ALL) == ETC2_MODE_ALLOWED_T ||
+	(user_data->flags & ETC2_MODE_ALLOWED_ALL) == ETC2_MODE_ALLOWED_H) {
+		if (r >= 8)
+			return false;
+		mode = (user_data->flags & ETC2_MODE_ALLOWED_T) ? 2 : 3;
+	}
+	else {
+		if (r >= 2)
+			return false;
+		if ((user_data->flags & ETC2_MODE_ALLOWED_T) && (user_data->flags & ETC2_MODE_ALLOWED_H))
+			mode = 2 + r;
+		else
+			mode = (user_data->flags & ETC2_MODE_ALLOWED_T) ? 2 : 3;
+	}
+	fgen_seed_random(pop, bitstring);
+	unsigned int pixels[16];
+	int w, h;
+	get_user_data_block_pixels(user_data, pixels, &w, &h);
+	encode_T_or_H_block4x4_etc2(pixels, w, h, mode, user_data->texture->type, bitstring);
+	if (user_data->texture->type == TEXTURE_TYPE_ETC2_EAC)
+		optimize_block_alpha_etc2_eac(bitstring, user_data->alpha_pixels, user_data->flags);
+	return true;
+}
+
+// Seed with the direct encoding of the block in mode 4, 5 or 6, for BPTC populations of blocks that are not
+// opaque that allow those modes, with chance 1/32th for islands that only use one of them and 3/256th otherwise.
+// Returns whether the individual was seeded.
+
+static bool seed_single_subset_bptc(FgenPopulation *pop, unsigned char *bitstring) {
+	BlockUserData *user_data = (BlockUserData *)pop->user_data;
+	if (user_data->texture->type != TEXTURE_TYPE_BPTC || (user_data->flags & MODES_ALLOWED_OPAQUE_ONLY))
+		return false;
+	int modes = user_data->flags & BPTC_MODE_ALLOWED_ALL;
+	int r = fgen_random_8(fgen_get_rng(pop));
+	int mode;
+	if (modes == (1 << 4) || modes == (1 << 5) || modes == (1 << 6)) {
+		if (r >= 8)
+			return false;
+		mode = modes == (1 << 4) ? 4 : (modes == (1 << 5) ? 5 : 6);
+	}
+	else {
+		if (r >= 3 || !(modes & (1 << (4 + r))))
+			return false;
+		mode = 4 + r;
+	}
+	unsigned int pixels[16];
+	int w, h;
+	get_user_data_block_pixels(user_data, pixels, &w, &h);
+	encode_single_subset_block4x4_bptc(pixels, w, h, mode, bitstring);
+	return true;
+}
+
+// Seed with the direct encoding of the block in one of the modes allowed for the island, for BPTC_FLOAT and
+// BPTC_SIGNED_FLOAT populations, with chance 1/16th. For modes with two subsets, one of the four partitions that
+// fit the pixels best is used. Returns whether the individual was seeded.
+
+static bool seed_bptc_float(FgenPopulation *pop, unsigned char *bitstring) {
+	BlockUserData *user_data = (BlockUserData *)pop->user_data;
+	if (user_data->texture->type != TEXTURE_TYPE_BPTC_FLOAT &&
+	user_data->texture->type != TEXTURE_TYPE_BPTC_SIGNED_FLOAT)
+		return false;
+	FgenRNG *rng = fgen_get_rng(pop);
+	int r = fgen_random_8(rng);
+	if (r >= 16)
+		return false;
+	int modes = user_data->flags & BPTC_FLOAT_MODE_ALLOWED_ALL;
+	int nu_modes = 0;
+	for (int i = 0; i < 14; i++)
+		if (modes & (1 << i))
+			nu_modes++;
+	int j = fgen_random_n(rng, nu_modes);
+	int mode = 0;
+	for (;; mode++)
+		if (modes & (1 << mode)) {
+			if (j == 0)
+				break;
+			j--;
+		}
+	uint64_t pixels[16];
+	int w, h;
+	get_user_data_block_half_float_pixels(user_data, pixels, &w, &h);
+	encode_block4x4_bptc_float(pixels, w, h, mode, r & 3,
+		user_data->texture->type == TEXTURE_TYPE_BPTC_SIGNED_FLOAT, bitstring);
+	return true;
+}
+
 // Custom seeding function for 128-bit formats for archipelagos where each island is compressing the same block.
 
 static void seed_128bit(FgenPopulation *pop, unsigned char *bitstring) {
@@ -430,7 +1036,7 @@ static void seed_128bit(FgenPopulation *pop, unsigned char *bitstring) {
 	// The chance of seeding with an already calculated neighbour block should be chosen carefully.
 	// A too high probability results in less diversity in the archipelago.
 	int factor;
-	if (population_size == 128)
+	if (user_data->context->population_size == 128)
 		factor = 1;
 	else	// population_size == 64?
 		factor = 2;
@@ -439,11 +1045,8 @@ static void seed_128bit(FgenPopulation *pop, unsigned char *bitstring) {
 		int compressed_block_index = (user_data->y_offset / user_data->texture->block_height) *
 			(user_data->texture->extended_width / user_data->texture->block_width) +
 			(user_data->x_offset / user_data->texture->block_width) - 1;
-		*(unsigned int *)&bitstring[0] = user_data->texture->pixels[compressed_block_index * 4];
-		*(unsigned int *)&bitstring[4] = user_data->texture->pixels[compressed_block_index * 4 + 1];
-		*(unsigned int *)&bitstring[8] = user_data->texture->pixels[compressed_block_index * 4 + 2];
-		*(unsigned int *)&bitstring[12] = user_data->texture->pixels[compressed_block_index * 4 + 3];
-		goto end;
+		if (get_compressed_block(user_data, compressed_block_index, bitstring))
+			goto end;
 	}
 	if (r < 4 * factor && user_data->y_offset > 0) {
 		// Seed with solution above with chance 1/128th (1/64th for x == 0).
@@ -451,11 +1054,8 @@ static void seed_128bit(FgenPopulation *pop, unsigned char *bitstring) {
 		int compressed_block_index = (user_data->y_offset / user_data->texture->block_height - 1) *
 			(user_data->texture->extended_width / user_data->texture->block_width) +
 			user_data->x_offset / user_data->texture->block_width;
-		*(unsigned int *)&bitstring[0] = user_data->texture->pixels[compressed_block_index * 4];
-		*(unsigned int *)&bitstring[4] = user_data->texture->pixels[compressed_block_index * 4 + 1];
-		*(unsigned int *)&bitstring[8] = user_data->texture->pixels[compressed_block_index * 4 + 2];
-		*(unsigned int *)&bitstring[12] = user_data->texture->pixels[compressed_block_index * 4 + 3];
-		goto end;
+		if (get_compressed_block(user_data, compressed_block_index, bitstring))
+			goto end;
 	}
 	if (r < 6 * factor && (user_data->x_offset > 0 || user_data->y_offset > 0)) {
 		// Seed with a random already calculated solution with chance 1/128th.
@@ -473,11 +1073,8 @@ static void seed_128bit(FgenPopulation *pop, unsigned char *bitstring) {
 			y = i / (user_data->texture->extended_width / user_data->texture->block_width);
 		}
 		int compressed_block_index = y * (user_data->texture->extended_width / user_data->texture->block_width) + x;
-		*(unsigned int *)&bitstring[0] = user_data->texture->pixels[compressed_block_index * 4];
-		*(unsigned int *)&bitstring[4] = user_data->texture->pixels[compressed_block_index * 4 + 1];
-		*(unsigned int *)&bitstring[8] = user_data->texture->pixels[compressed_block_index * 4 + 2];
-		*(unsigned int *)&bitstring[12] = user_data->texture->pixels[compressed_block_index * 4 + 3];
-		goto end;
+		if (get_compressed_block(user_data, compressed_block_index, bitstring))
+			goto end;
 	}
 	int nu_tries = 0;
 again :
@@ -529,6 +1126,9 @@ end :
 
 static void seed(FgenPopulation *pop, unsigned char *bitstring) {
 	BlockUserData *user_data = (BlockUserData *)pop->user_data;
+	if (seed_planar(pop, bitstring) || seed_T_or_H_mode(pop, bitstring) ||
+	seed_single_subset_bptc(pop, bitstring) || seed_bptc_float(pop, bitstring))
+		return;
 	if (user_data->texture->bits_per_block == 128) {
 		seed_128bit(pop, bitstring);
 		return;
@@ -538,7 +1138,7 @@ static void seed(FgenPopulation *pop, unsigned char *bitstring) {
 	// The chance of seeding with an already calculated neighbour block should be chosen carefully.
 	// A too high probability results in less diversity in the archipelago.
 	int factor;
-	if (population_size == 128)
+	if (user_data->context->population_size == 128)
 		factor = 1;
 	else	// population_size == 64
 		factor = 2;
@@ -547,18 +1147,16 @@ static void seed(FgenPopulation *pop, unsigned char *bitstring) {
 		int compressed_block_index = (user_data->y_offset / user_data->texture->block_height) *
 			(user_data->texture->extended_width / user_data->texture->block_width) +
 			(user_data->x_offset / user_data->texture->block_width) - 1;
-		*(unsigned int *)&bitstring[0] = user_data->texture->pixels[compressed_block_index * 2];
-		*(unsigned int *)&bitstring[4] = user_data->texture->pixels[compressed_block_index * 2 + 1];
-		goto end;
+		if (get_compressed_block(user_data, compressed_block_index, bitstring))
+			goto end;
 	}
 	if (r < 4 * factor && user_data->y_offset > 0) {
 		// Seed with solution above with chance 1/128th (1/64th for x == 0).
 		int compressed_block_index = (user_data->y_offset / user_data->texture->block_height - 1) *
 			(user_data->texture->extended_width / user_data->texture->block_width) +
 			user_data->x_offset / user_data->texture->block_width;
-		*(unsigned int *)&bitstring[0] = user_data->texture->pixels[compressed_block_index * 2];
-		*(unsigned int *)&bitstring[4] = user_data->texture->pixels[compressed_block_index * 2 + 1];
-		goto end;
+		if (get_compressed_block(user_data, compressed_block_index, bitstring))
+			goto end;
 	}
 	if (r < 6 * factor && (user_data->x_offset > 0 || user_data->y_offset > 0)) {
 		// Seed with a random already calculated solution with chance 1/128th.
@@ -575,9 +1173,8 @@ static void seed(FgenPopulation *pop, unsigned char *bitstring) {
 			y = i / (user_data->texture->extended_width / user_data->texture->block_width);
 		}
 		int compressed_block_index = y * (user_data->texture->extended_width / user_data->texture->block_width) + x;
-		*(unsigned int *)&bitstring[0] = user_data->texture->pixels[compressed_block_index * 2];
-		*(unsigned int *)&bitstring[4] = user_data->texture->pixels[compressed_block_index * 2 + 1];
-		goto end;
+		if (get_compressed_block(user_data, compressed_block_index, bitstring))
+			goto end;
 	}
 	int nu_tries = 0;
 again :
@@ -613,11 +1210,8 @@ static void seed2_128bit(FgenPopulation *pop, unsigned char *bitstring) {
 		int compressed_block_index = (user_data->y_offset / user_data->texture->block_height - 1) *
 			(user_data->texture->extended_width / user_data->texture->block_width) +
 			user_data->x_offset / user_data->texture->block_width;
-		*(unsigned int *)&bitstring[0] = user_data->texture->pixels[compressed_block_index * 4];
-		*(unsigned int *)&bitstring[4] = user_data->texture->pixels[compressed_block_index * 4 + 1];
-		*(unsigned int *)&bitstring[8] = user_data->texture->pixels[compressed_block_index * 4 + 2];
-		*(unsigned int *)&bitstring[12] = user_data->texture->pixels[compressed_block_index * 4 + 3];
-		goto end;
+		if (get_compressed_block(user_data, compressed_block_index, bitstring))
+			goto end;
 	}
 	if (r < 6 && user_data->y_offset > 0) {
 		// Seed with a random already calculated solution from the area above with chance 3/256th
@@ -627,11 +1221,8 @@ static void seed2_128bit(FgenPopulation *pop, unsigned char *bitstring) {
 		x = i % (user_data->texture->extended_width / user_data->texture->block_width);
 		y = i / (user_data->texture->extended_width / user_data->texture->block_width);
 		int compressed_block_index = y * (user_data->texture->extended_width / user_data->texture->block_width) + x;
-		*(unsigned int *)&bitstring[0] = user_data->texture->pixels[compressed_block_index * 4];
-		*(unsigned int *)&bitstring[4] = user_data->texture->pixels[compressed_block_index * 4 + 1];
-		*(unsigned int *)&bitstring[8] = user_data->texture->pixels[compressed_block_index * 4 + 2];
-		*(unsigned int *)&bitstring[12] = user_data->texture->pixels[compressed_block_index * 4 + 3];
-		goto end;
+		if (get_compressed_block(user_data, compressed_block_index, bitstring))
+			goto end;
 	}
 	fgen_seed_random(pop, bitstring);
 end : ;
@@ -643,6 +1234,9 @@ end : ;
 
 static void seed2(FgenPopulation *pop, unsigned char *bitstring) {
 	BlockUserData *user_data = (BlockUserData *)pop->user_data;
+	if (seed_planar(pop, bitstring) || seed_T_or_H_mode(pop, bitstring) ||
+	seed_single_subset_bptc(pop, bitstring) || seed_bptc_float(pop, bitstring))
+		return;
 	if (user_data->texture->bits_per_block == 128) {
 		seed2_128bit(pop, bitstring);
 		return;
@@ -655,9 +1249,8 @@ static void seed2(FgenPopulation *pop, unsigned char *bitstring) {
 		// Seed with solution above with chance 3/256th
 		int compressed_block_index = (user_data->y_offset / 4 - 1) * (user_data->texture->extended_width /
 			user_data->texture->block_width) + user_data->x_offset / user_data->texture->block_width;
-		*(unsigned int *)&bitstring[0] = user_data->texture->pixels[compressed_block_index * 2];
-		*(unsigned int *)&bitstring[4] = user_data->texture->pixels[compressed_block_index * 2 + 1];
-		goto end;
+		if (get_compressed_block(user_data, compressed_block_index, bitstring))
+			goto end;
 	}
 	if (r < 6 && user_data->y_offset > 0) {
 		// Seed with a random already calculated solution from the area above with chance 3/256th
@@ -667,9 +1260,8 @@ static void seed2(FgenPopulation *pop, unsigned char *bitstring) {
 		x = i % (user_data->texture->extended_width / user_data->texture->block_width);
 		y = i / (user_data->texture->extended_width / user_data->texture->block_width);
 		int compressed_block_index = y * (user_data->texture->extended_width / user_data->texture->block_width) + x;
-		*(unsigned int *)&bitstring[0] = user_data->texture->pixels[compressed_block_index * 2];
-		*(unsigned int *)&bitstring[4] = user_data->texture->pixels[compressed_block_index * 2 + 1];
-		goto end;
+		if (get_compressed_block(user_data, compressed_block_index, bitstring))
+			goto end;
 	}
 	fgen_seed_random(pop, bitstring);
 end : ;
@@ -700,9 +1292,22 @@ static void seed_second_pass(FgenPopulation *pop, unsigned char *bitstring) {
 	}
 }
 
+// Set the fields of the auxilliary data that depend on the mipmap level of the block.
+
+static void set_user_data_level(BlockUserData *user_data, MipmapLevel *level) {
+	Image *image = level->image;
+	user_data->image_pixels = image->pixels;
+	if (image->is_half_float)
+		user_data->image_rowstride = image->extended_width * 8;
+	else
+		user_data->image_rowstride = image->extended_width * 4;
+	user_data->texture = level->texture;
+}
+
 // Set the auxilliary data field for the GA population.
 
-static void set_user_data(BlockUserData *user_data, Image *image, Texture *texture, int pass) {
+static void set_user_data(CompressionContext *context, BlockUserData *user_data, MipmapLevel *level, int pass) {
+	Texture *texture = level->texture;
 	user_data->flags = ENCODE_BIT;
 	if (texture->type == TEXTURE_TYPE_ETC1)
 		user_data->flags |= ETC_MODE_ALLOWED_ALL;
@@ -714,12 +1319,8 @@ static void set_user_data(BlockUserData *user_data, Image *image, Texture *textu
 		user_data->flags |= BPTC_MODE_ALLOWED_ALL;
 	else if (texture->type == TEXTURE_TYPE_BPTC_FLOAT || texture->type == TEXTURE_TYPE_BPTC_SIGNED_FLOAT)
 		user_data->flags |= BPTC_FLOAT_MODE_ALLOWED_ALL;
-	user_data->image_pixels = image->pixels;
-	if (image->is_half_float)
-		user_data->image_rowstride = image->extended_width * 8;
-	else
-		user_data->image_rowstride = image->extended_width * 4;
-	user_data->texture = texture;
+	set_user_data_level(user_data, level);
+	user_data->context = context;
 	user_data->stop_signalled = 0;
 	user_data->pass = pass;
 }
@@ -738,10 +1339,12 @@ static void set_user_data_block_flags(BlockUserData *user_data, Texture *texure,
 }
 
 static void set_user_data_mode_flags(int i, BlockUserData *user_data, int block_flags) {
-		if ((user_data->texture->type & TEXTURE_TYPE_ETC_BIT) && option_allowed_modes_etc2 !=  - 1)
-			user_data->flags = option_allowed_modes_etc2 |
+		CompressionContext *context = user_data->context;
+		if ((user_data->texture->type & TEXTURE_TYPE_ETC_BIT) && context->options.allowed_modes_etc2 !=  - 1)
+			user_data->flags = context->options.allowed_modes_etc2 |
 				ENCODE_BIT;
-		else if (user_data->texture->type == TEXTURE_TYPE_ETC1 && option_modal_etc2 && nu_islands >= 2) {
+		else if (user_data->texture->type == TEXTURE_TYPE_ETC1 && context->options.modal_etc2 &&
+		context->nu_islands >= 2) {
 			if ((i & 1) == 0)
 				user_data->flags =
 					ETC_MODE_ALLOWED_INDIVIDUAL | ENCODE_BIT;
@@ -751,7 +1354,7 @@ static void set_user_data_mode_flags(int i, BlockUserData *user_data, int block_
 		}
 		else if ((user_data->texture->type == TEXTURE_TYPE_ETC2_RGB8 ||
 		user_data->texture->type == TEXTURE_TYPE_ETC2_EAC)
-		&& option_modal_etc2 && nu_islands >= 8) {
+		&& context->options.modal_etc2 && context->nu_islands >= 8) {
 			switch (i & 7) {
 			case 0 :
 			case 1 :
@@ -779,8 +1382,8 @@ static void set_user_data_mode_flags(int i, BlockUserData *user_data, int block_
 			}
 			user_data->flags |= ENCODE_BIT;
 		}
-		else if (user_data->texture->type == TEXTURE_TYPE_ETC2_PUNCHTHROUGH && option_modal_etc2 &&
-		nu_islands >= 8) {
+		else if (user_data->texture->type == TEXTURE_TYPE_ETC2_PUNCHTHROUGH && context->options.modal_etc2 &&
+		context->nu_islands >= 8) {
 			switch (i & 7) {
 			case 0 :
 			case 1 :
@@ -811,7 +1414,7 @@ static void set_user_data_mode_flags(int i, BlockUserData *user_data, int block_
 			}
 		}
 		// For the BPTC texture format, distribute different modes over the available islands.
-		if (user_data->texture->type == TEXTURE_TYPE_BPTC && nu_islands >= 8) {
+		if (user_data->texture->type == TEXTURE_TYPE_BPTC && context->nu_islands >= 8) {
 			if (block_flags & BLOCK_FLAG_OPAQUE)
 				if (block_flags & BLOCK_FLAG_TWO_COLORS)
 					// Only use mode 3.
@@ -830,7 +1433,7 @@ static void set_user_data_mode_flags(int i, BlockUserData *user_data, int block_
 		// For the BPTC_FLOAT texture format, distribute different modes over the available islands.
 		if (user_data->texture->type == TEXTURE_TYPE_BPTC_FLOAT ||
 		user_data->texture->type == TEXTURE_TYPE_BPTC_SIGNED_FLOAT) {
-			if (nu_islands >= 8) {
+			if (context->nu_islands >= 8) {
 				switch (i & 7) {
 				case 0 :
 				case 1 :	// Mode 0 (very common).
@@ -858,7 +1461,7 @@ static void set_user_data_mode_flags(int i, BlockUserData *user_data, int block_
 				}
 			}
 			else
-			if (/* option_modal_etc2 && */ nu_islands >= 4) {
+			if (/* context->options.modal_etc2 && */ context->nu_islands >= 4) {
 				switch (i & 3) {
 				case 0 :	// Mode 0.
 					user_data->flags = 0x1 | ENCODE_BIT;
@@ -884,12 +1487,34 @@ static char *etc2_modestr = "IDTHP";
 // Report the given GA solution and store its bitstring in the texture, printing information if required.
 
 static void report_solution(FgenIndividual *best, BlockUserData *user_data, int nu_gens, bool compress_callback) {
+	CompressionContext *context = user_data->context;
 	Texture *texture = user_data->texture;
 	int x_offset = user_data->x_offset;
 	int y_offset = user_data->y_offset;
 	// Calculate the block index of the block.
 	int compressed_block_index = (y_offset / texture->block_height) * (texture->extended_width / texture->block_width)
 		+ x_offset / texture->block_width;
+	FgenIndividual cached;
+	unsigned char cached_bitstring[16];
+	if (compress_callback && block_cache_usable(context, texture)) {
+		// When the block cache holds a better solution for the block, for example one that was stored by
+		// another process, use it. Otherwise store the solution in the block cache.
+		uint64_t key[2];
+		double fitness;
+		get_block_cache_key(context, get_texture_level(context, texture)->first_block + compressed_block_index,
+			key);
+		if (block_cache_lookup(context->block_cache, key, cached_bitstring, &fitness) &&
+		fitness > best->fitness) {
+			cached.bitstring = cached_bitstring;
+			cached.fitness = fitness;
+			best = &cached;
+		}
+		else {
+			memset(cached_bitstring, 0, 16);
+			memcpy(cached_bitstring, best->bitstring, texture->bits_per_block / 8);
+			block_cache_store(context->block_cache, key, cached_bitstring, best->fitness);
+		}
+	}
 	if (texture->bits_per_block == 64) {
 		// Copy the 64-bit block.
 		texture->pixels[compressed_block_index * 2] = *(unsigned int *)best->bitstring;
@@ -903,33 +1528,34 @@ static void report_solution(FgenIndividual *best, BlockUserData *user_data, int
 		texture->pixels[compressed_block_index * 4 + 3] = *(unsigned int *)&best->bitstring[12];
 	}
 	// When perceptive compression is enabled, store the decompressed block data.
-	if (option_perceptive && option_compression_level >= COMPRESSION_LEVEL_CLASS_1)
+	if (context->options.perceptive && context->options.compression_level >= COMPRESSION_LEVEL_CLASS_1)
 		user_data->texture->decoding_function(best->bitstring, user_data->texture_pixels, user_data->flags);
 	// Print info.
-	if (option_verbose) {
+	if (context->options.verbose) {
 		printf("Block %d: ", (y_offset / texture->block_height) * (texture->extended_width / texture->block_width)
 			+ (x_offset / texture->block_width));
 		if (texture->type & TEXTURE_TYPE_ETC_BIT) {
 			int mode = texture->get_mode_function(best->bitstring);
 			printf("Mode: %c ", etc2_modestr[mode]);
 			if (compress_callback)
-				mode_statistics[mode]++;
+				context->mode_statistics[mode]++;
 		}
 		else if (texture->type == TEXTURE_TYPE_BPTC ||
 		texture->type == TEXTURE_TYPE_BPTC_FLOAT || texture->type == TEXTURE_TYPE_BPTC_SIGNED_FLOAT) {
 			int mode = texture->get_mode_function(best->bitstring);
 			printf("Mode: %d ", mode);
 			if (compress_callback)
-				mode_statistics[mode]++;
+				context->mode_statistics[mode]++;
 		}
 		printf("Combined: ");
 		printf("RMSE per pixel: %lf, ", sqrt((1.0 / best->fitness) / 16));
 		printf("GA generations: %d\n", nu_gens);
 	}
-	if (option_progress) {
-		int n = (texture->extended_width / texture->block_width) * (texture->extended_height / texture->block_height);
-		int old_percentage = (compressed_block_index - 1) * 100 / n;
-		int new_percentage = compressed_block_index * 100 / n;
+	if (context->options.progress && compress_callback) {
+		// Base the progress on the number of blocks reported of all mipmap levels, since blocks are
+		// not necessarily finished in order.
+		int old_percentage = (context->nu_blocks_reported - 1) * 100 / context->nu_blocks_total;
+		int new_percentage = context->nu_blocks_reported * 100 / context->nu_blocks_total;
 		if (new_percentage == 99 && old_percentage == 98)
 			printf("99%%\n");
 		else
@@ -937,39 +1563,368 @@ static void report_solution(FgenIndividual *best, BlockUserData *user_data, int
 			printf("%d%% ", new_percentage);
 		fflush(stdout);
 	}
-	if (compress_callback)
-		compress_callback_func(user_data);
+	if (compress_callback) {
+		context->nu_blocks_reported++;
+		if (context->callback_func != NULL)
+			context->callback_func(user_data);
+	}
 }
 
-// Compress each block with a single GA population. Unused.
+// Store and report a final solution for a block that was not compressed itself, because its solution was
+// copied from a block with the same source pixels and block flags, from the previous texture or from the block
+// cache, and mark the block as finished. Returns whether the compress callback function signalled to stop.
+
+static bool report_copied_solution(FgenIndividual *best, BlockUserData *block_user_data, int block_index,
+int nu_gens) {
+	CompressionContext *context = block_user_data->context;
+	MipmapLevel *level = get_block_level(context, block_index);
+	Texture *texture = level->texture;
+	int i = block_index - level->first_block;
+	BlockUserData user_data = *block_user_data;
+	set_user_data_level(&user_data, level);
+	user_data.x_offset = (i % level->blocks_per_row) * texture->block_width;
+	user_data.y_offset = (i / level->blocks_per_row) * texture->block_height;
+	if (level->texture_pixels != NULL) {
+		int bytespp = 4;
+		if (texture->type & TEXTURE_TYPE_HALF_FLOAT_BIT)
+			bytespp = 8;	// 64-bit pixels
+		user_data.texture_pixels = level->texture_pixels +
+			i * (texture->block_width * texture->block_height * bytespp) / 4;
+	}
+	report_solution(best, &user_data, nu_gens, true);
+	__atomic_store_n(&level->block_done[i], 1, __ATOMIC_RELEASE);
+	return user_data.stop_signalled;
+}
 
-static void compress_with_single_population(Image *image, Texture *texture) {
-	if (!option_quiet)
-		printf("Running single GA for each pixel block.\n");
+// Report the blocks of which the solution is known before compression starts, and their duplicates. Returns
+// whether the compress callback function signalled to stop.
+
+static bool report_known_blocks(CompressionContext *context) {
+	bool stop = false;
+	for (int i = 0; i < context->nu_blocks_total; i++) {
+		if (context->known_fitness[i] == 0)
+			continue;
+		MipmapLevel *level = get_block_level(context, i);
+		Texture *texture = level->texture;
+		int j = i - level->first_block;
+		unsigned char bitstring[16];
+		memcpy(bitstring, &texture->pixels[j * (texture->bits_per_block / 32)], texture->bits_per_block / 8);
+		FgenIndividual best;
+		best.bitstring = bitstring;
+		best.fitness = context->known_fitness[i];
+		BlockUserData user_data;
+		unsigned char alpha_pixels[16];
+		unsigned int colors[2];
+		set_user_data(context, &user_data, level, 1);
+		set_user_data_block_flags(&user_data, texture, get_block_flags(level->image, texture,
+			(j % level->blocks_per_row) * texture->block_width,
+			(j / level->blocks_per_row) * texture->block_height, alpha_pixels, colors));
+		for (int k = i; k >= 0; k = context->next_duplicate[k])
+			if (report_copied_solution(&best, &user_data, k, 0))
+				stop = true;
+	}
+	return stop;
+}
+
+// Return whether a block has to be compressed, which is not the case for blocks that are a duplicate of another
+// block and blocks of which the solution is known before compression starts.
+
+static bool block_needs_compression(CompressionContext *context, int block_index) {
+	return context->duplicate_of[block_index] == block_index && context->known_fitness[block_index] == 0;
+}
+
+// Return whether the solution of a block is known before compression starts, because it or the block that it
+// is a duplicate of was encoded directly, kept from the previous texture or found in the block cache.
+
+static bool block_is_known(CompressionContext *context, int block_index) {
+	return context->known_fitness[context->duplicate_of[block_index]] != 0;
+}
+
+// Format-aware genetic operators, used instead of per-bit mutation and uniform per-bit crossover for the formats
+// of which the texture describes the fields of a block. Mutation changes a field when per-bit mutation would
+// have flipped one of its bits: a number is moved by a small step, usually 1 but occasionally a larger power of
+// two, a pixel index is replaced by another one, and other fields get one of their bits flipped. Crossover
+// exchanges whole fields between the parents.
+
+// A field has at most eight bits, so it is contained in two consecutive bytes.
+
+static unsigned int get_block_field_value(const unsigned char *bitstring, const BlockField *field) {
+	int byte = field->bit >> 3;
+	int shift = field->bit & 7;
+	unsigned int bits = bitstring[byte];
+	if (shift + field->nu_bits > 8)
+		bits |= bitstring[byte + 1] << 8;
+	return (bits >> shift) & ((1 << field->nu_bits) - 1);
+}
+
+static void set_block_field_value(unsigned char *bitstring, const BlockField *field, unsigned int value) {
+	int byte = field->bit >> 3;
+	int shift = field->bit & 7;
+	unsigned int mask = ((1 << field->nu_bits) - 1) << shift;
+	value <<= shift;
+	bitstring[byte] = (bitstring[byte] & ~mask) | (value & mask);
+	if (shift + field->nu_bits > 8)
+		bitstring[byte + 1] = (bitstring[byte + 1] & ~(mask >> 8)) | ((value & mask) >> 8);
+}
+
+static void mutate_block_field(FgenRNG *rng, const BlockField *field, unsigned char *bitstring) {
+	unsigned int max_value = (1 << field->nu_bits) - 1;
+	unsigned int value = get_block_field_value(bitstring, field);
+	switch (field->type) {
+	case BLOCK_FIELD_NUMERIC :
+	case BLOCK_FIELD_SIGNED : {
+		// Flipping the sign bit of a two's complement number maps it to an unsigned number in the same order.
+		unsigned int sign_bit = field->type == BLOCK_FIELD_SIGNED ? (max_value + 1) / 2 : 0;
+		int x = value ^ sign_bit;
+		int step = 1;
+		while (step < (int)(max_value + 1) / 4 && (fgen_random_8(rng) & 1))
+			step *= 2;
+		if (fgen_random_8(rng) & 1)
+			step = - step;
+		if (x + step < 0 || x + step > (int)max_value)
+			step = - step;
+		value = (x + step) ^ sign_bit;
+		break;
+		}
+	case BLOCK_FIELD_INDEX :
+		value ^= 1 + fgen_random_n(rng, max_value);
+		break;
+	default :
+		value ^= 1 << fgen_random_n(rng, field->nu_bits);
+		break;
+	}
+	set_block_field_value(bitstring, field, value);
+}
+
+static void mutate_block_fields(FgenPopulation *pop, const unsigned char *parent, unsigned char *child) {
+	BlockUserData *user_data = (BlockUserData *)pop->user_data;
+	CompressionContext *context = user_data->context;
+	int nu_bytes = user_data->texture->bits_per_block / 8;
+	// Let per-bit mutation determine which bits would be flipped.
+	unsigned char zero[16], flipped[16];
+	memset(zero, 0, nu_bytes);
+	memset(flipped, 0, nu_bytes);
+	fgen_mutation_per_bit_fast(pop, zero, flipped);
+	if (child != parent)
+		memcpy(child, parent, nu_bytes);
+	if (memcmp(flipped, zero, nu_bytes) == 0)
+		return;
+	BlockField fields[BLOCK_MAX_FIELDS];
+	int n = user_data->texture->get_fields_function(parent, fields);
+	if (n == 0) {
+		for (int i = 0; i < nu_bytes; i++)
+			child[i] ^= flipped[i];
+		return;
+	}
+	// Pixel indices that are calculated by the fitness function and an alpha part that is already optimal
+	// (calculated before compression, or when seeding a DXT3 block) are not mutated, since that cannot improve
+	// the block.
+	int first_bit = 0;
+	if (context->optimal_alpha_blocks != NULL || user_data->texture->type == TEXTURE_TYPE_DXT3)
+		first_bit = 64;
+	// Mutate the fields that contain a flipped bit, walking the flipped bits and the fields, which are in order of
+	// increasing bit position, together.
+	int i = 0;
+	for (int bit = first_bit; bit < nu_bytes * 8 && i < n; bit++) {
+		if (flipped[bit >> 3] == 0) {
+			bit |= 7;
+			continue;
+		}
+		if ((flipped[bit >> 3] & (1 << (bit & 7))) == 0)
+			continue;
+		while (i < n && fields[i].bit + fields[i].nu_bits <= bit)
+			i++;
+		if (i < n && fields[i].bit <= bit) {
+			if (fields[i].type != BLOCK_FIELD_INDEX || !context->calculate_pixel_indices)
+				mutate_block_field(fgen_get_rng(pop), &fields[i], child);
+			i++;
+		}
+	}
+}
+
+static void crossover_block_fields(FgenPopulation *pop, const unsigned char *parent1, const unsigned char *parent2,
+unsigned char *child1, unsigned char *child2) {
+	BlockUserData *user_data = (BlockUserData *)pop->user_data;
+	int nu_bytes = user_data->texture->bits_per_block / 8;
+	BlockField fields1[BLOCK_MAX_FIELDS], fields2[BLOCK_MAX_FIELDS];
+	int n1 = user_data->texture->get_fields_function(parent1, fields1);
+	int n2 = user_data->texture->get_fields_function(parent2, fields2);
+	if (n1 == 0 || n2 == 0) {
+		fgen_crossover_uniform_per_bit(pop, parent1, parent2, child1, child2);
+		return;
+	}
+	// The parents can have different layouts, for example different BPTC modes or partitions or different ETC1
+	// modes. Only the fields up to the first one that differs are exchanged, the rest of each child is taken
+	// from one parent as a whole.
+	int n = 0;
+	while (n < n1 && n < n2 && fields1[n].bit == fields2[n].bit && fields1[n].nu_bits == fields2[n].nu_bits &&
+	fields1[n].type == fields2[n].type)
+		n++;
+	// The fields for which the mask is set are taken from the first parent for the first child.
+	unsigned char mask[16];
+	memset(mask, 0, nu_bytes);
+	unsigned int r = 0;
+	for (int i = 0; i < n; i++) {
+		if ((i & 31) == 0)
+			r = fgen_random_32(fgen_get_rng(pop));
+		if (r & 1)
+			set_block_field_value(mask, &fields1[i], (1 << fields1[i].nu_bits) - 1);
+		r >>= 1;
+	}
+	if (n < n1) {
+		int bit = fields1[n].bit;
+		mask[bit >> 3] |= 0xFF << (bit & 7);
+		for (int i = (bit >> 3) + 1; i < nu_bytes; i++)
+			mask[i] = 0xFF;
+	}
+	for (int i = 0; i < nu_bytes; i++) {
+		unsigned char c1 = (parent1[i] & mask[i]) | (parent2[i] & ~mask[i]);
+		unsigned char c2 = (parent2[i] & mask[i]) | (parent1[i] & ~mask[i]);
+		child1[i] = c1;
+		child2[i] = c2;
+	}
+}
+
+// Populations that are kept for reuse by later compressions, so that a process that compresses many
+// textures does not allocate new populations for every texture. A population is only handed out again for
+// the same population size, individual size, generation callback, seed function and genetic operators.
+
+typedef struct CachedPopulation_t CachedPopulation;
+
+struct CachedPopulation_t {
+	FgenPopulation *pop;
+	int population_size;
+	int nu_bits;
+	FgenGenerationCallbackFunc generation_callback_func;
+	FgenSeedFunc seed_func;
+	FgenMutationFunc mutation_func;
+	bool in_use;
+	CachedPopulation *next;
+};
+
+struct PopulationCache_t {
+	pthread_mutex_t mutex;
+	CachedPopulation *populations;
+};
+
+PopulationCache *create_population_cache() {
+	PopulationCache *cache = (PopulationCache *)malloc(sizeof(PopulationCache));
+	pthread_mutex_init(&cache->mutex, NULL);
+	cache->populations = NULL;
+	return cache;
+}
+
+// Destroy a population cache and its populations. None of them should be in use.
+
+void destroy_population_cache(PopulationCache *cache) {
+	CachedPopulation *cached = cache->populations;
+	while (cached != NULL) {
+		CachedPopulation *next = cached->next;
+		free(cached->pop->user_data);
+		fgen_destroy(cached->pop);
+		free(cached);
+		cached = next;
+	}
+	pthread_mutex_destroy(&cache->mutex);
+	free(cache);
+}
+
+// Return a population with the given parameters and a BlockUserData structure as user data, taken from the
+// population cache of the context when possible. The genetic operators are the format-aware ones when the texture
+// describes the fields of its blocks. The caller sets the genetic parameters.
+
+static FgenPopulation *get_population(CompressionContext *context, int population_size, int nu_bits,
+FgenGenerationCallbackFunc generation_callback_func, FgenSeedFunc seed_func) {
+	FgenMutationFunc mutation_func = fgen_mutation_per_bit_fast;
+	FgenCrossoverFunc crossover_func = fgen_crossover_uniform_per_bit;
+	if (context->levels[0].texture->get_fields_function != NULL) {
+		mutation_func = mutate_block_fields;
+		crossover_func = crossover_block_fields;
+	}
+	PopulationCache *cache = context->population_cache;
+	if (cache != NULL) {
+		pthread_mutex_lock(&cache->mutex);
+		for (CachedPopulation *cached = cache->populations; cached != NULL; cached = cached->next)
+			if (!cached->in_use && cached->population_size == population_size &&
+			cached->nu_bits == nu_bits && cached->generation_callback_func == generation_callback_func &&
+			cached->seed_func == seed_func && cached->mutation_func == mutation_func) {
+				cached->in_use = true;
+				pthread_mutex_unlock(&cache->mutex);
+				return cached->pop;
+			}
+		pthread_mutex_unlock(&cache->mutex);
+	}
 	FgenPopulation *pop = fgen_create(
 		population_size,		// Population size.
-		texture->bits_per_block,	// Number of bits.
+		nu_bits,			// Number of bits.
 		1,				// Data element size.
-		generation_callback,
+		generation_callback_func,
 		calculate_fitness,
-		fgen_seed_random,
-		fgen_mutation_per_bit_fast,
-		fgen_crossover_uniform_per_bit
+		seed_func,
+		mutation_func,
+		crossover_func
 		);
+#ifdef TEXGENPACK_BUILTIN_GA
+	fgen_set_fitness_batch_function(pop, calculate_fitness_batch);
+#endif
+	pop->user_data = (BlockUserData *)malloc(sizeof(BlockUserData));
+	if (cache != NULL) {
+		CachedPopulation *cached = (CachedPopulation *)malloc(sizeof(CachedPopulation));
+		cached->pop = pop;
+		cached->population_size = population_size;
+		cached->nu_bits = nu_bits;
+		cached->generation_callback_func = generation_callback_func;
+		cached->seed_func = seed_func;
+		cached->mutation_func = mutation_func;
+		cached->in_use = true;
+		pthread_mutex_lock(&cache->mutex);
+		cached->next = cache->populations;
+		cache->populations = cached;
+		pthread_mutex_unlock(&cache->mutex);
+	}
+	return pop;
+}
+
+// Return a population obtained with get_population() to the cache, or destroy it when there is no cache.
+
+static void release_population(CompressionContext *context, FgenPopulation *pop) {
+	PopulationCache *cache = context->population_cache;
+	if (cache != NULL) {
+		pthread_mutex_lock(&cache->mutex);
+		for (CachedPopulation *cached = cache->populations; cached != NULL; cached = cached->next)
+			if (cached->pop == pop) {
+				cached->in_use = false;
+				break;
+			}
+		pthread_mutex_unlock(&cache->mutex);
+		return;
+	}
+	free(pop->user_data);
+	fgen_destroy(pop);
+}
+
+// Compress each block with a single GA population. Unused.
+
+static void compress_with_single_population(CompressionContext *context, MipmapLevel *level) {
+	Image *image = level->image;
+	Texture *texture = level->texture;
+	if (!context->options.quiet)
+		printf("Running single GA for each pixel block.\n");
+	FgenPopulation *pop = get_population(context, context->population_size, texture->bits_per_block,
+		generation_callback, fgen_seed_random);
 	fgen_set_parameters(
 		pop,
 		FGEN_ELITIST_SUS,
 		FGEN_SUBTRACT_MIN_FITNESS,
-		crossover_probability,	// Crossover prob.
-		mutation_probability,	// Mutation prob. per bit
+		context->crossover_probability,	// Crossover prob.
+		context->mutation_probability,	// Mutation prob. per bit
 		0		// Macro-mutation prob.
 		);
-	fgen_set_generation_callback_interval(pop, nu_generations);
-	if (!option_deterministic)
+	fgen_set_generation_callback_interval(pop, context->nu_generations);
+	if (!context->options.deterministic)
 		fgen_random_seed_with_timer(fgen_get_rng(pop));
 //	fgen_random_seed_rng(fgen_get_rng(pop), 0);
-	pop->user_data = (BlockUserData *)malloc(sizeof(BlockUserData));
-	set_user_data((BlockUserData *)pop->user_data, image, texture, 1);
+	set_user_data(context, (BlockUserData *)pop->user_data, level, 1);
 	for (int y = 0; y < image->extended_height; y += texture->block_height)
 		for (int x = 0; x < image->extended_width; x+= texture->block_width) {
 			BlockUserData *user_data = (BlockUserData *)pop->user_data;
@@ -980,17 +1935,16 @@ static void compress_with_single_population(Image *image, Texture *texture) {
 //			if (use_threading)
 //				fgen_run_threaded(pop, nu_generations);
 //			else
-				fgen_run(pop, nu_generations);
+				fgen_run(pop, context->nu_generations);
 			report_solution(fgen_best_individual_of_population(pop), user_data, pop->generation, true);
 			if (user_data->stop_signalled)
 				goto end;
 		}
 end :
-	free(pop->user_data);
-	fgen_destroy(pop);
+	release_population(context, pop);
 }
 
-unsigned int *allocate_texture_pixels(Texture *texture) {
+static unsigned int *allocate_texture_pixels(Texture *texture) {
 	int n = (texture->extended_height / texture->block_height) *
 		(texture->extended_width / texture->block_width);
 	int bytespp = 4;
@@ -1001,496 +1955,799 @@ unsigned int *allocate_texture_pixels(Texture *texture) {
 	return texture_pixels;
 }
 
-// Compress each block with an archipelago of algorithms running on the same block. The best one is chosen.
+// Queue of finished work items (block or slot indices). Items are pushed by tasks running on the thread pool
+// and popped by the thread that controls the compression, which reports the results.
+
+typedef struct {
+	int *items;
+	int size;
+	int head;
+	int nu_items;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+} CompletionQueue;
+
+static void completion_queue_init(CompletionQueue *queue, int size) {
+	queue->items = (int *)malloc(sizeof(int) * size);
+	queue->size = size;
+	queue->head = 0;
+	queue->nu_items = 0;
+	pthread_mutex_init(&queue->mutex, NULL);
+	pthread_cond_init(&queue->cond, NULL);
+}
+
+static void completion_queue_destroy(CompletionQueue *queue) {
+	pthread_cond_destroy(&queue->cond);
+	pthread_mutex_destroy(&queue->mutex);
+	free(queue->items);
+}
+
+static void completion_queue_push(CompletionQueue *queue, int item) {
+	pthread_mutex_lock(&queue->mutex);
+	queue->items[(queue->head + queue->nu_items) % queue->size] = item;
+	queue->nu_items++;
+	pthread_cond_signal(&queue->cond);
+	pthread_mutex_unlock(&queue->mutex);
+}
 
-static void compress_with_archipelago(Image *image, Texture *texture) {
-	unsigned char *alpha_pixels = (unsigned char *)alloca(texture->block_width * texture->block_height);
+// Wait until an item is available and remove it from the queue. The calling thread does not run queued
+// tasks while waiting, so that finished work is reported as soon as it is available (the seeding functions
+// only use blocks that have been reported). It must therefore not be called from a task of the thread pool.
+
+static int completion_queue_pop(CompletionQueue *queue) {
+	pthread_mutex_lock(&queue->mutex);
+	while (queue->nu_items == 0)
+		pthread_cond_wait(&queue->cond, &queue->mutex);
+	int item = queue->items[queue->head];
+	queue->head = (queue->head + 1) % queue->size;
+	queue->nu_items--;
+	pthread_mutex_unlock(&queue->mutex);
+	return item;
+}
+
+// Compress each block with an archipelago of algorithms running on the same block. The best one is chosen.
+//
+// Several blocks are compressed at the same time. Every block that is in flight occupies a slot, and uses
+// a set of first-pass populations for the first pass and a set of second-pass populations for the second
+// pass. The first-pass set is released as soon as the first pass has finished, so that the first pass of
+// the next block overlaps with the long second pass of the previous one. The number of first-pass sets is
+// chosen so that their islands fill the thread pool. The configuration of the genetic algorithm for each
+// block is the same as when the blocks are compressed one at a time.
+//
+// The calling thread controls the slots: it assigns blocks, reports the solution of each pass and starts
+// the second pass. The seeding functions use the blocks to the left and above, and the perceptive quality
+// strategy compares against their decompressed pixels, so a block is only started when both of those
+// blocks are finished. The blocks are scheduled as a wavefront: a block becomes ready when the last of its
+// two neighbours is finished, so that all blocks of an anti-diagonal can be compressed in parallel with
+// the same neighbour data as when compressing in raster order.
+
+typedef struct {
+	CompressionContext *context;
+	MipmapLevel *level;
+	Image *image;
+	Texture *texture;
+	FgenPopulation **pops;		// First-pass population set, during the first pass.
+	FgenPopulation **pops2;		// Second-pass population set, during the second pass.
+	int first_pass_set;
+	int second_pass_set;
+	int index;
+	int block_index;
+	int x;
+	int y;
+	int block_flags;
+	unsigned char alpha_pixels[16];
 	unsigned int colors[2];
-	FgenPopulation **pops = (FgenPopulation **)alloca(sizeof(FgenPopulation *) * nu_islands);
-	FgenPopulation **pops2 = (FgenPopulation **)alloca(sizeof(FgenPopulation *) * nu_islands_second_pass);
-	if (!option_quiet) {
-		const char *quality_strategy;
-		if (option_perceptive && option_compression_level >= COMPRESSION_LEVEL_CLASS_1 &&
-		texture->perceptive_comparison_function != NULL)
-			quality_strategy = "perceptive";
-		else
-			quality_strategy = "non-perceptive";
-		printf("Running GA archipelago of size %d for each pixel block, population size %d, "
-			"%d-%d generations, "
-			"%s quality strategy, second pass population size 8, %d generations.\n",
-			nu_islands, population_size, nu_generations, nu_generations * 3,
-			quality_strategy, nu_generations_second_pass);
-	}
-	unsigned int *texture_pixels;
-	if (option_perceptive)
-		texture_pixels = allocate_texture_pixels(texture);
-	for (int i = 0; i < nu_islands; i++) {
-		pops[i] = fgen_create(
-			population_size,		// Population size.
-			texture->bits_per_block,	// Number of bits.
-			1,				// Data element size.
-			generation_callback_archipelago,
-			calculate_fitness,
-			seed,
-			fgen_mutation_per_bit_fast,
-			fgen_crossover_uniform_per_bit
-			);
+	int pass;
+	// The user data of the best first-pass island and the mode of its solution, used for the second pass.
+	BlockUserData user_data;
+	int mode;
+	FgenIndividual *best;
+	int best_island;
+	CompletionQueue *finished_slots;
+} ArchipelagoSlot;
+
+static void create_first_pass_populations(CompressionContext *context, MipmapLevel *level, int nu_pops,
+FgenPopulation **pops) {
+	Texture *texture = level->texture;
+	for (int i = 0; i < nu_pops; i++) {
+		pops[i] = get_population(context, context->population_size, texture->bits_per_block,
+			generation_callback_archipelago, seed);
 		fgen_set_parameters(
 			pops[i],
 			FGEN_ELITIST_SUS,
 			FGEN_SUBTRACT_MIN_FITNESS,
-			crossover_probability,	// Crossover prob.
-			mutation_probability,	// Mutation prob. per bit
+			context->crossover_probability,	// Crossover prob.
+			context->mutation_probability,	// Mutation prob. per bit
 			0		// Macro-mutation prob.
 			);
-		fgen_set_generation_callback_interval(pops[i], nu_generations);
+		fgen_set_generation_callback_interval(pops[i], context->nu_generations);
 		fgen_set_migration_interval(pops[i], 0);	// No migration.
 		fgen_set_migration_probability(pops[i], 0.05);
-		pops[i]->user_data = (BlockUserData *)malloc(sizeof(BlockUserData));
-		set_user_data((BlockUserData *)pops[i]->user_data, image, texture, 1);
-
-	}
-	for (int i = 0; i < nu_islands_second_pass; i++) {
-		// Create second pass GAs.
-		pops2[i] = fgen_create(
-			8,				// Population size.
-			texture->bits_per_block,	// Number of bits.
-			1,				// Data element size.
-			generation_callback_second_pass,
-			calculate_fitness,
-			seed_second_pass,
-			fgen_mutation_per_bit_fast,
-			fgen_crossover_uniform_per_bit
-			);
+		set_user_data(context, (BlockUserData *)pops[i]->user_data, level, 1);
+	}
+}
+
+static void create_second_pass_populations(CompressionContext *context, Texture *texture, int nu_pops,
+FgenPopulation **pops2) {
+	for (int i = 0; i < nu_pops; i++) {
+		pops2[i] = get_population(context, 8, texture->bits_per_block, generation_callback_second_pass,
+			seed_second_pass);
 		fgen_set_parameters(
 			pops2[i],
 			FGEN_ELITIST_SUS,
 			FGEN_SUBTRACT_MIN_FITNESS,
 			0,					// Crossover prob.
-			mutation_probability_second_pass,	// Mutation prob. per bit
+			context->mutation_probability_second_pass,	// Mutation prob. per bit
 			0		// Macro-mutation prob.
 			);
-		fgen_set_generation_callback_interval(pops2[i], nu_generations_second_pass);
+		fgen_set_generation_callback_interval(pops2[i], context->nu_generations_second_pass);
 		fgen_set_migration_interval(pops2[i], 0);	// No migration.
 		fgen_set_migration_probability(pops2[i], 0.01);
-		pops2[i]->user_data = (BlockUserData *)malloc(sizeof(BlockUserData));
 	}
-	if (!option_deterministic)
-		fgen_random_seed_with_timer(fgen_get_rng(pops[0]));
-//	fgen_random_seed_rng(fgen_get_rng(pops[0]), 0);
+}
 
-	for (int y = 0; y < image->extended_height; y += texture->block_height)
-		for (int x = 0; x < image->extended_width; x+= texture->block_width) {
-			// Get block flags and prepare the alpha values of the image block for use in the
-			// seeding function.
-			int block_flags = 0;
-			if ((texture->type & (TEXTURE_TYPE_DXTC_BIT | TEXTURE_TYPE_ALPHA_BIT)) ==
-			(TEXTURE_TYPE_DXTC_BIT | TEXTURE_TYPE_ALPHA_BIT) || texture->type == TEXTURE_TYPE_ETC2_EAC ||
-			texture->type == TEXTURE_TYPE_ETC2_PUNCHTHROUGH || texture->type == TEXTURE_TYPE_BPTC) {
-				// Get early parameters for block (whether it is completely opaque or non-opaque,
-				// whether it uses only a limited amount of colors), and set alpha pixels.
-				block_flags = get_block_flags_rgba8(image, x, y, texture->block_width,
-					texture->block_height, alpha_pixels, colors);
-			}
-			// Calculate pointers to decompressed pixel buffer for block, and block above and left.
-			unsigned int *texture_pixels_block, *texture_pixels_above, *texture_pixels_left;
-			if (option_perceptive) {
-				int bytespp = 4;
-				if (texture->type & TEXTURE_TYPE_HALF_FLOAT_BIT)
-					bytespp = 8;	// 64-bit pixels
-				texture_pixels_block = texture_pixels +
-					((y / texture->block_height) * (image->extended_width /
-						texture->block_width) + x / texture->block_width) *
-					(texture->block_width * texture->block_height * bytespp) / 4;
-				if (y == 0)
-					texture_pixels_above = NULL;
-				else
-					texture_pixels_above = texture_pixels_block -
-						(image->extended_width / texture->block_width) *
-						(texture->block_width * texture->block_height * bytespp) / 4;
-				if (x == 0)
-					texture_pixels_left = NULL;
-				else
-					texture_pixels_left = texture_pixels_block -
-						(texture->block_width * texture->block_height * bytespp) / 4;
-			}
-			// Set up the auxilliary information for each population.
- 			for (int i = 0; i < nu_islands; i++) {
-				BlockUserData *user_data = (BlockUserData *)pops[i]->user_data;
-				user_data->x_offset = x;
-				user_data->y_offset = y;
-				user_data->alpha_pixels = alpha_pixels;
-				user_data->colors = colors;
-				if (option_perceptive) {
-					user_data->texture_pixels = texture_pixels_block;
-					user_data->texture_pixels_above = texture_pixels_above;
-					user_data->texture_pixels_left = texture_pixels_left;
+static void release_populations(CompressionContext *context, int nu_pops, FgenPopulation **pops) {
+	for (int i = 0; i < nu_pops; i++)
+		release_population(context, pops[i]);
+}
+
+// Prepare the first-pass populations of a slot for the block at (slot->x, slot->y) of the slot's mipmap level.
+
+static void set_up_archipelago_block(ArchipelagoSlot *slot) {
+	CompressionContext *context = slot->context;
+	unsigned int *texture_pixels = slot->level->texture_pixels;
+	Image *image = slot->image;
+	Texture *texture = slot->texture;
+	int x = slot->x;
+	int y = slot->y;
+	// Get block flags and prepare the alpha values of the image block for use in the
+	// seeding function.
+	slot->block_flags = get_block_flags(image, texture, x, y, slot->alpha_pixels, slot->colors);
+	// Calculate pointers to decompressed pixel buffer for block, and block above and left.
+	unsigned int *texture_pixels_block, *texture_pixels_above, *texture_pixels_left;
+	if (context->options.perceptive) {
+		int bytespp = 4;
+		if (texture->type & TEXTURE_TYPE_HALF_FLOAT_BIT)
+			bytespp = 8;	// 64-bit pixels
+		texture_pixels_block = texture_pixels +
+			((y / texture->block_height) * (image->extended_width /
+				texture->block_width) + x / texture->block_width) *
+			(texture->block_width * texture->block_height * bytespp) / 4;
+		if (y == 0)
+			texture_pixels_above = NULL;
+		else
+			texture_pixels_above = texture_pixels_block -
+				(image->extended_width / texture->block_width) *
+				(texture->block_width * texture->block_height * bytespp) / 4;
+		if (x == 0)
+			texture_pixels_left = NULL;
+		else
+			texture_pixels_left = texture_pixels_block -
+				(texture->block_width * texture->block_height * bytespp) / 4;
+	}
+	// Set up the auxilliary information for each population.
+	for (int i = 0; i < context->nu_islands; i++) {
+		BlockUserData *user_data = (BlockUserData *)slot->pops[i]->user_data;
+		set_user_data_level(user_data, slot->level);
+		user_data->x_offset = x;
+		user_data->y_offset = y;
+		user_data->alpha_pixels = slot->alpha_pixels;
+		user_data->colors = slot->colors;
+		if (context->options.perceptive) {
+			user_data->texture_pixels = texture_pixels_block;
+			user_data->texture_pixels_above = texture_pixels_above;
+			user_data->texture_pixels_left = texture_pixels_left;
+		}
+		set_user_data_mode_flags(i, user_data, slot->block_flags);
+		set_user_data_block_flags(user_data, texture, slot->block_flags);
+	}
+}
+
+// Run the first pass of a slot.
+
+static void run_archipelago_first_pass(ArchipelagoSlot *slot) {
+	CompressionContext *context = slot->context;
+	run_populations_concurrently(context, context->nu_islands, slot->pops);
+	slot->best = fgen_best_individual_and_island_of_archipelago(context->nu_islands, slot->pops, &slot->best_island);
+}
+
+// Save the information of the first pass that is needed by the second pass, so that the first-pass
+// populations can be reused for another block.
+
+static void save_archipelago_first_pass(ArchipelagoSlot *slot) {
+	Texture *texture = slot->texture;
+	slot->user_data = *(BlockUserData *)slot->pops[slot->best_island]->user_data;
+	slot->mode = - 1;
+	// For ETC1, ETC2, BPTC and BPTC_FLOAT, preserve the mode of the compressed block during the second pass.
+	if ((texture->type & TEXTURE_TYPE_ETC_BIT) || texture->type == TEXTURE_TYPE_BPTC ||
+	texture->type == TEXTURE_TYPE_BPTC_FLOAT || texture->type == TEXTURE_TYPE_BPTC_SIGNED_FLOAT)
+		slot->mode = texture->get_mode_function(slot->best->bitstring);
+}
+
+// Run the second pass of a slot, starting from the first-pass solution that has been stored in the texture.
+
+static void run_archipelago_second_pass(ArchipelagoSlot *slot) {
+	CompressionContext *context = slot->context;
+	Texture *texture = slot->texture;
+	for (int i = 0; i < context->nu_islands_second_pass; i++) {
+		BlockUserData *user_data = (BlockUserData *)slot->pops2[i]->user_data;
+		*user_data = slot->user_data;
+		if (slot->mode >= 0) {
+			user_data->flags = (1 << slot->mode) | ENCODE_BIT;
+			set_user_data_block_flags(user_data, texture, slot->block_flags);
+		}
+	}
+	run_populations_concurrently(context, context->nu_islands_second_pass, slot->pops2);
+	slot->best = fgen_best_individual_and_island_of_archipelago(context->nu_islands_second_pass, slot->pops2,
+		&slot->best_island);
+}
+
+static void archipelago_pass_task(void *task_data) {
+	ArchipelagoSlot *slot = (ArchipelagoSlot *)task_data;
+	if (slot->pass == 1)
+		run_archipelago_first_pass(slot);
+	else
+		run_archipelago_second_pass(slot);
+	completion_queue_push(slot->finished_slots, slot->index);
+}
+
+static void print_archipelago_island_statistics(ArchipelagoSlot *slot) {
+	CompressionContext *context = slot->context;
+	Texture *texture = slot->texture;
+	FgenPopulation **pops = slot->pops;
+	for (int i = 0; i < context->nu_islands; i++) {
+		printf("Block %d: ", (slot->y / texture->block_height) * (texture->extended_width /
+			texture->block_width) + (slot->x / texture->block_width));
+		if (texture->type & TEXTURE_TYPE_ETC_BIT) {
+			printf("Modes: ");
+			int modes_allowed = ((BlockUserData *)pops[i]->user_data)->flags;
+			if (modes_allowed & ETC_MODE_ALLOWED_INDIVIDUAL)
+				printf("I");
+			if (modes_allowed & ETC_MODE_ALLOWED_DIFFERENTIAL)
+				printf("D");
+			if (modes_allowed & ETC2_MODE_ALLOWED_T)
+				printf("T");
+			if (modes_allowed & ETC2_MODE_ALLOWED_H)
+				printf("H");
+			if (modes_allowed & ETC2_MODE_ALLOWED_PLANAR)
+				printf("P");
+		}
+		else if (texture->type == TEXTURE_TYPE_BPTC) {
+			printf("Modes: ");
+			int modes_allowed = ((BlockUserData *)pops[i]->user_data)->flags;
+			for (int j = 0; j < 8; j++)
+			if (modes_allowed & (1 << j))
+				printf("%d", j);
+		}
+		FgenIndividual *best = fgen_best_individual_of_population(pops[i]);
+		double rmse = sqrt((1.0 / best->fitness) / 16);
+		printf(" RMSE per pixel: %lf\n", rmse);
+		if (context->options.verbose >= 3 && rmse >= 1.0) {
+			for (int j = 0; j < pops[i]->size; j++) {
+				FgenIndividual *ind = pops[i]->ind[j];
+				printf("  Individual %d: ", j);
+				if (texture->get_mode_function != NULL) {
+					int mode = texture->get_mode_function(ind->bitstring);
+					printf("Mode: %d ", mode);
 				}
-				set_user_data_mode_flags(i, user_data, block_flags);
-				set_user_data_block_flags(user_data, texture, block_flags);
+				printf("RMSE per pixel: %lf\n",
+					sqrt((1.0 / ind->fitness) / 16));
 			}
-			// Run the genetic algorithm.
-			int nu_concurrent_islands = nu_islands;
-			if (option_max_threads != -1 && nu_islands > option_max_threads)
-				nu_concurrent_islands = option_max_threads;
-			for (int i = 0; i < nu_islands;) {
-				int n;
-				n = nu_concurrent_islands;
-				if (i + n > nu_islands)
-					n = nu_islands - i;
-				if (n == 1)
-					fgen_run(pops[i], - 1);
-				else
-					fgen_run_archipelago_threaded(n, &pops[i], - 1);
-				i += n;
-			}
-			// Report the best solution.
-			int best_island;
-			FgenIndividual *best = fgen_best_individual_and_island_of_archipelago(nu_islands,
-				pops, &best_island);
+		}
+	}
+}
+
+static void compress_with_archipelago(CompressionContext *context) {
+	Texture *texture = context->levels[0].texture;
+	bool perceptive = context->options.perceptive &&
+		context->options.compression_level >= COMPRESSION_LEVEL_CLASS_1 &&
+		texture->perceptive_comparison_function != NULL;
+	int n = context->nu_blocks_total;
+	// Use enough first-pass sets to keep every thread of the pool busy with an island, and one more
+	// second-pass set so that a second pass can always overlap with the first passes.
+	int nu_blocks_to_compress = 0;
+	for (int i = 0; i < n; i++)
+		nu_blocks_to_compress += block_needs_compression(context, i);
+	int nu_first_pass_sets = get_number_of_threads(context) / context->nu_islands;
+	if (nu_first_pass_sets > nu_blocks_to_compress)
+		nu_first_pass_sets = nu_blocks_to_compress;
+	if (nu_first_pass_sets < 1)
+		nu_first_pass_sets = 1;
+	int nu_second_pass_sets = nu_first_pass_sets + 1;
+	int nu_slots = nu_first_pass_sets + nu_second_pass_sets;
+	if (!context->options.quiet) {
+		const char *quality_strategy;
+		if (perceptive)
+			quality_strategy = "perceptive";
+		else
+			quality_strategy = "non-perceptive";
+		printf("Running GA archipelago of size %d for each pixel block, population size %d, "
+			"%d-%d generations, "
+			"%s quality strategy, second pass population size 8, %d generations.\n",
+			context->nu_islands, context->population_size, context->nu_generations,
+			context->nu_generations * 3, quality_strategy, context->nu_generations_second_pass);
+		if (nu_first_pass_sets > 1)
+			printf("Compressing %d blocks concurrently.\n", nu_first_pass_sets);
+	}
+	FgenPopulation **pops = (FgenPopulation **)malloc(sizeof(FgenPopulation *) * context->nu_islands *
+		nu_first_pass_sets);
+	FgenPopulation **pops2 = (FgenPopulation **)malloc(sizeof(FgenPopulation *) * context->nu_islands_second_pass *
+		nu_second_pass_sets);
+	create_first_pass_populations(context, &context->levels[0], context->nu_islands * nu_first_pass_sets, pops);
+	create_second_pass_populations(context, texture, context->nu_islands_second_pass * nu_second_pass_sets, pops2);
+	// The islands are run independently, so every population needs its own random seed.
+	seed_population_rngs(context, context->nu_islands * nu_first_pass_sets, pops);
+	seed_population_rngs(context, context->nu_islands_second_pass * nu_second_pass_sets, pops2);
+	int *free_first_pass_sets = (int *)malloc(sizeof(int) * nu_first_pass_sets);
+	for (int i = 0; i < nu_first_pass_sets; i++)
+		free_first_pass_sets[i] = nu_first_pass_sets - 1 - i;
+	int nu_free_first_pass_sets = nu_first_pass_sets;
+	int *free_second_pass_sets = (int *)malloc(sizeof(int) * nu_second_pass_sets);
+	for (int i = 0; i < nu_second_pass_sets; i++)
+		free_second_pass_sets[i] = nu_second_pass_sets - 1 - i;
+	int nu_free_second_pass_sets = nu_second_pass_sets;
+	CompletionQueue finished_slots;
+	completion_queue_init(&finished_slots, nu_slots);
+	ArchipelagoSlot *slots = (ArchipelagoSlot *)malloc(sizeof(ArchipelagoSlot) * nu_slots);
+	int *free_slots = (int *)malloc(sizeof(int) * nu_slots);
+	for (int i = 0; i < nu_slots; i++) {
+		slots[i].context = context;
+		slots[i].index = i;
+		slots[i].finished_slots = &finished_slots;
+		free_slots[i] = nu_slots - 1 - i;
+	}
+	int nu_free_slots = nu_slots;
+	// Slots of which the first pass has finished, waiting in order for a free second-pass set.
+	int *waiting_slots = (int *)malloc(sizeof(int) * nu_slots);
+	int waiting_head = 0;
+	int nu_waiting_slots = 0;
+	ThreadTaskGroup *group = thread_task_group_create();
+
+	// For every block, count the neighbours (left and above) in the same mipmap level that are not finished
+	// yet. Blocks without unfinished neighbours are queued as ready in the order in which they become
+	// ready. Initially, the top-left block of every level is ready, so that the blocks of all levels are
+	// compressed concurrently. Duplicate blocks are never queued; they are finished together with the
+	// block that they are a duplicate of. Blocks of which the solution is known before compression starts
+	// are finished from the start.
+	bool stop = report_known_blocks(context);
+	unsigned char *nu_unfinished_neighbours = (unsigned char *)malloc(n);
+	for (int i = 0; i < context->nu_levels; i++) {
+		MipmapLevel *level = &context->levels[i];
+		for (int j = 0; j < level->nu_blocks; j++) {
+			int block_index = level->first_block + j;
+			nu_unfinished_neighbours[block_index] = (j % level->blocks_per_row > 0 &&
+				!block_is_known(context, block_index - 1)) + (j >= level->blocks_per_row &&
+				!block_is_known(context, block_index - level->blocks_per_row));
+		}
+	}
+	int *ready_blocks = (int *)malloc(sizeof(int) * n);
+	int ready_head = 0;
+	int ready_tail = 0;
+	for (int i = 0; i < n; i++)
+		if (nu_unfinished_neighbours[i] == 0 && block_needs_compression(context, i))
+			ready_blocks[ready_tail++] = i;
+	for (;;) {
+		// Start the second pass of waiting blocks first, so that blocks are finished as early as possible.
+		while (nu_waiting_slots > 0 && nu_free_second_pass_sets > 0) {
+			ArchipelagoSlot *slot = &slots[waiting_slots[waiting_head]];
+			waiting_head = (waiting_head + 1) % nu_slots;
+			nu_waiting_slots--;
+			nu_free_second_pass_sets--;
+			slot->second_pass_set = free_second_pass_sets[nu_free_second_pass_sets];
+			slot->pops2 = &pops2[slot->second_pass_set * context->nu_islands_second_pass];
+			slot->pass = 2;
+			thread_task_group_submit(group, archipelago_pass_task, slot);
+		}
+		// Assign ready blocks to free first-pass sets.
+		while (!stop && ready_head < ready_tail && nu_free_first_pass_sets > 0 && nu_free_slots > 0) {
+			int block_index = ready_blocks[ready_head++];
+			nu_free_slots--;
+			ArchipelagoSlot *slot = &slots[free_slots[nu_free_slots]];
+			nu_free_first_pass_sets--;
+			slot->first_pass_set = free_first_pass_sets[nu_free_first_pass_sets];
+			slot->pops = &pops[slot->first_pass_set * context->nu_islands];
+			MipmapLevel *level = get_block_level(context, block_index);
+			int i = block_index - level->first_block;
+			slot->level = level;
+			slot->image = level->image;
+			slot->texture = level->texture;
+			slot->block_index = block_index;
+			slot->x = (i % level->blocks_per_row) * texture->block_width;
+			slot->y = (i / level->blocks_per_row) * texture->block_height;
+			set_up_archipelago_block(slot);
+			slot->pass = 1;
+			thread_task_group_submit(group, archipelago_pass_task, slot);
+		}
+		if (nu_free_slots == nu_slots)
+			break;
+		ArchipelagoSlot *slot = &slots[completion_queue_pop(&finished_slots)];
+		BlockUserData *user_data;
+		// Report the best solution.
+		if (slot->pass == 1) {
+			user_data = (BlockUserData *)slot->pops[slot->best_island]->user_data;
 			bool compress_callback;
-			if (isinf(best->fitness))
+			if (isinf(slot->best->fitness))
 				compress_callback = true;
 			else
 				compress_callback = false;
-//			if (texture->get_mode_function != NULL) {
-//				int mode = texture->get_mode_function(best->bitstring);
-//				printf("mode = %d", mode);
-//			}
-//			printf("\n");
-			report_solution(best, (BlockUserData *)pops[best_island]->user_data,
-				pops[best_island]->generation, compress_callback);
-			if (option_verbose >= 2)
-				for (int i = 0; i < nu_islands; i++) {
-					printf("Block %d: ", (y / texture->block_height) * (texture->extended_width /
-						texture->block_width) + (x / texture->block_width));
-					if (texture->type & TEXTURE_TYPE_ETC_BIT) {
-						printf("Modes: ");
-						int modes_allowed = ((BlockUserData *)pops[i]->user_data)->flags;
-						if (modes_allowed & ETC_MODE_ALLOWED_INDIVIDUAL)
-							printf("I");
-						if (modes_allowed & ETC_MODE_ALLOWED_DIFFERENTIAL)
-							printf("D");
-						if (modes_allowed & ETC2_MODE_ALLOWED_T)
-							printf("T");
-						if (modes_allowed & ETC2_MODE_ALLOWED_H)
-							printf("H");
-						if (modes_allowed & ETC2_MODE_ALLOWED_PLANAR)
-							printf("P");
-					}
-					else if (texture->type == TEXTURE_TYPE_BPTC) {
-						printf("Modes: ");
-						int modes_allowed = ((BlockUserData *)pops[i]->user_data)->flags;
-						for (int j = 0; j < 8; j++)
-						if (modes_allowed & (1 << j))
-							printf("%d", j);
-					}
-					FgenIndividual *best = fgen_best_individual_of_population(pops[i]);
-					double rmse = sqrt((1.0 / best->fitness) / 16);
-					printf(" RMSE per pixel: %lf\n", rmse);
-					if (option_verbose >= 3 && rmse >= 1.0) {
-						for (int j = 0; j < pops[i]->size; j++) {
-							FgenIndividual *ind = pops[i]->ind[j];
-							printf("  Individual %d: ", j);
-							if (texture->get_mode_function != NULL) {
-								int mode = texture->get_mode_function(ind->bitstring);
-								printf("Mode: %d ", mode);
-							}
-							printf("RMSE per pixel: %lf\n",
-								sqrt((1.0 / ind->fitness) / 16));
-						}
-					}
-				}
-			if (!isinf(best->fitness)) {
-				// Copy block user_data from first pass.
-				for (int i = 0; i < nu_islands_second_pass; i++) {
-					*(BlockUserData *)pops2[i]->user_data =
-						*(BlockUserData *)pops[best_island]->user_data;
-					// For ETC1, ETC2, BPTC and BPTC_FLOAT, preserve the mode of the compressed
-					// block during the second pass.
-					if ((texture->type & TEXTURE_TYPE_ETC_BIT) ||
-					texture->type == TEXTURE_TYPE_BPTC ||
-					texture->type == TEXTURE_TYPE_BPTC_FLOAT ||
-					texture->type == TEXTURE_TYPE_BPTC_SIGNED_FLOAT) {
-						int mode = texture->get_mode_function(best->bitstring);
-						((BlockUserData *)pops2[i]->user_data)->flags = (1 << mode) |
-							 ENCODE_BIT;
-						set_user_data_block_flags((BlockUserData *)pops2[i]->user_data,
-							texture, block_flags);
-					}
-				}
-				// Run the second pass.
-				nu_concurrent_islands = nu_islands_second_pass;
-				if (option_max_threads != -1 && nu_islands_second_pass > option_max_threads)
-					nu_concurrent_islands = option_max_threads;
-				for (int i = 0; i < nu_islands_second_pass;) {
-					int n;
-					n = nu_concurrent_islands;
-					if (i + n > nu_islands_second_pass)
-						n = nu_islands_second_pass - i;
-					if (n == 1)
-						fgen_run(pops2[i], - 1);
-					else
-						fgen_run_archipelago_threaded(n, &pops2[i], - 1);
-					i += n;
-				}
-				best = fgen_best_individual_and_island_of_archipelago(nu_islands_second_pass, pops2,
-					&best_island);
-				report_solution(best, (BlockUserData *)pops2[best_island]->user_data,
-					pops2[best_island]->generation, true);
+			report_solution(slot->best, user_data, slot->pops[slot->best_island]->generation,
+				compress_callback);
+			if (context->options.verbose >= 2)
+				print_archipelago_island_statistics(slot);
+			if (!compress_callback)
+				save_archipelago_first_pass(slot);
+			free_first_pass_sets[nu_free_first_pass_sets] = slot->first_pass_set;
+			nu_free_first_pass_sets++;
+			if (!compress_callback) {
+				// Queue the second pass.
+				waiting_slots[(waiting_head + nu_waiting_slots) % nu_slots] = slot->index;
+				nu_waiting_slots++;
+				continue;
 			}
-			if (((BlockUserData *)pops[0]->user_data)->stop_signalled)
-				goto end;
 		}
-end :
-	for (int i = 0; i < nu_islands; i++) {
-		free(pops[i]->user_data);
-		fgen_destroy(pops[i]);
+		else {
+			user_data = (BlockUserData *)slot->pops2[slot->best_island]->user_data;
+			report_solution(slot->best, user_data, slot->pops2[slot->best_island]->generation, true);
+			free_second_pass_sets[nu_free_second_pass_sets] = slot->second_pass_set;
+			nu_free_second_pass_sets++;
+		}
+		__atomic_store_n(&slot->level->block_done[slot->block_index - slot->level->first_block], 1,
+			__ATOMIC_RELEASE);
+		if (user_data->stop_signalled)
+			stop = true;
+		// Finish the block and its duplicates.
+		for (int block_index = slot->block_index; block_index >= 0;
+		block_index = context->next_duplicate[block_index]) {
+			if (block_index != slot->block_index)
+				if (report_copied_solution(slot->best, user_data, block_index, 0))
+					stop = true;
+			MipmapLevel *level = get_block_level(context, block_index);
+			int blocks_per_row = level->blocks_per_row;
+			// The blocks to the right and below may have become ready.
+			if ((block_index - level->first_block) % blocks_per_row < blocks_per_row - 1) {
+				nu_unfinished_neighbours[block_index + 1]--;
+				if (nu_unfinished_neighbours[block_index + 1] == 0 &&
+				block_needs_compression(context, block_index + 1))
+					ready_blocks[ready_tail++] = block_index + 1;
+			}
+			if (block_index + blocks_per_row < level->first_block + level->nu_blocks) {
+				nu_unfinished_neighbours[block_index + blocks_per_row]--;
+				if (nu_unfinished_neighbours[block_index + blocks_per_row] == 0 &&
+				block_needs_compression(context, block_index + blocks_per_row))
+					ready_blocks[ready_tail++] = block_index + blocks_per_row;
+			}
+		}
+		free_slots[nu_free_slots] = slot->index;
+		nu_free_slots++;
 	}
-	for (int i = 0; i < nu_islands_second_pass; i++) {
-		free(pops2[i]->user_data);
-		fgen_destroy(pops2[i]);
+	thread_task_group_wait(group);
+
+	thread_task_group_destroy(group);
+	free(ready_blocks);
+	free(nu_unfinished_neighbours);
+	free(waiting_slots);
+	free(free_slots);
+	free(slots);
+	completion_queue_destroy(&finished_slots);
+	free(free_second_pass_sets);
+	free(free_first_pass_sets);
+	release_populations(context, context->nu_islands * nu_first_pass_sets, pops);
+	release_populations(context, context->nu_islands_second_pass * nu_second_pass_sets, pops2);
+	free(pops);
+	free(pops2);
+}
+
+// Work-stealing block scheduler, used to compress multiple blocks concurrently (compression level class 0).
+// Every worker thread owns a population and a deque of blocks. The blocks are distributed over the deques
+// in round-robin raster order so that the workers progress through the image at roughly the same rate. The
+// blocks of all mipmap levels are distributed this way, starting with the largest level. A worker takes
+// blocks from the front of its own deque; when that is empty it steals a block from the back of the deque
+// of another worker, so that there are no barriers and no thread sits idle while blocks are left. The
+// calling thread reports the finished blocks, so that the compress callback function is always
+// called from the same thread.
+
+typedef struct {
+	int *block_index;
+	int head;
+	int tail;
+	pthread_mutex_t mutex;
+} BlockDeque;
+
+typedef struct {
+	BlockUserData user_data;
+	unsigned char bitstring[16];
+	double fitness;
+	int generation;
+} BlockResult;
+
+typedef struct {
+	CompressionContext *context;
+	int nu_workers;
+	int max_generations;
+	BlockDeque *deques;
+	BlockResult *results;
+	CompletionQueue finished_blocks;
+	int stop;
+} BlockScheduler;
+
+typedef struct {
+	BlockScheduler *scheduler;
+	FgenPopulation *pop;
+	int worker_index;
+	unsigned char alpha_pixels[16];
+} BlockWorker;
+
+static int block_deque_pop_front(BlockDeque *deque) {
+	int block_index = - 1;
+	pthread_mutex_lock(&deque->mutex);
+	if (deque->head < deque->tail) {
+		block_index = deque->block_index[deque->head];
+		deque->head++;
+	}
+	pthread_mutex_unlock(&deque->mutex);
+	return block_index;
+}
+
+static int block_deque_pop_back(BlockDeque *deque) {
+	int block_index = - 1;
+	pthread_mutex_lock(&deque->mutex);
+	if (deque->head < deque->tail) {
+		deque->tail--;
+		block_index = deque->block_index[deque->tail];
+	}
+	pthread_mutex_unlock(&deque->mutex);
+	return block_index;
+}
+
+static void block_worker_task(void *task_data) {
+	BlockWorker *worker = (BlockWorker *)task_data;
+	BlockScheduler *scheduler = worker->scheduler;
+	CompressionContext *context = scheduler->context;
+	BlockUserData *user_data = (BlockUserData *)worker->pop->user_data;
+	for (;;) {
+		if (__atomic_load_n(&scheduler->stop, __ATOMIC_ACQUIRE))
+			break;
+		int block_index = block_deque_pop_front(&scheduler->deques[worker->worker_index]);
+		// When the own deque is empty, steal a block from another worker.
+		for (int i = 1; block_index < 0 && i < scheduler->nu_workers; i++)
+			block_index = block_deque_pop_back(&scheduler->deques[(worker->worker_index + i) %
+				scheduler->nu_workers]);
+		if (block_index < 0)
+			break;
+		MipmapLevel *level = get_block_level(context, block_index);
+		Texture *texture = level->texture;
+		int x = ((block_index - level->first_block) % level->blocks_per_row) * texture->block_width;
+		int y = ((block_index - level->first_block) / level->blocks_per_row) * texture->block_height;
+		set_user_data_level(user_data, level);
+		user_data->x_offset = x;
+		user_data->y_offset = y;
+		// For 1-bit alpha texture, prepare the alpha values of the image block for use in the
+		// seeding function.
+		if (texture->type == TEXTURE_TYPE_DXT3 || texture->type == TEXTURE_TYPE_ETC2_PUNCHTHROUGH) {
+			set_alpha_pixels(level->image, x, y, texture->block_width, texture->block_height,
+				worker->alpha_pixels);
+			user_data->alpha_pixels = worker->alpha_pixels;
+		}
+		fgen_run(worker->pop, scheduler->max_generations);
+		FgenIndividual *best = fgen_best_individual_of_population(worker->pop);
+		BlockResult *result = &scheduler->results[block_index];
+		result->user_data = *user_data;
+		memcpy(result->bitstring, best->bitstring, texture->bits_per_block / 8);
+		result->fitness = best->fitness;
+		result->generation = worker->pop->generation;
+		completion_queue_push(&scheduler->finished_blocks, block_index);
+	}
+}
+
+// Compress all blocks of every mipmap level using one worker thread for each of the given populations.
+
+static void compress_blocks_with_work_stealing(CompressionContext *context, int nu_workers, FgenPopulation **pops,
+int max_generations) {
+	int n = context->nu_blocks_total;
+	BlockScheduler scheduler;
+	scheduler.context = context;
+	scheduler.nu_workers = nu_workers;
+	scheduler.max_generations = max_generations;
+	scheduler.deques = (BlockDeque *)malloc(sizeof(BlockDeque) * nu_workers);
+	for (int i = 0; i < nu_workers; i++) {
+		scheduler.deques[i].block_index = (int *)malloc(sizeof(int) * (n / nu_workers + 1));
+		scheduler.deques[i].head = 0;
+		scheduler.deques[i].tail = 0;
+		pthread_mutex_init(&scheduler.deques[i].mutex, NULL);
+	}
+	// Duplicate blocks are not compressed; they are reported together with the block that they are a
+	// duplicate of. Blocks of which the solution is known are reported before the others are compressed.
+	int nu_blocks_to_compress = 0;
+	for (int i = 0; i < n; i++) {
+		if (!block_needs_compression(context, i))
+			continue;
+		BlockDeque *deque = &scheduler.deques[nu_blocks_to_compress % nu_workers];
+		deque->block_index[deque->tail] = i;
+		deque->tail++;
+		nu_blocks_to_compress++;
+	}
+	scheduler.results = (BlockResult *)malloc(sizeof(BlockResult) * n);
+	completion_queue_init(&scheduler.finished_blocks, n);
+	for (int i = 0; i < context->nu_levels; i++)
+		memset(context->levels[i].block_done, 0, context->levels[i].nu_blocks);
+	scheduler.stop = report_known_blocks(context);
+
+	BlockWorker *workers = (BlockWorker *)malloc(sizeof(BlockWorker) * nu_workers);
+	ThreadTaskGroup *group = thread_task_group_create();
+	for (int i = 0; i < nu_workers; i++) {
+		workers[i].scheduler = &scheduler;
+		workers[i].pop = pops[i];
+		workers[i].worker_index = i;
+		thread_task_group_submit(group, block_worker_task, &workers[i]);
 	}
-	if (option_perceptive)
-		free(texture_pixels);
+	// Report the blocks as they are finished.
+	for (int i = 0; i < nu_blocks_to_compress && !scheduler.stop; i++) {
+		int block_index = completion_queue_pop(&scheduler.finished_blocks);
+		BlockResult *result = &scheduler.results[block_index];
+		FgenIndividual best;
+		best.bitstring = result->bitstring;
+		best.fitness = result->fitness;
+		report_solution(&best, &result->user_data, result->generation, true);
+		MipmapLevel *level = get_block_level(context, block_index);
+		__atomic_store_n(&level->block_done[block_index - level->first_block], 1, __ATOMIC_RELEASE);
+		for (int j = context->next_duplicate[block_index]; j >= 0; j = context->next_duplicate[j])
+			if (report_copied_solution(&best, &result->user_data, j, 0))
+				result->user_data.stop_signalled = 1;
+		if (result->user_data.stop_signalled) {
+			__atomic_store_n(&scheduler.stop, 1, __ATOMIC_RELEASE);
+			break;
+		}
+	}
+	thread_task_group_wait(group);
+
+	thread_task_group_destroy(group);
+	free(workers);
+	completion_queue_destroy(&scheduler.finished_blocks);
+	free(scheduler.results);
+	for (int i = 0; i < nu_workers; i++) {
+		pthread_mutex_destroy(&scheduler.deques[i].mutex);
+		free(scheduler.deques[i].block_index);
+	}
+	free(scheduler.deques);
 }
 
 // Compress multiple blocks concurrently. Used by --ultra setting. Note that larger population size used in this case.
 
-static void compress_multiple_blocks_concurrently(Image *image, Texture *texture) {
-	unsigned char *alpha_pixels = (unsigned char *)alloca(texture->block_width * texture->block_height * nu_islands);
-	if (option_generations != - 1)
-		nu_generations = option_generations;
-	if (option_islands != - 1)
-		nu_islands = option_islands;
-	FgenPopulation **pops = (FgenPopulation **)alloca(sizeof(FgenPopulation *) * nu_islands);
-	if (!option_quiet)
+static void compress_multiple_blocks_concurrently(CompressionContext *context) {
+	Texture *texture = context->levels[0].texture;
+	if (context->options.generations != - 1)
+		context->nu_generations = context->options.generations;
+	if (context->options.islands != - 1)
+		context->nu_islands = context->options.islands;
+	int nu_workers = context->nu_islands;
+	// Workers that do not have a thread of their own would only start when the others are done, and then
+	// take blocks out of raster order, so that neighbouring blocks are not available for seeding.
+	if (nu_workers > get_number_of_threads(context))
+		nu_workers = get_number_of_threads(context);
+	FgenPopulation **pops = (FgenPopulation **)alloca(sizeof(FgenPopulation *) * nu_workers);
+	if (!context->options.quiet)
 		printf("Running single GA for each pixel block, %d concurrently, population size %d, "
 			"%d generations, non-perceptive quality strategy.\n",
-			nu_islands, population_size, nu_generations);
-	for (int i = 0; i < nu_islands; i++) {
-		pops[i] = fgen_create(
-			population_size,		// Population size.
-			texture->bits_per_block,	// Number of bits.
-			1,				// Data element size.
-			generation_callback,
-			calculate_fitness,
-			seed2,
-			fgen_mutation_per_bit_fast,
-			fgen_crossover_uniform_per_bit
-			);
+			nu_workers, context->population_size, context->nu_generations);
+	for (int i = 0; i < nu_workers; i++) {
+		pops[i] = get_population(context, context->population_size, texture->bits_per_block,
+			generation_callback, seed2);
 		fgen_set_parameters(
 			pops[i],
 			FGEN_ELITIST_SUS,
 			FGEN_SUBTRACT_MIN_FITNESS,
-			crossover_probability,	// Crossover prob.
-			mutation_probability,	// Mutation prob. per bit
+			context->crossover_probability,	// Crossover prob.
+			context->mutation_probability,	// Mutation prob. per bit
 			0		// Macro-mutation prob.
 			);
-		fgen_set_generation_callback_interval(pops[i], nu_generations);
-		fgen_set_migration_interval(pops[i], 0);	// No migration.
-		fgen_set_migration_probability(pops[i], 0.01);
-		pops[i]->user_data = (BlockUserData *)malloc(sizeof(BlockUserData));
-		set_user_data((BlockUserData *)pops[i]->user_data, image, texture, 1);
+		fgen_set_generation_callback_interval(pops[i], context->nu_generations);
+		set_user_data(context, (BlockUserData *)pops[i]->user_data, &context->levels[0], 1);
 		if (texture->type == TEXTURE_TYPE_ETC2_RGB8 || texture->type == TEXTURE_TYPE_ETC2_EAC)
-			if (option_allowed_modes_etc2 != - 1)
+			if (context->options.allowed_modes_etc2 != - 1)
 				((BlockUserData *)pops[i]->user_data)->flags =
-					option_allowed_modes_etc2 | ENCODE_BIT;
-	}
-	if (!option_deterministic)
-		fgen_random_seed_with_timer(fgen_get_rng(pops[0]));
-	// Calculate the number of full archipelagos of nu_islands that fit on each each row.
-	int nu_full_archipelagos_per_row = image->extended_width / (nu_islands * texture->block_width);
-	int x_marker = nu_full_archipelagos_per_row * nu_islands * texture->block_width;
-	for (int y = 0; y < image->extended_height; y += texture->block_height) {
-		// Handle nu_islands horizontal blocks at a time.
-		for (int x = 0; x < x_marker; x+= nu_islands * texture->block_width) {
-			for (int i = 0; i < nu_islands; i++) {
-				BlockUserData *user_data = (BlockUserData *)pops[i]->user_data;
-				user_data->x_offset = x + i * texture->block_width;
-				user_data->y_offset = y;
-				// For 1-bit alpha texture, prepare the alpha values of the image block for use in the
-				// seeding function.
-				if (texture->type == TEXTURE_TYPE_DXT3 ||
-				texture->type == TEXTURE_TYPE_ETC2_PUNCHTHROUGH) {
-					set_alpha_pixels(image, x + i * texture->block_width, y, texture->block_width,
-						texture->block_height, &alpha_pixels[i * 16]);
-					user_data->alpha_pixels = &alpha_pixels[i * 16];
-				}
-			}
-			// Run with a seperate population on each island for different blocks.
-			int nu_concurrent_islands = nu_islands;
-			if (option_max_threads != -1 && nu_islands > option_max_threads)
-				nu_concurrent_islands = option_max_threads;
-			for (int i = 0; i < nu_islands;) {
-				int n;
-				n = nu_concurrent_islands;
-				if (i + n > nu_islands)
-					n = nu_islands - i;
-				if (n == 1)
-					fgen_run(pops[i], nu_generations_second_pass);
-				else
-					fgen_run_archipelago_threaded(n, &pops[i], nu_generations_second_pass);
-				i += n;
-			}
-			for (int i = 0; i < nu_islands; i++) {
-				FgenIndividual *best = fgen_best_individual_of_population(pops[i]);
-				report_solution(best, (BlockUserData *)pops[i]->user_data, pops[i]->generation, true);
-				if (((BlockUserData *)pops[i]->user_data)->stop_signalled)
-					goto end;
-			}
-		}
-		// Handle the remaining blocks on the row.
-		int nu_blocks_left = (image->extended_width - x_marker + texture->block_width - 1) / texture->block_width;
-		int x = x_marker;
-		for (int i = 0; i < nu_blocks_left; i++) {
-			BlockUserData *user_data = (BlockUserData *)pops[i]->user_data;
-			user_data->x_offset = x + i * texture->block_width;
-			user_data->y_offset = y;
-			// For 1-bit alpha texture, prepare the alpha values of the image block for use in the
-			// seeding function.
-			if (texture->type == TEXTURE_TYPE_DXT3 || texture->type == TEXTURE_TYPE_ETC2_PUNCHTHROUGH) {
-				set_alpha_pixels(image, x + i * texture->block_width, y, texture->block_width,
-					texture->block_height, &alpha_pixels[i * texture->block_width *
-					texture->block_height]);
-				user_data->alpha_pixels = &alpha_pixels[i * texture->block_width * texture->block_height];
-			}
-		}
-		if (nu_blocks_left > 0) {
-			if (nu_blocks_left > 1)
-				fgen_run_archipelago_threaded(nu_blocks_left, pops, - 1);
-			else
-				fgen_run(pops[0], - 1);
-		}
-		for (int i = 0; i < nu_blocks_left; i++) {
-			FgenIndividual *best = fgen_best_individual_of_population(pops[i]);
-			report_solution(best, (BlockUserData *)pops[i]->user_data, pops[i]->generation, true);
-			if (((BlockUserData *)pops[i]->user_data)->stop_signalled)
-				goto end;
-		}
-	}
-end :
-	for (int i = 0; i < nu_islands; i++) {
-		free(pops[i]->user_data);
-		fgen_destroy(pops[i]);
+					context->options.allowed_modes_etc2 | ENCODE_BIT;
 	}
+	seed_population_rngs(context, nu_workers, pops);
+	compress_blocks_with_work_stealing(context, nu_workers, pops, context->nu_generations_second_pass);
+	release_populations(context, nu_workers, pops);
 }
 
 // Perform the second-pass, processing multiple blocks concurrently, for ultra-class quality level.
 // Expectes mutation_probability_second_pass and nu_generations_second_pass to be predefined.
 
-static void compress_multiple_blocks_concurrently_second_pass(Image *image, Texture *texture) {
-	int nu_islands_second_pass = 8;
-	unsigned char *alpha_pixels = (unsigned char *)alloca(texture->block_width * texture->block_height *
-		nu_islands_second_pass);
-	FgenPopulation **pops = (FgenPopulation **)alloca(sizeof(FgenPopulation *) * nu_islands_second_pass);
-	if (!option_quiet)
+static void compress_multiple_blocks_concurrently_second_pass(CompressionContext *context) {
+	Texture *texture = context->levels[0].texture;
+	int nu_workers = context->nu_islands_second_pass;
+	// Workers that do not have a thread of their own would only start when the others are done, and then
+	// take blocks out of raster order, so that neighbouring blocks are not available for seeding.
+	if (nu_workers > get_number_of_threads(context))
+		nu_workers = get_number_of_threads(context);
+	FgenPopulation **pops = (FgenPopulation **)alloca(sizeof(FgenPopulation *) * nu_workers);
+	if (!context->options.quiet)
 		printf("Running second pass GA for each pixel block, %d concurrently, population size 8, "
-			"%d generations.\n", nu_islands_second_pass, nu_generations_second_pass);
-	for (int i = 0; i < nu_islands_second_pass; i++) {
-		pops[i] = fgen_create(
-			8,				// Population size.
-			texture->bits_per_block,	// Number of bits.
-			1,				// Data element size.
-			generation_callback_second_pass,
-			calculate_fitness,
-			seed_second_pass,
-			fgen_mutation_per_bit_fast,
-			fgen_crossover_uniform_per_bit
-			);
+			"%d generations.\n", nu_workers, context->nu_generations_second_pass);
+	for (int i = 0; i < nu_workers; i++) {
+		pops[i] = get_population(context, 8, texture->bits_per_block, generation_callback_second_pass,
+			seed_second_pass);
 		fgen_set_parameters(
 			pops[i],
 			FGEN_ELITIST_SUS,
 			FGEN_SUBTRACT_MIN_FITNESS,
 			0,					// Crossover prob.
-			mutation_probability_second_pass,	// Mutation prob. per bit
+			context->mutation_probability_second_pass,	// Mutation prob. per bit
 			0		// Macro-mutation prob.
 			);
-		fgen_set_generation_callback_interval(pops[i], nu_generations_second_pass);
-		fgen_set_migration_interval(pops[i], 0);	// No migration.
-		fgen_set_migration_probability(pops[i], 0.01);
+		fgen_set_generation_callback_interval(pops[i], context->nu_generations_second_pass);
 //		fgen_set_number_of_elites(pops[i], population_size / 2);
-		pops[i]->user_data = (BlockUserData *)malloc(sizeof(BlockUserData));
-		set_user_data((BlockUserData *)pops[i]->user_data, image, texture, 2);
+		set_user_data(context, (BlockUserData *)pops[i]->user_data, &context->levels[0], 2);
 		if (texture->type == TEXTURE_TYPE_ETC2_RGB8 || texture->type == TEXTURE_TYPE_ETC2_EAC)
-			if (option_allowed_modes_etc2 != - 1)
+			if (context->options.allowed_modes_etc2 != - 1)
 				((BlockUserData *)pops[i]->user_data)->flags =
-					option_allowed_modes_etc2 | ENCODE_BIT;
+					context->options.allowed_modes_etc2 | ENCODE_BIT;
 	}
-	if (!option_deterministic)
+	seed_population_rngs(context, nu_workers, pops);
+	compress_blocks_with_work_stealing(context, nu_workers, pops, context->nu_generations_second_pass);
+	release_populations(context, nu_workers, pops);
+}
+
+// Seed the random number generators of populations that are run independently from each other. The
+// generators of the other populations are seeded from the generator of the first one.
+
+static void seed_population_rngs(CompressionContext *context, int nu_pops, FgenPopulation **pops) {
+	if (nu_pops <= 0)
+		return;
+	if (!context->options.deterministic)
 		fgen_random_seed_with_timer(fgen_get_rng(pops[0]));
-	// Calculate the number of full archipelagos of nu_islands_second_pass that fit on each each row.
-	int nu_full_archipelagos_per_row = image->extended_width / (nu_islands * texture->block_width);
-	int x_marker = nu_full_archipelagos_per_row * nu_islands_second_pass * texture->block_width;
-	for (int y = 0; y < image->extended_height; y += texture->block_height) {
-		// Handle nu_islands_second_pass horizontal blocks at a time.
-		for (int x = 0; x < x_marker; x+= nu_islands_second_pass * texture->block_width) {
-			for (int i = 0; i < nu_islands_second_pass; i++) {
-				BlockUserData *user_data = (BlockUserData *)pops[i]->user_data;
-				user_data->x_offset = x + i * texture->block_width;
-				user_data->y_offset = y;
-				// For 1-bit alpha texture, prepare the alpha values of the image block for use in the
-				// seeding function.
-				if (texture->type == TEXTURE_TYPE_DXT3 ||
-				texture->type == TEXTURE_TYPE_ETC2_PUNCHTHROUGH) {
-					set_alpha_pixels(image, x + i * texture->block_width, y, texture->block_width,
-						texture->block_height, &alpha_pixels[i * 16]);
-					user_data->alpha_pixels = &alpha_pixels[i * 16];
-				}
-			}
-			// Run with a seperate population on each island for different blocks.
-			int nu_concurrent_islands = nu_islands_second_pass;
-			if (option_max_threads != -1 && nu_islands_second_pass > option_max_threads)
-				nu_concurrent_islands = option_max_threads;
-			for (int i = 0; i < nu_islands_second_pass;) {
-				int n;
-				n = nu_concurrent_islands;
-				if (i + n > nu_islands_second_pass)
-					n = nu_islands_second_pass - i;
-				fgen_run_archipelago_threaded(n, &pops[i], nu_generations_second_pass);
-				i += n;
-			}
-			for (int i = 0; i < nu_islands_second_pass; i++) {
-				FgenIndividual *best = fgen_best_individual_of_population(pops[i]);
-				report_solution(best, (BlockUserData *)pops[i]->user_data, pops[i]->generation, true);
-				if (((BlockUserData *)pops[i]->user_data)->stop_signalled)
-					goto end;
-			}
-		}
-		// Handle the remaining blocks on the row.
-		int nu_blocks_left = (image->extended_width - x_marker + texture->block_width - 1) / texture->block_width;
-		int x = x_marker;
-		for (int i = 0; i < nu_blocks_left; i++) {
-			BlockUserData *user_data = (BlockUserData *)pops[i]->user_data;
-			user_data->x_offset = x + i * texture->block_width;
-			user_data->y_offset = y;
-			// For 1-bit alpha texture, prepare the alpha values of the image block for use in the
-			// seeding function.
-			if (texture->type == TEXTURE_TYPE_DXT3 || texture->type == TEXTURE_TYPE_ETC2_PUNCHTHROUGH) {
-				set_alpha_pixels(image, x + i * texture->block_width, y, texture->block_width,
-					texture->block_height, &alpha_pixels[i * texture->block_width *
-					texture->block_height]);
-				user_data->alpha_pixels = &alpha_pixels[i * texture->block_width * texture->block_height];
-			}
-		}
-		if (nu_blocks_left > 0) {
-			if (nu_blocks_left > 1)
-				fgen_run_archipelago_threaded(nu_blocks_left, pops, - 1);
-			else
-				fgen_run(pops[0], - 1);
-		}
-		for (int i = 0; i < nu_blocks_left; i++) {
-			FgenIndividual *best = fgen_best_individual_of_population(pops[i]);
-			report_solution(best, (BlockUserData *)pops[i]->user_data, pops[i]->generation, true);
-			if (((BlockUserData *)pops[i]->user_data)->stop_signalled)
-				goto end;
-		}
+	for (int i = 1; i < nu_pops; i++)
+		fgen_random_seed_rng(fgen_get_rng(pops[i]), fgen_random_n(fgen_get_rng(pops[0]), 0x40000000));
+}
+
+// Return the number of threads that a compression uses, which is limited by the --maxthreads option also when
+// an earlier compression made the thread pool larger.
+
+static int get_number_of_threads(CompressionContext *context) {
+	int n = thread_pool_get_number_of_threads();
+	if (context->options.max_threads > 0 && n > context->options.max_threads)
+		n = context->options.max_threads;
+	return n;
+}
+
+// Run the given populations concurrently on the thread pool until each of them signals a stop. At most as many
+// tasks are submitted as the compression uses threads; a task runs its populations one after the other.
+
+typedef struct {
+	FgenPopulation **pops;
+	int nu_pops;
+	int first;
+	int stride;
+} PopulationTask;
+
+static void run_population_task(void *task_data) {
+	PopulationTask *task = (PopulationTask *)task_data;
+	for (int i = task->first; i < task->nu_pops; i += task->stride)
+		fgen_run(task->pops[i], - 1);
+}
+
+static void run_populations_concurrently(CompressionContext *context, int nu_pops, FgenPopulation **pops) {
+	int nu_tasks = get_number_of_threads(context);
+	if (nu_tasks > nu_pops)
+		nu_tasks = nu_pops;
+	if (nu_tasks <= 1) {
+		for (int i = 0; i < nu_pops; i++)
+			fgen_run(pops[i], - 1);
+		return;
 	}
-end :
-	for (int i = 0; i < nu_islands_second_pass; i++) {
-		free(pops[i]->user_data);
-		fgen_destroy(pops[i]);
+	PopulationTask *tasks = (PopulationTask *)alloca(sizeof(PopulationTask) * nu_tasks);
+	ThreadTaskGroup *group = thread_task_group_create();
+	for (int i = 0; i < nu_tasks; i++) {
+		tasks[i].pops = pops;
+		tasks[i].nu_pops = nu_pops;
+		tasks[i].first = i;
+		tasks[i].stride = nu_tasks;
+		thread_task_group_submit(group, run_population_task, &tasks[i]);
 	}
+	thread_task_group_wait(group);
+	thread_task_group_destroy(group);
 }
 
 // Copy the alpha pixel values of a block into an array.
@@ -1557,14 +2814,558 @@ unsigned int *colors) {
 		}
 	if (block_flags & BLOCK_FLAG_TWO_COLORS) {
 		colors[0] = color0;
-		if (color1 == - 1)
+		if (color1 == - 1) {
 			colors[1] = colors[0];
+			block_flags |= BLOCK_FLAG_ONE_COLOR;
+		}
 		else
 			colors[1] = color1;
 	}
 	return block_flags;
 }
 
+// Return the block flags of a block for the texture formats that use them, and set the alpha pixels and colors
+// of the block. For other formats, zero is returned.
+
+static int get_block_flags(Image *image, Texture *texture, int x, int y, unsigned char *alpha_pixels,
+unsigned int *colors) {
+	if ((texture->type & (TEXTURE_TYPE_DXTC_BIT | TEXTURE_TYPE_ALPHA_BIT)) ==
+	(TEXTURE_TYPE_DXTC_BIT | TEXTURE_TYPE_ALPHA_BIT) || texture->type == TEXTURE_TYPE_ETC2_EAC ||
+	texture->type == TEXTURE_TYPE_ETC2_PUNCHTHROUGH || texture->type == TEXTURE_TYPE_BPTC)
+		// Get early parameters for block (whether it is completely opaque or non-opaque,
+		// whether it uses only a limited amount of colors), and set alpha pixels.
+		return get_block_flags_rgba8(image, x, y, texture->block_width, texture->block_height,
+			alpha_pixels, colors);
+	return 0;
+}
+
+// Return a pointer to the source pixels of a block and the row stride of the image in 32-bit words, and set
+// the size of the part of the block that lies within the image in 32-bit words and rows. The comparison
+// functions only use that part of a block on the border of the image, and the image is not necessarily
+// extended beyond it.
+
+static unsigned int *get_block_source_pixels(CompressionContext *context, int block_index, int *rowstride,
+int *words_per_row, int *nu_rows) {
+	MipmapLevel *level = get_block_level(context, block_index);
+	Image *image = level->image;
+	Texture *texture = level->texture;
+	int i = block_index - level->first_block;
+	int x = (i % level->blocks_per_row) * texture->block_width;
+	int y = (i / level->blocks_per_row) * texture->block_height;
+	int words_per_pixel = 1;
+	if (image->is_half_float)
+		words_per_pixel = 2;	// 64-bit pixels
+	int w = texture->block_width;
+	if (x + w > image->width)
+		w = image->width - x;
+	*nu_rows = texture->block_height;
+	if (y + *nu_rows > image->height)
+		*nu_rows = image->height - y;
+	*words_per_row = w * words_per_pixel;
+	*rowstride = image->extended_width * words_per_pixel;
+	return image->pixels + (y * image->extended_width + x) * words_per_pixel;
+}
+
+// Find the blocks of all mipmap levels that have the same source pixels and block flags as an earlier block.
+// The comparison functions only use the source pixels of a block, so a block is compressed to the same
+// solution as any block that is identical to it; only the first one of them is compressed, and the solution
+// is copied to the others when it is final. Blocks on the border of the image are only identical to blocks
+// with the same part within the image. A duplicate always has a higher block index than the
+// first block, so that it can not be a neighbour that the first block has to wait for.
+
+static void find_duplicate_blocks(CompressionContext *context) {
+	int n = context->nu_blocks_total;
+	Texture *texture = context->levels[0].texture;
+	context->duplicate_of = (int *)malloc(sizeof(int) * n);
+	context->next_duplicate = (int *)malloc(sizeof(int) * n);
+	context->nu_unique_blocks = 0;
+	unsigned int *hash = (unsigned int *)malloc(sizeof(unsigned int) * n);
+	int *block_flags = (int *)malloc(sizeof(int) * n);
+	int *last_duplicate = (int *)malloc(sizeof(int) * n);
+	// Open addressing hash table of the unique blocks found so far, with a load factor of at most 0.5.
+	int table_size = 1;
+	while (table_size < n * 2)
+		table_size *= 2;
+	int *table = (int *)malloc(sizeof(int) * table_size);
+	for (int i = 0; i < table_size; i++)
+		table[i] = - 1;
+	for (int i = 0; i < context->nu_levels; i++) {
+		MipmapLevel *level = &context->levels[i];
+		for (int j = 0; j < level->nu_blocks; j++) {
+			int block_index = level->first_block + j;
+			unsigned char alpha_pixels[16];
+			unsigned int colors[2];
+			block_flags[block_index] = get_block_flags(level->image, level->texture,
+				(j % level->blocks_per_row) * texture->block_width,
+				(j / level->blocks_per_row) * texture->block_height, alpha_pixels, colors);
+			int rowstride, words_per_row, nu_rows;
+			unsigned int *pixels = get_block_source_pixels(context, block_index, &rowstride, &words_per_row,
+				&nu_rows);
+			// FNV-1a hash of the pixel words, the size and the block flags.
+			unsigned int h = 2166136261u;
+			for (int y = 0; y < nu_rows; y++)
+				for (int x = 0; x < words_per_row; x++)
+					h = (h ^ pixels[y * rowstride + x]) * 16777619u;
+			h = (h ^ (words_per_row << 8 | nu_rows)) * 16777619u;
+			h = (h ^ block_flags[block_index]) * 16777619u;
+			hash[block_index] = h;
+			context->duplicate_of[block_index] = block_index;
+			context->next_duplicate[block_index] = - 1;
+			int k = h & (table_size - 1);
+			for (; table[k] >= 0; k = (k + 1) & (table_size - 1)) {
+				int first = table[k];
+				if (hash[first] != h || block_flags[first] != block_flags[block_index])
+					continue;
+				int first_rowstride, first_words_per_row, first_nu_rows;
+				unsigned int *first_pixels = get_block_source_pixels(context, first, &first_rowstride,
+					&first_words_per_row, &first_nu_rows);
+				if (first_words_per_row != words_per_row || first_nu_rows != nu_rows)
+					continue;
+				int y;
+				for (y = 0; y < nu_rows; y++)
+					if (memcmp(&pixels[y * rowstride], &first_pixels[y * first_rowstride],
+					words_per_row * 4) != 0)
+						break;
+				if (y < nu_rows)
+					continue;
+				context->duplicate_of[block_index] = first;
+				context->next_duplicate[last_duplicate[first]] = block_index;
+				last_duplicate[first] = block_index;
+				break;
+			}
+			if (context->duplicate_of[block_index] == block_index) {
+				table[k] = block_index;
+				last_duplicate[block_index] = block_index;
+				context->nu_unique_blocks++;
+			}
+		}
+	}
+	free(table);
+	free(last_duplicate);
+	free(block_flags);
+	free(hash);
+}
+
+static void add_to_block_cache_key(uint64_t *key, unsigned int word) {
+	key[0] = (key[0] ^ word) * 0x100000001B3ULL;
+	key[1] = (key[1] + word) * 0x9E3779B97F4A7C15ULL;
+	key[1] ^= key[1] >> 29;
+}
+
+// Return whether the block cache is used. With the perceptive quality strategy, the fitness of a block depends on
+// the decompressed blocks to the left and above, so solutions found for another image cannot be compared with it
+// and the block cache is not used.
+
+static bool block_cache_usable(CompressionContext *context, Texture *texture) {
+	return context->block_cache != NULL && !(context->options.perceptive &&
+		context->options.compression_level >= COMPRESSION_LEVEL_CLASS_1 &&
+		texture->perceptive_comparison_function != NULL);
+}
+
+// Calculate the key of a block in the block cache from the source pixels and block flags of the block, the
+// texture type and the parameters of the compression that affect the solution, including the genetic operators
+// and the genetic algorithm engine, which find different solutions.
+
+#ifdef TEXGENPACK_BUILTIN_GA
+#define BLOCK_CACHE_GA_ENGINE	1
+#else
+#define BLOCK_CACHE_GA_ENGINE	0
+#endif
+
+static void get_block_cache_key(CompressionContext *context, int block_index, uint64_t *key) {
+	MipmapLevel *level = get_block_level(context, block_index);
+	Image *image = level->image;
+	Texture *texture = level->texture;
+	int i = block_index - level->first_block;
+	int x = (i % level->blocks_per_row) * texture->block_width;
+	int y = (i / level->blocks_per_row) * texture->block_height;
+	unsigned int mutation_probability, crossover_probability;
+	memcpy(&mutation_probability, &context->mutation_probability, 4);
+	memcpy(&crossover_probability, &context->crossover_probability, 4);
+	unsigned char alpha_pixels[16];
+	unsigned int colors[2];
+	unsigned int parameters[16] = {
+		texture->type,
+		context->options.compression_level,
+		context->options.modal_etc2,
+		context->options.allowed_modes_etc2,
+		context->options.hdr,
+		context->options.evolve_pixel_indices,
+		context->levels[0].texture->get_fields_function != NULL,
+		BLOCK_CACHE_GA_ENGINE,
+		context->population_size,
+		context->nu_generations,
+		context->nu_generations_second_pass,
+		context->nu_islands,
+		context->nu_islands_second_pass,
+		mutation_probability,
+		crossover_probability,
+		get_block_flags(image, texture, x, y, alpha_pixels, colors)
+	};
+	key[0] = 0xCBF29CE484222325ULL;
+	key[1] = 0;
+	for (int j = 0; j < 16; j++)
+		add_to_block_cache_key(key, parameters[j]);
+	int rowstride, words_per_row, nu_rows;
+	unsigned int *pixels = get_block_source_pixels(context, block_index, &rowstride, &words_per_row, &nu_rows);
+	add_to_block_cache_key(key, words_per_row << 8 | nu_rows);
+	for (int by = 0; by < nu_rows; by++)
+		for (int bx = 0; bx < words_per_row; bx++)
+			add_to_block_cache_key(key, pixels[by * rowstride + bx]);
+}
+
+// Set the auxilliary data for calculating the fitness of a compressed block for a block outside of the genetic
+// algorithm.
+
+static void set_single_block_user_data(CompressionContext *context, int block_index, BlockUserData *user_data) {
+	MipmapLevel *level = get_block_level(context, block_index);
+	Texture *texture = level->texture;
+	int i = block_index - level->first_block;
+	int x = (i % level->blocks_per_row) * texture->block_width;
+	int y = (i / level->blocks_per_row) * texture->block_height;
+	unsigned char alpha_pixels[16];
+	unsigned int colors[2];
+	set_user_data(context, user_data, level, 1);
+	set_user_data_block_flags(user_data, texture, get_block_flags(level->image, texture, x, y, alpha_pixels,
+		colors));
+	if ((texture->type & TEXTURE_TYPE_ETC_BIT) && context->options.allowed_modes_etc2 != - 1)
+		user_data->flags = context->options.allowed_modes_etc2 | ENCODE_BIT;
+	user_data->x_offset = x;
+	user_data->y_offset = y;
+	user_data->texture_pixels = NULL;
+	user_data->texture_pixels_above = NULL;
+	user_data->texture_pixels_left = NULL;
+}
+
+// Make a compressed block the solution of a block that is known before compression starts, if it is valid for
+// the block. Returns whether it is valid.
+
+static bool set_known_block(CompressionContext *context, int block_index, const unsigned char *bitstring) {
+	BlockUserData user_data;
+	set_single_block_user_data(context, block_index, &user_data);
+	double fitness = calculate_block_fitness(&user_data, bitstring);
+	if (fitness <= 0)
+		return false;
+	MipmapLevel *level = get_block_level(context, block_index);
+	Texture *texture = level->texture;
+	memcpy(&texture->pixels[(block_index - level->first_block) * (texture->bits_per_block / 32)], bitstring,
+		texture->bits_per_block / 8);
+	context->known_fitness[block_index] = fitness;
+	return true;
+}
+
+// Encode the blocks of which the pixels that are not completely transparent have only one color (or two colors
+// for some formats) directly with the encoder for such blocks of the texture format, instead of with the genetic
+// algorithm. The encoding is only used when it is valid for the block.
+
+static void encode_trivial_blocks(CompressionContext *context) {
+	Texture *texture = context->levels[0].texture;
+	if (context->levels[0].image->is_half_float || (texture->type & TEXTURE_TYPE_16_BIT_COMPONENTS_BIT) ||
+	texture->block_width != 4 || texture->block_height != 4)
+		return;
+	int nu_trivial_blocks = 0;
+	for (int i = 0; i < context->nu_blocks_total; i++) {
+		if (!block_needs_compression(context, i))
+			continue;
+		// Get the pixels of the block. The pixels of a block on the border that lie outside the image get the
+		// value of the first pixel, so that they don't add a color.
+		int rowstride, words_per_row, nu_rows;
+		unsigned int *source_pixels = get_block_source_pixels(context, i, &rowstride, &words_per_row, &nu_rows);
+		unsigned int pixels[16];
+		for (int y = 0; y < 4; y++)
+			for (int x = 0; x < 4; x++)
+				if (y < nu_rows && x < words_per_row)
+					pixels[y * 4 + x] = source_pixels[y * rowstride + x];
+				else
+					pixels[y * 4 + x] = source_pixels[0];
+		BlockUserData user_data;
+		set_single_block_user_data(context, i, &user_data);
+		unsigned char bitstring[16];
+		int r;
+		switch (texture->type) {
+		case TEXTURE_TYPE_DXT1 :
+		case TEXTURE_TYPE_DXT1A :
+		case TEXTURE_TYPE_DXT3 :
+		case TEXTURE_TYPE_DXT5 :
+			r = encode_trivial_block4x4_dxtc(pixels, texture->type, user_data.flags, bitstring);
+			break;
+		case TEXTURE_TYPE_ETC1 :
+		case TEXTURE_TYPE_ETC2_RGB8 :
+		case TEXTURE_TYPE_ETC2_EAC :
+		case TEXTURE_TYPE_ETC2_PUNCHTHROUGH :
+			r = encode_trivial_block4x4_etc(pixels, texture->type, user_data.flags, bitstring);
+			break;
+		case TEXTURE_TYPE_BPTC :
+			r = encode_trivial_block4x4_bptc(pixels, user_data.flags, bitstring);
+			break;
+		case TEXTURE_TYPE_RGTC1 :
+		case TEXTURE_TYPE_RGTC2 :
+			r = encode_trivial_block4x4_rgtc(pixels, texture->type, bitstring);
+			break;
+		default :
+			return;
+		}
+		if (r && set_known_block(context, i, bitstring))
+			nu_trivial_blocks++;
+	}
+	if (!context->options.quiet && nu_trivial_blocks > 0)
+		printf("%d blocks with only one or two colors encoded directly.\n", nu_trivial_blocks);
+}
+
+// For ETC2 RGB8 and ETC2 EAC, encode the blocks of which the least-squares planar mode encoding already meets
+// the RMSE threshold directly in planar mode, instead of with the genetic algorithm. This is the case for smooth
+// gradients. For ETC2 EAC, only blocks with alpha values that can be represented exactly are encoded this way.
+
+static void encode_planar_blocks(CompressionContext *context) {
+	Texture *texture = context->levels[0].texture;
+	if (context->levels[0].image->is_half_float || (texture->type != TEXTURE_TYPE_ETC2_RGB8 &&
+	texture->type != TEXTURE_TYPE_ETC2_EAC))
+		return;
+	int nu_planar_blocks = 0;
+	for (int i = 0; i < context->nu_blocks_total; i++) {
+		if (!block_needs_compression(context, i))
+			continue;
+		BlockUserData user_data;
+		set_single_block_user_data(context, i, &user_data);
+		if (!(user_data.flags & ETC2_MODE_ALLOWED_PLANAR))
+			return;
+		unsigned int pixels[16];
+		int w, h;
+		get_user_data_block_pixels(&user_data, pixels, &w, &h);
+		unsigned char bitstring[16];
+		if (!encode_planar_block4x4_etc2(pixels, w, h, texture->type, bitstring))
+			continue;
+		double fitness = calculate_block_fitness(&user_data, bitstring);
+		if (fitness <= 0 || sqrt((1.0 / fitness) / 16) >= context->rmse_threshold)
+			continue;
+		if (set_known_block(context, i, bitstring))
+			nu_planar_blocks++;
+	}
+	if (!context->options.quiet && nu_planar_blocks > 0)
+		printf("%d blocks with a smooth gradient encoded directly in planar mode.\n", nu_planar_blocks);
+}
+
+// For BPTC, encode the blocks that are not opaque of which the direct encoding in one of the modes with a single
+// subset (4, 5 and 6) already meets the RMSE threshold in that mode, instead of with the genetic algorithm. This
+// is the case for smooth gradients in color or in alpha.
+
+static void encode_single_subset_bptc_blocks(CompressionContext *context) {
+	Texture *texture = context->levels[0].texture;
+	if (context->levels[0].image->is_half_float || texture->type != TEXTURE_TYPE_BPTC)
+		return;
+	int nu_single_subset_blocks = 0;
+	for (int i = 0; i < context->nu_blocks_total; i++) {
+		if (!block_needs_compression(context, i))
+			continue;
+		BlockUserData user_data;
+		set_single_block_user_data(context, i, &user_data);
+		if (user_data.flags & MODES_ALLOWED_OPAQUE_ONLY)
+			continue;
+		unsigned int pixels[16];
+		int w, h;
+		get_user_data_block_pixels(&user_data, pixels, &w, &h);
+		unsigned char best_bitstring[16];
+		double best_fitness = 0;
+		for (int mode = 4; mode <= 6; mode++) {
+			unsigned char bitstring[16];
+			encode_single_subset_block4x4_bptc(pixels, w, h, mode, bitstring);
+			double fitness = calculate_block_fitness(&user_data, bitstring);
+			if (fitness > best_fitness) {
+				best_fitness = fitness;
+				memcpy(best_bitstring, bitstring, 16);
+			}
+		}
+		if (best_fitness <= 0 || sqrt((1.0 / best_fitness) / 16) >= context->rmse_threshold)
+			continue;
+		if (set_known_block(context, i, best_bitstring))
+			nu_single_subset_blocks++;
+	}
+	if (!context->options.quiet && nu_single_subset_blocks > 0)
+		printf("%d blocks encoded directly in a mode with a single subset.\n", nu_single_subset_blocks);
+}
+
+// Encode the components that are compressed with their own endpoints or base codeword, independently of the
+// other components, with the exhaustive encoders that give the smallest possible error. Unsigned RGTC1 and RGTC2
+// blocks are encoded completely this way, instead of with the genetic algorithm. For DXT5 and ETC2 EAC, when the
+// pixel indices are calculated, the alpha part of every block that is compressed is calculated here, so that the
+// genetic algorithm only has to optimize the color part.
+
+static void encode_optimal_components(CompressionContext *context) {
+	Texture *texture = context->levels[0].texture;
+	context->optimal_alpha_blocks = NULL;
+	if (context->levels[0].image->is_half_float)
+		return;
+	bool rgtc = (texture->type == TEXTURE_TYPE_RGTC1 || texture->type == TEXTURE_TYPE_RGTC2);
+	if (!rgtc) {
+		if (!context->calculate_pixel_indices || (texture->type != TEXTURE_TYPE_DXT5 &&
+		texture->type != TEXTURE_TYPE_ETC2_EAC))
+			return;
+		context->optimal_alpha_blocks = (unsigned char *)malloc(context->nu_blocks_total * 8);
+	}
+	int nu_optimal_blocks = 0;
+	for (int i = 0; i < context->nu_blocks_total; i++) {
+		if (!block_needs_compression(context, i))
+			continue;
+		BlockUserData user_data;
+		set_single_block_user_data(context, i, &user_data);
+		unsigned int pixels[16];
+		int w, h;
+		get_user_data_block_pixels(&user_data, pixels, &w, &h);
+		if (rgtc) {
+			unsigned char bitstring[16];
+			encode_optimal_block4x4_rgtc(pixels, w, h, texture->type, bitstring);
+			if (set_known_block(context, i, bitstring))
+				nu_optimal_blocks++;
+			continue;
+		}
+		unsigned char alpha_values[16];
+		for (int j = 0; j < 16; j++)
+			alpha_values[j] = pixel_get_a(pixels[j]);
+		if (texture->type == TEXTURE_TYPE_DXT5)
+			// Opaque blocks must use the encoding with six interpolated values.
+			encode_optimal_block4x4_rgtc1_component(alpha_values, w, h, user_data.flags,
+				&context->optimal_alpha_blocks[i * 8]);
+		else
+			encode_optimal_alpha_block4x4_etc2_eac(alpha_values, w, h,
+				&context->optimal_alpha_blocks[i * 8]);
+	}
+	if (!context->options.quiet && nu_optimal_blocks > 0)
+		printf("%d blocks encoded directly with the optimal endpoints.\n", nu_optimal_blocks);
+}
+
+// For every BPTC block that is compressed, rank the partitions of the modes with two or three subsets by how
+// well they fit the source pixels, so that the genetic algorithm only has to search the most promising ones
+// instead of all 64.
+
+static void preselect_bptc_partitions(CompressionContext *context) {
+	Texture *texture = context->levels[0].texture;
+	context->bptc_partitions = NULL;
+	if (texture->type != TEXTURE_TYPE_BPTC)
+		return;
+	context->bptc_partitions = (unsigned char *)malloc(context->nu_blocks_total *
+		BPTC_NU_PRESELECTED_PARTITIONS * 3);
+	for (int i = 0; i < context->nu_blocks_total; i++) {
+		if (!block_needs_compression(context, i))
+			continue;
+		BlockUserData user_data;
+		set_single_block_user_data(context, i, &user_data);
+		unsigned int pixels[16];
+		int w, h;
+		get_user_data_block_pixels(&user_data, pixels, &w, &h);
+		bptc_preselect_partitions(pixels, w, h,
+			&context->bptc_partitions[i * BPTC_NU_PRESELECTED_PARTITIONS * 3]);
+	}
+}
+
+// Return whether mipmap level i of the previous compression can be used, which requires a source image and
+// texture of the same size and type as the ones of the level that is being compressed.
+
+static bool previous_level_matches(CompressionContext *context, int i) {
+	if (i >= context->nu_previous_levels)
+		return false;
+	MipmapLevel *level = &context->levels[i];
+	Image *image = &context->previous_images[i];
+	Texture *texture = &context->previous_textures[i];
+	return image->width == level->image->width && image->height == level->image->height &&
+		image->is_half_float == level->image->is_half_float && image->alpha_bits == level->image->alpha_bits &&
+		texture->type == level->texture->type && texture->bits_per_block == level->texture->bits_per_block &&
+		texture->width == level->texture->width && texture->height == level->texture->height;
+}
+
+// Keep the compressed blocks of the previous texture where the source pixels have not changed. A block is
+// compressed again when it or one of its immediate neighbours has changed, so that the compressed blocks
+// around a change still fit together. The solution of a block is also kept when one of its duplicates is
+// kept.
+
+static void keep_unchanged_blocks(CompressionContext *context) {
+	if (context->previous_textures == NULL)
+		return;
+	int nu_kept_blocks = 0;
+	for (int i = 0; i < context->nu_levels; i++) {
+		if (!previous_level_matches(context, i)) {
+			if (i < context->nu_previous_levels && !context->options.quiet)
+				printf("Warning: mipmap level %d of the previous texture doesn't match, compressing it "
+					"completely.\n", i);
+			continue;
+		}
+		MipmapLevel *level = &context->levels[i];
+		Image *previous_image = &context->previous_images[i];
+		Texture *previous_texture = &context->previous_textures[i];
+		int blocks_per_row = level->blocks_per_row;
+		int nu_block_rows = level->nu_blocks / blocks_per_row;
+		int words_per_pixel = 1;
+		if (previous_image->is_half_float)
+			words_per_pixel = 2;	// 64-bit pixels
+		int previous_rowstride = previous_image->extended_width * words_per_pixel;
+		unsigned char *changed = (unsigned char *)malloc(level->nu_blocks);
+		for (int j = 0; j < level->nu_blocks; j++) {
+			int rowstride, words_per_row, nu_rows;
+			unsigned int *pixels = get_block_source_pixels(context, level->first_block + j, &rowstride,
+				&words_per_row, &nu_rows);
+			unsigned int *previous_pixels = previous_image->pixels +
+				(j / blocks_per_row) * level->texture->block_height * previous_rowstride +
+				(j % blocks_per_row) * level->texture->block_width * words_per_pixel;
+			changed[j] = 0;
+			for (int y = 0; y < nu_rows; y++)
+				if (memcmp(pixels + y * rowstride, previous_pixels + y * previous_rowstride,
+				words_per_row * 4) != 0) {
+					changed[j] = 1;
+					break;
+				}
+		}
+		for (int j = 0; j < level->nu_blocks; j++) {
+			int bx = j % blocks_per_row;
+			int by = j / blocks_per_row;
+			bool keep = true;
+			for (int y = by - 1; y <= by + 1; y++)
+				for (int x = bx - 1; x <= bx + 1; x++)
+					if (x >= 0 && x < blocks_per_row && y >= 0 && y < nu_block_rows &&
+					changed[y * blocks_per_row + x])
+						keep = false;
+			int first = context->duplicate_of[level->first_block + j];
+			if (!keep || context->known_fitness[first] != 0)
+				continue;
+			// Calculate the fitness of the previous compressed block for the block that is compressed.
+			Texture *texture = level->texture;
+			unsigned char bitstring[16];
+			memcpy(bitstring, &previous_texture->pixels[j * (texture->bits_per_block / 32)],
+				texture->bits_per_block / 8);
+			if (set_known_block(context, first, bitstring))
+				nu_kept_blocks++;
+		}
+		free(changed);
+	}
+	if (!context->options.quiet)
+		printf("%d blocks kept from the previous texture.\n", nu_kept_blocks);
+}
+
+// Look up the blocks that have to be compressed in the block cache. The solutions that are found are stored
+// in the texture, and those blocks are not compressed.
+
+static void look_up_cached_blocks(CompressionContext *context) {
+	if (!block_cache_usable(context, context->levels[0].texture))
+		return;
+	int nu_cached_blocks = 0;
+	for (int i = 0; i < context->nu_blocks_total; i++) {
+		if (!block_needs_compression(context, i))
+			continue;
+		uint64_t key[2];
+		unsigned char bitstring[16];
+		double fitness;
+		get_block_cache_key(context, i, key);
+		if (!block_cache_lookup(context->block_cache, key, bitstring, &fitness) || fitness <= 0)
+			continue;
+		MipmapLevel *level = get_block_level(context, i);
+		Texture *texture = level->texture;
+		memcpy(&texture->pixels[(i - level->first_block) * (texture->bits_per_block / 32)], bitstring,
+			texture->bits_per_block / 8);
+		context->known_fitness[i] = fitness;
+		nu_cached_blocks++;
+	}
+	if (!context->options.quiet && nu_cached_blocks > 0)
+		printf("%d blocks found in the block cache.\n", nu_cached_blocks);
+}
+
 
 // Optimize the alpha component of 1-bit alpha textures for the whole image.
 
@@ -1593,7 +3394,7 @@ static void optimize_alpha(Image *image, Texture *texture) {
 
 // Calculate the RMSE threshold for adaptive block optimization.
 
-static double get_rmse_threshold(Texture *texture, int level, Image *source_image) {
+static double get_rmse_threshold(CompressionContext *context, Texture *texture, int level, Image *source_image) {
 	// Convert level to fixed speed grade for legacy code.
 	// A better implementation of threshold determination would emperically determine the threshold
 	// by compressing a number of sample blocks from the image.
@@ -1693,7 +3494,7 @@ static double get_rmse_threshold(Texture *texture, int level, Image *source_imag
 			}
 		else
 		if (texture->type & TEXTURE_TYPE_HALF_FLOAT_BIT)
-			if (option_hdr)
+			if (context->options.hdr)
 				switch (speed) {
 				case SPEED_ULTRA :
 					threshold = 0.35;
@@ -1781,7 +3582,7 @@ static double get_rmse_threshold(Texture *texture, int level, Image *source_imag
 	if (source_image->bits_per_component == 16 && !(texture->type & TEXTURE_TYPE_16_BIT_COMPONENTS_BIT))
 		threshold *= 256.0;
 	// Adjust threshold upward for perceptive quality mode.
-	if (option_perceptive && option_compression_level >= COMPRESSION_LEVEL_CLASS_1
+	if (context->options.perceptive && context->options.compression_level >= COMPRESSION_LEVEL_CLASS_1
 	&& texture->perceptive_comparison_function != NULL)
 		threshold *= 1.2;
 	return threshold;
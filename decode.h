@@ -37,6 +37,14 @@ enum {
 	TWO_COLORS = 0x20000,
 };
 
+// The number of partitions preselected per block for each kind of BPTC partitioning.
+
+#define BPTC_NU_PRESELECTED_PARTITIONS 8
+
+// The number of blocks that the batched functions process together.
+
+#define BATCH_LANES 8
+
 // Functions defined in etc2.c.
 
 // Draw (decompress) a 64-bit 4x4 pixel block.
@@ -59,9 +67,25 @@ void block4x4_etc1_set_mode(unsigned char *bitstring, int flags);
 void block4x4_etc2_rgb8_set_mode(unsigned char *bitstring, int flags);
 void block4x4_etc2_punchthrough_set_mode(unsigned char *bitstring, int flags);
 void block4x4_etc2_eac_set_mode(unsigned char *bitstring, int flags);
+// Describe the fields of a block for the format-aware genetic operators.
+int block4x4_etc1_get_fields(const unsigned char *bitstring, BlockField *fields);
 // "Manual" optimization function.
 void optimize_block_alpha_etc2_punchthrough(unsigned char *bitstring, unsigned char *alpha_values);
 void optimize_block_alpha_etc2_eac(unsigned char *bitstring, unsigned char *alpha_values, int flags);
+void optimize_block_indices_etc(unsigned char *bitstring, const unsigned int *pixels, int texture_type);
+void optimize_block_indices_etc1_batch(int n, unsigned char *bitstrings, const unsigned int *pixels, int width,
+int height, int flags, int *errors);
+// Directly encode a block with only one color.
+int encode_trivial_block4x4_etc(const unsigned int *pixels, int texture_type, int flags, unsigned char *bitstring);
+// Directly encode a block in planar mode with a least-squares fit.
+int encode_planar_block4x4_etc2(const unsigned int *pixels, int width, int height, int texture_type,
+unsigned char *bitstring);
+// Directly encode the color part of a block in T or H mode from two clusters of pixels.
+void encode_T_or_H_block4x4_etc2(const unsigned int *pixels, int width, int height, int mode, int texture_type,
+unsigned char *bitstring);
+// Encode the alpha part of an ETC2 EAC block with the smallest possible error.
+void encode_optimal_alpha_block4x4_etc2_eac(const unsigned char *alpha_values, int width, int height,
+unsigned char *bitstring);
 
 // Functions defined in dxtc.c.
 
@@ -70,6 +94,14 @@ int draw_block4x4_dxt1a(const unsigned char *bitstring, unsigned int *image_buff
 int draw_block4x4_dxt3(const unsigned char *bitstring, unsigned int *image_buffer, int flags);
 int draw_block4x4_dxt5(const unsigned char *bitstring, unsigned int *image_buffer, int flags);
 void optimize_block_alpha_dxt3(unsigned char *bitstring, unsigned char *alpha_values);
+void optimize_block_indices_dxtc(unsigned char *bitstring, const unsigned int *pixels, int texture_type);
+int encode_trivial_block4x4_dxtc(const unsigned int *pixels, int texture_type, int flags, unsigned char *bitstring);
+int block4x4_dxt1_get_fields(const unsigned char *bitstring, BlockField *fields);
+int block4x4_dxt3_get_fields(const unsigned char *bitstring, BlockField *fields);
+int block4x4_dxt5_get_fields(const unsigned char *bitstring, BlockField *fields);
+// Set the optimal pixel indices of several DXT1 blocks and return their errors.
+void optimize_block_indices_dxt1_batch(int n, unsigned char *bitstrings, const unsigned int *pixels, int width,
+int height, int *errors);
 
 // Functions defined in astc.c
 
@@ -90,8 +122,19 @@ int draw_block4x4_bptc_signed_float(const unsigned char *bitstring, unsigned int
 int block4x4_bptc_float_get_mode(const unsigned char *bitstring);
 void block4x4_bptc_set_mode(unsigned char *bitstring, int flags);
 void block4x4_bptc_float_set_mode(unsigned char *bitstring, int flags);
+int block4x4_bptc_get_fields(const unsigned char *bitstring, BlockField *fields);
+// Directly encode a BPTC float block in a given mode with fitted endpoints.
+void encode_block4x4_bptc_float(const uint64_t *pixels, int width, int height, int mode, int partition_rank,
+int signed_flag, unsigned char *bitstring);
 // Try to preinitialize colors for particular modes.
 void bptc_set_block_colors(unsigned char *bitstring, int flags, unsigned int *colors);
+int encode_trivial_block4x4_bptc(const unsigned int *pixels, int flags, unsigned char *bitstring);
+// Select the most promising partitions for the modes with two or three subsets, and constrain a block to them.
+void bptc_preselect_partitions(const unsigned int *pixels, int width, int height, unsigned char *partitions);
+void block4x4_bptc_set_preselected_partition(unsigned char *bitstring, const unsigned char *partitions);
+// Directly encode a block in mode 4, 5 or 6 with fitted endpoints.
+void encode_single_subset_block4x4_bptc(const unsigned int *pixels, int width, int height, int mode,
+unsigned char *bitstring);
 
 // Functions defined in rgtc.c
 
@@ -99,6 +142,13 @@ int draw_block4x4_rgtc1(const unsigned char *bitstring, unsigned int *image_buff
 int draw_block4x4_signed_rgtc1(const unsigned char *bitstring, unsigned int *image_buffer, int flags);
 int draw_block4x4_rgtc2(const unsigned char *bitstring, unsigned int *image_buffer, int flags);
 int draw_block4x4_signed_rgtc2(const unsigned char *bitstring, unsigned int *image_buffer, int flags);
+int encode_trivial_block4x4_rgtc1_component(const unsigned char *values, unsigned char *bitstring);
+int encode_trivial_block4x4_rgtc(const unsigned int *pixels, int texture_type, unsigned char *bitstring);
+// Encode a component or a block with the smallest possible error.
+void encode_optimal_block4x4_rgtc1_component(const unsigned char *values, int width, int height, int flags,
+unsigned char *bitstring);
+void encode_optimal_block4x4_rgtc(const unsigned int *pixels, int width, int height, int texture_type,
+unsigned char *bitstring);
 
 // Function defined in texture.c.
 
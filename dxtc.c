@@ -19,6 +19,8 @@ OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <limits.h>
+#include <pthread.h>
 #include "texgenpack.h"
 #include "decode.h"
 #include "packing.h"
@@ -217,4 +219,415 @@ void optimize_block_alpha_dxt3(unsigned char *bitstring, unsigned char *alpha_va
 	*(uint64_t *)&bitstring[0] = alpha_pixels;
 }
 
+// Set the pixel indices of a DXT1, DXT1A, DXT3 or DXT5 block to the indices of the colors between the endpoints
+// that come closest to the given source pixels (in row-major order), so that only the endpoints have to be
+// optimized. For DXT1A, the alpha component is included, so that the transparent color of three-color mode is
+// used where appropriate.
 
+void optimize_block_indices_dxtc(unsigned char *bitstring, const unsigned int *pixels, int texture_type) {
+	if (texture_type == TEXTURE_TYPE_DXT3 || texture_type == TEXTURE_TYPE_DXT5)
+		bitstring = &bitstring[8];
+	unsigned int colors = (unsigned int)bitstring[0] | ((unsigned int)bitstring[1] << 8) |
+		((unsigned int)bitstring[2] << 16) | ((unsigned int)bitstring[3] << 24);
+	bool four_color_mode = (colors & 0xFFFF) > (colors >> 16);
+	if (!four_color_mode && texture_type != TEXTURE_TYPE_DXT1 && texture_type != TEXTURE_TYPE_DXT1A)
+		// The block is invalid for DXT3 and DXT5 anyway.
+		return;
+	bool alpha = (texture_type == TEXTURE_TYPE_DXT1A);
+	// Calculate the colors in the same way as the decoding functions.
+	int color_r[4], color_g[4], color_b[4], color_a[4];
+	color_b[0] = (colors & 0x0000001F) << 3;
+	color_g[0] = (colors & 0x000007E0) >> (5 - 2);
+	color_r[0] = (colors & 0x0000F800) >> (11 - 3);
+	color_b[1] = (colors & 0x001F0000) >> (16 - 3);
+	color_g[1] = (colors & 0x07E00000) >> (21 - 2);
+	color_r[1] = (colors & 0xF8000000) >> (27 - 3);
+	color_a[0] = color_a[1] = color_a[2] = color_a[3] = 0xFF;
+	if (four_color_mode) {
+		color_r[2] = (2 * color_r[0] + color_r[1]) / 3;
+		color_g[2] = (2 * color_g[0] + color_g[1]) / 3;
+		color_b[2] = (2 * color_b[0] + color_b[1]) / 3;
+		color_r[3] = (color_r[0] + 2 * color_r[1]) / 3;
+		color_g[3] = (color_g[0] + 2 * color_g[1]) / 3;
+		color_b[3] = (color_b[0] + 2 * color_b[1]) / 3;
+	}
+	else {
+		color_r[2] = (color_r[0] + color_r[1]) / 2;
+		color_g[2] = (color_g[0] + color_g[1]) / 2;
+		color_b[2] = (color_b[0] + color_b[1]) / 2;
+		color_r[3] = color_g[3] = color_b[3] = 0;
+		if (alpha)
+			color_a[3] = 0;
+	}
+	unsigned int pixel_indices = 0;
+	for (int i = 0; i < 16; i++) {
+		int r = pixel_get_r(pixels[i]);
+		int g = pixel_get_g(pixels[i]);
+		int b = pixel_get_b(pixels[i]);
+		int a = pixel_get_a(pixels[i]);
+		int best_error = INT_MAX;
+		int best_index = 0;
+		for (int j = 0; j < 4; j++) {
+			int error = (color_r[j] - r) * (color_r[j] - r) + (color_g[j] - g) * (color_g[j] - g) +
+				(color_b[j] - b) * (color_b[j] - b);
+			if (alpha) {
+				// When both alpha values are zero, the color doesn't matter.
+				if ((a | color_a[j]) == 0)
+					error = 0;
+				else
+					error += (color_a[j] - a) * (color_a[j] - a);
+			}
+			if (error < best_error) {
+				best_error = error;
+				best_index = j;
+			}
+		}
+		pixel_indices |= (unsigned int)best_index << (i * 2);
+	}
+	bitstring[4] = pixel_indices & 0xFF;
+	bitstring[5] = (pixel_indices >> 8) & 0xFF;
+	bitstring[6] = (pixel_indices >> 16) & 0xFF;
+	bitstring[7] = pixel_indices >> 24;
+}
+
+// Set the pixel indices of n DXT1 blocks stored consecutively in bitstrings to the optimal ones for the pixels of a
+// block (in row-major order), and store the error of each block over the width x height visible pixels in errors.
+// This is equivalent to optimize_block_indices_dxtc() followed by decoding and comparing each block, but the
+// blocks are processed BATCH_LANES at a time with the loops over the pixels running across the blocks, so that
+// the compiler can vectorize them.
+
+void optimize_block_indices_dxt1_batch(int n, unsigned char *bitstrings, const unsigned int *pixels, int width,
+int height, int *errors) {
+	int pixel_r[16], pixel_g[16], pixel_b[16];
+	// The weight of a pixel is zero when it lies outside the image.
+	int weight[16];
+	for (int i = 0; i < 16; i++) {
+		pixel_r[i] = pixel_get_r(pixels[i]);
+		pixel_g[i] = pixel_get_g(pixels[i]);
+		pixel_b[i] = pixel_get_b(pixels[i]);
+		weight[i] = (i & 3) < width && (i >> 2) < height;
+	}
+	for (int first = 0; first < n; first += BATCH_LANES) {
+		int nu_lanes = n - first;
+		if (nu_lanes > BATCH_LANES)
+			nu_lanes = BATCH_LANES;
+		int color_r[4][BATCH_LANES], color_g[4][BATCH_LANES], color_b[4][BATCH_LANES];
+		for (int l = 0; l < nu_lanes; l++) {
+			const unsigned char *bitstring = &bitstrings[(first + l) * 8];
+			unsigned int colors = (unsigned int)bitstring[0] | ((unsigned int)bitstring[1] << 8) |
+				((unsigned int)bitstring[2] << 16) | ((unsigned int)bitstring[3] << 24);
+			// Calculate the colors in the same way as the decoding function.
+			color_b[0][l] = (colors & 0x0000001F) << 3;
+			color_g[0][l] = (colors & 0x000007E0) >> (5 - 2);
+			color_r[0][l] = (colors & 0x0000F800) >> (11 - 3);
+			color_b[1][l] = (colors & 0x001F0000) >> (16 - 3);
+			color_g[1][l] = (colors & 0x07E00000) >> (21 - 2);
+			color_r[1][l] = (colors & 0xF8000000) >> (27 - 3);
+			if ((colors & 0xFFFF) > (colors >> 16)) {
+				color_r[2][l] = (2 * color_r[0][l] + color_r[1][l]) / 3;
+				color_g[2][l] = (2 * color_g[0][l] + color_g[1][l]) / 3;
+				color_b[2][l] = (2 * color_b[0][l] + color_b[1][l]) / 3;
+				color_r[3][l] = (color_r[0][l] + 2 * color_r[1][l]) / 3;
+				color_g[3][l] = (color_g[0][l] + 2 * color_g[1][l]) / 3;
+				color_b[3][l] = (color_b[0][l] + 2 * color_b[1][l]) / 3;
+			}
+			else {
+				color_r[2][l] = (color_r[0][l] + color_r[1][l]) / 2;
+				color_g[2][l] = (color_g[0][l] + color_g[1][l]) / 2;
+				color_b[2][l] = (color_b[0][l] + color_b[1][l]) / 2;
+				color_r[3][l] = color_g[3][l] = color_b[3][l] = 0;
+			}
+		}
+		int error[BATCH_LANES];
+		unsigned int pixel_indices[BATCH_LANES];
+		for (int l = 0; l < nu_lanes; l++) {
+			error[l] = 0;
+			pixel_indices[l] = 0;
+		}
+		// The loop over the blocks is kept free of branches.
+		for (int i = 0; i < 16; i++)
+			for (int l = 0; l < nu_lanes; l++) {
+				int best_error = INT_MAX;
+				int best_index = 0;
+				for (int j = 0; j < 4; j++) {
+					int e = (color_r[j][l] - pixel_r[i]) * (color_r[j][l] - pixel_r[i]) +
+						(color_g[j][l] - pixel_g[i]) * (color_g[j][l] - pixel_g[i]) +
+						(color_b[j][l] - pixel_b[i]) * (color_b[j][l] - pixel_b[i]);
+					best_index = e < best_error ? j : best_index;
+					best_error = e < best_error ? e : best_error;
+				}
+				error[l] += best_error * weight[i];
+				pixel_indices[l] |= (unsigned int)best_index << (i * 2);
+			}
+		for (int l = 0; l < nu_lanes; l++) {
+			unsigned char *bitstring = &bitstrings[(first + l) * 8];
+			bitstring[4] = pixel_indices[l] & 0xFF;
+			bitstring[5] = (pixel_indices[l] >> 8) & 0xFF;
+			bitstring[6] = (pixel_indices[l] >> 16) & 0xFF;
+			bitstring[7] = pixel_indices[l] >> 24;
+			errors[first + l] = error[l];
+		}
+	}
+}
+
+// Describe the fields of the DXT1 color block that starts at the given bit: the blue, green and red components of
+// both 565 endpoint colors followed by the 2-bit pixel indices.
+
+static int add_dxt1_color_block_fields(BlockField *fields, int nu_fields, int bit) {
+	for (int i = 0; i < 2; i++) {
+		fields[nu_fields++] = (BlockField){ BLOCK_FIELD_NUMERIC, bit + i * 16, 5 };
+		fields[nu_fields++] = (BlockField){ BLOCK_FIELD_NUMERIC, bit + i * 16 + 5, 6 };
+		fields[nu_fields++] = (BlockField){ BLOCK_FIELD_NUMERIC, bit + i * 16 + 11, 5 };
+	}
+	for (int i = 0; i < 16; i++)
+		fields[nu_fields++] = (BlockField){ BLOCK_FIELD_INDEX, bit + 32 + i * 2, 2 };
+	return nu_fields;
+}
+
+int block4x4_dxt1_get_fields(const unsigned char *bitstring, BlockField *fields) {
+	return add_dxt1_color_block_fields(fields, 0, 0);
+}
+
+// The alpha part of a DXT3 block consists of explicit 4-bit alpha values.
+
+int block4x4_dxt3_get_fields(const unsigned char *bitstring, BlockField *fields) {
+	int n = 0;
+	for (int i = 0; i < 16; i++)
+		fields[n++] = (BlockField){ BLOCK_FIELD_NUMERIC, i * 4, 4 };
+	return add_dxt1_color_block_fields(fields, n, 64);
+}
+
+// The alpha part of a DXT5 block consists of two 8-bit alpha endpoints and 3-bit pixel indices.
+
+int block4x4_dxt5_get_fields(const unsigned char *bitstring, BlockField *fields) {
+	int n = 0;
+	fields[n++] = (BlockField){ BLOCK_FIELD_NUMERIC, 0, 8 };
+	fields[n++] = (BlockField){ BLOCK_FIELD_NUMERIC, 8, 8 };
+	for (int i = 0; i < 16; i++)
+		fields[n++] = (BlockField){ BLOCK_FIELD_INDEX, 16 + i * 3, 3 };
+	return add_dxt1_color_block_fields(fields, n, 64);
+}
+
+// Encoding of blocks that only have one or two colors, without the genetic algorithm.
+
+typedef struct {
+	unsigned char endpoint0;
+	unsigned char endpoint1;
+	unsigned char error;
+} DXTCEndpointPair;
+
+static pthread_mutex_t table_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// For every 8-bit component value, the pair of 5-bit and 6-bit endpoint values of which the color at one third
+// (index 2 in four-color mode) and halfway (index 2 in three-color mode) between the endpoints comes closest to
+// the value. Indexed by [bits - 5][three_color_mode][value].
+static DXTCEndpointPair (*single_color_table)[2][256] = NULL;
+
+static void calculate_single_color_table() {
+	pthread_mutex_lock(&table_mutex);
+	if (single_color_table != NULL) {
+		pthread_mutex_unlock(&table_mutex);
+		return;
+	}
+	DXTCEndpointPair (*table)[2][256] = (DXTCEndpointPair (*)[2][256])malloc(sizeof(DXTCEndpointPair) * 2 * 2 * 256);
+	for (int bits = 5; bits <= 6; bits++)
+		for (int three_color_mode = 0; three_color_mode < 2; three_color_mode++)
+			for (int value = 0; value < 256; value++) {
+				int best_error = 256;
+				for (int e0 = 0; e0 < (1 << bits); e0++)
+					for (int e1 = 0; e1 < (1 << bits); e1++) {
+						int c0 = e0 << (8 - bits);
+						int c1 = e1 << (8 - bits);
+						int c;
+						if (three_color_mode)
+							c = (c0 + c1) / 2;
+						else
+							c = (2 * c0 + c1) / 3;
+						int error = abs(c - value);
+						if (error < best_error) {
+							best_error = error;
+							table[bits - 5][three_color_mode][value].endpoint0 = e0;
+							table[bits - 5][three_color_mode][value].endpoint1 = e1;
+							table[bits - 5][three_color_mode][value].error = error;
+						}
+					}
+			}
+	single_color_table = table;
+	pthread_mutex_unlock(&table_mutex);
+}
+
+static void set_color_block(unsigned char *bitstring, int color0, int color1, unsigned int pixels) {
+	bitstring[0] = color0 & 0xFF;
+	bitstring[1] = color0 >> 8;
+	bitstring[2] = color1 & 0xFF;
+	bitstring[3] = color1 >> 8;
+	bitstring[4] = pixels & 0xFF;
+	bitstring[5] = (pixels >> 8) & 0xFF;
+	bitstring[6] = (pixels >> 16) & 0xFF;
+	bitstring[7] = pixels >> 24;
+}
+
+static int pack_rgb565(int r, int g, int b) {
+	return (r << 11) | (g << 5) | b;
+}
+
+// Encode the 64-bit color block of a block of which the pixels that are not transparent have one or two colors.
+// The color of the pixels for which transparent is set doesn't matter. When use_transparent_index is set, those
+// pixels get index 3 of three-color mode, which is transparent in DXT1A. Return 0 when the colors can not be
+// encoded.
+
+static int encode_color_block(const unsigned int *pixels, const bool *transparent, bool use_transparent_index,
+bool three_color_mode_allowed, bool four_color_mode_allowed, unsigned char *bitstring) {
+	int nu_colors = 0;
+	unsigned int colors[2];
+	bool has_transparent_pixels = false;
+	for (int i = 0; i < 16; i++) {
+		if (transparent[i]) {
+			has_transparent_pixels = true;
+			continue;
+		}
+		unsigned int rgb = pixels[i] & 0xFFFFFF;
+		if (nu_colors > 0 && rgb == colors[0])
+			continue;
+		if (nu_colors > 1 && rgb == colors[1])
+			continue;
+		if (nu_colors == 2)
+			return 0;
+		colors[nu_colors++] = rgb;
+	}
+	if (has_transparent_pixels && use_transparent_index)
+		// Only three-color mode has transparent pixels.
+		four_color_mode_allowed = false;
+	if (!three_color_mode_allowed && !four_color_mode_allowed)
+		return 0;
+	int color0, color1;
+	int index[2];
+	if (nu_colors == 0) {
+		if (four_color_mode_allowed)
+			set_color_block(bitstring, 1, 0, 0);
+		else
+			set_color_block(bitstring, 0, 0, 0xFFFFFFFF);
+		return 1;
+	}
+	if (nu_colors == 1) {
+		// Use the color between the endpoints that comes closest in four-color or three-color mode.
+		calculate_single_color_table();
+		int r = pixel_get_r(colors[0]);
+		int g = pixel_get_g(colors[0]);
+		int b = pixel_get_b(colors[0]);
+		int best_error = INT_MAX;
+		int best_mode = four_color_mode_allowed ? 0 : 1;
+		for (int mode = 0; mode < 2; mode++) {
+			if ((mode == 0 && !four_color_mode_allowed) || (mode == 1 && !three_color_mode_allowed))
+				continue;
+			DXTCEndpointPair *pr = &single_color_table[0][mode][r];
+			DXTCEndpointPair *pg = &single_color_table[1][mode][g];
+			DXTCEndpointPair *pb = &single_color_table[0][mode][b];
+			int error = pr->error * pr->error + pg->error * pg->error + pb->error * pb->error;
+			if (error < best_error) {
+				best_error = error;
+				best_mode = mode;
+			}
+		}
+		DXTCEndpointPair *pr = &single_color_table[0][best_mode][r];
+		DXTCEndpointPair *pg = &single_color_table[1][best_mode][g];
+		DXTCEndpointPair *pb = &single_color_table[0][best_mode][b];
+		color0 = pack_rgb565(pr->endpoint0, pg->endpoint0, pb->endpoint0);
+		color1 = pack_rgb565(pr->endpoint1, pg->endpoint1, pb->endpoint1);
+		index[0] = 2;
+		index[1] = 2;
+		if (best_mode == 0) {
+			// Four-color mode requires color0 > color1.
+			if (color0 < color1) {
+				int temp = color0;
+				color0 = color1;
+				color1 = temp;
+				index[0] = index[1] = 3;
+			}
+			else if (color0 == color1) {
+				// The endpoints are equal and represent the color exactly.
+				if (color0 == 0) {
+					color0 = 1;
+					index[0] = index[1] = 1;
+				}
+				else {
+					color1 = color0 - 1;
+					index[0] = index[1] = 0;
+				}
+			}
+		}
+		else if (color0 > color1) {
+			int temp = color0;
+			color0 = color1;
+			color1 = temp;
+		}
+	}
+	else {
+		// Two colors can only be encoded exactly when they are both representable in 5-6-5 format.
+		for (int i = 0; i < 2; i++)
+			if ((colors[i] & 0xF8FCF8) != colors[i])
+				return 0;
+		color0 = pack_rgb565(pixel_get_r(colors[0]) >> 3, pixel_get_g(colors[0]) >> 2,
+			pixel_get_b(colors[0]) >> 3);
+		color1 = pack_rgb565(pixel_get_r(colors[1]) >> 3, pixel_get_g(colors[1]) >> 2,
+			pixel_get_b(colors[1]) >> 3);
+		index[0] = 0;
+		index[1] = 1;
+		// Four-color mode requires color0 > color1, three-color mode color0 <= color1.
+		if ((color0 < color1) == four_color_mode_allowed) {
+			int temp = color0;
+			color0 = color1;
+			color1 = temp;
+			index[0] = 1;
+			index[1] = 0;
+		}
+	}
+	unsigned int pixel_indices = 0;
+	for (int i = 0; i < 16; i++) {
+		int pixel_index;
+		if (transparent[i] && use_transparent_index)
+			pixel_index = 3;
+		else if (transparent[i] || (pixels[i] & 0xFFFFFF) == colors[0])
+			pixel_index = index[0];
+		else
+			pixel_index = index[1];
+		pixel_indices |= (unsigned int)pixel_index << (i * 2);
+	}
+	set_color_block(bitstring, color0, color1, pixel_indices);
+	return 1;
+}
+
+// Encode a DXT1, DXT1A, DXT3 or DXT5 block of which the pixels that are not transparent have one or two colors,
+// and of which the alpha values can be represented exactly (DXT1A and DXT5 only). The pixels are in row-major
+// order. Return 0 when the block can not be encoded this way.
+
+int encode_trivial_block4x4_dxtc(const unsigned int *pixels, int texture_type, int flags, unsigned char *bitstring) {
+	bool transparent[16];
+	unsigned char alpha_values[16];
+	for (int i = 0; i < 16; i++) {
+		alpha_values[i] = pixel_get_a(pixels[i]);
+		// The color of a pixel that is completely transparent in both the source and the texture doesn't
+		// matter.
+		transparent[i] = (texture_type & TEXTURE_TYPE_ALPHA_BIT) && alpha_values[i] == 0;
+	}
+	switch (texture_type) {
+	case TEXTURE_TYPE_DXT1 :
+		return encode_color_block(pixels, transparent, false, true, true, bitstring);
+	case TEXTURE_TYPE_DXT1A :
+		for (int i = 0; i < 16; i++)
+			if (alpha_values[i] != 0 && alpha_values[i] != 0xFF)
+				return 0;
+		return encode_color_block(pixels, transparent, true, (flags & MODES_ALLOWED_OPAQUE_ONLY) == 0,
+			(flags & MODES_ALLOWED_NON_OPAQUE_ONLY) == 0, bitstring);
+	case TEXTURE_TYPE_DXT3 :
+		if (!encode_color_block(pixels, transparent, false, false, true, &bitstring[8]))
+			return 0;
+		optimize_block_alpha_dxt3(bitstring, alpha_values);
+		return 1;
+	case TEXTURE_TYPE_DXT5 :
+		if (!encode_color_block(pixels, transparent, false, false, true, &bitstring[8]))
+			return 0;
+		return encode_trivial_block4x4_rgtc1_component(alpha_values, bitstring);
+	}
+	return 0;
+}
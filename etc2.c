@@ -20,6 +20,9 @@ OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <math.h>
 #include "texgenpack.h"
 #include "decode.h"
 #include "packing.h"
@@ -339,10 +342,12 @@ int draw_block4x4_etc1(const unsigned char *bitstring, unsigned int *image_buffe
 
 static int etc2_distance_table[8] = { 3, 6, 11, 16, 23, 32, 41, 64 };
 
-static void draw_block4x4_rgb8_etc2_T_or_H_mode(const unsigned char *bitstring, unsigned int *image_buffer, int mode) {
+// Calculate the four paint colors of an ETC2 block in T mode (mode 0) or H mode (mode 1).
+
+static void get_etc2_T_or_H_mode_paint_colors(const unsigned char *bitstring, int mode, int *paint_color_R,
+int *paint_color_G, int *paint_color_B) {
 	int base_color1_R, base_color1_G, base_color1_B;
 	int base_color2_R, base_color2_G, base_color2_B;
-	int paint_color_R[4], paint_color_G[4], paint_color_B[4];
 	int distance;
 	if (mode == 0) {
 		// T mode.
@@ -410,6 +415,11 @@ static void draw_block4x4_rgb8_etc2_T_or_H_mode(const unsigned char *bitstring,
 		paint_color_G[3] = clamp(base_color2_G - distance);
 		paint_color_B[3] = clamp(base_color2_B - distance);
 	}
+}
+
+static void draw_block4x4_rgb8_etc2_T_or_H_mode(const unsigned char *bitstring, unsigned int *image_buffer, int mode) {
+	int paint_color_R[4], paint_color_G[4], paint_color_B[4];
+	get_etc2_T_or_H_mode_paint_colors(bitstring, mode, paint_color_R, paint_color_G, paint_color_B);
 	unsigned int pixel_index_word = ((unsigned int)bitstring[4] << 24) | ((unsigned int)bitstring[5] << 16) |
 		((unsigned int)bitstring[6] << 8) | bitstring[7];
 	for (int i = 0; i < 16; i++) {
@@ -1218,6 +1228,212 @@ void optimize_block_alpha_etc2_eac(unsigned char *bitstring, unsigned char *alph
 	bitstring[7] = (uint8_t)pixels;
 }
 
+// Set the pixel indices of an ETC1, ETC2 RGB8 or ETC2 EAC block in individual, differential, T or H mode to the
+// indices of the colors that come closest to the given source pixels (in row-major order), so that only the
+// base colors, table codewords and flip bit have to be optimized. Blocks in planar mode, which has no pixel
+// indices, and invalid blocks are left unchanged.
+
+void optimize_block_indices_etc(unsigned char *bitstring, const unsigned int *pixels, int texture_type) {
+	if (texture_type == TEXTURE_TYPE_ETC2_EAC)
+		bitstring = &bitstring[8];
+	int mode = block4x4_etc2_rgb8_get_mode(bitstring);
+	if (mode >= 2 && texture_type == TEXTURE_TYPE_ETC1)
+		// Overflow in differential mode.
+		return;
+	if (mode == 4)
+		return;
+	int flipbit = bitstring[3] & 1;
+	// The colors that pixel index 0 to 3 of each subblock correspond to.
+	int color_R[2][4], color_G[2][4], color_B[2][4];
+	// In individual and differential mode, the modifiers of each subblock, and whether any of the colors is
+	// clamped.
+	int modifier[2][4];
+	bool clamped[2] = { true, true };
+	int base_color_sum[2];
+	if (mode <= 1) {
+		int base_color[2][3];
+		for (int i = 0; i < 3; i++)
+			if (mode == 1) {
+				base_color[0][i] = (bitstring[i] & 0xF8) | ((bitstring[i] & 0xE0) >> 5);
+				base_color[1][i] = (bitstring[i] & 0xF8) + complement3bitshifted(bitstring[i] & 7);
+				base_color[1][i] |= (base_color[1][i] & 0xE0) >> 5;
+			}
+			else {
+				base_color[0][i] = (bitstring[i] & 0xF0) | ((bitstring[i] & 0xF0) >> 4);
+				base_color[1][i] = (bitstring[i] & 0x0F) | ((bitstring[i] & 0x0F) << 4);
+			}
+		int table_codeword[2];
+		table_codeword[0] = (bitstring[3] & 224) >> 5;
+		table_codeword[1] = (bitstring[3] & 28) >> 2;
+		for (int j = 0; j < 2; j++) {
+			clamped[j] = false;
+			for (int k = 0; k < 4; k++) {
+				modifier[j][k] = modifier_table[table_codeword[j]][k];
+				color_R[j][k] = clamp(base_color[j][0] + modifier[j][k]);
+				color_G[j][k] = clamp(base_color[j][1] + modifier[j][k]);
+				color_B[j][k] = clamp(base_color[j][2] + modifier[j][k]);
+				if (color_R[j][k] != base_color[j][0] + modifier[j][k] ||
+				color_G[j][k] != base_color[j][1] + modifier[j][k] ||
+				color_B[j][k] != base_color[j][2] + modifier[j][k])
+					clamped[j] = true;
+			}
+			base_color_sum[j] = base_color[j][0] + base_color[j][1] + base_color[j][2];
+		}
+	}
+	else {
+		// T and H mode use the same four paint colors for the whole block.
+		get_etc2_T_or_H_mode_paint_colors(bitstring, mode - 2, color_R[0], color_G[0], color_B[0]);
+		for (int k = 0; k < 4; k++) {
+			color_R[1][k] = color_R[0][k];
+			color_G[1][k] = color_G[0][k];
+			color_B[1][k] = color_B[0][k];
+		}
+	}
+	unsigned int pixel_index_word = 0;
+	for (int i = 0; i < 16; i++) {
+		// The pixels are stored in column-major order.
+		unsigned int pixel = pixels[(i & 3) * 4 + ((i & 12) >> 2)];
+		int r = pixel_get_r(pixel);
+		int g = pixel_get_g(pixel);
+		int b = pixel_get_b(pixel);
+		int subblock;
+		if (flipbit == 0)
+			subblock = i >> 3;
+		else
+			subblock = (i & 2) >> 1;
+		int best_error = INT_MAX;
+		int best_pixel_index = 0;
+		if (!clamped[subblock]) {
+			// Without clamping, the error of a modifier m is 3 * m * m + 2 * m * d plus a term that is
+			// the same for every modifier, with d the difference between the sums of the components of the
+			// base color and the pixel.
+			int d = base_color_sum[subblock] - (r + g + b);
+			for (int k = 0; k < 4; k++) {
+				int m = modifier[subblock][k];
+				int error = m * (3 * m + 2 * d);
+				if (error < best_error) {
+					best_error = error;
+					best_pixel_index = k;
+				}
+			}
+		}
+		else
+			for (int k = 0; k < 4; k++) {
+				int error = (color_R[subblock][k] - r) * (color_R[subblock][k] - r) +
+					(color_G[subblock][k] - g) * (color_G[subblock][k] - g) +
+					(color_B[subblock][k] - b) * (color_B[subblock][k] - b);
+				if (error < best_error) {
+					best_error = error;
+					best_pixel_index = k;
+				}
+			}
+		pixel_index_word |= ((unsigned int)(best_pixel_index & 1) << i) |
+			((unsigned int)(best_pixel_index & 2) << (16 + i - 1));
+	}
+	bitstring[4] = pixel_index_word >> 24;
+	bitstring[5] = (pixel_index_word >> 16) & 0xFF;
+	bitstring[6] = (pixel_index_word >> 8) & 0xFF;
+	bitstring[7] = pixel_index_word & 0xFF;
+}
+
+// Set the pixel indices of n ETC1 blocks stored consecutively in bitstrings to the optimal ones for the pixels of a
+// block (in row-major order), and store the error of each block over the width x height visible pixels in errors,
+// or - 1 for blocks that are not valid for the modes allowed by flags. This is equivalent to
+// optimize_block_indices_etc() followed by decoding and comparing each block, but the blocks are processed
+// BATCH_LANES at a time with the loops over the pixels running across the blocks, so that the compiler can
+// vectorize them.
+
+void optimize_block_indices_etc1_batch(int n, unsigned char *bitstrings, const unsigned int *pixels, int width,
+int height, int flags, int *errors) {
+	// The pixels in column-major order, as the pixel indices.
+	int pixel_r[16], pixel_g[16], pixel_b[16];
+	// The weight of a pixel is zero when it lies outside the image.
+	int weight[16];
+	for (int i = 0; i < 16; i++) {
+		unsigned int pixel = pixels[(i & 3) * 4 + ((i & 12) >> 2)];
+		pixel_r[i] = pixel_get_r(pixel);
+		pixel_g[i] = pixel_get_g(pixel);
+		pixel_b[i] = pixel_get_b(pixel);
+		weight[i] = (i >> 2) < width && (i & 3) < height;
+	}
+	for (int first = 0; first < n; first += BATCH_LANES) {
+		int nu_lanes = n - first;
+		if (nu_lanes > BATCH_LANES)
+			nu_lanes = BATCH_LANES;
+		int color_R[2][4][BATCH_LANES], color_G[2][4][BATCH_LANES], color_B[2][4][BATCH_LANES];
+		int flipbit[BATCH_LANES];
+		bool valid[BATCH_LANES];
+		for (int l = 0; l < nu_lanes; l++) {
+			const unsigned char *bitstring = &bitstrings[(first + l) * 8];
+			int differential_mode = bitstring[3] & 2;
+			valid[l] = (flags & (differential_mode ? ETC_MODE_ALLOWED_DIFFERENTIAL :
+				ETC_MODE_ALLOWED_INDIVIDUAL)) != 0;
+			flipbit[l] = bitstring[3] & 1;
+			int base_color[2][3];
+			for (int i = 0; i < 3; i++)
+				if (differential_mode) {
+					base_color[0][i] = (bitstring[i] & 0xF8) | ((bitstring[i] & 0xE0) >> 5);
+					base_color[1][i] = (bitstring[i] & 0xF8) + complement3bitshifted(bitstring[i] & 7);
+					if (base_color[1][i] & 0xFF07)
+						// Overflow.
+						valid[l] = false;
+					base_color[1][i] |= (base_color[1][i] & 0xE0) >> 5;
+				}
+				else {
+					base_color[0][i] = (bitstring[i] & 0xF0) | ((bitstring[i] & 0xF0) >> 4);
+					base_color[1][i] = (bitstring[i] & 0x0F) | ((bitstring[i] & 0x0F) << 4);
+				}
+			int table_codeword[2];
+			table_codeword[0] = (bitstring[3] & 224) >> 5;
+			table_codeword[1] = (bitstring[3] & 28) >> 2;
+			for (int j = 0; j < 2; j++)
+				for (int k = 0; k < 4; k++) {
+					int modifier = modifier_table[table_codeword[j]][k];
+					color_R[j][k][l] = clamp(base_color[j][0] + modifier);
+					color_G[j][k][l] = clamp(base_color[j][1] + modifier);
+					color_B[j][k][l] = clamp(base_color[j][2] + modifier);
+				}
+		}
+		int error[BATCH_LANES];
+		unsigned int pixel_index_word[BATCH_LANES];
+		for (int l = 0; l < nu_lanes; l++) {
+			error[l] = 0;
+			pixel_index_word[l] = 0;
+		}
+		// The loop over the blocks is kept free of branches.
+		for (int i = 0; i < 16; i++)
+			for (int l = 0; l < nu_lanes; l++) {
+				int subblock = flipbit[l] ? (i & 2) >> 1 : i >> 3;
+				int best_error = INT_MAX;
+				int best_pixel_index = 0;
+				for (int k = 0; k < 4; k++) {
+					int r = subblock ? color_R[1][k][l] : color_R[0][k][l];
+					int g = subblock ? color_G[1][k][l] : color_G[0][k][l];
+					int b = subblock ? color_B[1][k][l] : color_B[0][k][l];
+					int e = (r - pixel_r[i]) * (r - pixel_r[i]) + (g - pixel_g[i]) * (g - pixel_g[i]) +
+						(b - pixel_b[i]) * (b - pixel_b[i]);
+					best_pixel_index = e < best_error ? k : best_pixel_index;
+					best_error = e < best_error ? e : best_error;
+				}
+				error[l] += best_error * weight[i];
+				pixel_index_word[l] |= ((unsigned int)(best_pixel_index & 1) << i) |
+					((unsigned int)(best_pixel_index & 2) << (16 + i - 1));
+			}
+		for (int l = 0; l < nu_lanes; l++) {
+			if (!valid[l]) {
+				errors[first + l] = - 1;
+				continue;
+			}
+			unsigned char *bitstring = &bitstrings[(first + l) * 8];
+			bitstring[4] = pixel_index_word[l] >> 24;
+			bitstring[5] = (pixel_index_word[l] >> 16) & 0xFF;
+			bitstring[6] = (pixel_index_word[l] >> 8) & 0xFF;
+			bitstring[7] = pixel_index_word[l] & 0xFF;
+			errors[first + l] = error[l];
+		}
+	}
+}
+
 // set_mode functions: Try to modify the bitstring so that it conforms to a single mode if a single
 // mode is defined in flags.
 
@@ -1293,6 +1509,32 @@ void block4x4_etc1_set_mode(unsigned char *bitstring, int flags) {
 		bitstring[3] |= 0x2;
 }
 
+// Describe the fields of an ETC1 block. In individual mode each of the first three bytes holds a 4-bit component
+// of both base colors, in differential mode a 3-bit signed difference and a 5-bit component of the first base
+// color. The pixel indices are split into a least significant and a most significant bit plane, so each bit is a
+// field of its own.
+
+int block4x4_etc1_get_fields(const unsigned char *bitstring, BlockField *fields) {
+	int n = 0;
+	for (int i = 0; i < 3; i++)
+		if (bitstring[3] & 2) {
+			fields[n++] = (BlockField){ BLOCK_FIELD_SIGNED, i * 8, 3 };
+			fields[n++] = (BlockField){ BLOCK_FIELD_NUMERIC, i * 8 + 3, 5 };
+		}
+		else {
+			fields[n++] = (BlockField){ BLOCK_FIELD_NUMERIC, i * 8, 4 };
+			fields[n++] = (BlockField){ BLOCK_FIELD_NUMERIC, i * 8 + 4, 4 };
+		}
+	// Flip bit, differential bit and table codewords.
+	fields[n++] = (BlockField){ BLOCK_FIELD_OTHER, 24, 1 };
+	fields[n++] = (BlockField){ BLOCK_FIELD_OTHER, 25, 1 };
+	fields[n++] = (BlockField){ BLOCK_FIELD_NUMERIC, 26, 3 };
+	fields[n++] = (BlockField){ BLOCK_FIELD_NUMERIC, 29, 3 };
+	for (int i = 0; i < 32; i++)
+		fields[n++] = (BlockField){ BLOCK_FIELD_INDEX, 32 + i, 1 };
+	return n;
+}
+
 void block4x4_etc2_rgb8_set_mode(unsigned char *bitstring, int flags) {
 	if ((flags & ETC2_MODE_ALLOWED_ALL) == ETC_MODE_ALLOWED_INDIVIDUAL)
 		bitstring[3] &= ~0x2;
@@ -1314,3 +1556,608 @@ void block4x4_etc2_punchthrough_set_mode(unsigned char *bitstring, int flags) {
 	etc2_set_mode_THP(bitstring, flags);
 }
 
+
+// Encoding of blocks that only have one color, without the genetic algorithm.
+
+typedef struct {
+	int error;
+	int mode;	// 0 for individual mode, 1 for differential mode, 4 for planar mode.
+	int table;
+	int pixel_index;
+	int base[3];
+} ETCSingleColorEncoding;
+
+// Find the base color, table and pixel index of individual or differential mode that come closest to a color
+// when every pixel uses the same pixel index. When punchthrough is set, the modifiers of the punchthrough
+// alpha format are used, in which pixel index 2 is transparent.
+
+static void find_single_color_encoding(const int *color, int mode, bool punchthrough,
+ETCSingleColorEncoding *best) {
+	int nu_levels = mode == 0 ? 16 : 32;
+	for (int table = 0; table < 8; table++)
+		for (int pixel_index = 0; pixel_index < 4; pixel_index++) {
+			int modifier;
+			if (punchthrough) {
+				if (pixel_index == 2)
+					continue;
+				modifier = punchthrough_modifier_table[table][pixel_index];
+			}
+			else
+				modifier = modifier_table[table][pixel_index];
+			int error = 0;
+			int base[3];
+			for (int c = 0; c < 3; c++) {
+				int best_component_error = INT_MAX;
+				for (int level = 0; level < nu_levels; level++) {
+					int value;
+					if (mode == 0)
+						value = (level << 4) | level;
+					else
+						value = (level << 3) | (level >> 2);
+					int component_error = abs(clamp(value + modifier) - color[c]);
+					if (component_error < best_component_error) {
+						best_component_error = component_error;
+						base[c] = level;
+					}
+				}
+				error += best_component_error * best_component_error;
+			}
+			if (error < best->error) {
+				best->error = error;
+				best->mode = mode;
+				best->table = table;
+				best->pixel_index = pixel_index;
+				for (int c = 0; c < 3; c++)
+					best->base[c] = base[c];
+			}
+		}
+}
+
+// Find the 6-7-6 bit color of planar mode that comes closest to a color when the horizontal and vertical
+// colors are the same as the origin color.
+
+static void find_single_color_encoding_planar(const int *color, ETCSingleColorEncoding *best) {
+	int error = 0;
+	int base[3];
+	for (int c = 0; c < 3; c++) {
+		int bits = c == 1 ? 7 : 6;
+		int best_component_error = INT_MAX;
+		for (int level = 0; level < (1 << bits); level++) {
+			int value = (level << (8 - bits)) | (level >> (2 * bits - 8));
+			int component_error = abs(value - color[c]);
+			if (component_error < best_component_error) {
+				best_component_error = component_error;
+				base[c] = level;
+			}
+		}
+		error += best_component_error * best_component_error;
+	}
+	if (error < best->error) {
+		best->error = error;
+		best->mode = 4;
+		for (int c = 0; c < 3; c++)
+			best->base[c] = base[c];
+	}
+}
+
+// Set a block in planar mode with the given origin, horizontal and vertical colors in 6-7-6 bit format.
+
+static void set_planar_block(unsigned char *bitstring, const int *O, const int *H, const int *V) {
+	bitstring[0] = (O[0] << 1) | (O[1] >> 6);
+	bitstring[1] = ((O[1] & 0x3F) << 1) | (O[2] >> 5);
+	bitstring[2] = (O[2] & 0x18) | ((O[2] & 0x06) >> 1);
+	bitstring[3] = ((O[2] & 0x01) << 7) | ((H[0] & 0x3E) << 1) | 0x02 | (H[0] & 0x01);
+	bitstring[4] = (H[1] << 1) | (H[2] >> 5);
+	bitstring[5] = ((H[2] & 0x1F) << 3) | (V[0] >> 3);
+	bitstring[6] = ((V[0] & 0x07) << 5) | (V[1] >> 2);
+	bitstring[7] = ((V[1] & 0x03) << 6) | V[2];
+	// Keep the R and G differential values within range by setting the unused bit 7 to the sign of the
+	// difference, so that the mode is not T or H.
+	bitstring[0] |= (bitstring[0] & 0x04) << 5;
+	bitstring[1] |= (bitstring[1] & 0x04) << 5;
+	// Make the B differential value overflow.
+	etc2_set_mode_THP(bitstring, ETC2_MODE_ALLOWED_PLANAR);
+}
+
+// Encode the 64-bit color part of a block of which the pixels that are not transparent have one color. When
+// punchthrough is set, the transparent pixels are encoded as transparent in the punchthrough alpha format.
+// Return 0 when there is more than one color or none of the allowed modes is suitable.
+
+static int encode_single_color_block(const unsigned int *pixels, const bool *transparent, int flags,
+bool punchthrough, unsigned char *bitstring) {
+	int nu_colors = 0;
+	unsigned int rgb = 0;
+	bool has_transparent_pixels = false;
+	for (int i = 0; i < 16; i++) {
+		if (transparent[i]) {
+			has_transparent_pixels = true;
+			continue;
+		}
+		if (nu_colors > 0 && (pixels[i] & 0xFFFFFF) != rgb)
+			return 0;
+		rgb = pixels[i] & 0xFFFFFF;
+		nu_colors = 1;
+	}
+	// The opaque bit of the punchthrough alpha format takes the place of the differential bit, and individual
+	// mode is not available.
+	bool opaque = !(punchthrough && (has_transparent_pixels || (flags & MODES_ALLOWED_NON_OPAQUE_ONLY)));
+	if (punchthrough) {
+		if (!opaque && (flags & MODES_ALLOWED_OPAQUE_ONLY))
+			return 0;
+		flags &= ~ETC_MODE_ALLOWED_INDIVIDUAL;
+	}
+	int color[3] = { pixel_get_r(rgb), pixel_get_g(rgb), pixel_get_b(rgb) };
+	ETCSingleColorEncoding best;
+	best.error = INT_MAX;
+	if (flags & ETC_MODE_ALLOWED_INDIVIDUAL)
+		find_single_color_encoding(color, 0, false, &best);
+	if (flags & ETC_MODE_ALLOWED_DIFFERENTIAL)
+		find_single_color_encoding(color, 1, !opaque, &best);
+	if ((flags & ETC2_MODE_ALLOWED_PLANAR) && opaque)
+		find_single_color_encoding_planar(color, &best);
+	if (best.error == INT_MAX)
+		return 0;
+	if (best.mode == 4) {
+		// O, H and V all have the same color.
+		set_planar_block(bitstring, best.base, best.base, best.base);
+		return 1;
+	}
+	for (int c = 0; c < 3; c++)
+		if (best.mode == 0)
+			bitstring[c] = (best.base[c] << 4) | best.base[c];
+		else
+			// The difference with the second sub-block is zero.
+			bitstring[c] = best.base[c] << 3;
+	bitstring[3] = (best.table << 5) | (best.table << 2);
+	if (best.mode == 1 && opaque)
+		bitstring[3] |= 0x02;
+	unsigned int pixel_index_word = 0;
+	for (int i = 0; i < 16; i++) {
+		// The pixel indices are in column-major order.
+		unsigned int pixel_index = best.pixel_index;
+		if (transparent[(i & 3) * 4 + ((i & 12) >> 2)] && !opaque)
+			pixel_index = 2;
+		pixel_index_word |= ((pixel_index & 1) << i) | ((pixel_index & 2) << (16 + i - 1));
+	}
+	bitstring[4] = pixel_index_word >> 24;
+	bitstring[5] = pixel_index_word >> 16;
+	bitstring[6] = pixel_index_word >> 8;
+	bitstring[7] = pixel_index_word;
+	return 1;
+}
+
+// Encode the alpha part of an ETC2 EAC block when it can be represented exactly, which is the case when there is
+// only one alpha value or only the values 0 and 255. Return 0 otherwise.
+
+static int encode_exact_alpha_etc2_eac(unsigned char *alpha_values, unsigned char *bitstring) {
+	int nu_alpha_values = 1;
+	for (int i = 1; i < 16; i++)
+		if (alpha_values[i] != alpha_values[0]) {
+			nu_alpha_values = 2;
+			if (alpha_values[i] != 0 && alpha_values[i] != 0xFF)
+				return 0;
+			if (alpha_values[0] != 0 && alpha_values[0] != 0xFF)
+				return 0;
+		}
+	if (nu_alpha_values == 2) {
+		// Only the values 0 and 255.
+		optimize_block_alpha_etc2_eac(bitstring, alpha_values, MODES_ALLOWED_PUNCHTHROUGH_ONLY);
+		return 1;
+	}
+	// Select modifier table entry 13: { -1, -2, -3, -10, 0, 1, 2, 9 }, multiplier 1 and pixel index 4
+	// (modifier 0) for every pixel, so that every pixel value is equal to the base codeword.
+	bitstring[0] = alpha_values[0];
+	bitstring[1] = 13 | (1 << 4);
+	uint64_t pixels_word = 0;
+	for (int i = 0; i < 16; i++)
+		pixels_word |= (uint64_t)0x4 << (45 - i * 3);
+	for (int i = 0; i < 6; i++)
+		bitstring[i + 2] = (pixels_word >> (40 - i * 8)) & 0xFF;
+	return 1;
+}
+
+// Encode an ETC1, ETC2, ETC2 punchthrough or ETC2 EAC block of which the pixels that are not transparent have
+// one color, using the modes allowed by flags, and of which the alpha values can be represented exactly (one
+// alpha value, or only the values 0 and 255). The pixels are in row-major order. Return 0 when the block can
+// not be encoded this way.
+
+int encode_trivial_block4x4_etc(const unsigned int *pixels, int texture_type, int flags, unsigned char *bitstring) {
+	bool transparent[16];
+	unsigned char alpha_values[16];
+	for (int i = 0; i < 16; i++) {
+		alpha_values[i] = pixel_get_a(pixels[i]);
+		// The color of a pixel that is completely transparent in both the source and the texture doesn't
+		// matter.
+		transparent[i] = (texture_type & TEXTURE_TYPE_ALPHA_BIT) && alpha_values[i] == 0;
+	}
+	switch (texture_type) {
+	case TEXTURE_TYPE_ETC1 :
+	case TEXTURE_TYPE_ETC2_RGB8 :
+		return encode_single_color_block(pixels, transparent, flags, false, bitstring);
+	case TEXTURE_TYPE_ETC2_PUNCHTHROUGH :
+		for (int i = 0; i < 16; i++)
+			if (alpha_values[i] != 0 && alpha_values[i] != 0xFF)
+				return 0;
+		return encode_single_color_block(pixels, transparent, flags, true, bitstring);
+	case TEXTURE_TYPE_ETC2_EAC :
+		if (!encode_exact_alpha_etc2_eac(alpha_values, bitstring))
+			return 0;
+		return encode_single_color_block(pixels, transparent, flags, false, &bitstring[8]);
+	}
+	return 0;
+}
+
+// Least-squares encoding of blocks in planar mode, without the genetic algorithm.
+
+// Return the squared error of one component of the visible pixels of a block in planar mode with the given
+// 6 or 7-bit origin, horizontal and vertical values.
+
+static int planar_component_error(const int *values, int width, int height, int bits, int O, int H, int V) {
+	O = (O << (8 - bits)) | (O >> (2 * bits - 8));	// Replicate bits.
+	H = (H << (8 - bits)) | (H >> (2 * bits - 8));
+	V = (V << (8 - bits)) | (V >> (2 * bits - 8));
+	int error = 0;
+	for (int y = 0; y < height; y++)
+		for (int x = 0; x < width; x++) {
+			int d = clamp((x * (H - O) + y * (V - O) + 4 * O + 2) >> 2) - values[y * 4 + x];
+			error += d * d;
+		}
+	return error;
+}
+
+// Return the level with the given number of bits of which the replicated value comes closest to value.
+
+static int planar_component_level(double value, int bits) {
+	int level = (int)floor(value * ((1 << bits) - 1) / 255.0 + 0.5);
+	if (level < 0)
+		return 0;
+	if (level > (1 << bits) - 1)
+		return (1 << bits) - 1;
+	return level;
+}
+
+// Encode an ETC2 RGB8 or ETC2 EAC block in planar mode. The origin, horizontal and vertical colors are fitted to
+// the visible width x height pixels of the block (in row-major order) with least squares, after which the
+// levels around the rounded fit are searched for the smallest error. Planar mode is a linear gradient, so this
+// is close to the best possible planar block. For ETC2 EAC, the alpha part is only encoded when it can be
+// represented exactly; otherwise it is left unchanged and 0 is returned. Returns 1 when the whole block was
+// encoded.
+
+int encode_planar_block4x4_etc2(const unsigned int *pixels, int width, int height, int texture_type,
+unsigned char *bitstring) {
+	int r = 1;
+	if (texture_type == TEXTURE_TYPE_ETC2_EAC) {
+		unsigned char alpha_values[16];
+		for (int i = 0; i < 16; i++)
+			alpha_values[i] = pixel_get_a(pixels[i]);
+		r = encode_exact_alpha_etc2_eac(alpha_values, bitstring);
+		bitstring = &bitstring[8];
+	}
+	// The visible part of a block is a rectangle, so that the centered x and y coordinates are orthogonal and
+	// the gradients in the x and y direction can be fitted separately.
+	double mean_x = (width - 1) * 0.5;
+	double mean_y = (height - 1) * 0.5;
+	double variance_x = 0;
+	double variance_y = 0;
+	for (int y = 0; y < height; y++)
+		for (int x = 0; x < width; x++) {
+			variance_x += (x - mean_x) * (x - mean_x);
+			variance_y += (y - mean_y) * (y - mean_y);
+		}
+	int O[3], H[3], V[3];
+	for (int c = 0; c < 3; c++) {
+		int values[16];
+		double sum = 0;
+		double sum_x = 0;
+		double sum_y = 0;
+		for (int y = 0; y < height; y++)
+			for (int x = 0; x < width; x++) {
+				unsigned int pixel = pixels[y * 4 + x];
+				values[y * 4 + x] = c == 0 ? pixel_get_r(pixel) : (c == 1 ? pixel_get_g(pixel) :
+					pixel_get_b(pixel));
+				sum += values[y * 4 + x];
+				sum_x += (x - mean_x) * values[y * 4 + x];
+				sum_y += (y - mean_y) * values[y * 4 + x];
+			}
+		double gradient_x = variance_x > 0 ? sum_x / variance_x : 0;
+		double gradient_y = variance_y > 0 ? sum_y / variance_y : 0;
+		// The value at pixel (0, 0), and the extrapolated values at pixel (4, 0) and (0, 4).
+		double origin = sum / (width * height) - gradient_x * mean_x - gradient_y * mean_y;
+		int bits = c == 1 ? 7 : 6;
+		int O0 = planar_component_level(origin, bits);
+		int H0 = planar_component_level(origin + 4 * gradient_x, bits);
+		int V0 = planar_component_level(origin + 4 * gradient_y, bits);
+		int best_error = INT_MAX;
+		for (int i = O0 - 1; i <= O0 + 1; i++)
+			for (int j = H0 - 1; j <= H0 + 1; j++)
+				for (int k = V0 - 1; k <= V0 + 1; k++) {
+					if (i < 0 || j < 0 || k < 0 || i >= (1 << bits) || j >= (1 << bits) || k >= (1 << bits))
+						continue;
+					int error = planar_component_error(values, width, height, bits, i, j, k);
+					if (error < best_error) {
+						best_error = error;
+						O[c] = i;
+						H[c] = j;
+						V[c] = k;
+					}
+				}
+	}
+	set_planar_block(bitstring, O, H, V);
+	return r;
+}
+
+// Encoding of blocks in T or H mode from two clusters of pixels, without the genetic algorithm.
+
+// Divide the visible width x height pixels of a block (in row-major order) into two clusters with a few
+// iterations of k-means, starting with the two pixels that are farthest apart, and return the mean colors of
+// the clusters.
+
+static void find_two_pixel_clusters(const unsigned int *pixels, int width, int height, double mean[2][3]) {
+	int values[16][3];
+	int nu_pixels = 0;
+	for (int y = 0; y < height; y++)
+		for (int x = 0; x < width; x++) {
+			values[nu_pixels][0] = pixel_get_r(pixels[y * 4 + x]);
+			values[nu_pixels][1] = pixel_get_g(pixels[y * 4 + x]);
+			values[nu_pixels][2] = pixel_get_b(pixels[y * 4 + x]);
+			nu_pixels++;
+		}
+	int best_distance = - 1;
+	for (int i = 0; i < nu_pixels; i++)
+		for (int j = i + 1; j < nu_pixels; j++) {
+			int distance = 0;
+			for (int c = 0; c < 3; c++)
+				distance += (values[i][c] - values[j][c]) * (values[i][c] - values[j][c]);
+			if (distance > best_distance) {
+				best_distance = distance;
+				for (int c = 0; c < 3; c++) {
+					mean[0][c] = values[i][c];
+					mean[1][c] = values[j][c];
+				}
+			}
+		}
+	if (best_distance < 0) {
+		// Only one visible pixel.
+		for (int c = 0; c < 3; c++)
+			mean[0][c] = mean[1][c] = values[0][c];
+		return;
+	}
+	for (int iteration = 0; iteration < 4; iteration++) {
+		double sum[2][3] = { { 0, 0, 0 }, { 0, 0, 0 } };
+		int count[2] = { 0, 0 };
+		for (int i = 0; i < nu_pixels; i++) {
+			double distance[2] = { 0, 0 };
+			for (int k = 0; k < 2; k++)
+				for (int c = 0; c < 3; c++)
+					distance[k] += (values[i][c] - mean[k][c]) * (values[i][c] - mean[k][c]);
+			int k = distance[1] < distance[0];
+			for (int c = 0; c < 3; c++)
+				sum[k][c] += values[i][c];
+			count[k]++;
+		}
+		for (int k = 0; k < 2; k++)
+			if (count[k] > 0)
+				for (int c = 0; c < 3; c++)
+					mean[k][c] = sum[k][c] / count[k];
+	}
+}
+
+// Set the pixel indices of a block in T or H mode (mode 2 or 3) to the paint colors that come closest to the
+// visible pixels and return the error.
+
+static int set_T_or_H_mode_pixel_indices(unsigned char *bitstring, const unsigned int *pixels, int width,
+int height, int mode) {
+	int paint_color_R[4], paint_color_G[4], paint_color_B[4];
+	get_etc2_T_or_H_mode_paint_colors(bitstring, mode - 2, paint_color_R, paint_color_G, paint_color_B);
+	unsigned int pixel_index_word = 0;
+	int error = 0;
+	for (int i = 0; i < 16; i++) {
+		// The pixel indices are in column-major order.
+		int x = i >> 2;
+		int y = i & 3;
+		if (x >= width || y >= height)
+			continue;
+		unsigned int pixel = pixels[y * 4 + x];
+		int best_error = INT_MAX;
+		int best_pixel_index = 0;
+		for (int k = 0; k < 4; k++) {
+			int e = (paint_color_R[k] - pixel_get_r(pixel)) * (paint_color_R[k] - pixel_get_r(pixel)) +
+				(paint_color_G[k] - pixel_get_g(pixel)) * (paint_color_G[k] - pixel_get_g(pixel)) +
+				(paint_color_B[k] - pixel_get_b(pixel)) * (paint_color_B[k] - pixel_get_b(pixel));
+			if (e < best_error) {
+				best_error = e;
+				best_pixel_index = k;
+			}
+		}
+		error += best_error;
+		pixel_index_word |= ((unsigned int)(best_pixel_index & 1) << i) |
+			((unsigned int)(best_pixel_index & 2) << (16 + i - 1));
+	}
+	bitstring[4] = pixel_index_word >> 24;
+	bitstring[5] = (pixel_index_word >> 16) & 0xFF;
+	bitstring[6] = (pixel_index_word >> 8) & 0xFF;
+	bitstring[7] = pixel_index_word & 0xFF;
+	return error;
+}
+
+// Set the base colors (in 4-4-4 bit format) and distance index of a block in T mode.
+
+static void set_T_mode_block(unsigned char *bitstring, const int *color1, const int *color2, int distance_index) {
+	bitstring[0] = ((color1[0] & 0xC) << 1) | (color1[0] & 0x3);
+	bitstring[1] = (color1[1] << 4) | color1[2];
+	bitstring[2] = (color2[0] << 4) | color2[1];
+	bitstring[3] = (color2[2] << 4) | ((distance_index & 0x6) << 1) | 0x2 | (distance_index & 0x1);
+	// Make the R differential value overflow.
+	etc2_set_mode_THP(bitstring, ETC2_MODE_ALLOWED_T);
+}
+
+// Set the base colors (in 4-4-4 bit format) and distance index of a block in H mode. The least significant bit of
+// the distance index is implied by the order of the base colors, so they are swapped when required. Return 0 when
+// that is not possible because the base colors are equal.
+
+static int set_H_mode_block(unsigned char *bitstring, const int *color1, const int *color2, int distance_index) {
+	int value1 = (color1[0] << 8) | (color1[1] << 4) | color1[2];
+	int value2 = (color2[0] << 8) | (color2[1] << 4) | color2[2];
+	if ((value1 >= value2) != (distance_index & 1)) {
+		if (value1 == value2)
+			return 0;
+		const int *color = color1;
+		color1 = color2;
+		color2 = color;
+	}
+	bitstring[0] = (color1[0] << 3) | (color1[1] >> 1);
+	bitstring[1] = ((color1[1] & 0x1) << 4) | (color1[2] & 0x8) | ((color1[2] & 0x6) >> 1);
+	bitstring[2] = ((color1[2] & 0x1) << 7) | (color2[0] << 3) | (color2[1] >> 1);
+	bitstring[3] = ((color2[1] & 0x1) << 7) | (color2[2] << 3) | (distance_index & 0x4) | 0x2 |
+		((distance_index & 0x2) >> 1);
+	// Keep the R differential value within range by setting the unused bit 7 to the sign of the difference, so
+	// that the mode is not T.
+	bitstring[0] |= (bitstring[0] & 0x04) << 5;
+	// Make the G differential value overflow.
+	etc2_set_mode_THP(bitstring, ETC2_MODE_ALLOWED_H);
+	return 1;
+}
+
+// Encode the color part of an ETC2 RGB8 or ETC2 EAC block in T or H mode (mode 2 or 3). The visible width x height
+// pixels of the block (in row-major order) are divided into two clusters, of which the mean colors are used as
+// the base colors, and the distance index with the smallest error is selected. In T mode, both assignments of the
+// clusters to the base colors are tried. The pixel indices are set to the closest paint colors. For ETC2 EAC,
+// the alpha part is left unchanged.
+
+void encode_T_or_H_block4x4_etc2(const unsigned int *pixels, int width, int height, int mode, int texture_type,
+unsigned char *bitstring) {
+	if (texture_type == TEXTURE_TYPE_ETC2_EAC)
+		bitstring = &bitstring[8];
+	double mean[2][3];
+	find_two_pixel_clusters(pixels, width, height, mean);
+	int color[2][3];
+	for (int k = 0; k < 2; k++)
+		for (int c = 0; c < 3; c++) {
+			color[k][c] = (int)floor(mean[k][c] * 15.0 / 255.0 + 0.5);
+			if (color[k][c] > 15)
+				color[k][c] = 15;
+		}
+	if (mode == 3 && color[0][0] == color[1][0] && color[0][1] == color[1][1] && color[0][2] == color[1][2]) {
+		// H mode cannot encode two equal base colors. Step the component of the second color in which the
+		// cluster means differ most by one in the direction of its mean.
+		int c = 0;
+		for (int i = 1; i < 3; i++)
+			if (fabs(mean[1][i] - mean[0][i]) > fabs(mean[1][c] - mean[0][c]))
+				c = i;
+		if ((mean[1][c] >= mean[0][c] && color[1][c] < 15) || color[1][c] == 0)
+			color[1][c]++;
+		else
+			color[1][c]--;
+	}
+	int best_error = INT_MAX;
+	unsigned char candidate[8];
+	for (int order = 0; order < (mode == 2 ? 2 : 1); order++)
+		for (int distance_index = 0; distance_index < 8; distance_index++) {
+			if (mode == 2)
+				set_T_mode_block(candidate, color[order], color[order ^ 1], distance_index);
+			else
+				set_H_mode_block(candidate, color[0], color[1], distance_index);
+			int error = set_T_or_H_mode_pixel_indices(candidate, pixels, width, height, mode);
+			if (error < best_error) {
+				best_error = error;
+				memcpy(bitstring, candidate, 8);
+			}
+		}
+}
+
+// Return the squared error of a set of distinct values with counts when encoded with the given EAC palette. The
+// calculation stops as soon as the error is not smaller than max_error.
+
+static int eac_palette_error(const int *palette, const int *value, const int *value_count, int nu_values,
+int max_error) {
+	int error = 0;
+	for (int i = 0; i < nu_values && error < max_error; i++) {
+		int value_error = INT_MAX;
+		for (int k = 0; k < 8; k++) {
+			int d = palette[k] - value[i];
+			if (d * d < value_error)
+				value_error = d * d;
+		}
+		error += value_count[i] * value_error;
+	}
+	return error;
+}
+
+// Encode the alpha part of an ETC2 EAC block with the smallest possible squared error of the visible width x height
+// alpha values (16 values in row-major order). Every combination of modifier table, multiplier and base codeword
+// is considered, but most are rejected with a lower bound of the error, which is the error of the values that lie
+// outside the range of the palette. The color part of the bitstring is left unchanged.
+
+void encode_optimal_alpha_block4x4_etc2_eac(const unsigned char *alpha_values, int width, int height,
+unsigned char *bitstring) {
+	int count[256];
+	memset(count, 0, sizeof(count));
+	for (int y = 0; y < height; y++)
+		for (int x = 0; x < width; x++)
+			count[alpha_values[y * 4 + x]]++;
+	int value[16], value_count[16];
+	int nu_values = 0;
+	for (int v = 0; v < 256; v++)
+		if (count[v] > 0) {
+			value[nu_values] = v;
+			value_count[nu_values] = count[v];
+			nu_values++;
+		}
+	// Lower bounds of the error of the values below and above a palette value.
+	int error_below[256], error_above[256];
+	for (int e = 0; e < 256; e++) {
+		error_below[e] = error_above[e] = 0;
+		for (int i = 0; i < nu_values; i++)
+			if (value[i] < e)
+				error_below[e] += value_count[i] * (e - value[i]) * (e - value[i]);
+			else
+				error_above[e] += value_count[i] * (value[i] - e) * (value[i] - e);
+	}
+	int best_error = INT_MAX;
+	int best_base_codeword = 0;
+	int best_modifier_table = 0;
+	int best_multiplier = 1;
+	for (int modifier_table = 0; modifier_table < 16 && best_error > 0; modifier_table++) {
+		// Modifier 3 is the most negative one and modifier 7 the most positive one.
+		const char *modifiers = eac_modifier_table[modifier_table];
+		for (int multiplier = 1; multiplier < 16; multiplier++)
+			for (int base_codeword = 0; base_codeword < 256; base_codeword++) {
+				int bound = error_below[clamp(base_codeword + modifiers[3] * multiplier)] +
+					error_above[clamp(base_codeword + modifiers[7] * multiplier)];
+				if (bound >= best_error)
+					continue;
+				int palette[8];
+				for (int k = 0; k < 8; k++)
+					palette[k] = clamp(base_codeword + modifiers[k] * multiplier);
+				int error = eac_palette_error(palette, value, value_count, nu_values, best_error);
+				if (error < best_error) {
+					best_error = error;
+					best_base_codeword = base_codeword;
+					best_modifier_table = modifier_table;
+					best_multiplier = multiplier;
+				}
+			}
+	}
+	int palette[8];
+	for (int k = 0; k < 8; k++)
+		palette[k] = clamp(best_base_codeword + eac_modifier_table[best_modifier_table][k] * best_multiplier);
+	uint64_t pixels_word = 0;
+	for (int i = 0; i < 16; i++) {
+		// The pixels are stored in column-major order.
+		int alpha = alpha_values[(i & 3) * 4 + (i >> 2)];
+		uint64_t best_k = 0;
+		int best_value_error = INT_MAX;
+		for (int k = 0; k < 8; k++) {
+			int d = palette[k] - alpha;
+			if (d * d < best_value_error) {
+				best_value_error = d * d;
+				best_k = k;
+			}
+		}
+		pixels_word |= best_k << (45 - i * 3);
+	}
+	bitstring[0] = best_base_codeword;
+	bitstring[1] = best_modifier_table | (best_multiplier << 4);
+	for (int i = 0; i < 6; i++)
+		bitstring[i + 2] = (pixels_word >> (40 - i * 8)) & 0xFF;
+}
@@ -26,22 +26,48 @@ OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 #include "decode.h"
 #include "packing.h"
 
+// Open a file for reading or writing. mode is passed to fopen().
+
+FILE *open_file(const char *filename, const char *mode) {
+	FILE *f = fopen(filename, mode);
+	if (f == NULL) {
+		report_error("Error -- could not open file %s.\n", filename);
+	}
+	return f;
+}
+
+// Free the pixels of the mipmap levels of a texture that have been loaded when an error is reported.
+
+static void free_texture_levels(Texture *texture, int nu_levels) {
+	for (int i = 0; i < nu_levels; i++) {
+		free(texture[i].pixels);
+		texture[i].pixels = NULL;
+	}
+}
+
 // Load a .pkm texture.
 
 void load_pkm_file(const char *filename, Texture *texture) {
 	if (!option_quiet)
 		printf("Reading .pkm file %s.\n", filename);
-	FILE *f = fopen(filename, "rb");
+	FILE *f = open_file(filename, "rb");
+	load_pkm_stream(f, texture);
+	fclose(f);
+}
+
+// Load a .pkm texture from a stream.
+
+void load_pkm_stream(FILE *f, Texture *texture) {
 	unsigned char header[16];
-	fread(header, 1, 16, f);
+	if (fread(header, 1, 16, f) < 16) {
+		report_error("Error -- unexpected end of .pkm data.\n");
+	}
 	if (header[0] != 'P' || header[1] != 'K' || header[2] != 'M' || header[3] != ' ') {
-		printf("Error -- couldn't find PKM signature.\n");
-		exit(1);
+		report_error("Error -- couldn't find PKM signature.\n");
 	}
 	int texture_type = ((int)header[6] << 8) | header[7];
 	if (texture_type != 0 && texture_type != 1) {
-		printf("Error -- unsupported format (only ETC1 and ETC2 RGB8 supported).\n");
-		exit(1);
+		report_error("Error -- unsupported format (only ETC1 and ETC2 RGB8 supported).\n");
 	}
 	int ext_width = ((int)header[8] << 8) | header[9];
 	int ext_height = ((int)header[10] << 8) | header[11];
@@ -51,10 +77,9 @@ void load_pkm_file(const char *filename, Texture *texture) {
 	texture->bits_per_block = 64;
 	texture->pixels = (unsigned int *)malloc(n * (texture->bits_per_block / 8));
 	if (fread(texture->pixels, 1, n * (texture->bits_per_block / 8), f) < n * (texture->bits_per_block / 8)) {
-		printf("Error reading file %s.\n", filename);
-		exit (1);
+		free_texture_levels(texture, 1);
+		report_error("Error -- unexpected end of .pkm data.\n");
 	}
-	fclose(f);
 	texture->extended_width = ext_width;
 	texture->extended_height = ext_height;
 	texture->width = width;
@@ -72,11 +97,14 @@ void load_pkm_file(const char *filename, Texture *texture) {
 void save_pkm_file(Texture *texture, const char *filename) {
 	if (!option_quiet)
 		printf("Writing .pkm file %s with texture format %s.\n", filename, texture->info->text1);
-	FILE *f = fopen(filename, "wb");
-	if (f == NULL) {
-		printf("Error opening output file.\n");
-		exit(1);
-	}
+	FILE *f = open_file(filename, "wb");
+	save_pkm_stream(texture, f);
+	fclose(f);
+}
+
+// Write a .pkm texture to a stream.
+
+void save_pkm_stream(Texture *texture, FILE *f) {
 	fputc('P', f); fputc('K', f); fputc('M', f); fputc(' ', f);
 	fputc('1', f); fputc('0', f);
 	fputc(0, f); fputc(0, f);
@@ -89,8 +117,7 @@ void save_pkm_file(Texture *texture, const char *filename) {
 		pkm_texture_type = 1;
 		break;
 	default :
-		printf("Error -- writing of texture format to .pkm file not supported.\n");
-		exit(1);
+		report_error("Error -- writing of texture format to .pkm file not supported.\n");
 	}
 	fputc((pkm_texture_type & 0xFF00) >> 8, f);
 	fputc((pkm_texture_type & 0xFF), f);
@@ -105,7 +132,6 @@ void save_pkm_file(Texture *texture, const char *filename) {
 	fputc((texture->height & 0xFF), f);
 	int n = (texture->extended_height / texture->block_height) * (texture->extended_width / texture->block_width);
 	fwrite(texture->pixels, 1, n * (texture->bits_per_block / 8), f);
-	fclose(f);
 }
 
 // Load a .ktx texture. At most max_mipmaps are stored in the array of Textures texture. The number of
@@ -116,12 +142,21 @@ static unsigned char ktx_id[12] = { 0xAB, 0x4B, 0x54, 0x58, 0x20, 0x31, 0x31, 0x
 int load_ktx_file(const char *filename, int max_mipmaps, Texture *texture) {
 	if (!option_quiet)
 		printf("Reading .ktx file %s.\n", filename);
-	FILE *f = fopen(filename, "rb");
+	FILE *f = open_file(filename, "rb");
+	int n = load_ktx_stream(f, max_mipmaps, texture);
+	fclose(f);
+	return n;
+}
+
+// Load a .ktx texture from a stream.
+
+int load_ktx_stream(FILE *f, int max_mipmaps, Texture *texture) {
 	int header[16];
-	fread(header, 1, 64, f);
+	if (fread(header, 1, 64, f) < 64) {
+		report_error("Error -- unexpected end of .ktx data.\n");
+	}
 	if (memcmp(header, ktx_id, 12) != 0) {
-		printf("Error -- couldn't find KTX signature.\n");
-		exit(1);
+		report_error("Error -- couldn't find KTX signature.\n");
 	}
 	int wrong_endian = 0;
 	if (header[3] == 0x01020304) {
@@ -144,8 +179,7 @@ int load_ktx_file(const char *filename, int max_mipmaps, Texture *texture) {
 	int pixelDepth = header[11];
 	TextureInfo *info = match_ktx_id(glInternalFormat, glFormat, glType);
 	if (info == NULL) {
-		printf("Error -- unsupported format in .ktx file (glInternalFormat = 0x%04X).\n", glInternalFormat);
-		exit(1);
+		report_error("Error -- unsupported format in .ktx file (glInternalFormat = 0x%04X).\n", glInternalFormat);
 	}
 	type = info->type;
 	if (type == TEXTURE_TYPE_DXT1 && option_texture_format == TEXTURE_TYPE_DXT1A) {
@@ -170,8 +204,8 @@ int load_ktx_file(const char *filename, int max_mipmaps, Texture *texture) {
 		// Skip metadata.
 		unsigned char *metadata = (unsigned char *)malloc(header[15]);
 		if (fread(metadata, 1, header[15], f) < header[15]) {
-			printf("Error reading metadata.\n");
-			exit(1);
+			free(metadata);
+			report_error("Error reading metadata.\n");
 		}
 		free(metadata);
 	}
@@ -193,9 +227,9 @@ int load_ktx_file(const char *filename, int max_mipmaps, Texture *texture) {
 		type != TEXTURE_TYPE_UNCOMPRESSED_R16 && type != TEXTURE_TYPE_UNCOMPRESSED_SIGNED_R16 &&
 		type != TEXTURE_TYPE_UNCOMPRESSED_R_HALF_FLOAT &&
 		*(int *)&image_size[0] != n * (ktx_block_size / 8)) {
-			printf("Error -- image size field of mipmap level %d does not match (%d vs %d).\n",
+			free_texture_levels(texture, i);
+			report_error("Error -- image size field of mipmap level %d does not match (%d vs %d).\n",
 				i, *(int *)&image_size[0], n * (ktx_block_size / 8));
-			exit(1);
 		}
 		texture[i].info = info;
 		texture[i].width = width;
@@ -217,22 +251,22 @@ int load_ktx_file(const char *filename, int max_mipmaps, Texture *texture) {
 				if (*(int *)&image_size[0] == height * row_size_no_padding) {
 					// This file violates .ktx specification by have no 32-bit row alignment.
 					// Load it anyway.
-					printf("Warning: file %s violates KTX row alignment specification for "
-						"uncompressed textures.\n", filename);
+					printf("Warning: .ktx data violates KTX row alignment specification for "
+						"uncompressed textures.\n");
 					row_size = row_size_no_padding;
 				}
 				else {
-					printf("Error -- image size field of mipmap level %d does not match (%d vs %d).\n",
-						i, *(int *)&image_size[0], height * row_size);
-					printf("bpp = %d, ktx_block_size == %d\n", bpp, ktx_block_size);
-					exit(1);
+					free_texture_levels(texture, i + 1);
+					report_error("Error -- image size field of mipmap level %d does not match (%d vs %d).\n"
+						"bpp = %d, ktx_block_size == %d\n", i, *(int *)&image_size[0], height * row_size,
+						bpp, ktx_block_size);
 				}
 			}
 			unsigned char *row = (unsigned char *)alloca(row_size);
 			for (int y = 0; y < height; y++) {
 				if (fread(row, 1, row_size, f) < row_size) {
-					printf("Error reading file %s.\n", filename);
-					exit(1);
+					free_texture_levels(texture, i + 1);
+					report_error("Error -- unexpected end of .ktx data.\n");
 				}
 				for (int x = 0; x < width; x++) {
 					unsigned int pixel;
@@ -264,16 +298,16 @@ int load_ktx_file(const char *filename, int max_mipmaps, Texture *texture) {
 						*(uint64_t *)&texture[i].pixels[(y * extended_width + x) * 2] = pack_half_float(*(uint16_t *)&row[x * 4],
 							*(uint16_t *)&row[x * 4 + 2]);
 					else {
-						printf("Error -- cannot handle combination of internal size and real size of texture data.\n");
-							exit(1);
+						free_texture_levels(texture, i + 1);
+						report_error("Error -- cannot handle combination of internal size and real size of texture data.\n");
 					}
 				}
 			}
 		}
 		else
 			if (fread(texture[i].pixels, 1, n * (ktx_block_size / 8), f) < n * (ktx_block_size / 8)) {
-				printf("Error reading file %s.\n", filename);
-				exit (1);
+				free_texture_levels(texture, i + 1);
+				report_error("Error -- unexpected end of .ktx data.\n");
 			}
 		// Divide by two for the next mipmap level, rounding down.
 		width >>= 1;
@@ -285,7 +319,6 @@ int load_ktx_file(const char *filename, int max_mipmaps, Texture *texture) {
 		if (i + 1 < max_mipmaps && i + 1 < nu_mipmaps)
 			fread(buffer, 1, 3 - ((*(int *)&image_size[0] + 3) % 4), f);
 	}
-	fclose(f);
 	// Return the number of stored textures.
 	if (max_mipmaps < nu_mipmaps)
 		return max_mipmaps;
@@ -303,11 +336,14 @@ static char ktx_orientation_key_up[24] = { 'K', 'T', 'X', 'o', 'r', 'i', 'e', 'n
 void save_ktx_file(Texture *texture, int nu_mipmaps, const char *filename) {
 	if (!option_quiet)
 		printf("Writing .ktx file %s with texture format %s.\n", filename, texture->info->text1);
-	FILE *f = fopen(filename, "wb");
-	if (f == NULL) {
-		printf("Error opening output file.\n");
-		exit(1);
-	}
+	FILE *f = open_file(filename, "wb");
+	save_ktx_stream(texture, nu_mipmaps, f);
+	fclose(f);
+}
+
+// Write a .ktx texture to a stream.
+
+void save_ktx_stream(Texture *texture, int nu_mipmaps, FILE *f) {
 	unsigned int header[16];
 	memset(header, 0, 64);
 	memcpy(header, ktx_id, 12);	// Set id.
@@ -435,7 +471,6 @@ void save_ktx_file(Texture *texture, int nu_mipmaps, const char *filename) {
 			fwrite(texture[i].pixels, 1, n * (texture[i].bits_per_block / 8), f);
 		}
 	}
-	fclose(f);
 }
 
 // Load a .dds texture.
@@ -443,19 +478,23 @@ void save_ktx_file(Texture *texture, int nu_mipmaps, const char *filename) {
 int load_dds_file(const char *filename, int max_mipmaps, Texture *texture) {
 	if (!option_quiet)
 		printf("Reading .dds file %s.\n", filename);
-	FILE *f = fopen(filename, "rb");
-	if (f == NULL) {
-		printf("Error opening file %s.\n", filename);
-		exit(1);
-	}
+	FILE *f = open_file(filename, "rb");
+	int n = load_dds_stream(f, max_mipmaps, texture);
+	fclose(f);
+	return n;
+}
+
+// Load a .dds texture from a stream.
+
+int load_dds_stream(FILE *f, int max_mipmaps, Texture *texture) {
 	char id[4];
-	fread(id, 1, 4, f);
+	unsigned char header[124];
+	if (fread(id, 1, 4, f) < 4 || fread(header, 1, 124, f) < 124) {
+		report_error("Error -- unexpected end of .dds data.\n");
+	}
 	if (id[0] != 'D' || id[1] != 'D' || id[2] != 'S' || id[3] != ' ') {
-		printf("Error -- couldn't find DDS signature.\n");
-		exit(1);
+		report_error("Error -- couldn't find DDS signature.\n");
 	}
-	unsigned char header[124];
-	fread(header, 1, 124, f);
 	int width = *(unsigned int *)&header[12];
 	int height = *(unsigned int *)&header[8];
 	int pitch = *(unsigned int *)&header[16];
@@ -476,18 +515,18 @@ int load_dds_file(const char *filename, int max_mipmaps, Texture *texture) {
 	unsigned int dx10_format = 0;
 	if (strncmp(four_cc, "DX10", 4) == 0) {
 		unsigned char dx10_header[20];
-		fread(dx10_header, 1, 20, f);
+		if (fread(dx10_header, 1, 20, f) < 20) {
+			report_error("Error -- unexpected end of .dds data.\n");
+		}
 		dx10_format = *(unsigned int *)&dx10_header[0];
 		unsigned int resource_dimension = *(unsigned int *)&dx10_header[4];
 		if (resource_dimension != 3) {
-			printf("Error -- only 2D textures supported for .dds files.\n");
-			exit(1);
+			report_error("Error -- only 2D textures supported for .dds files.\n");
 		}
 	}
 	TextureInfo *info = match_dds_id(four_cc, dx10_format, pixel_format_flags, bitcount, red_mask, green_mask, blue_mask, alpha_mask);
 	if (info == NULL) {
-		printf("Error -- unsupported format in .dds file (fourCC = %s, DX10 format = %d).\n", four_cc, dx10_format);
-		exit(1);
+		report_error("Error -- unsupported format in .dds file (fourCC = %s, DX10 format = %d).\n", four_cc, dx10_format);
 	}
 	type = info->type;
 	if (type == TEXTURE_TYPE_DXT1 && option_texture_format == TEXTURE_TYPE_DXT1A) {
@@ -532,8 +571,8 @@ int load_dds_file(const char *filename, int max_mipmaps, Texture *texture) {
 			texture[i].pixels = (unsigned int *)malloc(n * (internal_bits_per_block / 8));
 			for (int y = 0; y < height; y++) {
 				if (fread(row, 1, row_size, f) < row_size) {
-					printf("Error reading file %s.\n", filename);
-					exit(1);
+					free_texture_levels(texture, i + 1);
+					report_error("Error -- unexpected end of .dds data.\n");
 				}
 				if (bpp == 3)
 					for (int x = 0; x < width; x++)
@@ -559,9 +598,9 @@ int load_dds_file(const char *filename, int max_mipmaps, Texture *texture) {
 							pack_half_float(*(uint16_t *)&row[x * 4],
 							*(uint16_t *)&row[x * 4 + 2]);
 				else {
-					printf("Error -- cannot handle combination of internal size and real size "
+					free_texture_levels(texture, i + 1);
+					report_error("Error -- cannot handle combination of internal size and real size "
 						"of texture data.\n");
-					exit(1);
 				}
 			}
 		}
@@ -569,9 +608,9 @@ int load_dds_file(const char *filename, int max_mipmaps, Texture *texture) {
 			texture[i].pixels = (unsigned int *)malloc(n * (internal_bits_per_block / 8));
 			int r = fread(texture[i].pixels, 1, n * (internal_bits_per_block / 8), f);
 			if (r < n * (internal_bits_per_block / 8)) {
-				printf("Error reading file %s.\n", filename);
-				printf("%d bytes read vs. %d requested.\n", r, n * (internal_bits_per_block / 8));
-				exit(1);
+				free_texture_levels(texture, i + 1);
+				report_error("Error -- unexpected end of .dds data (%d bytes read vs. %d requested).\n", r,
+					n * (internal_bits_per_block / 8));
 			}
 		}
 		// Divide by two for the next mipmap level, rounding down.
@@ -580,7 +619,6 @@ int load_dds_file(const char *filename, int max_mipmaps, Texture *texture) {
 		extended_width = ((width + block_width - 1) / block_width) * block_width;
 		extended_height = ((height + block_height - 1) / block_height) * block_height;
 	}
-	fclose(f);
 	// Return the number of stored textures.
 	if (max_mipmaps < nu_mipmaps)
 		return max_mipmaps;
@@ -593,12 +631,15 @@ int load_dds_file(const char *filename, int max_mipmaps, Texture *texture) {
 void save_dds_file(Texture *texture, int nu_mipmaps, const char *filename) {
 	if (!option_quiet)
 		printf("Writing .dds file %s with texture format %s.\n", filename, texture->info->text1);
+	FILE *f = open_file(filename, "wb");
+	save_dds_stream(texture, nu_mipmaps, f);
+	fclose(f);
+}
+
+// Write a .dds texture to a stream.
+
+void save_dds_stream(Texture *texture, int nu_mipmaps, FILE *f) {
 	int n = (texture->extended_height / texture->block_height) * (texture->extended_width / texture->block_width);
-	FILE *f = fopen(filename, "wb");
-	if (f == NULL) {
-		printf("Error opening output file.\n");
-		exit(1);
-	}
 	fputc('D', f); fputc('D', f); fputc('S', f); fputc(' ', f);
 	unsigned char header[124];
 	unsigned char dx10_header[20];
@@ -740,14 +781,12 @@ void save_dds_file(Texture *texture, int nu_mipmaps, const char *filename) {
 				}
 			}
 			else {
-				printf("Error -- unsupported pixel size when writing .dds file.\n"
+				report_error("Error -- unsupported pixel size when writing .dds file.\n"
 					"bits_per_block = %d, internal_bits_per_block = %d.\n",
 					texture[i].bits_per_block, texture[i].info->internal_bits_per_block);
-				exit(1);
 			}
 		}
 	}
-	fclose(f);
 }
 
 // Load an .astc file.
@@ -755,24 +794,30 @@ void save_dds_file(Texture *texture, int nu_mipmaps, const char *filename) {
 void load_astc_file(const char *filename, Texture *texture) {
 	if (!option_quiet)
 		printf("Reading .astc file %s.\n", filename);
-	FILE *f = fopen(filename, "rb");
+	FILE *f = open_file(filename, "rb");
+	load_astc_stream(f, texture);
+	fclose(f);
+}
+
+// Load an .astc texture from a stream.
+
+void load_astc_stream(FILE *f, Texture *texture) {
 	unsigned char header[16];
-	fread(header, 1, 16, f);
+	if (fread(header, 1, 16, f) < 16) {
+		report_error("Error -- unexpected end of .astc data.\n");
+	}
 	if (header[0] != 0x13 || header[1] != 0xAB || header[2] != 0xA1 || header[3] != 0x5c) {
-		printf("Error -- couldn't find ASTC signature.\n");
-		exit(1);
+		report_error("Error -- couldn't find ASTC signature.\n");
 	}
 	int blockdim_x = header[4];
 	int blockdim_y = header[5];
 	int blockdim_z = header[6];
 	if (blockdim_z != 1) {
-		printf("Error -- 3D blocksize not supported.\n");
-		exit(1);
+		report_error("Error -- 3D blocksize not supported.\n");
 	}
 	int i = match_astc_block_size(blockdim_x, blockdim_y);
 	if (i == - 1) {
-		printf("Error -- unrecognized block size in .astc file.\n");
-		exit(1);
+		report_error("Error -- unrecognized block size in .astc file.\n");
 	}
 	texture->block_width = blockdim_x;
 	texture->block_height = blockdim_y;
@@ -780,8 +825,7 @@ void load_astc_file(const char *filename, Texture *texture) {
 	int height = header[10] + (int)header[11] * 256 + (int)header[12] * 65536;
 	int zsize = header[13] + (int)header[14] * 256 + (int)header[15] * 65536;
 	if (zsize != 1) {
-		printf("Error -- 3D textures not supported.\n");
-		exit(1);
+		report_error("Error -- 3D textures not supported.\n");
 	}
 	int xblocks = (width + blockdim_x - 1) / blockdim_x;
 	int yblocks = (height + blockdim_y - 1) / blockdim_y;
@@ -790,10 +834,9 @@ void load_astc_file(const char *filename, Texture *texture) {
 	texture->pixels = (unsigned int *)malloc(n * 16);
 	texture->bits_per_block = 128;
 	if (fread(texture->pixels, 1, n * 16, f) < n * 16) {
-		printf("Error reading file %s.\n", filename);
-		exit (1);
+		free_texture_levels(texture, 1);
+		report_error("Error -- unexpected end of .astc data.\n");
 	}
-	fclose(f);
 	texture->extended_width = xblocks * blockdim_x;
 	texture->extended_height = yblocks * blockdim_y;
 	texture->width = width;
@@ -807,11 +850,14 @@ void load_astc_file(const char *filename, Texture *texture) {
 void save_astc_file(Texture *texture, const char *filename) {
 	if (!option_quiet)
 		printf("Writing .astc file %s.\n", filename);
-	FILE *f = fopen(filename, "wb");
-	if (f == NULL) {
-		printf("Error opening output file.\n");
-		exit(1);
-	}
+	FILE *f = open_file(filename, "wb");
+	save_astc_stream(texture, f);
+	fclose(f);
+}
+
+// Write an .astc texture to a stream.
+
+void save_astc_stream(Texture *texture, FILE *f) {
 	unsigned char header[16];
 	header[0] = 0x13; header[1] = 0xAB; header[2] = 0xA1; header[3] = 0x5C;
 	header[4] = texture->block_width;
@@ -830,7 +876,6 @@ void save_astc_file(Texture *texture, const char *filename) {
 	fwrite(header, 1, 16, f);
 	int n = (texture->extended_height / texture->block_height) * (texture->extended_width / texture->block_width);
 	fwrite(texture->pixels, 1, n * (texture->bits_per_block / 8), f);
-	fclose(f);
 }
 
 // Load a .ppm file.
@@ -842,9 +887,23 @@ void load_ppm_file(const char *filename, Image *image) {
 	fclose(f);
 }
 
+static void free_png_rows(png_bytep *row_pointers, int height) {
+	for (int y = 0; y < height; y++)
+		free(row_pointers[y]);
+	free(row_pointers);
+}
+
 // Load a .png file.
 
 void load_png_file(const char *filename, Image *image) {
+	FILE *fp = open_file(filename, "rb");
+	load_png_stream(fp, image);
+	fclose(fp);
+}
+
+// Load a .png image from a stream.
+
+void load_png_stream(FILE *fp, Image *image) {
 	int png_width, png_height;
 	png_byte color_type;
 	png_byte bit_depth;
@@ -855,33 +914,25 @@ void load_png_file(const char *filename, Image *image) {
 
 	png_byte header[8];    // 8 is the maximum size that can be checked
 
-        FILE *fp = fopen(filename, "rb");
-	if (!fp) {
-		printf("Error - file %s could not be opened for reading.\n", filename);
-		exit(1);
-	}
-	fread(header, 1, 8, fp);
-	if (png_sig_cmp(header, 0, 8)) {
-		printf("Error - file %s is not recognized as a PNG file.\n", filename);
-		exit(1);
+	if (fread(header, 1, 8, fp) < 8 || png_sig_cmp(header, 0, 8)) {
+		report_error("Error - data is not recognized as a PNG file.\n");
 	}
 
 	png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
 
 	if (!png_ptr) {
-		printf("png_create_read_struct failed\n");
-		exit(1);
+		report_error("png_create_read_struct failed\n");
 	}   
 
 	info_ptr = png_create_info_struct(png_ptr);
 	if (!info_ptr) {
-		printf("png_create_info_struct failed\n");
-		exit(1);
+		png_destroy_read_struct(&png_ptr, NULL, NULL);
+		report_error("png_create_info_struct failed\n");
 	}
 
 	if (setjmp(png_jmpbuf(png_ptr))) {
-		printf("Error during init_io.");
-		exit(1);
+		png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+		report_error("Error during init_io.\n");
 	}
 
 	png_init_io(png_ptr, fp);
@@ -897,19 +948,19 @@ void load_png_file(const char *filename, Image *image) {
 	number_of_passes = png_set_interlace_handling(png_ptr);
 	png_read_update_info(png_ptr, info_ptr);
 
-        /* read file */
-	if (setjmp(png_jmpbuf(png_ptr))) {
-		printf("Error during read_image.\n");
-		exit(1);
-        }
-
 	row_pointers = (png_bytep *)malloc(sizeof(png_bytep) * png_height);
 	for (int y = 0; y < png_height; y++)
 		row_pointers[y] = (png_byte *)malloc(png_get_rowbytes(png_ptr, info_ptr));
 
-	png_read_image(png_ptr, row_pointers);
+        /* read file */
+	if (setjmp(png_jmpbuf(png_ptr))) {
+		png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+		free_png_rows(row_pointers, png_height);
+		report_error("Error during read_image.\n");
+        }
 
-	fclose(fp);
+	png_read_image(png_ptr, row_pointers);
+	png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
 
 	if (!option_quiet) {
 		printf("Loading .png image with size (%d x %d), bit depth %d", png_width, png_height, bit_depth);
@@ -919,12 +970,12 @@ void load_png_file(const char *filename, Image *image) {
 			printf(".\n");
 	}
 	if (color_type != PNG_COLOR_TYPE_GRAY && color_type != PNG_COLOR_TYPE_RGB && color_type != PNG_COLOR_TYPE_RGBA) {
-		printf("Error - unrecognized color format.\n");
-		exit(1);
+		free_png_rows(row_pointers, png_height);
+		report_error("Error - unrecognized color format.\n");
 	}
 	if (bit_depth != 8) {
-		printf("Error - expected bit depth of 8 in PNG file.\n");
-		exit(1);
+		free_png_rows(row_pointers, png_height);
+		report_error("Error - expected bit depth of 8 in PNG file.\n");
 	}
 
 	image->width = png_width;
@@ -971,15 +1022,22 @@ void load_png_file(const char *filename, Image *image) {
 				printf("1-bit alpha detected.\n");
 	}
 	pad_image_borders(image);
-	for (int y = 0; y < png_height; y++)
-		free(row_pointers[y]);
-	free(row_pointers);
+	free_png_rows(row_pointers, png_height);
 }
 
 // Save a .png file.
 
 void save_png_file(Image *image, const char *filename) {
-	FILE *fp;
+	if (!option_quiet)
+		printf("Writing .png file %s.\n", filename);
+	FILE *fp = open_file(filename, "wb");
+	save_png_stream(image, fp);
+	fclose(fp);
+}
+
+// Write a .png image to a stream.
+
+void save_png_stream(Image *image, FILE *fp) {
 	png_structp png_ptr;
 	png_infop info_ptr;
 
@@ -988,31 +1046,22 @@ void save_png_file(Image *image, const char *filename) {
 	}
 	else
 	if (image->bits_per_component != 8) {
-		printf("Error -- cannot write PNG file with non 8-bit components.\n");
-		exit(1);
+		report_error("Error -- cannot write PNG file with non 8-bit components.\n");
 	}
 
-	if (!option_quiet)
-		printf("Writing .png file %s.\n", filename);
-	fp = fopen(filename, "wb");
-	if (fp == NULL) {
-		printf("Error - file %s could not be opened for writing.\n", filename);
-		exit(1);
-	}
 	png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
 	if (png_ptr == NULL) {
-		printf("Error using libpng.\n");
-		exit(1);
+		report_error("Error using libpng.\n");
 	}
 	info_ptr = png_create_info_struct(png_ptr);
 	if (info_ptr == NULL) {
-		printf("Error using libpng.\n");
-		exit(1);
+		png_destroy_write_struct(&png_ptr, NULL);
+		report_error("Error using libpng.\n");
 	}
 	if (setjmp(png_jmpbuf(png_ptr))) {
 		/* If we get here, we had a problem writing the file. */
-		printf("Error writing png file %s.\n", filename);
-		exit(1);
+		png_destroy_write_struct(&png_ptr, &info_ptr);
+		report_error("Error writing png data.\n");
 	}
 	png_init_io(png_ptr, fp);
 	int t;
@@ -1039,7 +1088,6 @@ void save_png_file(Image *image, const char *filename) {
 	png_write_image(png_ptr, row_pointers);
 
 	png_write_end(png_ptr, info_ptr);
-	png_destroy_write_struct(&png_ptr, (png_infopp)NULL);
-	fclose(fp);
+	png_destroy_write_struct(&png_ptr, &info_ptr);
 }
 
@@ -0,0 +1,422 @@
+/*
+
+Copyright (c) 2015 Harm Hanemaaijer <fgenfb@yahoo.com>
+
+Permission to use, copy, modify, and/or distribute this software for any
+purpose with or without fee is hereby granted, provided that the above
+copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+*/
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "ga.h"
+
+// Built-in genetic algorithm engine with the libfgen interface. See ga.h.
+//
+// A generation is created as follows. The best individuals (elites) are copied unchanged, the other places are
+// filled with individuals selected with binary tournaments, and consecutive selected individuals are paired up
+// for uniform crossover. Mutation then flips each bit of the non-elite individuals with the mutation probability,
+// by drawing the distance to the next flipped bit from a geometric distribution, so that only a few random
+// numbers are needed per generation. Only the individuals that differ from the individual they were copied from
+// are evaluated again; they are moved together so that the whole generation is evaluated with a single call of
+// the batch fitness function if there is one.
+
+// Random number generator (xorshift128+).
+
+uint64_t fgen_random_64(FgenRNG *rng) {
+	uint64_t s1 = rng->state[0];
+	uint64_t s0 = rng->state[1];
+	rng->state[0] = s0;
+	s1 ^= s1 << 23;
+	rng->state[1] = s1 ^ s0 ^ (s1 >> 18) ^ (s0 >> 5);
+	return rng->state[1] + s0;
+}
+
+static uint64_t splitmix64(uint64_t *x) {
+	uint64_t z = (*x += 0x9E3779B97F4A7C15ULL);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+void fgen_random_seed_rng(FgenRNG *rng, unsigned int seed) {
+	uint64_t x = seed;
+	rng->state[0] = splitmix64(&x);
+	rng->state[1] = splitmix64(&x);
+	if (rng->state[0] == 0 && rng->state[1] == 0)
+		rng->state[0] = 1;
+}
+
+void fgen_random_seed_with_timer(FgenRNG *rng) {
+	fgen_random_seed_rng(rng, (unsigned int)time(NULL) ^ ((unsigned int)clock() << 12));
+}
+
+int fgen_random_2(FgenRNG *rng) {
+	return fgen_random_64(rng) >> 62;
+}
+
+int fgen_random_8(FgenRNG *rng) {
+	return fgen_random_64(rng) >> 56;
+}
+
+int fgen_random_16(FgenRNG *rng) {
+	return fgen_random_64(rng) >> 48;
+}
+
+unsigned int fgen_random_32(FgenRNG *rng) {
+	return fgen_random_64(rng) >> 32;
+}
+
+// Return a random integer from 0 to n - 1.
+
+int fgen_random_n(FgenRNG *rng, int n) {
+	return ((uint64_t)fgen_random_32(rng) * (unsigned int)n) >> 32;
+}
+
+// Return a random double from 0 to (but not including) range.
+
+double fgen_random_d(FgenRNG *rng, double range) {
+	return (fgen_random_64(rng) >> 11) * (1.0 / 9007199254740992.0) * range;
+}
+
+FgenRNG *fgen_get_rng(const FgenPopulation *pop) {
+	return (FgenRNG *)&pop->rng;
+}
+
+// Population management.
+
+FgenPopulation *fgen_create(int population_size, int individual_size_in_bits, int data_element_size,
+FgenGenerationCallbackFunc generation_callback_func, FgenCalculateFitnessFunc calculate_fitness_func,
+FgenSeedFunc seed_func, FgenMutationFunc mutation_func, FgenCrossoverFunc crossover_func) {
+	FgenPopulation *pop = (FgenPopulation *)malloc(sizeof(FgenPopulation));
+	int n = population_size;
+	int nu_words = (individual_size_in_bits + 63) / 64;
+	pop->size = n;
+	pop->individual_size_in_bits = individual_size_in_bits;
+	pop->individual_size_in_words = nu_words;
+	pop->words = (uint64_t *)calloc(n * nu_words, sizeof(uint64_t));
+	pop->new_words = (uint64_t *)calloc(n * nu_words, sizeof(uint64_t));
+	pop->fitness = (double *)calloc(n, sizeof(double));
+	pop->new_fitness = (double *)calloc(n, sizeof(double));
+	pop->changed = (unsigned char *)malloc(n);
+	pop->selected = (int *)malloc(sizeof(int) * n);
+	pop->individuals = (FgenIndividual *)malloc(sizeof(FgenIndividual) * n);
+	pop->ind = (FgenIndividual **)malloc(sizeof(FgenIndividual *) * n);
+	for (int i = 0; i < n; i++) {
+		pop->individuals[i].bitstring = (unsigned char *)&pop->words[i * nu_words];
+		pop->individuals[i].fitness = 0;
+		pop->ind[i] = &pop->individuals[i];
+	}
+	pop->best = 0;
+	pop->generation = 0;
+	pop->user_data = NULL;
+	pop->nu_elites = 1;
+	pop->generation_callback_interval = 1;
+	pop->stop = 0;
+	pop->generation_callback = generation_callback_func;
+	pop->calculate_fitness = calculate_fitness_func;
+	pop->calculate_fitness_batch = NULL;
+	pop->seed = seed_func;
+	pop->mutation = mutation_func;
+	pop->crossover = crossover_func;
+	fgen_set_parameters(pop, FGEN_ELITIST_SUS, FGEN_SUBTRACT_MIN_FITNESS, 0.7, 0.01, 0);
+	fgen_random_seed_rng(&pop->rng, 0);
+	return pop;
+}
+
+// Selection is always elitist tournament selection, so the selection types are ignored, as is the
+// macro-mutation probability.
+
+void fgen_set_parameters(FgenPopulation *pop, int selection_type, int selection_fitness_type,
+float crossover_probability, float mutation_probability, float macro_mutation_probability) {
+	pop->selection_type = selection_type;
+	pop->selection_fitness_type = selection_fitness_type;
+	pop->crossover_probability = crossover_probability;
+	pop->mutation_probability = mutation_probability;
+	pop->mutation_log_factor = 1.0 / log1p(- (double)mutation_probability);
+}
+
+void fgen_set_generation_callback_interval(FgenPopulation *pop, int interval) {
+	pop->generation_callback_interval = interval;
+}
+
+// The populations always run independently, so migration settings have no effect.
+
+void fgen_set_migration_interval(FgenPopulation *pop, int interval) {
+}
+
+void fgen_set_migration_probability(FgenPopulation *pop, float probability) {
+}
+
+void fgen_set_number_of_elites(FgenPopulation *pop, int nu_elites) {
+	pop->nu_elites = nu_elites;
+}
+
+void fgen_set_fitness_batch_function(FgenPopulation *pop, FgenCalculateFitnessBatchFunc calculate_fitness_batch_func) {
+	pop->calculate_fitness_batch = calculate_fitness_batch_func;
+}
+
+void fgen_destroy(FgenPopulation *pop) {
+	free(pop->words);
+	free(pop->new_words);
+	free(pop->fitness);
+	free(pop->new_fitness);
+	free(pop->changed);
+	free(pop->selected);
+	free(pop->individuals);
+	free(pop->ind);
+	free(pop);
+}
+
+void fgen_signal_stop(FgenPopulation *pop) {
+	pop->stop = 1;
+}
+
+FgenIndividual *fgen_best_individual_of_population(FgenPopulation *pop) {
+	return pop->ind[pop->best];
+}
+
+FgenIndividual *fgen_best_individual_and_island_of_archipelago(int nu_pops, FgenPopulation **pops, int *island) {
+	int best_island = 0;
+	for (int i = 1; i < nu_pops; i++)
+		if (pops[i]->fitness[pops[i]->best] > pops[best_island]->fitness[pops[best_island]->best])
+			best_island = i;
+	*island = best_island;
+	return fgen_best_individual_of_population(pops[best_island]);
+}
+
+// Seeding, mutation and crossover functions. The genetic algorithm itself doesn't call the mutation and
+// crossover functions below, but performs the same operations on whole words of the population.
+
+void fgen_seed_random(FgenPopulation *pop, unsigned char *bitstring) {
+	int nu_bytes = (pop->individual_size_in_bits + 7) / 8;
+	for (int i = 0; i < nu_bytes; i += 8) {
+		uint64_t r = fgen_random_64(&pop->rng);
+		memcpy(&bitstring[i], &r, nu_bytes - i < 8 ? nu_bytes - i : 8);
+	}
+}
+
+// Return the number of bits that are skipped before the next bit that is mutated, or limit when it is not
+// smaller than limit.
+
+static uint64_t mutation_distance(FgenPopulation *pop, uint64_t limit) {
+	double u = ((fgen_random_64(&pop->rng) >> 11) + 1) * (1.0 / 9007199254740992.0);
+	double d = log(u) * pop->mutation_log_factor;
+	if (!(d < (double)limit))
+		return limit;
+	return (uint64_t)d;
+}
+
+void fgen_mutation_per_bit_fast(FgenPopulation *pop, const unsigned char *parent, unsigned char *child) {
+	uint64_t n = pop->individual_size_in_bits;
+	if (child != parent)
+		memcpy(child, parent, (n + 7) / 8);
+	if (pop->mutation_probability <= 0)
+		return;
+	for (uint64_t i = mutation_distance(pop, n); i < n; i += 1 + mutation_distance(pop, n))
+		child[i >> 3] ^= 1 << (i & 7);
+}
+
+void fgen_crossover_uniform_per_bit(FgenPopulation *pop, const unsigned char *parent1, const unsigned char *parent2,
+unsigned char *child1, unsigned char *child2) {
+	int nu_bytes = (pop->individual_size_in_bits + 7) / 8;
+	for (int i = 0; i < nu_bytes; i++) {
+		unsigned char mask = fgen_random_64(&pop->rng);
+		unsigned char c1 = (parent1[i] & mask) | (parent2[i] & ~mask);
+		unsigned char c2 = (parent2[i] & mask) | (parent1[i] & ~mask);
+		child1[i] = c1;
+		child2[i] = c2;
+	}
+}
+
+// Evaluate n consecutive individuals.
+
+static void calculate_fitness(FgenPopulation *pop, int n, uint64_t *words, double *fitness) {
+	if (n == 0)
+		return;
+	if (pop->calculate_fitness_batch != NULL) {
+		pop->calculate_fitness_batch(pop, n, (unsigned char *)words, fitness);
+		return;
+	}
+	for (int i = 0; i < n; i++)
+		fitness[i] = pop->calculate_fitness(pop, (unsigned char *)&words[i * pop->individual_size_in_words]);
+}
+
+// Point the individuals at the current generation and determine the best one.
+
+static void update_individuals(FgenPopulation *pop) {
+	int best = 0;
+	for (int i = 0; i < pop->size; i++) {
+		pop->individuals[i].bitstring = (unsigned char *)&pop->words[i * pop->individual_size_in_words];
+		pop->individuals[i].fitness = pop->fitness[i];
+		if (pop->fitness[i] > pop->fitness[best])
+			best = i;
+	}
+	pop->best = best;
+}
+
+// Select nu_selected individuals of the current generation with binary tournaments. Unlike fitness-proportional
+// selection, this only depends on the order of the fitness values, which are the reciprocal of the error of a
+// block and therefore vary widely in scale between blocks.
+
+static void select_individuals(FgenPopulation *pop, int nu_selected) {
+	const double *fitness = pop->fitness;
+	for (int k = 0; k < nu_selected; k++) {
+		int i = fgen_random_n(&pop->rng, pop->size);
+		int j = fgen_random_n(&pop->rng, pop->size);
+		pop->selected[k] = fitness[i] >= fitness[j] ? i : j;
+	}
+}
+
+// Copy the nu_elites best individuals of the current generation to the start of the next generation.
+
+static void copy_elites(FgenPopulation *pop, int nu_elites, const int nu_words) {
+	int n = pop->size;
+	memset(pop->changed, 0, n);
+	for (int k = 0; k < nu_elites; k++) {
+		int best = - 1;
+		for (int i = 0; i < n; i++)
+			if (!pop->changed[i] && (best < 0 || pop->fitness[i] > pop->fitness[best]))
+				best = i;
+		pop->changed[best] = 1;
+		memcpy(&pop->new_words[k * nu_words], &pop->words[best * nu_words], nu_words * 8);
+		pop->new_fitness[k] = pop->fitness[best];
+	}
+}
+
+// Create and evaluate the next generation in new_words and new_fitness. Always inlined with a constant number of
+// words for the common individual sizes.
+
+static inline __attribute__((always_inline)) void create_next_generation(FgenPopulation *pop, const int nu_words) {
+	FgenRNG *rng = &pop->rng;
+	int n = pop->size;
+	int nu_elites = pop->nu_elites < n ? pop->nu_elites : n;
+	int m = n - nu_elites;
+	copy_elites(pop, nu_elites, nu_words);
+	select_individuals(pop, m);
+	uint64_t *children = &pop->new_words[nu_elites * nu_words];
+	double *children_fitness = &pop->new_fitness[nu_elites];
+	unsigned char *changed = &pop->changed[nu_elites];
+	for (int k = 0; k < m; k++) {
+		for (int j = 0; j < nu_words; j++)
+			children[k * nu_words + j] = pop->words[pop->selected[k] * nu_words + j];
+		children_fitness[k] = pop->fitness[pop->selected[k]];
+		changed[k] = 0;
+	}
+	// Uniform crossover of consecutive pairs.
+	unsigned int crossover_threshold = pop->crossover_probability * 4294967295.0;
+	for (int k = 0; k + 1 < m; k += 2) {
+		if (fgen_random_32(rng) >= crossover_threshold)
+			continue;
+		uint64_t *a = &children[k * nu_words];
+		uint64_t *b = &children[(k + 1) * nu_words];
+		if (pop->crossover != fgen_crossover_uniform_per_bit) {
+			uint64_t parent1[nu_words], parent2[nu_words];
+			memcpy(parent1, a, nu_words * 8);
+			memcpy(parent2, b, nu_words * 8);
+			pop->crossover(pop, (unsigned char *)parent1, (unsigned char *)parent2, (unsigned char *)a,
+				(unsigned char *)b);
+			changed[k] = memcmp(a, parent1, nu_words * 8) != 0;
+			changed[k + 1] = memcmp(b, parent2, nu_words * 8) != 0;
+			continue;
+		}
+		uint64_t swapped = 0;
+		for (int j = 0; j < nu_words; j++) {
+			// Exchange the differing bits outside the random mask.
+			uint64_t d = (a[j] ^ b[j]) & ~fgen_random_64(rng);
+			a[j] ^= d;
+			b[j] ^= d;
+			swapped |= d;
+		}
+		if (swapped != 0) {
+			changed[k] = 1;
+			changed[k + 1] = 1;
+		}
+	}
+	// Mutation.
+	if (pop->mutation != fgen_mutation_per_bit_fast) {
+		for (int k = 0; k < m; k++) {
+			uint64_t parent[nu_words];
+			memcpy(parent, &children[k * nu_words], nu_words * 8);
+			pop->mutation(pop, (unsigned char *)parent, (unsigned char *)&children[k * nu_words]);
+			if (memcmp(parent, &children[k * nu_words], nu_words * 8) != 0)
+				changed[k] = 1;
+		}
+	}
+	else if (pop->mutation_probability > 0) {
+		int nu_bits = pop->individual_size_in_bits;
+		uint64_t total_bits = (uint64_t)m * nu_bits;
+		for (uint64_t i = mutation_distance(pop, total_bits); i < total_bits;
+		i += 1 + mutation_distance(pop, total_bits)) {
+			int k = i / nu_bits;
+			int bit = i % nu_bits;
+			children[k * nu_words + (bit >> 6)] ^= (uint64_t)1 << (bit & 63);
+			changed[k] = 1;
+		}
+	}
+	// Move the changed individuals to the front and evaluate them.
+	int nu_changed = 0;
+	for (int k = 0; k < m; k++)
+		if (changed[k]) {
+			if (k != nu_changed) {
+				for (int j = 0; j < nu_words; j++) {
+					uint64_t t = children[nu_changed * nu_words + j];
+					children[nu_changed * nu_words + j] = children[k * nu_words + j];
+					children[k * nu_words + j] = t;
+				}
+				double t = children_fitness[nu_changed];
+				children_fitness[nu_changed] = children_fitness[k];
+				children_fitness[k] = t;
+			}
+			nu_changed++;
+		}
+	calculate_fitness(pop, nu_changed, children, children_fitness);
+}
+
+// Run the genetic algorithm until it is stopped by the generation callback function, or until max_generation
+// generations have passed when max_generation is not - 1.
+
+void fgen_run(FgenPopulation *pop, int max_generation) {
+	int n = pop->size;
+	int nu_words = pop->individual_size_in_words;
+	pop->stop = 0;
+	pop->generation = 0;
+	memset(pop->words, 0, n * nu_words * 8);
+	for (int i = 0; i < n; i++)
+		pop->seed(pop, (unsigned char *)&pop->words[i * nu_words]);
+	calculate_fitness(pop, n, pop->words, pop->fitness);
+	update_individuals(pop);
+	if (pop->generation_callback != NULL)
+		pop->generation_callback(pop, 0);
+	while (!pop->stop && (max_generation < 0 || pop->generation < max_generation)) {
+		if (nu_words == 1)
+			create_next_generation(pop, 1);
+		else if (nu_words == 2)
+			create_next_generation(pop, 2);
+		else
+			create_next_generation(pop, nu_words);
+		uint64_t *words = pop->words;
+		pop->words = pop->new_words;
+		pop->new_words = words;
+		double *fitness = pop->fitness;
+		pop->fitness = pop->new_fitness;
+		pop->new_fitness = fitness;
+		pop->generation++;
+		update_individuals(pop);
+		if (pop->generation_callback != NULL && pop->generation_callback_interval > 0 &&
+		pop->generation % pop->generation_callback_interval == 0)
+			pop->generation_callback(pop, pop->generation);
+	}
+}
@@ -0,0 +1,126 @@
+/*
+
+Copyright (c) 2015 Harm Hanemaaijer <fgenfb@yahoo.com>
+
+Permission to use, copy, modify, and/or distribute this software for any
+purpose with or without fee is hereby granted, provided that the above
+copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+*/
+
+// Built-in genetic algorithm engine, used instead of libfgen when texgenpack is compiled with
+// TEXGENPACK_BUILTIN_GA defined. It implements the part of the libfgen API that texgenpack uses, with the same
+// names and semantics, but is specialized for the 64-bit and 128-bit blocks of the texture formats: the
+// individuals of a population are stored consecutively as 64-bit words, with their fitness values in a separate
+// array, and mutation and crossover operate on whole words.
+
+#include <stdint.h>
+
+typedef struct FgenPopulation_t FgenPopulation;
+
+typedef struct {
+	uint64_t state[2];
+} FgenRNG;
+
+typedef struct {
+	unsigned char *bitstring;
+	double fitness;
+} FgenIndividual;
+
+typedef void (*FgenGenerationCallbackFunc)(FgenPopulation *pop, int generation);
+typedef double (*FgenCalculateFitnessFunc)(const FgenPopulation *pop, const unsigned char *bitstring);
+typedef void (*FgenCalculateFitnessBatchFunc)(const FgenPopulation *pop, int n, unsigned char *bitstrings,
+	double *fitness);
+typedef void (*FgenSeedFunc)(FgenPopulation *pop, unsigned char *bitstring);
+typedef void (*FgenMutationFunc)(FgenPopulation *pop, const unsigned char *parent, unsigned char *child);
+typedef void (*FgenCrossoverFunc)(FgenPopulation *pop, const unsigned char *parent1, const unsigned char *parent2,
+	unsigned char *child1, unsigned char *child2);
+
+struct FgenPopulation_t {
+	int size;
+	int individual_size_in_bits;
+	int individual_size_in_words;
+	// The bitstrings of the current and the next generation, individual_size_in_words words per individual.
+	uint64_t *words;
+	uint64_t *new_words;
+	double *fitness;
+	double *new_fitness;
+	// Whether an individual of the next generation differs from the parent it was copied from.
+	unsigned char *changed;
+	int *selected;
+	// The individuals of the current generation, pointing into words and updated after every generation.
+	FgenIndividual **ind;
+	FgenIndividual *individuals;
+	int best;
+	int generation;
+	void *user_data;
+	int selection_type;
+	int selection_fitness_type;
+	float crossover_probability;
+	float mutation_probability;
+	// The reciprocal of log(1 - mutation_probability), used to draw the distance to the next mutated bit.
+	double mutation_log_factor;
+	int nu_elites;
+	int generation_callback_interval;
+	int stop;
+	FgenGenerationCallbackFunc generation_callback;
+	FgenCalculateFitnessFunc calculate_fitness;
+	FgenCalculateFitnessBatchFunc calculate_fitness_batch;
+	FgenSeedFunc seed;
+	FgenMutationFunc mutation;
+	FgenCrossoverFunc crossover;
+	FgenRNG rng;
+};
+
+// Selection and fitness scaling types, accepted for compatibility. The built-in engine always uses elitist
+// tournament selection.
+
+#define FGEN_ELITIST_SUS		1
+#define FGEN_SUBTRACT_MIN_FITNESS	1
+
+FgenPopulation *fgen_create(int population_size, int individual_size_in_bits, int data_element_size,
+	FgenGenerationCallbackFunc generation_callback_func, FgenCalculateFitnessFunc calculate_fitness_func,
+	FgenSeedFunc seed_func, FgenMutationFunc mutation_func, FgenCrossoverFunc crossover_func);
+void fgen_set_parameters(FgenPopulation *pop, int selection_type, int selection_fitness_type,
+	float crossover_probability, float mutation_probability, float macro_mutation_probability);
+void fgen_set_generation_callback_interval(FgenPopulation *pop, int interval);
+void fgen_set_migration_interval(FgenPopulation *pop, int interval);
+void fgen_set_migration_probability(FgenPopulation *pop, float probability);
+void fgen_set_number_of_elites(FgenPopulation *pop, int nu_elites);
+// Evaluate the individuals of a generation with a single call instead of one call per individual. Not part of
+// libfgen.
+void fgen_set_fitness_batch_function(FgenPopulation *pop, FgenCalculateFitnessBatchFunc calculate_fitness_batch_func);
+void fgen_destroy(FgenPopulation *pop);
+void fgen_run(FgenPopulation *pop, int max_generation);
+void fgen_signal_stop(FgenPopulation *pop);
+FgenIndividual *fgen_best_individual_of_population(FgenPopulation *pop);
+FgenIndividual *fgen_best_individual_and_island_of_archipelago(int nu_pops, FgenPopulation **pops, int *island);
+
+// Seeding, mutation and crossover functions. The built-in engine performs per-bit mutation and uniform per-bit
+// crossover itself, word by word, when these are passed to fgen_create().
+
+void fgen_seed_random(FgenPopulation *pop, unsigned char *bitstring);
+void fgen_mutation_per_bit_fast(FgenPopulation *pop, const unsigned char *parent, unsigned char *child);
+void fgen_crossover_uniform_per_bit(FgenPopulation *pop, const unsigned char *parent1, const unsigned char *parent2,
+	unsigned char *child1, unsigned char *child2);
+
+// Random number functions.
+
+FgenRNG *fgen_get_rng(const FgenPopulation *pop);
+void fgen_random_seed_rng(FgenRNG *rng, unsigned int seed);
+void fgen_random_seed_with_timer(FgenRNG *rng);
+int fgen_random_2(FgenRNG *rng);
+int fgen_random_8(FgenRNG *rng);
+int fgen_random_16(FgenRNG *rng);
+unsigned int fgen_random_32(FgenRNG *rng);
+uint64_t fgen_random_64(FgenRNG *rng);
+int fgen_random_n(FgenRNG *rng, int n);
+double fgen_random_d(FgenRNG *rng, double range);
@@ -27,36 +27,48 @@ OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 #include "decode.h"
 #include "packing.h"
 
+static const char *file_type_extension(int filetype) {
+	switch (filetype) {
+	case FILE_TYPE_PNG :
+		return ".png";
+	case FILE_TYPE_PPM :
+		return ".ppm";
+	case FILE_TYPE_KTX :
+		return ".ktx";
+	case FILE_TYPE_PKM :
+		return ".pkm";
+	case FILE_TYPE_DDS :
+		return ".dds";
+	case FILE_TYPE_ASTC :
+		return ".astc";
+	}
+	return "";
+}
+
+static FILE *open_file_for_reading(const char *filename, int filetype) {
+	if (!option_quiet)
+		printf("Reading %s file %s.\n", file_type_extension(filetype), filename);
+	return open_file(filename, "rb");
+}
+
 // Load image file or texture file. In the latter case, the texture is decoded into an image.
 
 void load_image(const char *filename, int filetype, Image *image) {
 	if (filetype == FILE_TYPE_ASTC) {
 		decompress_astc_file(filename, image);
+		return;
 	}
-	else
+	FILE *f = open_file_for_reading(filename, filetype);
+	load_image_stream(f, filetype, image);
+	fclose(f);
+}
+
+// Load an image or texture from a stream. In the latter case, the texture is decoded into an image.
+
+void load_image_stream(FILE *f, int filetype, Image *image) {
 	if (filetype & FILE_TYPE_TEXTURE_BIT) {
 		Texture texture;
-		switch (filetype) {
-		case FILE_TYPE_PKM :
-			load_pkm_file(filename, &texture);
-			break;
-		case FILE_TYPE_KTX :
-			load_ktx_file(filename, 1, &texture);
-			break;
-		case FILE_TYPE_DDS :
-			load_dds_file(filename, 1, &texture);
-			break;
-		case FILE_TYPE_ASTC :
-			load_astc_file(filename, &texture);
-			break;
-		default :
-			printf("Error -- no support for loading texture file format.\n");
-			exit(1);
-		}
-		const char *texture_type_str = texture_type_text(texture.type);
-		if (!option_quiet)
-			printf("Texture format: %s\n", texture_type_str);
-		set_texture_decoding_function(&texture, NULL);
+		load_texture_stream(f, filetype, 1, &texture);
 		convert_texture_to_image(&texture, image);
 		destroy_texture(&texture);
 	}
@@ -66,11 +78,10 @@ void load_image(const char *filename, int filetype, Image *image) {
 //			load_ppm_file(filename, image);
 //			break;
 		case FILE_TYPE_PNG :
-			load_png_file(filename, image);
+			load_png_stream(f, image);
 			break;
 		default :
-			printf("Error -- no support for loading image file format.\n");
-			exit(1);
+			report_error("Error -- no support for loading image file format.\n");
 		}
 		// Optionally convert to half-float format.
 		if (option_half_float)
@@ -84,50 +95,38 @@ void load_image(const char *filename, int filetype, Image *image) {
 int load_mipmap_images(const char *filename, int filetype, int max_images, Image *image) {
 	if (filetype & FILE_TYPE_TEXTURE_BIT) {
 		Texture *texture = (Texture *)alloca(sizeof(Texture) * max_images);
-		int n;
-		switch (filetype) {
-		case FILE_TYPE_KTX :
-			n = load_ktx_file(filename, max_images, &texture[0]);
-			break;
-		case FILE_TYPE_DDS :
-			n = load_dds_file(filename, max_images, &texture[0]);
-			break;
-		case FILE_TYPE_PKM :
-			load_pkm_file(filename, &texture[0]);
-			n = 1;
-			break;
-		case FILE_TYPE_ASTC :
-			load_astc_file(filename, &texture[0]);
-			n = 1;
-			break;
-		}
-		const char *texture_type_str = texture_type_text(texture[0].type);
-		if (!option_quiet)
-			printf("Texture format: %s\n", texture_type_str);
+		int n = load_texture(filename, filetype, max_images, texture);
 		for (int i = 0; i < n; i++) {
-			set_texture_decoding_function(&texture[i], NULL);
 			convert_texture_to_image(&texture[i], &image[i]);
 			destroy_texture(&texture[i]);
 		}
 		return n;
 	}
-	printf("Error -- no method implemented for loading mipmaps from file %s.\n", filename);
-	exit(1);
+	report_error("Error -- no method implemented for loading mipmaps from file %s.\n", filename);
 }
 
 // Save image file.
 
 void save_image(Image *image, const char *filename, int filetype) {
+	if (!option_quiet)
+		printf("Writing %s file %s.\n", file_type_extension(filetype), filename);
+	FILE *f = open_file(filename, "wb");
+	save_image_stream(image, f, filetype);
+	fclose(f);
+}
+
+// Write an image to a stream.
+
+void save_image_stream(Image *image, FILE *f, int filetype) {
 	switch (filetype) { 
 //	case FILE_TYPE_PPM :
 //		load_ppm_file(filename, image);
 //		break;
 	case FILE_TYPE_PNG :
-		save_png_file(image, filename);
+		save_png_stream(image, f);
 		break;
 	default :
-		printf("Error -- no support for saving image file format.\n");
-		exit(1);
+		report_error("Error -- no support for saving image file format.\n");
 	}
 }
 
@@ -136,71 +135,92 @@ void save_image(Image *image, const char *filename, int filetype) {
 
 int load_texture(const char *filename, int filetype, int max_mipmaps, Texture *texture) {
 	if (filetype & FILE_TYPE_TEXTURE_BIT) {
-		int n;
-		switch (filetype) {
-		case FILE_TYPE_KTX :
-			n = load_ktx_file(filename, max_mipmaps, &texture[0]);
-			break;
-		case FILE_TYPE_DDS :
-			n = load_dds_file(filename, max_mipmaps, &texture[0]);
-			break;
-		case FILE_TYPE_PKM :
-			load_pkm_file(filename, &texture[0]);
-			n = 1;
-			break;
-		case FILE_TYPE_ASTC :
-			load_astc_file(filename, &texture[0]);
-			n = 1;
-			break;
-		}
-		const char *texture_type_str = texture_type_text(texture[0].type);
-		if (!option_quiet)
-			printf("Texture format: %s\n", texture_type_str);
-		for (int i = 0; i < n; i++)
-			set_texture_decoding_function(&texture[i], NULL);
+		FILE *f = open_file_for_reading(filename, filetype);
+		int n = load_texture_stream(f, filetype, max_mipmaps, texture);
+		fclose(f);
 		return n;
 	}
-	printf("Error -- no method implemented for loading mipmaps from file %s.\n", filename);
-	exit(1);
+	report_error("Error -- no method implemented for loading mipmaps from file %s.\n", filename);
+}
+
+// Load multiple mipmaps from a texture stream. texture must be an array big enough to hold max_texture.
+// Return the number of mipmap images.
+
+int load_texture_stream(FILE *f, int filetype, int max_mipmaps, Texture *texture) {
+	int n;
+	switch (filetype) {
+	case FILE_TYPE_KTX :
+		n = load_ktx_stream(f, max_mipmaps, &texture[0]);
+		break;
+	case FILE_TYPE_DDS :
+		n = load_dds_stream(f, max_mipmaps, &texture[0]);
+		break;
+	case FILE_TYPE_PKM :
+		load_pkm_stream(f, &texture[0]);
+		n = 1;
+		break;
+	case FILE_TYPE_ASTC :
+		load_astc_stream(f, &texture[0]);
+		n = 1;
+		break;
+	default :
+		report_error("Error -- no support for loading texture file format.\n");
+	}
+	const char *texture_type_str = texture_type_text(texture[0].type);
+	if (!option_quiet)
+		printf("Texture format: %s\n", texture_type_str);
+	for (int i = 0; i < n; i++)
+		set_texture_decoding_function(&texture[i], NULL);
+	return n;
 }
 
 // Save texture file.
 
 void save_texture(Texture *texture, int nu_mipmaps, const char *filename, int filetype) {
+	if (!option_quiet) {
+		if (filetype == FILE_TYPE_ASTC)
+			printf("Writing .astc file %s.\n", filename);
+		else
+			printf("Writing %s file %s with texture format %s.\n", file_type_extension(filetype), filename,
+				texture->info->text1);
+	}
+	FILE *f = open_file(filename, "wb");
+	save_texture_stream(texture, nu_mipmaps, f, filetype);
+	fclose(f);
+}
+
+// Write a texture to a stream.
+
+void save_texture_stream(Texture *texture, int nu_mipmaps, FILE *f, int filetype) {
 	switch (filetype) {
 	case FILE_TYPE_PKM :
 		if (texture->type != TEXTURE_TYPE_ETC1) {
-			printf("Error -- only ETC1 compression format supported in .pkm file.\n");
-			exit(1);
+			report_error("Error -- only ETC1 compression format supported in .pkm file.\n");
 		}
 		if (nu_mipmaps > 1)
 			printf("Warning: only saving first mipmap level.\n");
-		save_pkm_file(texture, filename);
+		save_pkm_stream(texture, f);
 		break;
 	case FILE_TYPE_KTX :
 		if (!texture->info->ktx_support) {
-			printf("Error -- texture format not supported in .ktx file.\n");
-			exit(1);
+			report_error("Error -- texture format not supported in .ktx file.\n");
 		}
-		save_ktx_file(texture, nu_mipmaps, filename);
+		save_ktx_stream(texture, nu_mipmaps, f);
 		break;
 	case FILE_TYPE_DDS :
 		if (!texture->info->dds_support) {
-			printf("Error -- texture format not supported in .dds file.\n");
-			exit(1);
+			report_error("Error -- texture format not supported in .dds file.\n");
 		}
-		save_dds_file(texture, nu_mipmaps, filename);
+		save_dds_stream(texture, nu_mipmaps, f);
 		break;
 	case FILE_TYPE_ASTC :
 		if (!(texture->type & TEXTURE_TYPE_ASTC_BIT)) {
-			printf("Error -- .astc file format does not support texture format.\n");
-			exit(1);
+			report_error("Error -- .astc file format does not support texture format.\n");
 		}
-		save_astc_file(texture, filename);
+		save_astc_stream(texture, f);
 		break;
 	default :
-		printf("Error -- no support for saving texture file format.\n");
-		exit(1);
+		report_error("Error -- no support for saving texture file format.\n");
 	}
 }
 
@@ -594,8 +614,7 @@ void convert_image_from_srgb_to_rgb(Image *source_image, Image *dest_image) {
 	dest_image->is_half_float = 0;
 	dest_image->is_signed = 0;
 	if (source_image->is_half_float) {
-		printf("Error -- cannot convert half-float image from sRGB to RGB.\n");
-		exit(1);
+		report_error("Error -- cannot convert half-float image from sRGB to RGB.\n");
 	}
 	for (int y = 0; y < source_image->height; y++)
 		for (int x = 0; x < source_image->width; x++) {
@@ -635,8 +654,7 @@ void convert_image_from_rgb_to_srgb(Image *source_image, Image *dest_image) {
 	dest_image->is_half_float = 0;
 	dest_image->is_signed = 0;
 	if (source_image->is_half_float) {
-		printf("Error -- cannot convert half-float image from RGB to sRGB.\n");
-		exit(1);
+		report_error("Error -- cannot convert half-float image from RGB to sRGB.\n");
 	}
 	for (int y = 0; y < source_image->height; y++)
 		for (int x = 0; x < source_image->width; x++) {
@@ -663,6 +681,13 @@ void copy_image_to_uncompressed_texture(Image *image, int texture_type, Texture
 	texture->block_height = 1;
 	texture->bits_per_block = texture->info->bits_per_block;
 	set_texture_decoding_function(texture, NULL);
+	// Textures without 16-bit components are copied from an image with 8-bit components and the number of
+	// components of the source image. Check their masks before a converted clone of the image is allocated.
+	if (!(texture_type & TEXTURE_TYPE_16_BIT_COMPONENTS_BIT) && texture_type != TEXTURE_TYPE_UNCOMPRESSED_ARGB8 &&
+	image->nu_components >= 3 && (texture->info->red_mask != 0xFF || texture->info->green_mask != 0xFF00 ||
+	texture->info->blue_mask != 0xFF0000)) {
+		report_error("Error -- unable to convert image to texture with unconventional red, green or blue masks.\n");
+	}
 	if (image->bits_per_component == 8 && !(image->is_signed) && (texture_type & TEXTURE_TYPE_HALF_FLOAT_BIT)) {
 		// Convert image from 8-bit unsigned format to normalized half-float texture.
 		Image cloned_image;
@@ -694,8 +719,7 @@ void copy_image_to_uncompressed_texture(Image *image, int texture_type, Texture
 		return;
 	}
 	if (image->is_half_float) {
-		printf("Error -- no support for converting half-float image to non-half-float texture format.\n");
-		exit(1);
+		report_error("Error -- no support for converting half-float image to non-half-float texture format.\n");
 	}
 	if (image->bits_per_component == 16) {
 		if (!(texture_type & TEXTURE_TYPE_16_BIT_COMPONENTS_BIT)) {
@@ -737,8 +761,7 @@ void copy_image_to_uncompressed_texture(Image *image, int texture_type, Texture
 		else
 		if (texture_type & TEXTURE_TYPE_HALF_FLOAT_BIT) {
 			if (image->is_signed) {
-				printf("Error -- no support for converting 16-bit image to half-float texture format.\n");
-				exit(1);
+				report_error("Error -- no support for converting 16-bit image to half-float texture format.\n");
 			}
 			Image cloned_image;
 			clone_image(image, &cloned_image);
@@ -796,6 +819,9 @@ void copy_image_to_uncompressed_texture(Image *image, int texture_type, Texture
 		}
 	}
 copy :
+	if (texture->info->internal_bits_per_block != 32) {
+		report_error("Error -- unable to convert image to uncompressed texture with internal non-32-bit packed pixel size.\n");
+	}
 	texture->pixels = (unsigned int *)malloc(image->height * image->width * 4);
 	if (texture_type == TEXTURE_TYPE_UNCOMPRESSED_ARGB8) {
 		// Reverse component order.
@@ -807,15 +833,6 @@ copy :
 			}
 		return;
 	}
-	if (image->bits_per_component == 8 && image->nu_components >= 3 && (texture->info->red_mask != 0xFF ||
-	texture->info->green_mask != 0xFF00 || texture->info->blue_mask != 0xFF0000)) {
-		printf("Error -- unable to convert image to texture with unconventional red, green or blue masks.\n");
-		exit(1);
-	}
-	if (texture->info->internal_bits_per_block != 32) {
-		printf("Error -- unable to convert image to uncompressed texture with internal non-32-bit packed pixel size.\n");
-		exit(1);
-	}
 	for (int y = 0; y < image->height; y++)
 		memcpy(&texture->pixels[y * texture->width], &image->pixels[y * image->extended_width],
 			image->width * 4);
@@ -928,8 +945,7 @@ void convert_image_from_half_float(Image *image, float _range_min, float _range_
 			range_max = powf(_range_max, 1 / 2.2);
 	}
 	else {
-		printf("Error -- unsupported gamma value.\n");
-		exit(1);
+		report_error("Error -- unsupported gamma value.\n");
 	}
 	for (int y = 0; y < image->height; y++)
 		for (int x = 0; x < image->width; x++) {
@@ -0,0 +1,278 @@
+/*
+
+Copyright (c) 2015 Harm Hanemaaijer <fgenfb@yahoo.com>
+
+Permission to use, copy, modify, and/or distribute this software for any
+purpose with or without fee is hereby granted, provided that the above
+copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+*/
+
+// Library interface of texgenpack. Images and textures can be loaded from and saved to memory buffers, and
+// errors are returned as TEXGENPACK_ERROR instead of terminating the process.
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <setjmp.h>
+#include "texgenpack.h"
+
+#ifdef _MSC_VER
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+
+// Option variables used by the texgenpack modules. The command-line and GUI clients set them; library users
+// can leave the defaults or set them before calling into the library.
+
+int command;
+int option_verbose = 0;
+int option_max_threads = - 1;
+int option_orientation = 0;
+int option_texture_format = - 1;
+int option_compression_level = SPEED_FAST;
+int option_progress = 0;
+int option_modal_etc2 = 1;
+int option_allowed_modes_etc2 = - 1;
+int option_evolve_indices = 0;
+int option_generations = - 1;
+int option_islands = - 1;
+int option_generations_second_pass = - 1;
+int option_islands_second_pass = - 1;
+int option_flip_vertical = 0;
+int option_quiet = 0;
+int option_block_width = 4;
+int option_block_height = 4;
+int option_half_float = 0;
+int option_deterministic = 0;
+int option_hdr = 0;
+int option_perceptive = 1;
+
+// Error handling. When the calling thread is inside one of the library entry points below, report_error()
+// stores the message and jumps back to the entry point, which returns TEXGENPACK_ERROR. Otherwise the
+// message is printed and the process exits, which is what the command-line utility expects. Because the jump
+// skips the rest of the code that reported the error, that code frees its temporary buffers before calling
+// report_error(), and the entry point frees the pixels of the images or textures it returns.
+
+static THREAD_LOCAL jmp_buf *error_jump_buffer = NULL;
+static THREAD_LOCAL char error_message[256];
+
+void report_error(const char *format, ...) {
+	va_list args;
+	va_start(args, format);
+	if (error_jump_buffer == NULL) {
+		vprintf(format, args);
+		va_end(args);
+		exit(1);
+	}
+	vsnprintf(error_message, sizeof(error_message), format, args);
+	va_end(args);
+	longjmp(*error_jump_buffer, 1);
+}
+
+// Return the message of the last error reported to the calling thread by a library entry point.
+
+const char *texgenpack_get_error_message() {
+	return error_message;
+}
+
+// Open a stream to read from a memory buffer.
+
+static FILE *open_memory_for_reading(const unsigned char *data, size_t size) {
+	if (size == 0) {
+		report_error("Error -- empty input buffer.\n");
+	}
+#ifdef _WIN32
+	FILE *f = tmpfile();
+	if (f != NULL) {
+		fwrite(data, 1, size, f);
+		rewind(f);
+	}
+#else
+	FILE *f = fmemopen((void *)data, size, "rb");
+#endif
+	if (f == NULL) {
+		report_error("Error -- could not open input buffer.\n");
+	}
+	return f;
+}
+
+typedef struct {
+	FILE *f;
+	char *data;
+	size_t size;
+} MemoryStream;
+
+// Open a stream that writes to a memory buffer. The buffer is returned by close_memory_for_writing(). This
+// is called before the error trap is set up, so that the stream does not change after setjmp().
+
+static int open_memory_for_writing(MemoryStream *stream) {
+	stream->data = NULL;
+	stream->size = 0;
+#ifdef _WIN32
+	stream->f = tmpfile();
+#else
+	stream->f = open_memstream(&stream->data, &stream->size);
+#endif
+	if (stream->f == NULL) {
+		strcpy(error_message, "Error -- could not open output buffer.\n");
+		return TEXGENPACK_ERROR;
+	}
+	return TEXGENPACK_OK;
+}
+
+static void close_memory_for_writing(MemoryStream *stream, unsigned char **data_out, size_t *size_out) {
+#ifdef _WIN32
+	fflush(stream->f);
+	stream->size = ftell(stream->f);
+	stream->data = (char *)malloc(stream->size);
+	rewind(stream->f);
+	stream->size = fread(stream->data, 1, stream->size, stream->f);
+	fclose(stream->f);
+#else
+	fclose(stream->f);
+#endif
+	*data_out = (unsigned char *)stream->data;
+	*size_out = stream->size;
+}
+
+static void discard_memory_stream(MemoryStream *stream) {
+	fclose(stream->f);
+	free(stream->data);
+}
+
+// Free the pixels of textures that were set up by an entry point that failed.
+
+static void free_texture_pixels(Texture *textures, int nu_textures) {
+	for (int i = 0; i < nu_textures; i++) {
+		free(textures[i].pixels);
+		textures[i].pixels = NULL;
+	}
+}
+
+// Load an image from a memory buffer holding a file of the given type. Textures are decoded into an image.
+
+int load_image_from_memory(const unsigned char *data, size_t size, int filetype, Image *image) {
+	jmp_buf jump_buffer;
+	FILE * volatile f = NULL;
+	image->pixels = NULL;
+	if (setjmp(jump_buffer)) {
+		if (f != NULL)
+			fclose(f);
+		free(image->pixels);
+		image->pixels = NULL;
+		error_jump_buffer = NULL;
+		return TEXGENPACK_ERROR;
+	}
+	error_jump_buffer = &jump_buffer;
+	f = open_memory_for_reading(data, size);
+	load_image_stream(f, filetype, image);
+	fclose(f);
+	error_jump_buffer = NULL;
+	return TEXGENPACK_OK;
+}
+
+// Load at most max_mipmaps mipmap levels from a memory buffer holding a texture file of the given type. The
+// number of levels loaded is stored in nu_mipmaps.
+
+int load_texture_from_memory(const unsigned char *data, size_t size, int filetype, int max_mipmaps,
+Texture *texture, int *nu_mipmaps) {
+	jmp_buf jump_buffer;
+	FILE * volatile f = NULL;
+	for (int i = 0; i < max_mipmaps; i++)
+		texture[i].pixels = NULL;
+	if (setjmp(jump_buffer)) {
+		if (f != NULL)
+			fclose(f);
+		free_texture_pixels(texture, max_mipmaps);
+		error_jump_buffer = NULL;
+		return TEXGENPACK_ERROR;
+	}
+	error_jump_buffer = &jump_buffer;
+	if (!(filetype & FILE_TYPE_TEXTURE_BIT)) {
+		report_error("Error -- file type is not a texture file type.\n");
+	}
+	f = open_memory_for_reading(data, size);
+	*nu_mipmaps = load_texture_stream(f, filetype, max_mipmaps, texture);
+	fclose(f);
+	error_jump_buffer = NULL;
+	return TEXGENPACK_OK;
+}
+
+// Save an image as a file of the given type to a newly allocated buffer. The buffer should be freed with
+// free().
+
+int save_image_to_memory(Image *image, int filetype, unsigned char **data, size_t *size) {
+	jmp_buf jump_buffer;
+	MemoryStream stream;
+	if (open_memory_for_writing(&stream) != TEXGENPACK_OK)
+		return TEXGENPACK_ERROR;
+	if (setjmp(jump_buffer)) {
+		discard_memory_stream(&stream);
+		error_jump_buffer = NULL;
+		return TEXGENPACK_ERROR;
+	}
+	error_jump_buffer = &jump_buffer;
+	save_image_stream(image, stream.f, filetype);
+	close_memory_for_writing(&stream, data, size);
+	error_jump_buffer = NULL;
+	return TEXGENPACK_OK;
+}
+
+// Save nu_mipmaps levels of a texture as a file of the given type to a newly allocated buffer. The buffer
+// should be freed with free().
+
+int save_texture_to_memory(Texture *texture, int nu_mipmaps, int filetype, unsigned char **data, size_t *size) {
+	jmp_buf jump_buffer;
+	MemoryStream stream;
+	if (open_memory_for_writing(&stream) != TEXGENPACK_OK)
+		return TEXGENPACK_ERROR;
+	if (setjmp(jump_buffer)) {
+		discard_memory_stream(&stream);
+		error_jump_buffer = NULL;
+		return TEXGENPACK_ERROR;
+	}
+	error_jump_buffer = &jump_buffer;
+	save_texture_stream(texture, nu_mipmaps, stream.f, filetype);
+	close_memory_for_writing(&stream, data, size);
+	error_jump_buffer = NULL;
+	return TEXGENPACK_OK;
+}
+
+// Compress a chain of mipmap images into textures of the given type with the options of the context.
+// Errors detected while setting up the compression are returned; the compression itself runs in the
+// worker threads of the pool and does not fail.
+
+int compress_mipmap_images_to_textures(CompressionContext *context, Image *images, int nu_images,
+int texture_type, Texture *textures) {
+	jmp_buf jump_buffer;
+	for (int i = 0; i < nu_images; i++)
+		textures[i].pixels = NULL;
+	if (setjmp(jump_buffer)) {
+		free_texture_pixels(textures, nu_images);
+		error_jump_buffer = NULL;
+		return TEXGENPACK_ERROR;
+	}
+	error_jump_buffer = &jump_buffer;
+	if (match_texture_type(texture_type) == NULL) {
+		report_error("Error -- invalid texture type.\n");
+	}
+	compress_mipmap_images_with_context(context, images, nu_images, texture_type, textures);
+	error_jump_buffer = NULL;
+	return TEXGENPACK_OK;
+}
+
+int compress_image_to_texture(CompressionContext *context, Image *image, int texture_type, Texture *texture) {
+	return compress_mipmap_images_to_textures(context, image, 1, texture_type, texture);
+}
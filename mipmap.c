@@ -548,8 +548,7 @@ static void generate_mipmap_level(Image *source_image, int divider, Image *dest_
 	}
 	if (count != 2) {
 		if (divider != 2) {
-			printf("Error -- non-power-of-two mipmap must be generated from previous level.\n");
-			exit(1);
+			report_error("Error -- non-power-of-two mipmap must be generated from previous level.\n");
 		}
 		if (source_image->is_half_float) {
 			dest_image->pixels = (unsigned int *)realloc(dest_image->pixels,
@@ -594,12 +593,10 @@ static void generate_mipmap_level(Image *source_image, int divider, Image *dest_
 				create_mipmap_with_averaging_divider_2(source_image, dest_image);
 		else {
 			if (source_image->is_half_float) {
-				printf("Error -- cannot generate mipmaps for image with half-float components.");
-				exit(1);
+				report_error("Error -- cannot generate mipmaps for image with half-float components.");
 			}
 			if (source_image->bits_per_component == 16 || source_image->is_signed) {
-				printf("Error -- cannot generate mipmaps for image with 16-bit or signed components.\n");
-				exit(1);
+				report_error("Error -- cannot generate mipmaps for image with 16-bit or signed components.\n");
 			}
 			create_mipmap_with_averaging(source_image, divider, dest_image);
 		}
@@ -25,6 +25,7 @@ OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 #include <stdio.h>
 #include <stdint.h>
 #include <string.h>
+#include <limits.h>
 #include "texgenpack.h"
 #include "decode.h"
 #include "packing.h"
@@ -139,3 +140,213 @@ int draw_block4x4_signed_rgtc2(const unsigned char *bitstring, unsigned int *ima
 	return draw_block4x4_signed_rgtc1_shared(&bitstring[8], image_buffer, 1, flags);
 }
 
+
+// Encode 16 8-bit values in row-major order exactly into a 64-bit unsigned RGTC1 block (which has the same format
+// as the alpha part of DXT5) when there are at most two different values other than 0 and 255. The endpoints are
+// ordered so that 0 and 255 are available as codes 6 and 7. Return 0 when the values can not be encoded this way.
+
+int encode_trivial_block4x4_rgtc1_component(const unsigned char *values, unsigned char *bitstring) {
+	int nu_values = 0;
+	int value[2];
+	for (int i = 0; i < 16; i++) {
+		if (values[i] == 0 || values[i] == 0xFF)
+			continue;
+		if ((nu_values > 0 && values[i] == value[0]) || (nu_values > 1 && values[i] == value[1]))
+			continue;
+		if (nu_values == 2)
+			return 0;
+		value[nu_values++] = values[i];
+	}
+	if (nu_values == 0)
+		value[0] = value[1] = 0;
+	else if (nu_values == 1)
+		value[1] = value[0];
+	else if (value[0] > value[1]) {
+		int temp = value[0];
+		value[0] = value[1];
+		value[1] = temp;
+	}
+	uint64_t bits = 0;
+	for (int i = 0; i < 16; i++) {
+		uint64_t code;
+		if (values[i] == value[0])
+			code = 0;
+		else if (values[i] == value[1])
+			code = 1;
+		else if (values[i] == 0)
+			code = 6;
+		else
+			code = 7;
+		bits |= code << (i * 3);
+	}
+	bitstring[0] = value[0];
+	bitstring[1] = value[1];
+	for (int i = 0; i < 6; i++)
+		bitstring[i + 2] = (bits >> (i * 8)) & 0xFF;
+	return 1;
+}
+
+// Encode an unsigned RGTC1 or RGTC2 block of which every component has at most two different values other than
+// 0 and 255. The pixels are in row-major order. Return 0 when the block can not be encoded this way.
+
+int encode_trivial_block4x4_rgtc(const unsigned int *pixels, int texture_type, unsigned char *bitstring) {
+	unsigned char values[16];
+	for (int i = 0; i < 16; i++)
+		values[i] = pixel_get_r(pixels[i]);
+	if (!encode_trivial_block4x4_rgtc1_component(values, bitstring))
+		return 0;
+	if (texture_type == TEXTURE_TYPE_RGTC1)
+		return 1;
+	for (int i = 0; i < 16; i++)
+		values[i] = pixel_get_g(pixels[i]);
+	return encode_trivial_block4x4_rgtc1_component(values, &bitstring[8]);
+}
+
+// Return the value of an unsigned RGTC1 code for the given endpoints, like the decoder.
+
+static int rgtc1_code_value(int lum0, int lum1, int code) {
+	if (code == 0)
+		return lum0;
+	if (code == 1)
+		return lum1;
+	if (lum0 > lum1)
+		return ((8 - code) * lum0 + (code - 1) * lum1) / 7;
+	if (code == 6)
+		return 0;
+	if (code == 7)
+		return 0xFF;
+	return ((6 - code) * lum0 + (code - 1) * lum1) / 5;
+}
+
+// Return the squared error of a set of distinct values with counts when encoded with the given endpoints. The
+// calculation stops as soon as the error is not smaller than max_error.
+
+static int rgtc1_endpoints_error(int lum0, int lum1, const int *value, const int *value_count, int nu_values,
+int max_error) {
+	int palette[8];
+	for (int code = 0; code < 8; code++)
+		palette[code] = rgtc1_code_value(lum0, lum1, code);
+	int error = 0;
+	for (int i = 0; i < nu_values && error < max_error; i++) {
+		int value_error = INT_MAX;
+		for (int code = 0; code < 8; code++) {
+			int d = palette[code] - value[i];
+			if (d * d < value_error)
+				value_error = d * d;
+		}
+		error += value_count[i] * value_error;
+	}
+	return error;
+}
+
+// Encode the visible width x height values of a block (16 8-bit values in row-major order) into a 64-bit unsigned
+// RGTC1 block (which has the same format as the alpha part of DXT5) with the smallest possible squared error.
+// Every pair of endpoints is considered, but most pairs are rejected with a lower bound of the error, which is
+// the error of the values that lie outside the range of the endpoints. When flags contains
+// MODES_ALLOWED_OPAQUE_ONLY, only the encoding with six interpolated values is used, as required for opaque DXT5
+// blocks.
+
+void encode_optimal_block4x4_rgtc1_component(const unsigned char *values, int width, int height, int flags,
+unsigned char *bitstring) {
+	int count[256];
+	memset(count, 0, sizeof(count));
+	for (int y = 0; y < height; y++)
+		for (int x = 0; x < width; x++)
+			count[values[y * 4 + x]]++;
+	// Collect the distinct values, alternately taken from the low and the high end of the range so that the
+	// error calculation of bad endpoints tends to stop early.
+	int sorted_value[16];
+	int nu_values = 0;
+	for (int v = 0; v < 256; v++)
+		if (count[v] > 0)
+			sorted_value[nu_values++] = v;
+	int value[16], value_count[16];
+	for (int i = 0, low = 0, high = nu_values - 1; i < nu_values; i++) {
+		value[i] = (i & 1) ? sorted_value[high--] : sorted_value[low++];
+		value_count[i] = count[value[i]];
+	}
+	// Lower bounds of the error of the values below and above an endpoint. In the encoding with six
+	// interpolated values, the values outside the range may also use 0 or 255.
+	int error_below8[256], error_above8[256], error_below6[256], error_above6[256];
+	for (int e = 0; e < 256; e++) {
+		error_below8[e] = error_above8[e] = error_below6[e] = error_above6[e] = 0;
+		for (int i = 0; i < nu_values; i++) {
+			int v = value[i];
+			if (v < e) {
+				int d = e - v < v ? e - v : v;
+				error_below8[e] += value_count[i] * (e - v) * (e - v);
+				error_below6[e] += value_count[i] * d * d;
+			}
+			else if (v > e) {
+				int d = v - e < 0xFF - v ? v - e : 0xFF - v;
+				error_above8[e] += value_count[i] * (v - e) * (v - e);
+				error_above6[e] += value_count[i] * d * d;
+			}
+		}
+	}
+	// Start with the best encoding that has the endpoints at the extremes of the values.
+	int best_lum0 = sorted_value[0];
+	int best_lum1 = sorted_value[nu_values - 1];
+	int best_error = rgtc1_endpoints_error(best_lum0, best_lum1, value, value_count, nu_values, INT_MAX);
+	if (best_lum1 > best_lum0 && !(flags & MODES_ALLOWED_OPAQUE_ONLY)) {
+		int error = rgtc1_endpoints_error(best_lum1, best_lum0, value, value_count, nu_values, best_error);
+		if (error < best_error) {
+			best_error = error;
+			best_lum0 = sorted_value[nu_values - 1];
+			best_lum1 = sorted_value[0];
+		}
+	}
+	for (int lum0 = 0; lum0 < 256 && best_error > 0; lum0++)
+		for (int lum1 = 0; lum1 < 256; lum1++) {
+			int bound;
+			if (lum0 > lum1) {
+				if (flags & MODES_ALLOWED_OPAQUE_ONLY)
+					continue;
+				bound = error_above8[lum0] + error_below8[lum1];
+			}
+			else
+				bound = error_below6[lum0] + error_above6[lum1];
+			if (bound >= best_error)
+				continue;
+			int error = rgtc1_endpoints_error(lum0, lum1, value, value_count, nu_values, best_error);
+			if (error < best_error) {
+				best_error = error;
+				best_lum0 = lum0;
+				best_lum1 = lum1;
+			}
+		}
+	uint64_t bits = 0;
+	for (int i = 0; i < 16; i++) {
+		uint64_t best_code = 0;
+		int best_value_error = INT_MAX;
+		for (int code = 0; code < 8; code++) {
+			int d = rgtc1_code_value(best_lum0, best_lum1, code) - values[i];
+			if (d * d < best_value_error) {
+				best_value_error = d * d;
+				best_code = code;
+			}
+		}
+		bits |= best_code << (i * 3);
+	}
+	bitstring[0] = best_lum0;
+	bitstring[1] = best_lum1;
+	for (int i = 0; i < 6; i++)
+		bitstring[i + 2] = (bits >> (i * 8)) & 0xFF;
+}
+
+// Encode an unsigned RGTC1 or RGTC2 block with the smallest possible error, each component with
+// encode_optimal_block4x4_rgtc1_component(). The pixels are in row-major order and only the visible width x height
+// pixels are taken into account.
+
+void encode_optimal_block4x4_rgtc(const unsigned int *pixels, int width, int height, int texture_type,
+unsigned char *bitstring) {
+	unsigned char values[16];
+	for (int i = 0; i < 16; i++)
+		values[i] = pixel_get_r(pixels[i]);
+	encode_optimal_block4x4_rgtc1_component(values, width, height, 0, bitstring);
+	if (texture_type == TEXTURE_TYPE_RGTC1)
+		return;
+	for (int i = 0; i < 16; i++)
+		values[i] = pixel_get_g(pixels[i]);
+	encode_optimal_block4x4_rgtc1_component(values, width, height, 0, &bitstring[8]);
+}
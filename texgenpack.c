@@ -22,6 +22,7 @@ OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 #include <string.h>
 #include <ctype.h>
 #include <malloc.h>
+#include <pthread.h>
 #include "texgenpack.h"
 #include "decode.h"
 #ifndef __GNUC__
@@ -37,51 +38,37 @@ static void compare_files();
 static void decompress();
 static void compress();
 static void calibrate();
+static void batch(const char *manifest_filename);
 
-// Variables reflecting command-line options.
+// Variables reflecting command-line options. The option variables used by the texgenpack modules are
+// defined in library.c.
 
-int command;
-int option_verbose = 0;
-int option_max_threads = - 1;
 char *source_filename;
 char *dest_filename;
 int source_filetype;
 int dest_filetype;
-int option_orientation = 0;
-int option_texture_format = - 1;
-int option_compression_level = SPEED_FAST;
-int option_progress = 0;
-int option_modal_etc2 = 1;
-int option_allowed_modes_etc2 = - 1;
 int option_mipmaps = 0;
-int option_generations = - 1;
-int option_islands = - 1;
-int option_generations_second_pass = - 1;
-int option_islands_second_pass = - 1;
-int option_flip_vertical = 0;
-int option_quiet = 0;
-int option_block_width = 4;
-int option_block_height = 4;
-int option_half_float = 0;
-int option_hdr = 0;
-int option_perceptive = 1;
-
-// Other option variables that are not actually set by command-line options.
-
-int option_deterministic = 0;
+char *option_cache_filename = NULL;
+char *option_previous_source_filename = NULL;
+char *option_previous_texture_filename = NULL;
 
 static char *instructions1 =
 "texgenpack v0.9.6 -- Texture conversion and compression using a genetic algorithm.\n"
 "Usage: texgenpack <command> <options> <source filename> <destination filename>.\n"
+"       texgenpack --batch <options> <manifest filename>.\n"
+"\n"
+"A batch manifest lists one compression per line as <source filename> <destination filename>, optionally\n"
+"followed by a texture format that overrides the --format option. Empty lines and lines starting with #\n"
+"are ignored.\n"
 "\n"
 "Commands:\n";
 
-#define NU_COMMANDS 4
+#define NU_COMMANDS 5
 
 static const char *commands[NU_COMMANDS] = {
-	"--compress", "--decompress", "--compare", "--calibrate" };
+	"--compress", "--decompress", "--compare", "--calibrate", "--batch" };
 
-#define NU_OPTIONS 24
+#define NU_OPTIONS 28
 
 enum {
 	OPTION_COMPRESSION_LEVEL = 0,
@@ -98,11 +85,15 @@ enum {
 	OPTION_FLIP_VERTICAL,
 	OPTION_MODAL_ETC2,
 	OPTION_ALLOWED_MODES,
+	OPTION_EVOLVE_INDICES,
 	OPTION_MAXTHREADS,
 	OPTION_GENERATIONS,
 	OPTION_ISLANDS,
 	OPTION_GENERATIONS_SECOND_PASS,
 	OPTION_ISLANDS_SECOND_PASS,
+	OPTION_CACHE,
+	OPTION_PREVIOUS_SOURCE,
+	OPTION_PREVIOUS_TEXTURE,
 	OPTION_PROGRESS,
 	OPTION_VERBOSE,
 	OPTION_VERY_VERBOSE,
@@ -117,8 +108,10 @@ static const char *options[NU_OPTIONS] = {
 	"--half-float", "--hdr",
 	"--mipmaps",
 	"--orientation", "--flip-vertical",
-	"--modal", "--allowed-modes",
+	"--modal", "--allowed-modes", "--evolve-indices",
 	"--maxthreads", "--generations", "--islands", "--generations-second-pass", "--islands-second-pass",
+	"--cache",
+	"--previous-source", "--previous-texture",
 	"--progress", "--verbose", "--very-verbose", "--quiet", "--verbosity"
 };
 
@@ -129,8 +122,10 @@ static const char *option_argument[NU_OPTIONS] = {
 	"", "",
 	"",
 	"<direction>", "",
-	"", "<modes>",
+	"", "<modes>", "",
 	"<number>", "<number>", "<number>", "<number>", "<number>",
+	"<filename>",
+	"<filename>", "<filename>",
 	"", "", "", "", "<number>",
 };
 
@@ -150,13 +145,23 @@ static const char *option_description[NU_OPTIONS] = {
 	"Flip the texture vertically during the conversion process.",
 	"Use a different technique for ETC2 compression with islands tied to specific ETC2 modes.",
 	"Specify the ETC2 modes to use. Argument is a string containing a subset of the letters IDTHP.",
-	"Specify the maximum number of threads to use (not recommended; uses --islands option to control threading level).",
+	"Let the genetic algorithm search for the pixel indices of DXT1, DXT1A, DXT3, DXT5, ETC1, ETC2_RGB8 and "
+	"ETC2_EAC blocks instead of calculating the optimal ones from the other fields of a block.",
+	"Specify the number of worker threads used for compression (default is the number of processors).",
 	"Set the number of generations for the genetic algorithm per block (adjusted from compression level).",
 	"Set the number of concurrent islands for the genetic algorithm (adjusted from compression level).",
 	"Set the number of generations for the second pass of the genetic algorithm per block (adjusted from "
 	"compression level).",
 	"Set the number of concurrent islands for the second pass of the genetic algorithm (adjusted from "
 	"compression level).",
+	"Look up compressed blocks in and store them in the given block cache file, which is created when it "
+	"doesn't exist. Blocks with the same pixels that were compressed earlier with the same texture format "
+	"and compression parameters are not compressed again. The file can be shared by several processes. Not "
+	"used with the perceptive quality strategy.",
+	"Source image of an earlier compression, for use with --previous-texture. Only the blocks of which the "
+	"source pixels differ from it, and their neighbours, are compressed again. Not available with --batch.",
+	"Texture produced by the earlier compression of the image given with --previous-source. The compressed "
+	"blocks of which the source pixels have not changed are kept.",
 	"Display a percentage progress indicator.",
 	"Be verbose (information for each block).",
 	"Be very verbose (more information for each block).",
@@ -242,6 +247,10 @@ int main(int argc, char **argv) {
 			option_modal_etc2 = 1;
 			i++;
 			continue;
+		case OPTION_EVOLVE_INDICES :
+			option_evolve_indices = 1;
+			i++;
+			continue;
 		case OPTION_ULTRA :
 			option_compression_level = SPEED_ULTRA;
 			i++;
@@ -369,6 +378,18 @@ int main(int argc, char **argv) {
 			option_islands_second_pass = value;
 			i += 2;
 			break;
+		case OPTION_CACHE :
+			option_cache_filename = argv[i + 1];
+			i += 2;
+			break;
+		case OPTION_PREVIOUS_SOURCE :
+			option_previous_source_filename = argv[i + 1];
+			i += 2;
+			break;
+		case OPTION_PREVIOUS_TEXTURE :
+			option_previous_texture_filename = argv[i + 1];
+			i += 2;
+			break;
 		case OPTION_COMPRESSION_LEVEL :
 			value = atoi(argv[i + 1]);
 			if (value < 0 || value > 50) {
@@ -410,6 +431,18 @@ int main(int argc, char **argv) {
 		}
 	}
 
+	if (command == COMMAND_BATCH) {
+		if (i != argc - 1) {
+			printf("Error -- expected the manifest filename at the end of the command line.\n");
+			exit(1);
+		}
+		if (option_previous_source_filename != NULL || option_previous_texture_filename != NULL) {
+			printf("Error -- --previous-source and --previous-texture cannot be used with --batch.\n");
+			exit(1);
+		}
+		batch(argv[i]);
+		exit(0);
+	}
 	if (i >= argc - 1) {
 		printf("Error -- expected two filenames at the end of the command line.\n");
 		exit(1);
@@ -472,6 +505,24 @@ int main(int argc, char **argv) {
 			printf("Error -- destination file type cannot hold multiple mipmap levels.\n");
 			exit(1);
 		}
+		if ((option_previous_source_filename == NULL) != (option_previous_texture_filename == NULL)) {
+			printf("Error -- --previous-source and --previous-texture must be given together.\n");
+			exit(1);
+		}
+		if (option_previous_source_filename != NULL) {
+			if (determine_filename_type(option_previous_source_filename) == FILE_TYPE_UNDEFINED ||
+			(determine_filename_type(option_previous_texture_filename) & FILE_TYPE_TEXTURE_BIT) == 0) {
+				printf("Error -- expected an image or texture file as previous source and a texture "
+					"file as previous texture.\n");
+				exit(1);
+			}
+			if (!file_exists(option_previous_source_filename) ||
+			!file_exists(option_previous_texture_filename)) {
+				printf("Error -- previous source or previous texture file doesn't exist or is "
+					"unreadable.\n");
+				exit(1);
+			}
+		}
 		compress();
 	}
 	if (command == COMMAND_CALIBRATE) {
@@ -602,30 +653,46 @@ static void compress_callback(BlockUserData *user_data) {
 	// Do nothing.
 }
 
-static void compress() {
+// A compression of one source file into one texture file. The source images are loaded and the mipmaps are
+// generated by load_compression_source(), which the batch command runs ahead of the compression.
+
+typedef struct {
+	const char *source_filename;
+	const char *dest_filename;
+	int source_filetype;
+	int dest_filetype;
+	int texture_type;
+	int nu_mipmaps;
+	Image *mipmap_image;
+	// The source images and texture of an earlier compression given with --previous-source and
+	// --previous-texture, or NULL.
+	int nu_previous_levels;
+	Image *previous_image;
+	Texture *previous_texture;
+} CompressionJob;
+
+static void load_compression_source(CompressionJob *job) {
 	Image image[32];
-	if (!option_quiet)
-		printf("Compressing %s to %s.\n", source_filename, dest_filename);
 	int nu_mipmaps;
-	if (source_filetype & FILE_TYPE_MIPMAPS_BIT)
-		nu_mipmaps = load_mipmap_images(source_filename, source_filetype, 32, &image[0]);
+	if (job->source_filetype & FILE_TYPE_MIPMAPS_BIT)
+		nu_mipmaps = load_mipmap_images(job->source_filename, job->source_filetype, 32, &image[0]);
 	else {
-		load_image(source_filename, source_filetype, &image[0]);
+		load_image(job->source_filename, job->source_filetype, &image[0]);
 		nu_mipmaps = 1;
 	}
 	if (option_flip_vertical)
 		for (int i = 0; i < nu_mipmaps; i++)
 			flip_image_vertical(&image[i]);
-	int texture_type;
-	if (option_texture_format != - 1)
-		texture_type = option_texture_format;
-	else
+	int texture_type = job->texture_type;
+	if (texture_type == - 1) {
 		// Set default compression format for the given the file type.
-		if (dest_filetype == FILE_TYPE_KTX || dest_filetype == FILE_TYPE_PKM)
+		if (job->dest_filetype == FILE_TYPE_KTX || job->dest_filetype == FILE_TYPE_PKM)
 			texture_type = TEXTURE_TYPE_ETC1;
 		else
-		if (dest_filetype == FILE_TYPE_DDS)
+		if (job->dest_filetype == FILE_TYPE_DDS)
 			texture_type = TEXTURE_TYPE_DXT1;
+	}
+	job->texture_type = texture_type;
 	const char *texture_type_str = texture_type_text(texture_type);
 	if (!option_quiet) {
 		if (nu_mipmaps > 1)
@@ -640,8 +707,7 @@ static void compress() {
 		if (!option_quiet)
 			printf("Generating %d mipmaps.\n", nu_mipmaps);
 	}
-	Texture *texture = (Texture *)alloca(sizeof(Texture) * nu_mipmaps);
-	Image *mipmap_image = (Image *)alloca(sizeof(Image) * nu_mipmaps);
+	Image *mipmap_image = (Image *)malloc(sizeof(Image) * nu_mipmaps);
 	if (generate_mipmaps) {
 		mipmap_image[0] = image[0];
 		if ((texture_type & TEXTURE_TYPE_SRGB_BIT) && nu_mipmaps > 1) {
@@ -659,6 +725,8 @@ static void compress() {
 			for (int i = 1; i < nu_mipmaps; i++) {
 				convert_image_from_rgb_to_srgb(&rgb_mipmap_image[i], &mipmap_image[i]);
 			}
+			for (int i = 0; i < nu_mipmaps; i++)
+				destroy_image(&rgb_mipmap_image[i]);
 		}
 		else
 			for (int i = 1; i < nu_mipmaps; i++) {
@@ -672,11 +740,59 @@ static void compress() {
 			printf("Source mipmap %d: %d x %d\n", i, mipmap_image[i].width, mipmap_image[i].height);
 		}
 	}
+	job->nu_mipmaps = nu_mipmaps;
+	job->mipmap_image = mipmap_image;
+}
+
+// Load the source images and the texture of an earlier compression for a job that has been loaded. The
+// mipmaps of the previous source are generated in the same way as those of the new source, so that they can
+// be compared level by level.
+
+static void load_previous_compression(CompressionJob *job) {
+	if (!option_quiet)
+		printf("Loading previous source %s and previous texture %s.\n", option_previous_source_filename,
+			option_previous_texture_filename);
+	CompressionJob previous;
+	previous.source_filename = option_previous_source_filename;
+	previous.source_filetype = determine_filename_type(option_previous_source_filename);
+	previous.dest_filetype = job->dest_filetype;
+	previous.texture_type = job->texture_type;
+	load_compression_source(&previous);
+	Texture *texture = (Texture *)malloc(sizeof(Texture) * 32);
+	int nu_textures = load_texture(option_previous_texture_filename,
+		determine_filename_type(option_previous_texture_filename), 32, texture);
+	int n = previous.nu_mipmaps;
+	if (nu_textures < n)
+		n = nu_textures;
+	for (int i = n; i < previous.nu_mipmaps; i++)
+		destroy_image(&previous.mipmap_image[i]);
+	for (int i = n; i < nu_textures; i++)
+		destroy_texture(&texture[i]);
+	job->nu_previous_levels = n;
+	job->previous_image = previous.mipmap_image;
+	job->previous_texture = texture;
+}
+
+// Compress the loaded images of a job, save the texture and free the images. When population_cache is not
+// NULL, the populations of the genetic algorithm are reused from earlier compressions. When block_cache is
+// not NULL, compressed blocks are looked up in and stored in it.
+
+static void compress_and_save(CompressionJob *job, PopulationCache *population_cache, BlockCache *block_cache) {
+	int nu_mipmaps = job->nu_mipmaps;
+	Image *mipmap_image = job->mipmap_image;
+	Texture *texture = (Texture *)alloca(sizeof(Texture) * nu_mipmaps);
+	// Compress the images of all mipmap levels into textures.
+	CompressionContext context;
+	init_compression_context(&context, compress_callback);
+	context.population_cache = population_cache;
+	context.block_cache = block_cache;
+	context.previous_images = job->previous_image;
+	context.previous_textures = job->previous_texture;
+	context.nu_previous_levels = job->nu_previous_levels;
+	compress_mipmap_images_with_context(&context, &mipmap_image[0], nu_mipmaps, job->texture_type, &texture[0]);
 	for (int i = 0; i < nu_mipmaps; i++) {
-		// Compress the image into a texture.
 		if (!option_quiet)
 			printf("Mipmap level: %d (%d x %d)\n", i, mipmap_image[i].width, mipmap_image[i].height);
-		compress_image(&mipmap_image[i], texture_type, compress_callback, &texture[i], 0, 0, 0);
 		// Decompress the compressed texture and calculate the difference with the original.
 		Image compressed_image;
 		convert_texture_to_image(&texture[i], &compressed_image);
@@ -684,7 +800,193 @@ static void compress() {
 		destroy_image(&compressed_image);
 	}
 	// Save texture.
-	save_texture(&texture[0], nu_mipmaps, dest_filename, dest_filetype);
+	save_texture(&texture[0], nu_mipmaps, job->dest_filename, job->dest_filetype);
+	for (int i = 0; i < nu_mipmaps; i++) {
+		destroy_texture(&texture[i]);
+		destroy_image(&mipmap_image[i]);
+	}
+	free(mipmap_image);
+	if (job->previous_texture != NULL) {
+		for (int i = 0; i < job->nu_previous_levels; i++) {
+			destroy_texture(&job->previous_texture[i]);
+			destroy_image(&job->previous_image[i]);
+		}
+		free(job->previous_texture);
+		free(job->previous_image);
+	}
+}
+
+static void compress() {
+	if (!option_quiet)
+		printf("Compressing %s to %s.\n", source_filename, dest_filename);
+	CompressionJob job;
+	job.source_filename = source_filename;
+	job.dest_filename = dest_filename;
+	job.source_filetype = source_filetype;
+	job.dest_filetype = dest_filetype;
+	job.texture_type = option_texture_format;
+	job.nu_previous_levels = 0;
+	job.previous_image = NULL;
+	job.previous_texture = NULL;
+	load_compression_source(&job);
+	if (option_previous_source_filename != NULL)
+		load_previous_compression(&job);
+	BlockCache *block_cache = NULL;
+	if (option_cache_filename != NULL)
+		block_cache = open_block_cache(option_cache_filename);
+	compress_and_save(&job, NULL, block_cache);
+	if (block_cache != NULL)
+		close_block_cache(block_cache);
+}
+
+// Batch compression. All compressions share the thread pool and the populations of the genetic algorithm,
+// and a separate thread loads the sources of the next jobs while the current one is being compressed.
+
+#define BATCH_PREFETCH_DEPTH 2
+
+typedef struct {
+	CompressionJob *jobs;
+	int nu_jobs;
+	int nu_loaded;
+	int nu_finished;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+} Batch;
+
+static void *batch_loader_thread(void *arg) {
+	Batch *batch = (Batch *)arg;
+	for (int i = 0; i < batch->nu_jobs; i++) {
+		// Do not run more than BATCH_PREFETCH_DEPTH jobs ahead, so that memory use stays bounded.
+		pthread_mutex_lock(&batch->mutex);
+		while (i - batch->nu_finished >= BATCH_PREFETCH_DEPTH)
+			pthread_cond_wait(&batch->cond, &batch->mutex);
+		pthread_mutex_unlock(&batch->mutex);
+		load_compression_source(&batch->jobs[i]);
+		pthread_mutex_lock(&batch->mutex);
+		batch->nu_loaded = i + 1;
+		pthread_cond_broadcast(&batch->cond);
+		pthread_mutex_unlock(&batch->mutex);
+	}
+	return NULL;
+}
+
+// Read the manifest and check all of its jobs before anything is compressed.
+
+static int read_batch_manifest(const char *manifest_filename, CompressionJob **jobs_out) {
+	FILE *f = fopen(manifest_filename, "rb");
+	if (f == NULL) {
+		printf("Error -- manifest file %s doesn't exist or is unreadable.\n", manifest_filename);
+		exit(1);
+	}
+	int max_jobs = 64;
+	CompressionJob *jobs = (CompressionJob *)malloc(sizeof(CompressionJob) * max_jobs);
+	int nu_jobs = 0;
+	char line[4096];
+	int line_number = 0;
+	while (fgets(line, sizeof(line), f) != NULL) {
+		line_number++;
+		char source[4096], dest[4096], format[4096];
+		int n = sscanf(line, "%4095s %4095s %4095s", source, dest, format);
+		if (n <= 0 || source[0] == '#')
+			continue;
+		if (n < 2) {
+			printf("Error -- expected source and destination filename on line %d of manifest.\n",
+				line_number);
+			exit(1);
+		}
+		if (nu_jobs == max_jobs) {
+			max_jobs *= 2;
+			jobs = (CompressionJob *)realloc(jobs, sizeof(CompressionJob) * max_jobs);
+		}
+		CompressionJob *job = &jobs[nu_jobs];
+		job->source_filename = strdup(source);
+		job->dest_filename = strdup(dest);
+		job->source_filetype = determine_filename_type(source);
+		if (job->source_filetype == FILE_TYPE_UNDEFINED) {
+			printf("Error -- unknown file %s (no known extension found).\n", source);
+			exit(1);
+		}
+		job->dest_filetype = determine_filename_type(dest);
+		if ((job->dest_filetype & FILE_TYPE_TEXTURE_BIT) == 0) {
+			printf("Error -- expected texture file as destination of %s.\n", source);
+			exit(1);
+		}
+		if (!file_exists(source)) {
+			printf("Error -- source file %s doesn't exist or is unreadable.\n", source);
+			exit(1);
+		}
+		if (strcasecmp(source, dest) == 0) {
+			printf("Error -- source filename and destination filename %s are identical.\n", source);
+			exit(1);
+		}
+		if (option_mipmaps && (job->dest_filetype & FILE_TYPE_MIPMAPS_BIT) == 0) {
+			printf("Error -- destination file type of %s cannot hold multiple mipmap levels.\n", dest);
+			exit(1);
+		}
+		job->texture_type = option_texture_format;
+		job->nu_previous_levels = 0;
+		job->previous_image = NULL;
+		job->previous_texture = NULL;
+		if (n == 3) {
+			TextureInfo *info = match_texture_description(format);
+			if (info == NULL) {
+				printf("Error -- unknown texture format %s on line %d of manifest.\n", format,
+					line_number);
+				exit(1);
+			}
+			job->texture_type = info->type;
+		}
+		nu_jobs++;
+	}
+	fclose(f);
+	*jobs_out = jobs;
+	return nu_jobs;
+}
+
+static void batch(const char *manifest_filename) {
+	Batch batch;
+	batch.nu_jobs = read_batch_manifest(manifest_filename, &batch.jobs);
+	batch.nu_loaded = 0;
+	batch.nu_finished = 0;
+	pthread_mutex_init(&batch.mutex, NULL);
+	pthread_cond_init(&batch.cond, NULL);
+	if (!option_quiet)
+		printf("Compressing %d files listed in %s.\n", batch.nu_jobs, manifest_filename);
+	pthread_t loader_thread;
+	if (pthread_create(&loader_thread, NULL, batch_loader_thread, &batch) != 0) {
+		printf("Error -- could not create loader thread.\n");
+		exit(1);
+	}
+	PopulationCache *population_cache = create_population_cache();
+	BlockCache *block_cache = NULL;
+	if (option_cache_filename != NULL)
+		block_cache = open_block_cache(option_cache_filename);
+	for (int i = 0; i < batch.nu_jobs; i++) {
+		pthread_mutex_lock(&batch.mutex);
+		while (batch.nu_loaded <= i)
+			pthread_cond_wait(&batch.cond, &batch.mutex);
+		pthread_mutex_unlock(&batch.mutex);
+		CompressionJob *job = &batch.jobs[i];
+		if (!option_quiet)
+			printf("Compressing %s to %s (%d of %d).\n", job->source_filename, job->dest_filename, i + 1,
+				batch.nu_jobs);
+		compress_and_save(job, population_cache, block_cache);
+		pthread_mutex_lock(&batch.mutex);
+		batch.nu_finished = i + 1;
+		pthread_cond_broadcast(&batch.cond);
+		pthread_mutex_unlock(&batch.mutex);
+	}
+	pthread_join(loader_thread, NULL);
+	destroy_population_cache(population_cache);
+	if (block_cache != NULL)
+		close_block_cache(block_cache);
+	for (int i = 0; i < batch.nu_jobs; i++) {
+		free((char *)batch.jobs[i].source_filename);
+		free((char *)batch.jobs[i].dest_filename);
+	}
+	free(batch.jobs);
+	pthread_mutex_destroy(&batch.mutex);
+	pthread_cond_destroy(&batch.cond);
 }
 
 static void calibrate() {
@@ -16,6 +16,10 @@ OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 
 */
 
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
 #define NU_FILE_TYPES		6
 
 #define FILE_TYPE_PNG		0x101
@@ -30,6 +34,11 @@ OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 #define FILE_TYPE_UNDEFINED	0x000
 #define FILE_TYPE_IMAGE_UNKNOWN 0x100
 
+// Return values of the library functions.
+
+#define TEXGENPACK_OK		0
+#define TEXGENPACK_ERROR	1
+
 // Structures.
 
 typedef struct {
@@ -132,12 +141,39 @@ typedef struct {
 } TextureInfo;
 
 typedef struct BlockUserData_t BlockUserData;
+typedef struct CompressionContext_t CompressionContext;
 
 typedef int (*TextureDecodingFunction)(const unsigned char *bitstring, unsigned int *image_buffer, int flags);
 typedef double (*TextureComparisonFunction)(unsigned int *image_buffer, BlockUserData *user_data);
 typedef int (*TextureGetModeFunction)(const unsigned char *bitstring);
 typedef void (*TextureSetModeFunction)(unsigned char *bitstring, int flags);
 
+// Types of the fields of a compressed block, used by the format-aware mutation and crossover operators of the
+// genetic algorithm.
+
+enum {
+	// An unsigned number such as an endpoint color component, mutated by small steps.
+	BLOCK_FIELD_NUMERIC,
+	// A two's complement number such as an ETC1 color difference, mutated by small steps.
+	BLOCK_FIELD_SIGNED,
+	// A pixel index, mutated by replacing it with another index.
+	BLOCK_FIELD_INDEX,
+	// Mode, partition, flag and P-bits, mutated by flipping one of the bits.
+	BLOCK_FIELD_OTHER
+};
+
+typedef struct {
+	unsigned char type;
+	unsigned char bit;		// The position of the lowest bit of the field in the bitstring.
+	unsigned char nu_bits;		// At most 8.
+} BlockField;
+
+#define BLOCK_MAX_FIELDS	64
+
+// Describe the fields of the block in the given bitstring, which depend on its mode for some formats, in order of
+// increasing bit position and return the number of fields. Returns 0 when the block has no valid mode.
+typedef int (*TextureGetFieldsFunction)(const unsigned char *bitstring, BlockField *fields);
+
 typedef struct {
 	unsigned int *pixels;
 	int width;
@@ -154,6 +190,7 @@ typedef struct {
 	TextureComparisonFunction perceptive_comparison_function;
 	TextureGetModeFunction get_mode_function;
 	TextureSetModeFunction set_mode_function;
+	TextureGetFieldsFunction get_fields_function;
 	TextureInfo *info;
 } Texture;
 
@@ -171,16 +208,99 @@ struct BlockUserData_t {
 	unsigned int *texture_pixels;
 	unsigned int *texture_pixels_above;
 	unsigned int *texture_pixels_left;
+	CompressionContext *context;
 };
 
 typedef void (*CompressCallbackFunction)(BlockUserData *user_data);
 
+// Options of a compression. init_compression_context() initializes them from the command line options.
+
+typedef struct {
+	int compression_level;
+	int perceptive;
+	int modal_etc2;
+	int allowed_modes_etc2;
+	int evolve_pixel_indices;
+	int generations;		// - 1 for the default of the compression level.
+	int islands;			// - 1 for the default of the compression level.
+	int generations_second_pass;	// - 1 for the default of the compression level.
+	int islands_second_pass;	// - 1 for the default of the compression level.
+	int max_threads;		// - 1 for the number of processors.
+	int deterministic;
+	int hdr;
+	int verbose;
+	int quiet;
+	int progress;
+	int genetic_parameters;		// When set, use the mutation and crossover probabilities given below.
+	float mutation_probability;
+	float crossover_probability;
+} CompressionOptions;
+
+typedef struct MipmapLevel_t MipmapLevel;
+typedef struct PopulationCache_t PopulationCache;
+typedef struct BlockCache_t BlockCache;
+
+// The state of a compression. Compressions that use different contexts are independent from each other and
+// can run concurrently in different threads.
+
+struct CompressionContext_t {
+	CompressionOptions options;
+	CompressCallbackFunction callback_func;
+	void *callback_data;		// Not used by the compressor.
+	PopulationCache *population_cache;	// When not NULL, populations are taken from and returned to it.
+	BlockCache *block_cache;		// When not NULL, compressed blocks are looked up in and stored in it.
+	// When not NULL, the source images and textures of an earlier compression of the same texture. The
+	// compressed blocks of the previous texture are kept where the source pixels have not changed. Only the
+	// first nu_previous_levels mipmap levels are used, and only when their size and texture type match.
+	Image *previous_images;
+	Texture *previous_textures;
+	int nu_previous_levels;
+	// Parameters of the genetic algorithm, derived from the options and the texture type.
+	int population_size;
+	int nu_generations;
+	int nu_generations_second_pass;
+	int nu_islands;
+	int nu_islands_second_pass;
+	float mutation_probability;
+	float mutation_probability_second_pass;
+	float crossover_probability;
+	double rmse_threshold;
+	// When set, the pixel indices of the blocks evaluated by the genetic algorithm are set to the optimal ones
+	// for the other fields of the block, instead of being evolved.
+	int calculate_pixel_indices;
+	// When not NULL, the alpha part (the first 64 bits) with the smallest possible error of every block that is
+	// compressed, which replaces the alpha part of the blocks evaluated by the genetic algorithm (DXT5 and ETC2
+	// EAC).
+	unsigned char *optimal_alpha_blocks;
+	// When not NULL, the partitions preselected for the BPTC modes with two or three subsets for every block
+	// that is compressed, to which the partition of the blocks evaluated by the genetic algorithm is
+	// constrained.
+	unsigned char *bptc_partitions;
+	// Statistics.
+	int mode_statistics[16];
+	int nu_blocks_reported;
+	// The mipmap levels that are being compressed.
+	MipmapLevel *levels;
+	int nu_levels;
+	int nu_blocks_total;
+	// For every block, the first block with the same source pixels and block flags, and the next block that
+	// is a duplicate of the same first block (- 1 for the last one). Only the first block is compressed.
+	int *duplicate_of;
+	int *next_duplicate;
+	int nu_unique_blocks;
+	// For every block, the fitness of the compressed block that is known before compression starts, because
+	// it was encoded directly, kept from the previous texture or found in the block cache, or zero when the
+	// block has to be compressed.
+	double *known_fitness;
+};
+
 // Command line options defined in texgenpack.c
 
 #define COMMAND_COMPRESS	0
 #define COMMAND_DECOMPRESS	1
 #define COMMAND_COMPARE		2
 #define COMMAND_CALIBRATE	3
+#define COMMAND_BATCH		4
 
 #define ORIENTATION_DOWN	1
 #define ORIENTATION_UP		2
@@ -219,6 +339,7 @@ extern int option_compression_level;
 extern int option_progress;
 extern int option_modal_etc2;
 extern int option_allowed_modes_etc2;
+extern int option_evolve_indices;
 extern int option_generations;
 extern int option_islands;
 extern int option_generations_second_pass;
@@ -236,11 +357,15 @@ extern int option_perceptive;
 // Defined in image.c
 
 void load_image(const char *filename, int filetype, Image *image);
+void load_image_stream(FILE *f, int filetype, Image *image);
 int load_mipmap_images(const char *filename, int filetype, int max_images, Image *image);
 void save_image(Image *image, const char *filename, int filetype);
+void save_image_stream(Image *image, FILE *f, int filetype);
 double compare_images(Image *image1, Image *image2);
 int load_texture(const char *filename, int filetype, int max_mipmaps, Texture *texture);
+int load_texture_stream(FILE *f, int filetype, int max_mipmaps, Texture *texture);
 void save_texture(Texture *texture, int nu_mipmaps, const char *filename, int filetype);
+void save_texture_stream(Texture *texture, int nu_mipmaps, FILE *f, int filetype);
 void convert_texture_to_image(Texture *texture, Image *image);
 void destroy_texture(Texture *texture);
 void destroy_image(Image *image);
@@ -268,6 +393,14 @@ void convert_image_to_8_bit_format(Image *image, int nu_components, int signed_f
 
 void compress_image(Image *image, int texture_type, CompressCallbackFunction func, Texture *texture,
 int genetic_parameters, float mutation_prob, float crossover_prob);
+void compress_mipmap_images(Image *images, int nu_images, int texture_type, CompressCallbackFunction func,
+Texture *textures, int genetic_parameters, float mutation_prob, float crossover_prob);
+void init_compression_context(CompressionContext *context, CompressCallbackFunction func);
+void compress_image_with_context(CompressionContext *context, Image *image, int texture_type, Texture *texture);
+void compress_mipmap_images_with_context(CompressionContext *context, Image *images, int nu_images,
+int texture_type, Texture *textures);
+PopulationCache *create_population_cache();
+void destroy_population_cache(PopulationCache *cache);
 
 // Defined in mipmap.c
 
@@ -277,17 +410,28 @@ int count_mipmap_levels(Image *image);
 
 // Defined in file.c
 
+FILE *open_file(const char *filename, const char *mode);
 void load_pkm_file(const char *filename, Texture *texture);
+void load_pkm_stream(FILE *f, Texture *texture);
 void save_pkm_file(Texture *texture, const char *fikename);
+void save_pkm_stream(Texture *texture, FILE *f);
 int load_ktx_file(const char *filename, int max_mipmaps, Texture *texture);
+int load_ktx_stream(FILE *f, int max_mipmaps, Texture *texture);
 void save_ktx_file(Texture *texture, int nu_mipmaps, const char *filename);
+void save_ktx_stream(Texture *texture, int nu_mipmaps, FILE *f);
 int load_dds_file(const char *filename, int max_mipmaps, Texture *texture);
+int load_dds_stream(FILE *f, int max_mipmaps, Texture *texture);
 void save_dds_file(Texture *texture, int nu_mipmaps, const char *filename);
+void save_dds_stream(Texture *texture, int nu_mipmaps, FILE *f);
 void load_astc_file(const char *filename, Texture *texture);
+void load_astc_stream(FILE *f, Texture *texture);
 void save_astc_file(Texture *texture, const char *filename);
+void save_astc_stream(Texture *texture, FILE *f);
 void load_ppm_file(const char *filename, Image *image);
 void load_png_file(const char *filename, Image *image);
+void load_png_stream(FILE *f, Image *image);
 void save_png_file(Image *image, const char *filename);
+void save_png_stream(Image *image, FILE *f);
 
 // Defined in texture.c
 
@@ -337,6 +481,49 @@ double compare_block_4x4_rgba_half_float_hdr(unsigned int *image_buffer, BlockUs
 int halfp2singles(void *target, void *source, int numel);
 int singles2halfp(void *target, void *source, int numel);
 
+// Defined in thread.c
+
+typedef void (*ThreadTaskFunction)(void *task_data);
+typedef struct ThreadTaskGroup_t ThreadTaskGroup;
+
+int get_number_of_processors();
+void thread_pool_initialize(int nu_threads);
+int thread_pool_get_number_of_threads();
+int thread_pool_run_queued_task();
+ThreadTaskGroup *thread_task_group_create();
+void thread_task_group_destroy(ThreadTaskGroup *group);
+void thread_task_group_submit(ThreadTaskGroup *group, ThreadTaskFunction func, void *task_data);
+void thread_task_group_wait(ThreadTaskGroup *group);
+
+// Defined in cache.c
+
+BlockCache *open_block_cache(const char *filename);
+void close_block_cache(BlockCache *cache);
+int block_cache_lookup(BlockCache *cache, const uint64_t *key, unsigned char *bitstring, double *fitness);
+void block_cache_store(BlockCache *cache, const uint64_t *key, const unsigned char *bitstring, double fitness);
+
+// Defined in library.c. The library functions return TEXGENPACK_ERROR on errors that are detected in the calling
+// thread, after freeing the pixels of the images or textures they were setting up. Errors that are raised in the
+// worker threads of the compression, and a failure to create the worker threads, still print the message and exit
+// the process.
+
+#if defined(__GNUC__)
+void report_error(const char *format, ...) __attribute__((noreturn, format(printf, 1, 2)));
+#elif defined(_MSC_VER)
+__declspec(noreturn) void report_error(const char *format, ...);
+#else
+void report_error(const char *format, ...);
+#endif
+const char *texgenpack_get_error_message();
+int load_image_from_memory(const unsigned char *data, size_t size, int filetype, Image *image);
+int load_texture_from_memory(const unsigned char *data, size_t size, int filetype, int max_mipmaps,
+Texture *texture, int *nu_mipmaps);
+int save_image_to_memory(Image *image, int filetype, unsigned char **data, size_t *size);
+int save_texture_to_memory(Texture *texture, int nu_mipmaps, int filetype, unsigned char **data, size_t *size);
+int compress_image_to_texture(CompressionContext *context, Image *image, int texture_type, Texture *texture);
+int compress_mipmap_images_to_textures(CompressionContext *context, Image *images, int nu_images,
+int texture_type, Texture *textures);
+
 // Defined in calibrate.c
 
 void calibrate_genetic_parameters(Image *image, int texture_type);
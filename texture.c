@@ -239,8 +239,7 @@ const char *texture_type_text(int texture_type) {
 	TextureInfo *info;
 	info = match_texture_type(texture_type);
 	if (info == NULL) {
-		printf("Error -- invalid texture type.\n");
-		exit(1);
+		report_error("Error -- invalid texture type.\n");
 	}
 	return info->text1;
 }
@@ -256,6 +255,7 @@ void set_texture_decoding_function(Texture *texture, Image *image) {
 	TextureComparisonFunction perceptive_comparison_func = NULL;
 	TextureGetModeFunction get_mode_func = NULL;
 	TextureSetModeFunction set_mode_func = NULL;
+	TextureGetFieldsFunction get_fields_func = NULL;
 	if (texture->type >= TEXTURE_TYPE_RGBA_ASTC_4X4 && texture->type <= TEXTURE_TYPE_RGBA_ASTC_12X12) {
 		decoding_func = draw_block_rgba_astc;
 		comparison_func = compare_block_any_size_rgba;
@@ -267,6 +267,7 @@ void set_texture_decoding_function(Texture *texture, Image *image) {
 		decoding_func = draw_block4x4_etc1;
 		get_mode_func = block4x4_etc1_get_mode;
 		set_mode_func = block4x4_etc1_set_mode;
+		get_fields_func = block4x4_etc1_get_fields;
 		break;
 	case TEXTURE_TYPE_ETC2_RGB8 :
 	case TEXTURE_TYPE_ETC2_SRGB8 :
@@ -300,15 +301,19 @@ void set_texture_decoding_function(Texture *texture, Image *image) {
 		break;
 	case TEXTURE_TYPE_DXT1 :
 		decoding_func = draw_block4x4_dxt1;
+		get_fields_func = block4x4_dxt1_get_fields;
 		break;
 	case TEXTURE_TYPE_DXT3 :
 		decoding_func = draw_block4x4_dxt3;
+		get_fields_func = block4x4_dxt3_get_fields;
 		break;
 	case TEXTURE_TYPE_DXT5 :
 		decoding_func = draw_block4x4_dxt5;
+		get_fields_func = block4x4_dxt5_get_fields;
 		break;
 	case TEXTURE_TYPE_DXT1A :
 		decoding_func = draw_block4x4_dxt1a;	
+		get_fields_func = block4x4_dxt1_get_fields;
 		break;
 	case TEXTURE_TYPE_UNCOMPRESSED_RGB8 :
 	case TEXTURE_TYPE_UNCOMPRESSED_RGBA8 :
@@ -341,6 +346,7 @@ void set_texture_decoding_function(Texture *texture, Image *image) {
 		decoding_func = draw_block4x4_bptc;
 		get_mode_func = block4x4_bptc_get_mode;
 		set_mode_func = block4x4_bptc_set_mode;
+		get_fields_func = block4x4_bptc_get_fields;
 		break;
 	case TEXTURE_TYPE_BPTC_FLOAT :
 		decoding_func = draw_block4x4_bptc_float;
@@ -365,8 +371,7 @@ void set_texture_decoding_function(Texture *texture, Image *image) {
 		decoding_func = draw_block4x4_signed_rgtc2;
 		break;
 	default :
-		printf("Error -- no decoding function defined for texture type.\n");
-		exit(1);
+		report_error("Error -- no decoding function defined for texture type.\n");
 	}
 	switch (texture->type) {
 	case TEXTURE_TYPE_UNCOMPRESSED_RGB8 :
@@ -439,8 +444,7 @@ void set_texture_decoding_function(Texture *texture, Image *image) {
 		comparison_func = compare_block_4x4_rg_half_float;
 		break;
 	default :
-		printf("Error -- no block comparison function defined for texture type.\n");
-		exit(1);
+		report_error("Error -- no block comparison function defined for texture type.\n");
 	}
 end :
 	if (image != NULL) {
@@ -458,6 +462,7 @@ end :
 	texture->perceptive_comparison_function = perceptive_comparison_func;
 	texture->get_mode_function = get_mode_func;
 	texture->set_mode_function = set_mode_func;
+	texture->get_fields_function = get_fields_func;
 }
 
 int get_number_of_texture_formats() {
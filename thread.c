@@ -0,0 +1,212 @@
+/*
+
+Copyright (c) 2015 Harm Hanemaaijer <fgenfb@yahoo.com>
+
+Permission to use, copy, modify, and/or distribute this software for any
+purpose with or without fee is hereby granted, provided that the above
+copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+#include "texgenpack.h"
+
+// Persistent pool of worker threads. The pool is created when the first task is submitted and lives for
+// the rest of the process, so that the compression passes for every block, mipmap level and file share the
+// same threads instead of creating and joining threads for every block.
+//
+// Tasks are submitted as part of a task group. Waiting for a task group is allowed from within a task; the
+// waiting thread executes queued tasks itself while the group is unfinished, so nested task groups cannot
+// run out of threads.
+
+typedef struct ThreadTask_t ThreadTask;
+
+struct ThreadTask_t {
+	ThreadTaskFunction func;
+	void *task_data;
+	ThreadTaskGroup *group;
+	ThreadTask *next;
+};
+
+struct ThreadTaskGroup_t {
+	int nu_unfinished_tasks;
+	pthread_cond_t finished_cond;
+};
+
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_cond = PTHREAD_COND_INITIALIZER;
+static ThreadTask *queue_head = NULL;
+static ThreadTask *queue_tail = NULL;
+static ThreadTask *free_tasks = NULL;
+static int nu_pool_threads = 0;
+
+// Return the number of processors that are available.
+
+int get_number_of_processors() {
+#ifdef _WIN32
+	SYSTEM_INFO system_info;
+	GetSystemInfo(&system_info);
+	return system_info.dwNumberOfProcessors;
+#else
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	if (n < 1)
+		return 1;
+	return n;
+#endif
+}
+
+// Take the first task from the queue. The pool mutex must be held.
+
+static ThreadTask *dequeue_task() {
+	ThreadTask *task = queue_head;
+	if (task != NULL) {
+		queue_head = task->next;
+		if (queue_head == NULL)
+			queue_tail = NULL;
+	}
+	return task;
+}
+
+// Run a task that was taken from the queue and mark it as finished. The pool mutex must be held when
+// calling this function; it is released while the task runs.
+
+static void run_task(ThreadTask *task) {
+	pthread_mutex_unlock(&pool_mutex);
+	task->func(task->task_data);
+	pthread_mutex_lock(&pool_mutex);
+	ThreadTaskGroup *group = task->group;
+	group->nu_unfinished_tasks--;
+	if (group->nu_unfinished_tasks == 0)
+		pthread_cond_broadcast(&group->finished_cond);
+	task->next = free_tasks;
+	free_tasks = task;
+}
+
+static void *pool_thread(void *arg) {
+	pthread_mutex_lock(&pool_mutex);
+	for (;;) {
+		ThreadTask *task = dequeue_task();
+		if (task == NULL) {
+			pthread_cond_wait(&pool_cond, &pool_mutex);
+			continue;
+		}
+		run_task(task);
+	}
+	pthread_mutex_unlock(&pool_mutex);
+	return NULL;
+}
+
+// Add threads to the pool until it has the given number of threads. Called with pool_mutex held.
+
+static void add_pool_threads(int nu_threads) {
+	while (nu_pool_threads < nu_threads) {
+		pthread_t thread;
+		if (pthread_create(&thread, NULL, pool_thread, NULL) != 0) {
+			printf("Error -- could not create worker thread.\n");
+			exit(1);
+		}
+		pthread_detach(thread);
+		nu_pool_threads++;
+	}
+}
+
+// Make sure the pool has at least the given number of threads. When nu_threads is zero or negative, the
+// number of processors is used. Threads are never removed from the pool; a compression that should use fewer
+// threads limits the number of tasks it submits.
+
+void thread_pool_initialize(int nu_threads) {
+	if (nu_threads <= 0)
+		nu_threads = get_number_of_processors();
+	pthread_mutex_lock(&pool_mutex);
+	add_pool_threads(nu_threads);
+	pthread_mutex_unlock(&pool_mutex);
+}
+
+int thread_pool_get_number_of_threads() {
+	pthread_mutex_lock(&pool_mutex);
+	int n = nu_pool_threads;
+	pthread_mutex_unlock(&pool_mutex);
+	return n;
+}
+
+ThreadTaskGroup *thread_task_group_create() {
+	ThreadTaskGroup *group = (ThreadTaskGroup *)malloc(sizeof(ThreadTaskGroup));
+	group->nu_unfinished_tasks = 0;
+	pthread_cond_init(&group->finished_cond, NULL);
+	return group;
+}
+
+// Destroy a task group. The group should not have any unfinished tasks.
+
+void thread_task_group_destroy(ThreadTaskGroup *group) {
+	pthread_cond_destroy(&group->finished_cond);
+	free(group);
+}
+
+// Add a task to the queue of the pool.
+
+void thread_task_group_submit(ThreadTaskGroup *group, ThreadTaskFunction func, void *task_data) {
+	pthread_mutex_lock(&pool_mutex);
+	if (nu_pool_threads == 0)
+		add_pool_threads(get_number_of_processors());
+	ThreadTask *task = free_tasks;
+	if (task != NULL)
+		free_tasks = task->next;
+	else
+		task = (ThreadTask *)malloc(sizeof(ThreadTask));
+	task->func = func;
+	task->task_data = task_data;
+	task->group = group;
+	task->next = NULL;
+	if (queue_tail == NULL)
+		queue_head = task;
+	else
+		queue_tail->next = task;
+	queue_tail = task;
+	group->nu_unfinished_tasks++;
+	pthread_cond_signal(&pool_cond);
+	pthread_mutex_unlock(&pool_mutex);
+}
+
+// Wait until all tasks submitted to the group have finished. While waiting, the calling thread runs queued
+// tasks itself.
+
+void thread_task_group_wait(ThreadTaskGroup *group) {
+	pthread_mutex_lock(&pool_mutex);
+	while (group->nu_unfinished_tasks > 0) {
+		ThreadTask *task = dequeue_task();
+		if (task != NULL)
+			run_task(task);
+		else
+			pthread_cond_wait(&group->finished_cond, &pool_mutex);
+	}
+	pthread_mutex_unlock(&pool_mutex);
+}
+
+// Run one queued task in the calling thread. Returns 1 if a task was run, 0 if the queue was empty. This
+// allows a thread that waits for something else than a task group to help the pool.
+
+int thread_pool_run_queued_task() {
+	pthread_mutex_lock(&pool_mutex);
+	ThreadTask *task = dequeue_task();
+	if (task != NULL)
+		run_task(task);
+	pthread_mutex_unlock(&pool_mutex);
+	return task != NULL;
+}
@@ -32,31 +32,10 @@ OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 #endif
 
 
-// Define the option variables used by the texgenpack modules.
-
-int command;
-int option_verbose = 0;
-int option_max_threads = - 1;
-int option_orientation = 0;
-int option_texture_format = - 1;
-int option_compression_level = SPEED_FAST;
-int option_progress = 0;
-int option_modal_etc2 = 1;
-int option_allowed_modes_etc2 = - 1;
+// Options of the viewer. The option variables used by the texgenpack modules are defined in library.c.
+
 int option_mipmaps = 0;
-int option_generations = - 1;
-int option_islands = - 1;
-int option_generations_second_pass = - 1;
-int option_islands_second_pass = - 1;
-int option_flip_vertical = 0;
-int option_quiet = 0;
-int option_block_width = 4;
-int option_block_height = 4;
-int option_half_float = 0;
-int option_deterministic = 0;
 int option_half_float_fit_to_range = 0;
-int option_hdr = 0;
-int option_perceptive = 1;
 
 // Global variables
 